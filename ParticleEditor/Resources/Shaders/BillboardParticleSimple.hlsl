@@ -23,6 +23,25 @@ VSIn VS(VSIn input)
 	return input;
 }
 
+// Quads expanded on the CPU by ExpandBillboardQuads, no geometry shader.
+struct VSQuadIn {
+	float3 pos : POSITION;
+	float2 uv : TEXCOORD;
+	float age : AGE;
+};
+
+GSOut VSQuad(VSQuadIn input)
+{
+	GSOut output;
+
+	// the first camera matrix is the view projection, see Camera.hlsli
+	output.pos = mul(View, float4(input.pos, 1.0));
+	output.uv = input.uv;
+	output.age = input.age;
+
+	return output;
+}
+
 static const float4 UV = float4(0, 0, 1, 1);
 
 [maxvertexcount(4)]
@@ -129,4 +148,11 @@ void PS_depth(GSOut input)
 
     float N = ((mask.b*bsize) + ((3.9*distort * mask.r) * (mask.g * falloff))) * falloff;
     clip(saturate(step(0.5 + input.uv.y, N)) - 0.5);
-}
\ No newline at end of file
+}
+
+// Cells of a flipbook baked by FlipbookBaker, straight alpha like every other
+// particle.
+float4 PSFlipbook(GSOut input) : SV_Target0
+{
+	return Plane.Sample(SamplerClamp, input.uv);
+}
@@ -18,6 +18,20 @@ struct VSIn {
 	float noisespeed : NOISESPEED;
 };
 
+struct VSInCompact {
+	// vb(0)
+	float3 position : POSITION;
+	float3 normal : NORMAL;
+	float2 uv : TEXCOORD;
+
+	// ib(1), GeometryParticleInstanceCompact
+	float3 offset : OFFSET;
+	float2 scale : SCALE; // scale, noise speed
+	float4 rotation : ROTATION;
+	float4 color : COLOR;
+	float4 params : PARAMS; // age, deform, deform speed, noise scale
+};
+
 struct VSOutput {
 	float4 position : SV_POSITION;
 	float4 color : COLOR;
@@ -218,5 +232,44 @@ VSOutput VS(VSIn input) {
 	output.color = input.color;
 	output.deform = expand;
 
+	return output;
+}
+
+// Same as XMMatrixRotationQuaternion, for row vectors
+float3x3 QuaternionToMatrix(float4 q)
+{
+	float3 q2 = q.xyz * 2.0;
+	float xx = q.x * q2.x, yy = q.y * q2.y, zz = q.z * q2.z;
+	float xy = q.x * q2.y, xz = q.x * q2.z, yz = q.y * q2.z;
+	float wx = q.w * q2.x, wy = q.w * q2.y, wz = q.w * q2.z;
+
+	return float3x3(
+		1.0 - yy - zz, xy + wz, xz - wy,
+		xy - wz, 1.0 - xx - zz, yz + wx,
+		xz + wy, yz - wx, 1.0 - xx - yy
+	);
+}
+
+VSOutput VSCompact(VSInCompact input) {
+	VSOutput output;
+
+	float3x3 rotation = QuaternionToMatrix(normalize(input.rotation));
+	float age = input.params.x;
+	float deform = input.params.y;
+	float deformspeed = input.params.z;
+
+	float4 world = float4(mul(input.position * input.scale.x, rotation) + input.offset, 1);
+	float expand = cnoise(world * deform + input.position*age*deformspeed);
+
+	output.position = mul(camera.viewProjection, world + float4(input.normal * expand * deform, 0));
+	output.worldPos = world;
+	output.normal = normalize(mul(input.normal, rotation));
+	output.uv = input.uv;
+	output.age = age;
+	output.noisescale = input.params.w;
+	output.noisespeed = input.scale.y;
+	output.color = input.color;
+	output.deform = expand;
+
 	return output;
 }
\ No newline at end of file
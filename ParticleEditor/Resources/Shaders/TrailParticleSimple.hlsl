@@ -20,6 +20,23 @@ struct GSOut
 	float2 uv : TEXCOORD;
 };
 
+// Ribbons built on the CPU by BuildTrailRibbon, drawn as triangle strips.
+struct VSRibbonIn {
+	float3 position : POSITION;
+	float2 uv : TEXCOORD;
+};
+
+GSOut VSRibbon(VSRibbonIn input)
+{
+	GSOut output;
+
+	// the first camera matrix is the view projection, see Camera.hlsli
+	output.pos = mul(View, float4(input.position, 1));
+	output.uv = input.uv;
+
+	return output;
+}
+
 static const float4 UV = float4(0, 0, 1, 1);
 
 #define TRAIL_COUNT 30
@@ -0,0 +1,46 @@
+#include "BillboardQuads.h"
+
+BillboardAxes GetBillboardAxes(const float view[4][4])
+{
+    BillboardAxes axes;
+    for (int c = 0; c < 3; c++) {
+        axes.m_Right[c] = view[c][0];
+        axes.m_Up[c] = view[c][1];
+    }
+
+    return axes;
+}
+
+void ExpandBillboardQuad(const float position[3], const float size[2], float age, const BillboardAxes &axes, BillboardVertex *out)
+{
+    for (int c = 0; c < 3; c++) {
+        float n = axes.m_Up[c] * size[0];
+        float w = axes.m_Right[c] * size[1];
+
+        out[0].m_Position[c] = position[c] + n + w;
+        out[1].m_Position[c] = position[c] - n + w;
+        out[2].m_Position[c] = position[c] + n - w;
+        out[3].m_Position[c] = position[c] - n - w;
+    }
+
+    // (0, 0), (0, 1), (1, 0), (1, 1)
+    for (int i = 0; i < 4; i++) {
+        out[i].m_UV[0] = (float)(i >> 1);
+        out[i].m_UV[1] = (float)(i & 1);
+        out[i].m_Age = age;
+    }
+}
+
+void BuildBillboardQuadIndices(uint16_t *out, size_t quads)
+{
+    for (size_t i = 0; i < quads; i++, out += 6) {
+        auto base = (uint16_t)(i * 4);
+
+        out[0] = base + 0;
+        out[1] = base + 1;
+        out[2] = base + 2;
+        out[3] = base + 2;
+        out[4] = base + 1;
+        out[5] = base + 3;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Largest quad count a 16 bit index buffer can address.
+#define BILLBOARD_QUAD_MAX (65536 / 4)
+
+// Plain floats so the quad math builds without DirectXMath, the layout is
+// the same as XMFLOAT3, XMFLOAT2 and a float.
+struct BillboardVertex {
+    float m_Position[3];
+    float m_UV[2];
+    float m_Age;
+};
+static_assert(sizeof(BillboardVertex) == 24, "billboard vertex layout must match the quad input layout");
+
+// The camera's right and up axes in world space, what the billboards are
+// spanned along.
+struct BillboardAxes {
+    float m_Right[3];
+    float m_Up[3];
+};
+
+// From a row major world to view matrix, as XMStoreFloat4x4 writes the
+// DirectXMath ones: the view space x and y axes are its first two columns.
+BillboardAxes GetBillboardAxes(const float view[4][4]);
+
+// Expands one billboard into four camera facing vertices in world space,
+// the same corners and uvs the BillboardParticleSimple.hlsl GS emits.
+// `size` is what BillboardParticle stores, the half height along the up
+// axis first, then the half width. Lets billboards be drawn as plain
+// indexed triangles without a geometry shader.
+void ExpandBillboardQuad(const float position[3], const float size[2], float age, const BillboardAxes &axes, BillboardVertex *out);
+
+// Two triangles per quad, matching the strip order of the GS.
+void BuildBillboardQuadIndices(uint16_t *out, size_t quads);
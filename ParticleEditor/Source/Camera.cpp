@@ -22,16 +22,20 @@ void Camera::Update(ID3D11DeviceContext *cxt)
 
     m_View = XMMatrixLookAtRH(m_Position, m_Origo, Up);
 
-    CameraValues values = {
+    auto ptr = m_Buffer->Map(cxt);
+    *ptr = GetValues();
+    m_Buffer->Unmap(cxt);
+}
+
+CameraValues Camera::GetValues() const
+{
+    return {
         m_View * m_Proj,
         {},
         {},
         m_Position,
         {}
     };
-    auto ptr = m_Buffer->Map(cxt);
-    *ptr = values;
-    m_Buffer->Unmap(cxt);
 }
 
 void Camera::Rotate(float x, float y)
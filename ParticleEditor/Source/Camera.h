@@ -29,6 +29,8 @@ public:
 
 	XMMATRIX GetProjection() const { return m_Proj; }
 	XMMATRIX GetView() const { return m_View; }
+	// what Update() wrote to the buffer
+	CameraValues GetValues() const;
 
 	ConstantBuffer<CameraValues> *GetBuffer() const { return m_Buffer; }
 
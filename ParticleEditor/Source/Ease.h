@@ -61,4 +61,27 @@ inline EaseFunc GetEaseFunc(ParticleEase ease)
 inline EaseFuncV GetEaseFuncV(ParticleEase ease)
 {
 	return ease_funcs_xmv[(int)ease];
-}
\ No newline at end of file
+}
+
+// Compile time counterpart of GetEaseFunc/GetEaseFuncV, lets the easing be
+// inlined into update kernels that are specialized on it.
+template <ParticleEase E>
+struct StaticEase;
+
+template <>
+struct StaticEase<ParticleEase::Linear> {
+	template <typename T>
+	static T Apply(T start, T end, float t) { return ease::Lerp(start, end, t); }
+};
+
+template <>
+struct StaticEase<ParticleEase::EaseIn> {
+	template <typename T>
+	static T Apply(T start, T end, float t) { return ease::EaseIn(start, end, t); }
+};
+
+template <>
+struct StaticEase<ParticleEase::EaseOut> {
+	template <typename T>
+	static T Apply(T start, T end, float t) { return ease::EaseOut(start, end, t); }
+};
@@ -0,0 +1,193 @@
+#include "EditJournal.h"
+
+#include <cstring>
+
+#include "ImageIO.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+static const char JOURNAL_MAGIC[4] = { 'p', 'j', 'n', 'l' };
+
+// op, object, size, index, offset
+#define RECORD_HEADER_SIZE 12
+#define RECORD_CRC_SIZE 4
+
+EditJournal::EditJournal()
+    : m_File(nullptr), m_Generation(0), m_Records(0), m_Size(0), m_Last(-1)
+{
+}
+
+EditJournal::~EditJournal()
+{
+    Close();
+}
+
+bool EditJournal::Open(const char *path, uint32_t layout, uint32_t generation)
+{
+    Close();
+
+    m_File = fopen(path, "wb");
+    if (!m_File)
+        return false;
+
+    EditJournalHeader header = {};
+    memcpy(header.m_Magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.m_Version = EDIT_JOURNAL_VERSION;
+    header.m_Layout = layout;
+    header.m_Generation = generation;
+
+    if (fwrite(&header, sizeof(header), 1, m_File) != 1 || fflush(m_File) != 0) {
+        Close();
+        return false;
+    }
+
+    m_Generation = generation;
+    m_Size = sizeof(header);
+
+    return true;
+}
+
+void EditJournal::Close()
+{
+    if (!m_File)
+        return;
+
+    Flush();
+    fclose(m_File);
+
+    m_File = nullptr;
+    m_Records = 0;
+    m_Size = 0;
+    m_Pending.clear();
+    m_Last = -1;
+}
+
+void EditJournal::Append(JournalOp op, JournalObject object, uint32_t index, uint32_t offset, const void *data, uint16_t size)
+{
+    if (!m_File)
+        return;
+
+    uint8_t header[RECORD_HEADER_SIZE];
+    header[0] = (uint8_t)op;
+    header[1] = (uint8_t)object;
+    memcpy(header + 2, &size, 2);
+    memcpy(header + 4, &index, 4);
+    memcpy(header + 8, &offset, 4);
+
+    // same field as the record before it, overwrite the value in place
+    if (op == JournalOp::Field && m_Last >= 0 && memcmp(m_Pending.data() + m_Last, header, RECORD_HEADER_SIZE) == 0) {
+        m_Pending.resize((size_t)m_Last);
+    }
+    else {
+        m_Last = (int64_t)m_Pending.size();
+        m_Records++;
+    }
+
+    auto start = m_Pending.size();
+    m_Pending.insert(m_Pending.end(), header, header + RECORD_HEADER_SIZE);
+    m_Pending.insert(m_Pending.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+
+    uint32_t crc = Crc32(m_Pending.data() + start, RECORD_HEADER_SIZE + size);
+    uint8_t bytes[RECORD_CRC_SIZE];
+    memcpy(bytes, &crc, RECORD_CRC_SIZE);
+    m_Pending.insert(m_Pending.end(), bytes, bytes + RECORD_CRC_SIZE);
+}
+
+bool EditJournal::Flush()
+{
+    if (!m_File || m_Pending.empty())
+        return m_File != nullptr;
+
+    bool ok = fwrite(m_Pending.data(), 1, m_Pending.size(), m_File) == m_Pending.size();
+    ok = fflush(m_File) == 0 && ok;
+
+    m_Size += m_Pending.size();
+    m_Pending.clear();
+    m_Last = -1;
+
+    return ok;
+}
+
+static bool Fail(std::string *error, const char *reason)
+{
+    if (error)
+        *error = reason;
+
+    return false;
+}
+
+bool EditJournal::Replay(const char *path, uint32_t layout, const std::function<void(const JournalRecord&)> &apply, JournalReplay &result, std::string *error)
+{
+    result = {};
+
+    MappedFile file;
+    if (!file.Open(path))
+        return Fail(error, "could not open journal");
+
+    auto data = file.GetData();
+    auto size = file.GetSize();
+
+    EditJournalHeader header;
+    if (size < sizeof(header))
+        return Fail(error, "journal too small");
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.m_Magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0)
+        return Fail(error, "not an edit journal");
+    if (header.m_Version != EDIT_JOURNAL_VERSION)
+        return Fail(error, "unsupported journal version");
+    if (header.m_Layout != layout)
+        return Fail(error, "journal was written by a different build");
+
+    result.m_Generation = header.m_Generation;
+
+    uint64_t offset = sizeof(header);
+    while (size - offset >= RECORD_HEADER_SIZE + RECORD_CRC_SIZE) {
+        auto ptr = data + offset;
+
+        JournalRecord record;
+        record.m_Op = (JournalOp)ptr[0];
+        record.m_Object = (JournalObject)ptr[1];
+        memcpy(&record.m_Size, ptr + 2, 2);
+        memcpy(&record.m_Index, ptr + 4, 4);
+        memcpy(&record.m_Offset, ptr + 8, 4);
+        record.m_Data = ptr + RECORD_HEADER_SIZE;
+
+        uint64_t length = RECORD_HEADER_SIZE + record.m_Size + RECORD_CRC_SIZE;
+        if (length > size - offset)
+            break;
+
+        uint32_t crc;
+        memcpy(&crc, ptr + RECORD_HEADER_SIZE + record.m_Size, 4);
+        if (crc != Crc32(ptr, RECORD_HEADER_SIZE + record.m_Size))
+            break;
+
+        apply(record);
+
+        result.m_Records++;
+        offset += length;
+    }
+
+    result.m_TornBytes = size - offset;
+
+    return true;
+}
+
+#ifdef _WIN32
+
+bool ReplaceFileAtomic(const char *from, const char *to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+#else
+
+bool ReplaceFileAtomic(const char *from, const char *to)
+{
+    return rename(from, to) == 0;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define EDIT_JOURNAL_VERSION 1
+
+/*
+ * Append-only log of edits made on top of a project snapshot, so saving
+ * costs the size of the change instead of the size of the project.
+ *
+ * File format, little endian:
+ *   header: EditJournalHeader,
+ *   records: [{
+ *     op: u8, JournalOp,
+ *     object: u8, JournalObject,
+ *     size: u16,
+ *     index: u32, which object, entries are effect << 4 | entry,
+ *     offset: u32, byte offset of the field inside the object,
+ *     data: [u8; size],
+ *     crc: u32, Crc32 of everything above
+ *   }]
+ *
+ * Offsets are only meaningful to the build that wrote them, the header
+ * carries a layout hash and journals from another layout are not replayed.
+ * A record that is cut short or fails its crc ends the journal, that is
+ * where a crash interrupted the last write.
+ */
+struct EditJournalHeader {
+    char m_Magic[4];
+    uint32_t m_Version;
+    uint32_t m_Layout;
+    // snapshot generation the records apply on top of
+    uint32_t m_Generation;
+};
+
+enum class JournalOp : uint8_t {
+    Field,     // data is the new value of the plain data field at offset
+    String,    // data is the new contents of the std::string at offset
+    Material,  // data is an i32 index into the trail materials, -1 for none
+    AddEffect, // data is the name of a new, empty effect
+    AddEntry,  // data is an i32 geometry definition to add a new entry for
+};
+
+enum class JournalObject : uint8_t {
+    Texture,
+    Material,
+    Billboard,
+    Geometry,
+    Trail,
+    Effect,
+    Entry,
+};
+
+struct JournalRecord {
+    JournalOp m_Op;
+    JournalObject m_Object;
+    uint16_t m_Size;
+    uint32_t m_Index;
+    uint32_t m_Offset;
+    // points into the journal, only valid inside the replay callback
+    const uint8_t *m_Data;
+};
+
+struct JournalReplay {
+    uint32_t m_Generation;
+    uint32_t m_Records;
+    // bytes dropped after the last intact record
+    uint64_t m_TornBytes;
+};
+
+class EditJournal {
+public:
+    EditJournal();
+    ~EditJournal();
+
+    // starts an empty journal at `path`, replacing what was there
+    bool Open(const char *path, uint32_t layout, uint32_t generation);
+    void Close();
+
+    bool IsOpen() const { return m_File != nullptr; }
+
+    // Consecutive changes to the same field before the next Flush() replace
+    // each other, a drag only leaves its last value.
+    void Append(JournalOp op, JournalObject object, uint32_t index, uint32_t offset, const void *data, uint16_t size);
+
+    // hands everything appended so far to the OS, false if the write failed
+    bool Flush();
+
+    uint32_t GetGeneration() const { return m_Generation; }
+    uint32_t GetRecordCount() const { return m_Records; }
+    uint64_t GetSize() const { return m_Size + m_Pending.size(); }
+
+    // Calls `apply` for every intact record of the journal at `path`. False
+    // if the file is missing, not a journal or from another layout.
+    static bool Replay(const char *path, uint32_t layout, const std::function<void(const JournalRecord&)> &apply, JournalReplay &result, std::string *error = nullptr);
+
+private:
+    EditJournal(const EditJournal &) = delete;
+    EditJournal &operator=(const EditJournal &) = delete;
+
+    FILE *m_File;
+    uint32_t m_Generation;
+    uint32_t m_Records;
+    uint64_t m_Size;
+
+    std::vector<uint8_t> m_Pending;
+    // start of the last record in m_Pending, -1 if there is none
+    int64_t m_Last;
+};
+
+// Moves `from` over `to` in one step, readers see either the old or the new
+// file but never a partly written one.
+bool ReplaceFileAtomic(const char *from, const char *to);
@@ -3,6 +3,8 @@
 #include <Windows.h>
 
 #include <vector>
+#include <chrono>
+#include <atomic>
 #include <algorithm>
 #include <fstream>
 #include <experimental\filesystem>
@@ -21,6 +23,19 @@
 #include "External\IconsMaterialDesign.h"
 
 #include "ParticleSystem.h"
+#include "FlipbookBaker.h"
+#include "PartPackage.h"
+#include "ExportCache.h"
+#include "TextureAtlas.h"
+#include "TextureCompress.h"
+#include "JsonStream.h"
+#include "MappedFile.h"
+#include "SimulationCache.h"
+#include "EditJournal.h"
+#include "JobPool.h"
+#include "FileWatcher.h"
+#include "TextureLoader.h"
+#include "ImageIO.h"
 
 #include "Camera.h"
 #include "Particle.h"
@@ -65,7 +80,7 @@ public:
 
             if (ImGui::MenuItem("Save", "CTRL+S", nullptr, true))
             {
-                Editor::Save();
+                Editor::RequestSave();
             }
             if (ImGui::MenuItem("Save As", "CTRL+S", nullptr, false))
             {
@@ -92,6 +107,98 @@ public:
                 }
             }
 
+            if (ImGui::MenuItem("Render Reference", nullptr, nullptr, true))
+            {
+                Editor::CaptureReference = true;
+            }
+
+            if (ImGui::MenuItem("Bake Flipbook", nullptr, nullptr, Editor::SelectedEffect != nullptr))
+            {
+                FlipbookBaker baker(FlipbookSettings{});
+
+                std::string path = std::string(Editor::SelectedEffect->name) + "_flipbook";
+                if (baker.Bake(*Editor::SelectedEffect, path.c_str())) {
+                    auto &stats = baker.GetStats();
+                    Editor::ConsoleOutput->AddLog("Baked %s.png/.json: %u sim steps in %.2fms, %u splats in %.2fms\n",
+                        path.c_str(), stats.m_SimSteps, stats.m_SimulateMs, stats.m_Splats, stats.m_SplatMs);
+
+                    path += ".json";
+                    if (!Editor::LoadFlipbook(Editor::SelectedEffect->name, path.c_str()))
+                        Editor::ConsoleOutput->AddLog("[error] Failed to load flipbook '%s'\n", path.c_str());
+                }
+                else {
+                    Editor::ConsoleOutput->AddLog("[error] Failed to bake flipbook for '%s'\n", Editor::SelectedEffect->name);
+                }
+            }
+
+            if (ImGui::MenuItem("Benchmark Project IO", nullptr, nullptr, true))
+            {
+                Editor::ProjectIOBenchmark result;
+                if (Editor::BenchmarkProjectIO("project_benchmark.json", 50ull << 20, result)) {
+                    Editor::ConsoleOutput->AddLog("Project with %u effects, %.1f MB: stream save %.1fms, load %.1fms; json DOM dump %.1fms, parse %.1fms\n",
+                        result.m_Effects, result.m_Bytes / (1024.f * 1024.f), result.m_SaveMs, result.m_LoadMs, result.m_DomDumpMs, result.m_DomParseMs);
+                }
+                else {
+                    Editor::ConsoleOutput->AddLog("[error] Project IO benchmark failed\n");
+                }
+            }
+
+            if (ImGui::MenuItem("Benchmark Simulation Cache", nullptr, nullptr, true))
+            {
+                SimulationCacheBenchmark result;
+                if (BenchmarkSimulationCache("simulation_benchmark.cache", 1800, 5000, result)) {
+                    Editor::ConsoleOutput->AddLog("Cache with %u frames of %u instances, %.1f MB: write %.1fms, sequential read %.1fms, %u random seeks %.1fms\n",
+                        result.m_Frames, result.m_Instances, result.m_Bytes / (1024.f * 1024.f), result.m_WriteMs, result.m_SequentialMs, result.m_Seeks, result.m_SeekMs);
+                }
+                else {
+                    Editor::ConsoleOutput->AddLog("[error] Simulation cache benchmark failed\n");
+                }
+            }
+
+            if (ImGui::MenuItem("Benchmark Package", nullptr, nullptr, true))
+            {
+                PartPackageBenchmark result;
+                if (BenchmarkPartPackage("part_benchmark.part", 10000, result)) {
+                    Editor::ConsoleOutput->AddLog("Package with %u effects, %llu bytes: write %.2fms, open %.3fms, validate %.2fms, lookup all %.2fms\n",
+                        result.m_Effects, (unsigned long long)result.m_Bytes, result.m_WriteMs, result.m_OpenMs, result.m_ValidateMs, result.m_LookupMs);
+                }
+                else {
+                    Editor::ConsoleOutput->AddLog("[error] Package benchmark failed\n");
+                }
+            }
+
+            if (ImGui::MenuItem("Benchmark Geometry Update", nullptr, nullptr, true))
+            {
+                GeometryUpdateBenchmark result;
+                if (BenchmarkGeometryUpdate(100000, 27, 120, result)) {
+                    Editor::ConsoleOutput->AddLog("%u particles over %u definitions, per frame: mixed vector %.2fms, pools %.2fms with %u byte instances, %.2fms with %u byte compact instances; generic kernel %.2fms, specialized %.2fms\n",
+                        result.m_Particles, result.m_Definitions, result.m_MixedMs, result.m_PooledMs, result.m_FullInstanceBytes, result.m_CompactMs, result.m_CompactInstanceBytes, result.m_GenericMs, result.m_SpecializedMs);
+                    Editor::ConsoleOutput->AddLog("Particle state per frame: full layout %.2fms, %u bytes read and written per particle; compact layout %.2fms, %u bytes\n",
+                        result.m_FullParticleMs, result.m_FullParticleBytes, result.m_CompactParticleMs, result.m_CompactParticleBytes);
+                }
+                else {
+                    Editor::ConsoleOutput->AddLog("[error] Geometry update benchmark failed\n");
+                }
+            }
+
+            if (ImGui::MenuItem("Benchmark Texture Loads", nullptr, nullptr, true))
+            {
+                std::vector<std::string> paths;
+                for (auto &tex : Editor::MaterialTextures) {
+                    if (!tex.m_TexturePath.empty())
+                        paths.push_back(tex.m_TexturePath);
+                }
+
+                TextureLoadBenchmark result;
+                if (!paths.empty() && BenchmarkTextureLoads(paths, result)) {
+                    Editor::ConsoleOutput->AddLog("Decoded %u textures, %.1f MB: one by one %.1fms, loader %.1fms with %.3fms spent requesting\n",
+                        result.m_Textures, result.m_Bytes / (1024.f * 1024.f), result.m_SerialMs, result.m_AsyncMs, result.m_RequestMs);
+                }
+                else {
+                    Editor::ConsoleOutput->AddLog("[error] Texture load benchmark failed, it needs textures ReadImage decodes\n");
+                }
+            }
+
             ImGui::Separator();
 
             if (ImGui::MenuItem("Exit", "ALT-F4"))
@@ -106,6 +213,24 @@ public:
             ImGui::DragFloat("speed##settings", &Editor::Speed, 0.01f, 0.f, 5.f, "%.1fx speed");
             ImGui::Checkbox("paused##settings", &Editor::Paused);
             ImGui::Checkbox("debug##settings", &Editor::Debug);
+            ImGui::Checkbox("stats##settings", &Editor::ShowStats);
+            ImGui::Checkbox("specialized kernels##settings", &Editor::SpecializedKernels);
+            ImGui::Checkbox("compact instances##settings", &Editor::CompactInstances);
+            ImGui::Checkbox("cpu billboards##settings", &Editor::BillboardQuads);
+            ImGui::Checkbox("cpu trails##settings", &Editor::TrailRibbons);
+            if (Editor::TrailRibbons)
+                ImGui::DragFloat("trail tolerance##settings", &Editor::TrailRibbonTolerance, 0.0001f, 0.f, 0.05f, "%.4f");
+            ImGui::Checkbox("temporal lod##settings", &Editor::TemporalLOD);
+            ImGui::Checkbox("sphere lod##settings", &Editor::MeshLOD);
+            if (Editor::MeshLOD)
+                ImGui::DragFloat("sphere lod tolerance##settings", &Editor::MeshLODTolerance, 0.0001f, 0.f, 0.05f, "%.4f");
+            ImGui::Checkbox("show spawn lod##settings", &Editor::ShowSpawnLOD);
+            ImGui::Checkbox("flipbook lod##settings", &Editor::FlipbookLOD);
+            ImGui::Separator();
+            if (ImGui::Checkbox("record cache##settings", &Editor::RecordCache) && Editor::RecordCache)
+                Editor::PlayCache = false;
+            if (ImGui::Checkbox("play cache##settings", &Editor::PlayCache) && Editor::PlayCache)
+                Editor::RecordCache = false;
             ImGui::EndMenu();
         }
     }
@@ -127,6 +252,7 @@ public:
         if (ImGui::Button(FX_ICON " [FX]")) {
             ParticleEffect effect = {};
             snprintf(effect.name, 16, "FX#%d", Editor::EffectDefinitions.size());
+            Editor::Journal.Append(JournalOp::AddEffect, JournalObject::Effect, (uint32_t)Editor::EffectDefinitions.size(), 0, effect.name, (uint16_t)strlen(effect.name));
             Editor::EffectDefinitions.push_back(effect);
         }
         if (ImGui::IsItemHovered())
@@ -170,8 +296,11 @@ public:
             entry.type = ParticleType::Geometry;
             entry.geometry = &Editor::GeometryDefinitions[0];
 
-            if (Editor::SelectedAnchorEffect.fx) {
-                Editor::SelectedAnchorEffect.fx->m_Entries[Editor::SelectedAnchorEffect.fx->m_Count++] = entry;
+            auto fx = Editor::SelectedAnchorEffect.fx;
+            if (fx && fx->m_Count < ARRAYSIZE(fx->m_Entries)) {
+                int32_t def = 0;
+                Editor::Journal.Append(JournalOp::AddEntry, JournalObject::Entry, (uint32_t)(fx - Editor::EffectDefinitions.data()), 0, &def, sizeof(def));
+                fx->m_Entries[fx->m_Count++] = entry;
             }
         }
         if (ImGui::IsItemHovered())
@@ -197,7 +326,7 @@ public:
 
 };
 
-void MaterialCombo(int *idx)
+bool MaterialCombo(int *idx)
 {
     std::vector<const char *> names;
     for (int i = 0; i < MAX_TRAIL_MATERIALS; i++) {
@@ -208,9 +337,51 @@ void MaterialCombo(int *idx)
         names.push_back(mat.m_MaterialName.c_str());
     }
 
-    ImGui::Combo("Material", idx, (const char**)names.data(), names.size());
+    return ImGui::Combo("Material", idx, (const char**)names.data(), names.size());
 }
 
+// Turns a widget that reported a change into a journal record for the field
+// it edited, the field has to live inside `base`.
+class JournalTarget {
+public:
+    JournalTarget(JournalObject object, uint32_t index, const void *base)
+        : m_Object(object), m_Index(index), m_Base((const uint8_t*)base)
+    {
+    }
+
+    template<typename T>
+    void Field(bool changed, const T &field)
+    {
+        if (changed)
+            Editor::Journal.Append(JournalOp::Field, m_Object, m_Index, GetOffset(&field), &field, sizeof(T));
+    }
+
+    void String(bool changed, const std::string &str)
+    {
+        if (changed)
+            Editor::Journal.Append(JournalOp::String, m_Object, m_Index, GetOffset(&str), str.c_str(), (uint16_t)strlen(str.c_str()));
+    }
+
+    void Material(bool changed, TrailParticleMaterial *const &material)
+    {
+        if (!changed)
+            return;
+
+        int32_t idx = material ? (int32_t)(material - Editor::TrailMaterials) : -1;
+        Editor::Journal.Append(JournalOp::Material, m_Object, m_Index, GetOffset(&material), &idx, sizeof(idx));
+    }
+
+private:
+    uint32_t GetOffset(const void *field) const
+    {
+        return (uint32_t)((const uint8_t*)field - m_Base);
+    }
+
+    JournalObject m_Object;
+    uint32_t m_Index;
+    const uint8_t *m_Base;
+};
+
 class AttributeEditor : public ImwWindow {
 public:
     AttributeEditor()
@@ -223,181 +394,233 @@ public:
         switch (Editor::SelectedObject.type) {
             case Editor::AttributeType::Texture: {
                 MaterialTexture &tex = Editor::MaterialTextures[Editor::SelectedObject.index];
+                JournalTarget tex_journal(JournalObject::Texture, Editor::SelectedObject.index, &tex);
                 ImGui::Text("Texture");
                 auto w = ImGui::GetContentRegionAvailWidth();
                 if (tex.m_SRV)
                     ImGui::Image(tex.m_SRV, ImVec2(w, w));
 
                 tex.m_TextureName.resize(128, '\0');
-                ImGui::InputText("Name", (char*)tex.m_TextureName.data(), 120);
+                tex_journal.String(ImGui::InputText("Name", (char*)tex.m_TextureName.data(), 120), tex.m_TextureName);
                 tex.m_TexturePath.resize(128, '\0');
-                ImGui::InputText("Path", (char*)tex.m_TexturePath.data(), 120);
+                tex_journal.String(ImGui::InputText("Path", (char*)tex.m_TexturePath.data(), 120), tex.m_TexturePath);
+                tex_journal.Field(ImGui::Checkbox("Wrap", &tex.m_Wrap), tex.m_Wrap);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Sampled with repeating uvs, kept out of the export atlas");
 
             } break;
             case Editor::AttributeType::Material: {
                 TrailParticleMaterial &mat = Editor::TrailMaterials[Editor::SelectedObject.index];
+                JournalTarget mat_journal(JournalObject::Material, Editor::SelectedObject.index, &mat);
                 ImGui::Text("Material");
 
                 mat.m_MaterialName.resize(128, '\0');
-                ImGui::InputText("Name", (char*)mat.m_MaterialName.data(), 120);
+                mat_journal.String(ImGui::InputText("Name", (char*)mat.m_MaterialName.data(), 120), mat.m_MaterialName);
                 mat.m_ShaderPath.resize(128, '\0');
-                ImGui::InputText("Path", (char*)mat.m_ShaderPath.data(), 120);
+                mat_journal.String(ImGui::InputText("Path", (char*)mat.m_ShaderPath.data(), 120), mat.m_ShaderPath);
 
             } break;
             case Editor::AttributeType::Billboard: {
                 BillboardParticleDefinition &def = Editor::BillboardDefinitions[Editor::SelectedObject.index];
+                JournalTarget def_journal(JournalObject::Billboard, Editor::SelectedObject.index, &def);
                 ImGui::Text("Billboard");
 
                 def.name.resize(128, '\0');
-                ImGui::InputText("Name", (char*)def.name.data(), 120);
+                def_journal.String(ImGui::InputText("Name", (char*)def.name.data(), 120), def.name);
 
                 int idx = def.m_Material - Editor::TrailMaterials;
-                MaterialCombo(&idx);
+                bool material = MaterialCombo(&idx);
 
                 def.m_Material = &Editor::TrailMaterials[idx];
+                def_journal.Material(material, def.m_Material);
             } break;
             case Editor::AttributeType::Effect: {
                 auto &fx = Editor::EffectDefinitions[Editor::SelectedObject.index];
+                JournalTarget fx_journal(JournalObject::Effect, Editor::SelectedObject.index, &fx);
                 ImGui::TextColored(FX_COLORS[0], FX_ICON " %s", Editor::SelectedAnchorEffect.fx->name);
                 ImGui::Separator();
 
-                ImGui::InputText("Name#fcxc", fx.name, 15);
-                ImGui::DragFloat("Time##efefex", &fx.time, 0.005f, 0.f, 50.f);
-                ImGui::Checkbox("Anchor##Fx", &fx.anchor);
-                ImGui::Checkbox("Loop##Fx", &fx.loop);
+                fx_journal.Field(ImGui::InputText("Name#fcxc", fx.name, 15), fx.name);
+                fx_journal.Field(ImGui::DragFloat("Time##efefex", &fx.time, 0.005f, 0.f, 50.f), fx.time);
+                fx_journal.Field(ImGui::Checkbox("Anchor##Fx", &fx.anchor), fx.anchor);
+                fx_journal.Field(ImGui::Checkbox("Loop##Fx", &fx.loop), fx.loop);
 
                 ImGui::Text("Light");
-                ImGui::DragFloat("Radius##fxradi", &fx.light.m_LightRadius, 0.005f);
-                ImGui::ColorEdit4("Color##fxlighty", (float*)&fx.light.m_LightColor);
+                fx_journal.Field(ImGui::DragFloat("Radius##fxradi", &fx.light.m_LightRadius, 0.005f), fx.light.m_LightRadius);
+                fx_journal.Field(ImGui::ColorEdit4("Color##fxlighty", (float*)&fx.light.m_LightColor), fx.light.m_LightColor);
             } break;
             case Editor::AttributeType::GeometryEntry: {
                 auto &fx = *Editor::SelectedAnchorEffect.fx;
+                auto fx_index = (uint32_t)(Editor::SelectedAnchorEffect.fx - Editor::EffectDefinitions.data());
+                JournalTarget fx_journal(JournalObject::Effect, fx_index, &fx);
                 ImGui::TextColored(FX_COLORS[0], FX_ICON " %s", Editor::SelectedAnchorEffect.fx->name);
                 ImGui::Separator();
 
-                ImGui::DragFloat("Time##fx", &fx.time, 0.005f, 0.f, 50.f);
-                ImGui::Checkbox("Anchor##Fx", &fx.anchor);
-                ImGui::Checkbox("Loop##Fx", &fx.loop);
+                fx_journal.Field(ImGui::DragFloat("Time##fx", &fx.time, 0.005f, 0.f, 50.f), fx.time);
+                fx_journal.Field(ImGui::Checkbox("Anchor##Fx", &fx.anchor), fx.anchor);
+                fx_journal.Field(ImGui::Checkbox("Loop##Fx", &fx.loop), fx.loop);
 
                 ImGui::Text("Light");
-                ImGui::DragFloat("Radius##fxradi", &fx.light.m_LightRadius, 0.005f);
-                ImGui::ColorEdit4("Color##fxlighty", (float*)&fx.light.m_LightColor);;
+                fx_journal.Field(ImGui::DragFloat("Radius##fxradi", &fx.light.m_LightRadius, 0.005f), fx.light.m_LightRadius);
+                fx_journal.Field(ImGui::ColorEdit4("Color##fxlighty", (float*)&fx.light.m_LightColor), fx.light.m_LightColor);
 
                 auto &entry = Editor::SelectedAnchorEffect.fx->m_Entries[Editor::SelectedObject.index];
+                JournalTarget entry_journal(JournalObject::Entry, fx_index << 4 | Editor::SelectedObject.index, &entry);
                 ImGui::TextColored(FX_COLORS[0], FX_ICON " %s[%d] > " GEOMETRY_ICON " %s", Editor::SelectedAnchorEffect.fx->name, Editor::SelectedObject.index, entry.geometry->name.c_str());
                 ImGui::Separator();
 
-                ImGui::DragFloat("time##entry", &entry.time, 0.005f);
-                ImGui::Checkbox("anchor##entry", (bool*)&entry.m_Anchor);
+                entry_journal.Field(ImGui::DragFloat("time##entry", &entry.time, 0.005f), entry.time);
+                entry_journal.Field(ImGui::Checkbox("anchor##entry", (bool*)&entry.m_Anchor), entry.m_Anchor);
 
                 ImGui::Text("Start Position");
-                ImGui::DragFloat3("min##start", (float*)&entry.m_StartPosition.m_Min, 0.005f);
-                ImGui::DragFloat3("max##start", (float*)&entry.m_StartPosition.m_Max, 0.005f);
+                entry_journal.Field(ImGui::DragFloat3("min##start", (float*)&entry.m_StartPosition.m_Min, 0.005f), entry.m_StartPosition.m_Min);
+                entry_journal.Field(ImGui::DragFloat3("max##start", (float*)&entry.m_StartPosition.m_Max, 0.005f), entry.m_StartPosition.m_Max);
 
                 ImGui::Text("Start Velocity");
-                ImGui::DragFloat3("min##vel", (float*)&entry.m_StartVelocity.m_Min, 0.005f);
-                ImGui::DragFloat3("max##vel", (float*)&entry.m_StartVelocity.m_Max, 0.005f);
+                entry_journal.Field(ImGui::DragFloat3("min##vel", (float*)&entry.m_StartVelocity.m_Min, 0.005f), entry.m_StartVelocity.m_Min);
+                entry_journal.Field(ImGui::DragFloat3("max##vel", (float*)&entry.m_StartVelocity.m_Max, 0.005f), entry.m_StartVelocity.m_Max);
+                entry_journal.Field(ImGui::DragFloat("inherit##vel", &entry.m_InheritVelocity, 0.005f, 0.f, 1.f), entry.m_InheritVelocity);
+                ImGui::SameLine();
+                ShowHelpMarker("Fraction of the emitter velocity added to the start velocity");
 
                 ImGui::Text("Rotation Axis");
-                ImGui::DragFloat("min##rotaxis", &entry.m_RotLimitMin, 0.005f);
-                ImGui::DragFloat("max##rotaxis", &entry.m_RotLimitMax, 0.005f);
+                entry_journal.Field(ImGui::DragFloat("min##rotaxis", &entry.m_RotLimitMin, 0.005f), entry.m_RotLimitMin);
+                entry_journal.Field(ImGui::DragFloat("max##rotaxis", &entry.m_RotLimitMax, 0.005f), entry.m_RotLimitMax);
 
 
                 ImGui::Text("Rotation Speed");
-                ImGui::DragFloat("min##rotspeed", &entry.m_RotSpeedMin, 0.005f);
-                ImGui::DragFloat("max##rotspeed", &entry.m_RotSpeedMax, 0.005f);
+                entry_journal.Field(ImGui::DragFloat("min##rotspeed", &entry.m_RotSpeedMin, 0.005f), entry.m_RotSpeedMin);
+                entry_journal.Field(ImGui::DragFloat("max##rotspeed", &entry.m_RotSpeedMax, 0.005f), entry.m_RotSpeedMax);
 
 
                 ImGui::Text("Spawn Rate");
-                ComboFunc("easing##spawn", &entry.m_SpawnEasing);
-                ImGui::DragFloat("start##spawn", (float*)&entry.m_SpawnStart, 0.005f);
-                ImGui::DragFloat("end##spawn", (float*)&entry.m_SpawnEnd, 0.005f);
+                entry_journal.Field(ComboFunc("easing##spawn", &entry.m_SpawnEasing), entry.m_SpawnEasing);
+                entry_journal.Field(ImGui::DragFloat("start##spawn", (float*)&entry.m_SpawnStart, 0.005f), entry.m_SpawnStart);
+                entry_journal.Field(ImGui::DragFloat("end##spawn", (float*)&entry.m_SpawnEnd, 0.005f), entry.m_SpawnEnd);
+
+                ImGui::Text("Spawn LOD");
+                ImGui::SameLine();
+                ShowHelpMarker("Below this share of the screen height the entry spawns fewer, larger particles, 0 turns it off");
+                entry_journal.Field(ComboFunc("easing##lod", &entry.m_LODEasing), entry.m_LODEasing);
+                entry_journal.Field(ImGui::DragFloat("screen size##lod", &entry.m_LODScreenSize, 0.001f, 0.f, 1.f), entry.m_LODScreenSize);
+                entry_journal.Field(ImGui::DragFloat("min##lod", &entry.m_LODMinFactor, 0.005f, 0.01f, 1.f), entry.m_LODMinFactor);
 
                 ImGui::Separator();
 
                 auto &def = *entry.geometry;
+                JournalTarget def_journal(JournalObject::Geometry, (uint32_t)(entry.geometry - Editor::GeometryDefinitions), &def);
                 ImGui::TextColored(GEOMETRY_COLORS[0], GEOMETRY_ICON " %s (" ICON_MD_LINK ")", entry.geometry->name.c_str());
                 ImGui::SameLine();
                 ShowHelpMarker("This will edit the referenced definition as well");
                 ImGui::Separator();
 
-                ImGui::DragFloat("lifetime", &def.lifetime, 0.005f);
-                ImGui::DragFloat("gravity", &def.m_Gravity, 0.005f);
+                def_journal.Field(ImGui::DragFloat("lifetime", &def.lifetime, 0.005f), def.lifetime);
+                def_journal.Field(ImGui::DragFloat("gravity", &def.m_Gravity, 0.005f), def.m_Gravity);
 
                 ImGui::Text("Noise");
-                ImGui::DragFloat("scale##noise", &def.m_NoiseScale, 0.005f);
-                ImGui::DragFloat("speed##noise", &def.m_NoiseSpeed, 0.005f);
+                def_journal.Field(ImGui::DragFloat("scale##noise", &def.m_NoiseScale, 0.005f), def.m_NoiseScale);
+                def_journal.Field(ImGui::DragFloat("speed##noise", &def.m_NoiseSpeed, 0.005f), def.m_NoiseSpeed);
 
                 ImGui::Text("Deform");
-                ImGui::DragFloat("speed##Deform", &def.m_DeformSpeed, 0.005f);
-                ComboFunc("easing##Deform", &def.m_DeformEasing);
-                ImGui::DragFloat("start##Deform", &def.m_DeformFactorStart, 0.005f);
-                ImGui::DragFloat("end##Deform", &def.m_DeformFactorEnd, 0.005f);
+                def_journal.Field(ImGui::DragFloat("speed##Deform", &def.m_DeformSpeed, 0.005f), def.m_DeformSpeed);
+                def_journal.Field(ComboFunc("easing##Deform", &def.m_DeformEasing), def.m_DeformEasing);
+                def_journal.Field(ImGui::DragFloat("start##Deform", &def.m_DeformFactorStart, 0.005f), def.m_DeformFactorStart);
+                def_journal.Field(ImGui::DragFloat("end##Deform", &def.m_DeformFactorEnd, 0.005f), def.m_DeformFactorEnd);
 
                 ImGui::Text("Size");  
-                ComboFunc("easing##Size",       &def.m_SizeEasing);
-                ImGui::DragFloat("start##Size", &def.m_SizeStart, 0.005f);
-                ImGui::DragFloat("end##Size",   &def.m_SizeEnd, 0.005f);
+                def_journal.Field(ComboFunc("easing##Size",       &def.m_SizeEasing), def.m_SizeEasing);
+                def_journal.Field(ImGui::DragFloat("start##Size", &def.m_SizeStart, 0.005f), def.m_SizeStart);
+                def_journal.Field(ImGui::DragFloat("end##Size",   &def.m_SizeEnd, 0.005f), def.m_SizeEnd);
 
                 ImGui::Text("Color");
-                ComboFunc("easing##Color",        &def.m_ColorEasing);
-                ImGui::ColorEdit4("start##Color", (float*)&def.m_ColorStart);
-                ImGui::ColorEdit4("end##Color",   (float*)&def.m_ColorEnd);
+                def_journal.Field(ComboFunc("easing##Color",        &def.m_ColorEasing), def.m_ColorEasing);
+                def_journal.Field(ImGui::ColorEdit4("start##Color", (float*)&def.m_ColorStart), def.m_ColorStart);
+                def_journal.Field(ImGui::ColorEdit4("end##Color",   (float*)&def.m_ColorEnd), def.m_ColorEnd);
 
                 ImGui::Text("Light Color");
-                ComboFunc("easing##lightColor",        &def.m_LightColorEasing);
-                ImGui::ColorEdit4("start##lightColor", (float*)&def.m_LightColorStart);
-                ImGui::ColorEdit4("end##lightColor",   (float*)&def.m_LightColorEnd);
+                def_journal.Field(ComboFunc("easing##lightColor",        &def.m_LightColorEasing), def.m_LightColorEasing);
+                def_journal.Field(ImGui::ColorEdit4("start##lightColor", (float*)&def.m_LightColorStart), def.m_LightColorStart);
+                def_journal.Field(ImGui::ColorEdit4("end##lightColor",   (float*)&def.m_LightColorEnd), def.m_LightColorEnd);
 
                 ImGui::Text("Light Radius");
-                ComboFunc("easing##lightradish",         &def.m_LightRadiusEasing);
-                ImGui::DragFloat("start##ligthradius", (float*)&def.m_LightRadiusStart, 0.005f);
-                ImGui::DragFloat("end##lightradus",     (float*)&def.m_LightRadiusEnd, 0.005f);
+                def_journal.Field(ComboFunc("easing##lightradish",         &def.m_LightRadiusEasing), def.m_LightRadiusEasing);
+                def_journal.Field(ImGui::DragFloat("start##ligthradius", (float*)&def.m_LightRadiusStart, 0.005f), def.m_LightRadiusStart);
+                def_journal.Field(ImGui::DragFloat("end##lightradus",     (float*)&def.m_LightRadiusEnd, 0.005f), def.m_LightRadiusEnd);
             } break;
             case Editor::AttributeType::Geometry: {
                 auto &def = Editor::GeometryDefinitions[Editor::SelectedObject.index];
+                JournalTarget def_journal(JournalObject::Geometry, Editor::SelectedObject.index, &def);
                 ImGui::TextColored(GEOMETRY_COLORS[0], GEOMETRY_ICON " %s", def.name.c_str());
                 ImGui::Separator();
 
                 def.name.resize(128, '\0');
-                ImGui::InputText("Name", (char*)def.name.data(), 120);
+                def_journal.String(ImGui::InputText("Name", (char*)def.name.data(), 120), def.name);
 
                 int idx = def.m_Material - Editor::TrailMaterials;
-                MaterialCombo(&idx);
+                bool material = MaterialCombo(&idx);
                 def.m_Material = &Editor::TrailMaterials[idx];
+                def_journal.Material(material, def.m_Material);
 
-                ImGui::DragFloat("lifetime", &def.lifetime);
-                ImGui::DragFloat("gravity", &def.m_Gravity);
+                def_journal.Field(ImGui::DragFloat("lifetime", &def.lifetime), def.lifetime);
+                def_journal.Field(ImGui::DragFloat("gravity", &def.m_Gravity), def.m_Gravity);
 
                 ImGui::Text("Noise");
-                ImGui::DragFloat("scale##noise", &def.m_NoiseScale, 0.005f);
-                ImGui::DragFloat("speed##noise", &def.m_NoiseSpeed, 0.005f);
+                def_journal.Field(ImGui::DragFloat("scale##noise", &def.m_NoiseScale, 0.005f), def.m_NoiseScale);
+                def_journal.Field(ImGui::DragFloat("speed##noise", &def.m_NoiseSpeed, 0.005f), def.m_NoiseSpeed);
 
                 ImGui::Text("Deform");
-                ImGui::DragFloat("speed##Deform", &def.m_DeformSpeed, 0.005f);
-                ComboFunc("easing##Deform", &def.m_DeformEasing);
-                ImGui::DragFloat("start##Deform", &def.m_DeformFactorStart, 0.005f);
-                ImGui::DragFloat("end##Deform", &def.m_DeformFactorEnd, 0.005f);
+                def_journal.Field(ImGui::DragFloat("speed##Deform", &def.m_DeformSpeed, 0.005f), def.m_DeformSpeed);
+                def_journal.Field(ComboFunc("easing##Deform", &def.m_DeformEasing), def.m_DeformEasing);
+                def_journal.Field(ImGui::DragFloat("start##Deform", &def.m_DeformFactorStart, 0.005f), def.m_DeformFactorStart);
+                def_journal.Field(ImGui::DragFloat("end##Deform", &def.m_DeformFactorEnd, 0.005f), def.m_DeformFactorEnd);
 
                 ImGui::Text("Size");
-                ComboFunc("easing##Size", &def.m_SizeEasing);
-                ImGui::DragFloat("start##Size", &def.m_SizeStart, 0.005f);
-                ImGui::DragFloat("end##Size", &def.m_SizeEnd, 0.005f);
+                def_journal.Field(ComboFunc("easing##Size", &def.m_SizeEasing), def.m_SizeEasing);
+                def_journal.Field(ImGui::DragFloat("start##Size", &def.m_SizeStart, 0.005f), def.m_SizeStart);
+                def_journal.Field(ImGui::DragFloat("end##Size", &def.m_SizeEnd, 0.005f), def.m_SizeEnd);
 
                 ImGui::Text("Color");
-                ComboFunc("easing##Color", &def.m_ColorEasing);
-                ImGui::ColorEdit4("start##Color", (float*)&def.m_ColorStart);
-                ImGui::ColorEdit4("end##Color", (float*)&def.m_ColorEnd);
+                def_journal.Field(ComboFunc("easing##Color", &def.m_ColorEasing), def.m_ColorEasing);
+                def_journal.Field(ImGui::ColorEdit4("start##Color", (float*)&def.m_ColorStart), def.m_ColorStart);
+                def_journal.Field(ImGui::ColorEdit4("end##Color", (float*)&def.m_ColorEnd), def.m_ColorEnd);
 
                 ImGui::Text("Light Color");
-                ComboFunc("easing##lightColor", &def.m_LightColorEasing);
-                ImGui::ColorEdit4("start##lightColor", (float*)&def.m_LightColorStart);
-                ImGui::ColorEdit4("end##lightColor", (float*)&def.m_LightColorEnd);
+                def_journal.Field(ComboFunc("easing##lightColor", &def.m_LightColorEasing), def.m_LightColorEasing);
+                def_journal.Field(ImGui::ColorEdit4("start##lightColor", (float*)&def.m_LightColorStart), def.m_LightColorStart);
+                def_journal.Field(ImGui::ColorEdit4("end##lightColor", (float*)&def.m_LightColorEnd), def.m_LightColorEnd);
 
                 ImGui::Text("Light Radius");
-                ComboFunc("easing##lightradish", &def.m_LightRadiusEasing);
-                ImGui::ColorEdit4("start##ligthradius", (float*)&def.m_LightRadiusStart);
-                ImGui::ColorEdit4("end##lightradus", (float*)&def.m_LightRadiusEnd);
+                def_journal.Field(ComboFunc("easing##lightradish", &def.m_LightRadiusEasing), def.m_LightRadiusEasing);
+                def_journal.Field(ImGui::DragFloat("start##ligthradius", &def.m_LightRadiusStart, 0.005f), def.m_LightRadiusStart);
+                def_journal.Field(ImGui::DragFloat("end##lightradus", &def.m_LightRadiusEnd, 0.005f), def.m_LightRadiusEnd);
+            } break;
+            case Editor::AttributeType::Trail: {
+                auto &def = Editor::TrailDefinitions[Editor::SelectedObject.index];
+                JournalTarget def_journal(JournalObject::Trail, Editor::SelectedObject.index, &def);
+                ImGui::Text(TRAIL_ICON " %s", def.name.c_str());
+                ImGui::Separator();
+
+                def.name.resize(128, '\0');
+                def_journal.String(ImGui::InputText("Name", (char*)def.name.data(), 120), def.name);
+
+                int idx = def.m_Material - Editor::TrailMaterials;
+                bool material = MaterialCombo(&idx);
+                def.m_Material = &Editor::TrailMaterials[idx];
+                def_journal.Material(material, def.m_Material);
+
+                def_journal.Field(ImGui::DragFloat("lifetime##trail", &def.lifetime, 0.005f), def.lifetime);
+                def_journal.Field(ImGui::DragFloat("gravity##trail", &def.m_Gravity, 0.005f), def.m_Gravity);
+
+                ImGui::Text("Sampling");
+                const char *samplings[] = { "time", "distance" };
+                def_journal.Field(ImGui::Combo("mode##sampling", (int*)&def.m_Sampling, samplings, ARRAYSIZE(samplings)), def.m_Sampling);
+                if (def.m_Sampling == TrailSampling::Distance) {
+                    def_journal.Field(ImGui::DragFloat("distance##sampling", &def.m_SampleDistance, 0.001f, 0.001f, 10.f), def.m_SampleDistance);
+                    def_journal.Field(ImGui::DragFloat("angle##sampling", &def.m_SampleAngle, 0.1f, 0.f, 180.f), def.m_SampleAngle);
+                }
+                else {
+                    def_journal.Field(ImGui::DragFloat("frequency##sampling", &def.frequency, 0.001f, 0.001f, 10.f), def.frequency);
+                }
             } break;
             case Editor::AttributeType::None:
                 ImGui::Text("No selection");
@@ -583,7 +806,7 @@ public:
             ImGui::SameLine(ImGui::GetWindowContentRegionWidth() - 42);
             sprintf(label, ICON_MD_PLAY_ARROW "##%s%d", fx.name, i);
             if (ImGui::Button(label)) {
-                Editor::SelectedAnchorEffect.fx = &Editor::EffectDefinitions[i];
+                Editor::SelectEffect(&Editor::EffectDefinitions[i]);
             }
             
             ImGui::SameLine();
@@ -606,7 +829,7 @@ public:
                             auto def = entry.billboard;
                             sprintf(label, "[%d] " BILLBOARD_ICON " %s", j, def->name.c_str());
                             if (ImGui::Selectable(label, selected == j)) {
-                                Editor::SelectedAnchorEffect.fx = &Editor::EffectDefinitions[i];
+                                Editor::SelectEffect(&Editor::EffectDefinitions[i]);
                                 Editor::SelectedObject = {
                                     Editor::AttributeType::Billboard,
                                     (int)(def - Editor::BillboardDefinitions)
@@ -617,7 +840,7 @@ public:
                             auto def = entry.geometry;
                             sprintf(label, "[%d] " GEOMETRY_ICON " %s##%s%d", j, def->name.c_str(), fx.name, j);
                             if (ImGui::Selectable(label, selected == j)) {
-                                Editor::SelectedAnchorEffect.fx = &Editor::EffectDefinitions[i];
+                                Editor::SelectEffect(&Editor::EffectDefinitions[i]);
                                 Editor::SelectedObject = {
                                     Editor::AttributeType::GeometryEntry,
                                     j
@@ -628,7 +851,7 @@ public:
                             auto def = entry.trail.def;
                             sprintf(label, "[%d] " TRAIL_ICON " %s", j, def->name.c_str());
                             if (ImGui::Selectable(label, selected == j)) {
-                                Editor::SelectedAnchorEffect.fx = &Editor::EffectDefinitions[i];
+                                Editor::SelectEffect(&Editor::EffectDefinitions[i]);
                                 Editor::SelectedObject = {
                                     Editor::AttributeType::Trail,
                                     (int)(def - Editor::TrailDefinitions)
@@ -658,7 +881,67 @@ float Speed = 1.f;
 
 bool Paused = false;
 bool Debug = false;
+bool ShowStats = false;
+bool SpecializedKernels = true;
+bool CompactInstances = false;
+bool BillboardQuads = false;
+bool TrailRibbons = false;
+float TrailRibbonTolerance = 0.002f;
+bool TemporalLOD = false;
+bool MeshLOD = false;
+float MeshLODTolerance = 0.001f;
+bool ShowSpawnLOD = false;
+bool FlipbookLOD = true;
+bool CaptureReference = false;
+bool RecordCache = false;
+bool PlayCache = false;
 bool UnsavedChanges = true;
+EditJournal Journal;
+ShaderCache *Shaders;
+
+static ShaderCompiler *ShaderBackend;
+// request each material's pixel shader is waiting on, 0 once swapped in
+static ShaderTicket MaterialShaders[MAX_TRAIL_MATERIALS];
+static bool ShaderBatch = false;
+static uint32_t ShaderBatchCompiled;
+static uint32_t ShaderBatchCached;
+static uint32_t ShaderBatchFailed;
+static std::chrono::high_resolution_clock::time_point ShaderBatchStart;
+
+// pixels uploaded per frame at most, a burst of loads is spread over frames
+#define TEXTURE_UPLOAD_BUDGET (16 << 20)
+
+static TextureLoader *Textures;
+// drawn in place of textures that have not finished loading
+static ID3D11ShaderResourceView *PlaceholderSRV;
+// the load each material texture is waiting on
+static TextureSlots MaterialTextureLoads(MAX_MATERIAL_TEXTURES);
+static bool TextureBatch = false;
+static uint32_t TextureBatchLoaded;
+static uint32_t TextureBatchFailed;
+static uint64_t TextureBatchBytes;
+static std::chrono::high_resolution_clock::time_point TextureBatchStart;
+
+static FileWatcher *Watcher;
+// what the watcher was last handed, paths can be edited in the meantime
+static std::string WatchedTextures[MAX_MATERIAL_TEXTURES];
+static std::string WatchedShaders[MAX_TRAIL_MATERIALS];
+// each material's shader and everything it includes
+static std::vector<std::string> MaterialFiles[MAX_TRAIL_MATERIALS];
+
+// editor.json holds snapshot SnapshotGeneration, "editor.journal.<n>" the
+// edits made on top of snapshot n. ProjectGeneration is the journal written to.
+static uint32_t ProjectGeneration = 0;
+static std::atomic<uint32_t> SnapshotGeneration(0);
+static bool ProjectLoaded = false;
+
+static JobPool *Compactor;
+static std::atomic<bool> Compacting(false);
+// 0 while nothing to report, 1 once a compaction finished, -1 if it failed
+static std::atomic<int> CompactionResult(0);
+static std::chrono::high_resolution_clock::time_point LastCompaction;
+// File > Save while a compaction was running, compacts again once it is done
+static bool SaveQueued = false;
 AttributeObject SelectedObject;
 
 MaterialTexture MaterialTextures[MAX_MATERIAL_TEXTURES];
@@ -672,41 +955,11 @@ std::vector<ParticleEffect> EffectDefinitions;
 AnchoredParticleEffect SelectedAnchorEffect;
 ParticleEffect *SelectedEffect;
 
-JsonValue EditorState;
-
-PosBox GetPositionBox(json &table, std::string name)
-{
-    auto box = table[name];
-    auto min = box["min"];
-    auto max = box["max"];
-
-    PosBox vel = {
-        { min[0], min[1], min[2] },
-        { max[0], max[1], max[2] },
-    };
-
-    return vel;
-}
-
-
-VelocityBox GetVelocityBox(json &table, std::string name)
-{
-    auto box = table[name];
-    auto min = box["min"];
-    auto max = box["max"];
-
-    VelocityBox vel = {
-        { min[0], min[1], min[2] },
-        { max[0], max[1], max[2] },
-    };
-
-    return vel;
-}
+Flipbook *LoadedFlipbook;
+std::string LoadedFlipbookEffect;
+ID3D11ShaderResourceView *LoadedFlipbookSRV;
 
-SimpleMath::Vector4 GetVector4(json &vec)
-{
-    return { vec[0], vec[1], vec[2], vec[3] };
-}
+JsonValue EditorState;
 
 BillboardParticleDefinition *GetBillboardDef(std::string name)
 {
@@ -752,713 +1005,1756 @@ TrailParticleMaterial *GetMaterial(std::string name)
     return nullptr;
 }
 
-void Reload(ID3D11Device *device)
+// Decoded on the texture loader workers, UpdateTextures uploads it once it
+// finishes. Until then the old texture, or the placeholder, stays in use.
+static void RequestTexture(int index)
 {
-    int texcount = 0;
-    for (int i = 0; i < MAX_MATERIAL_TEXTURES; i++) {
-        auto &mat = MaterialTextures[i];
-        
-        if (!mat.m_TexturePath.empty()) {
-            //if (mat.m_SRV) {
-                ID3D11ShaderResourceView *newtex = nullptr;
-
-                std::wstring file = ConvertToWString(mat.m_TexturePath);
-                auto res = CreateWICTextureFromFile(device, file.c_str(), (ID3D11Resource**)nullptr, &newtex);
-                if (!SUCCEEDED(res)) {
-                    char err[256];
-                    WinErrorMsg(res, err, 256);
-
-                    ConsoleOutput->AddLog("[error] Failed to load texture '%s'\n", mat.m_TexturePath.c_str());
-                    ConsoleOutput->AddLog("[error] %s", err);
-                    continue;
-                }
-                if (mat.m_SRV)
-                    mat.m_SRV->Release();
-                mat.m_SRV = newtex;
-            //}
-            texcount++;
-        }
-    }
-
-    int trailmatcount = 0;
-    for (int i = 0; i < MAX_TRAIL_MATERIALS; i++) {
-        auto &mat = TrailMaterials[i];
-
-        if (!mat.m_ShaderPath.empty()) {
-            //if (mat.m_PixelShader) {
-                ID3D11PixelShader *newps = nullptr;
-                ID3DBlob *blob = nullptr;
-                ID3DBlob *error = nullptr;
-
-                std::wstring file = ConvertToWString(mat.m_ShaderPath);
-                auto res = D3DCompileFromFile(
-                    file.c_str(),
-                    nullptr,
-                    D3D_COMPILE_STANDARD_FILE_INCLUDE,
-                    "PS",
-                    "ps_5_0",
-                    D3DCOMPILE_DEBUG,
-                    0,
-                    &blob,
-                    &error
-                );
-                if (!SUCCEEDED(res)) {
-                    ConsoleOutput->AddLog("[error] Failed to compile shader '%s'\n", mat.m_ShaderPath.c_str());
-
-                    if (error) {
-                        ConsoleOutput->AddLog("[error] %s", (char*)error->GetBufferPointer());
-                    } else {
-                        char err[256];
-                        WinErrorMsg(res, err, 256);
-                        ConsoleOutput->AddLog("[error] %s", err);
-                    }
+    auto &mat = MaterialTextures[index];
 
-                    continue;
-                }
-
-                if (!SUCCEEDED(device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &newps))) {
-                    ConsoleOutput->AddLog("[error] Failed to create pixel shader '%s'\n", mat.m_ShaderPath.c_str());
-                    continue;
-                }
-
-                if (mat.m_PixelShader)
-                    mat.m_PixelShader->Release();
-                mat.m_PixelShader = newps;
-            //}
-            trailmatcount++;
-        }
+    if (MaterialTextureLoads.Request(*Textures, index, mat.m_TexturePath)) {
+        mat.m_SRV = PlaceholderSRV;
+        mat.m_SRV->AddRef();
     }
 
-    ConsoleOutput->AddLog("Reloaded %d textures and %d materials\n", texcount, trailmatcount);
+    if (!TextureBatch) {
+        TextureBatch = true;
+        TextureBatchLoaded = 0;
+        TextureBatchFailed = 0;
+        TextureBatchBytes = 0;
+        TextureBatchStart = std::chrono::high_resolution_clock::now();
+    }
 }
 
-void Style();
+static ID3D11ShaderResourceView *CreateTexture(ID3D11Device *device, uint32_t width, uint32_t height, const uint8_t *rgba)
+{
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA data = {};
+    data.pSysMem = rgba;
+    data.SysMemPitch = width * 4;
+
+    ID3D11Texture2D *texture = nullptr;
+    if (!SUCCEEDED(device->CreateTexture2D(&desc, &data, &texture)))
+        return nullptr;
+
+    ID3D11ShaderResourceView *srv = nullptr;
+    device->CreateShaderResourceView(texture, nullptr, &srv);
+    texture->Release();
+
+    return srv;
+}
 
-void Load()
+static void UpdateTextures(ID3D11Device *device)
 {
-    std::ifstream i("editor.json");
-    json data;
-    i >> data;
-    
-    auto materials = data["materials"];
-    auto mats = TrailMaterials;
-    for (auto entry : materials) {
-        auto mat = TrailParticleMaterial {
-            entry["name"],
-            entry["path"],
-            nullptr
-        };
-        *mats++ = mat;
-    }
-
-    auto textures = data.at("textures");
-    auto texs = MaterialTextures;
-    for (auto entry : textures) {
-        auto tex = MaterialTexture{
-            entry["name"],
-            entry["path"],
-            nullptr
-        };
-        *texs++ = tex;
-    }
-
-    auto bdefs = data.at("billboard_definitions");
-    auto bd = BillboardDefinitions;
-    for (auto entry : bdefs) {
-        BillboardParticleDefinition def = {};
-        std::string n = entry["name"];
-        def.name = n;
-        def.m_Material = GetMaterial(entry["material_name"]);
-        def.lifetime = entry["lifetime"];
-        *bd++ = def;
-    }
-
-    auto gdefs = data.at("geometry_definitions");
-    auto gd = GeometryDefinitions;
-    for (auto entry : gdefs) {
-        GeometryParticleDefinition def = {};
-        std::string n = entry["name"];
-        def.name = n;
-        def.m_Material = GetMaterial(entry["material_name"]);
-        def.lifetime = entry["lifetime"];
-        def.m_Gravity = entry["gravity"];
-        def.m_NoiseScale = entry["noise_scale"];
-        def.m_NoiseSpeed = entry["noise_speed"];
-
-        auto color = entry["color"];
-        def.m_ColorEasing = GetEasingFromString(color["function"]);
-        def.m_ColorStart = GetVector4(color["start"]);
-        def.m_ColorEnd = GetVector4(color["end"]);
-
-        auto deform = entry["deform"];
-        def.m_DeformEasing = GetEasingFromString(deform["function"]);
-        def.m_DeformFactorStart = deform["start"];
-        def.m_DeformFactorEnd = deform["end"];
-
-        def.m_DeformSpeed = entry["deform_speed"];
-        
-        auto size = entry["size"];
-        def.m_SizeEasing = GetEasingFromString(size["function"]);
-        def.m_SizeStart = size["start"];
-        def.m_SizeEnd = size["end"];
-
-        auto light = entry["light"];
-        auto light_color = light["color"];
-        def.m_LightColorEasing = GetEasingFromString(light_color["function"]);
-        def.m_LightColorStart = GetVector4(light_color["start"]);
-        def.m_LightColorEnd = GetVector4(light_color["end"]);
-        auto light_radius = light["radius"];
-        def.m_LightRadiusEasing = GetEasingFromString(light_radius["function"]);
-        def.m_LightRadiusStart = light_radius["start"];
-        def.m_LightRadiusEnd = light_radius["end"];
-        *gd++ = def;
-    }
-
-
-    auto tdefs = data.at("trail_definitions");
-    auto td = TrailDefinitions;
-    for (auto entry :tdefs) {
-        TrailParticleDefinition def = {};
-        std::string n = entry["name"];
-        def.name = n;
-        def.lifetime = entry["lifetime"];
-        def.frequency = entry["frequency"];
-        def.m_Gravity = entry["gravity"];
-        def.m_Material = GetMaterial(entry["material_name"]);
-        //def.m_StartPosition = GetPositionBox(entry, "start_position");
-        //def.m_StartVelocity = GetVelocityBox(entry, "start_velocity");
-        //def.lifetime = entry["lifetime"];
-        *td++ = def;
-    }
-
-    auto effects = data.at("fx");
-    for (auto entry : effects) {
-
-        ParticleEffect fx = {};
-        std::string name = entry["name"];
-        memcpy(fx.name, name.data(), min(name.size(), 15));
-        for (int i = name.size(); i < 15; i++)
-            fx.name[i] = '\0';
-        fx.time = entry["time"];
-        fx.loop = entry["loop"];
-
-        if (entry.find("light") != entry.end()) {
-            auto light = entry["light"];
-            fx.light.m_LightRadius = light["radius"];
-            fx.light.m_LightColor = GetVector4(light["color"]);
-        }
-
-        auto entries = entry["entries"];
-        for (auto fxentry : entries) {
-            auto type = ParticleTypeFromString(fxentry["type"]);
-            std::string name = fxentry["name"];
-            
-            ParticleEffectEntry ent = {};
-            ent.type = type;
+    MaterialTextureLoads.Update(*Textures, TEXTURE_UPLOAD_BUDGET, [&](size_t i, TextureLoadResult &result) {
+        auto &mat = MaterialTextures[i];
+        if (mat.m_TexturePath != result.m_Path)
+            return false;
+
+        ID3D11ShaderResourceView *newtex = nullptr;
+        if (result.m_Ok) {
+            newtex = CreateTexture(device, result.m_Width, result.m_Height, result.m_Pixels.data());
+            if (!newtex) {
+                ConsoleOutput->AddLog("[error] Failed to create texture '%s'\n", mat.m_TexturePath.c_str());
+                TextureBatchFailed++;
+                return false;
+            }
+        }
+        else {
+            // not a format ReadImage decodes, WIC does it on this thread
+            std::wstring file = ConvertToWString(mat.m_TexturePath);
+            auto res = CreateWICTextureFromFile(device, file.c_str(), (ID3D11Resource**)nullptr, &newtex);
+            if (!SUCCEEDED(res)) {
+                char err[256];
+                WinErrorMsg(res, err, 256);
+
+                ConsoleOutput->AddLog("[error] Failed to load texture '%s'\n", mat.m_TexturePath.c_str());
+                ConsoleOutput->AddLog("[error] %s", err);
+                TextureBatchFailed++;
+                return false;
+            }
+        }
 
-            ent.start = fxentry["start"];
-            ent.time = fxentry["time"];
+        if (mat.m_SRV)
+            mat.m_SRV->Release();
+        mat.m_SRV = newtex;
 
-            bool anchor = false;
-            auto it = fxentry.find("anchor");
-            if (it != fxentry.end())
-                anchor = fxentry["anchor"];
-            ent.m_Anchor = anchor;
+        TextureBatchLoaded++;
+        TextureBatchBytes += result.m_Pixels.size();
+        return true;
+    });
 
-            ent.m_StartPosition = GetPositionBox(fxentry, "start_position");
-            ent.m_StartVelocity = GetVelocityBox(fxentry, "start_velocity");
+    if (!TextureBatch)
+        return;
 
-            auto spawn = fxentry["spawn"];
-            ent.m_SpawnEasing  = GetEasingFromString(spawn["function"]);
-            ent.m_SpawnStart = spawn["start"];
-            ent.m_SpawnEnd = spawn["end"];
+    if (!MaterialTextureLoads.IsIdle())
+        return;
 
-            auto rotlim = fxentry["rotation"];
-            ent.m_RotLimitMin = rotlim["min"];
-            ent.m_RotLimitMax = rotlim["max"];
+    TextureBatch = false;
 
-            auto rot = fxentry["rotation_speed"];
-            ent.m_RotSpeedMin = rot["min"];
-            ent.m_RotSpeedMax = rot["max"];
+    auto ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - TextureBatchStart).count();
+    ConsoleOutput->AddLog("Loaded %u textures (%.2f MB), %u failed in %.1fms\n",
+        TextureBatchLoaded, TextureBatchBytes / (1024.f * 1024.f), TextureBatchFailed, ms);
+}
 
-            switch (type) {
-                case ParticleType::Billboard:
-                    ent.billboard = GetBillboardDef(name);
-                    break;
-                case ParticleType::Geometry:
-                    ent.geometry = GetGeometryDef(name);
-                    break;
-                case ParticleType::Trail:
-                    ent.trail = {
-                        GetTrailDef(name),
-                        -1
-                    };
-                    break;
-            }
+void SelectEffect(ParticleEffect *fx)
+{
+    // the particles of the previous effect live in its transform node
+    if (SelectedAnchorEffect.fx != fx && FXSystem)
+        FXSystem->ReleaseAnchoredFX(&SelectedAnchorEffect);
 
-            fx.m_Entries[fx.m_Count++] = ent;
-        }
+    SelectedAnchorEffect.fx = fx;
+}
 
-        EffectDefinitions.push_back(fx);
+bool LoadFlipbook(const char *effect, const char *path)
+{
+    auto flipbook = new Flipbook();
+    if (!flipbook->Load(path)) {
+        delete flipbook;
+        return false;
     }
-}
 
-void Save() {
-    json j;
+    // the descriptor names the atlas next to it
+    std::string atlas = path;
+    auto slash = atlas.find_last_of("/\\");
+    atlas = (slash == std::string::npos ? "" : atlas.substr(0, slash + 1)) + flipbook->m_Atlas;
+
+    uint32_t width, height;
+    std::vector<uint8_t> pixels;
+    ID3D11ShaderResourceView *srv = nullptr;
+    if (ReadImage(atlas.c_str(), width, height, pixels))
+        srv = CreateTexture(ImwPlatformWindowDX11::s_pDevice, width, height, pixels.data());
+
+    if (!srv) {
+        ConsoleOutput->AddLog("[error] Failed to load flipbook atlas '%s'\n", atlas.c_str());
+        delete flipbook;
+        return false;
+    }
 
-    j["billboard_definitions"] = {};
-    for (int i = 0; i < MAX_BILLBOARD_PARTICLE_DEFINITIONS; i++) {
-        auto def = BillboardDefinitions[i];
-        if (def.name.empty())
-            continue;
+    delete LoadedFlipbook;
+    if (LoadedFlipbookSRV)
+        LoadedFlipbookSRV->Release();
 
-        json definition = {
-            { "name", def.name },
-            { "material_name", def.m_Material->m_MaterialName },
-            { "lifetime", def.lifetime },
-            /*{"start",
-            {
-            "min", {def.m_StartPosition.m_Min.x, def.m_StartPosition.m_Min.y, def.m_StartPosition.m_Min.z }
-            },
-            {
-            "max", {def.m_StartPosition.m_Max.x, def.m_StartPosition.m_Max.y, def.m_StartPosition.m_Max.z }
-            }
-            }*/
-        };
+    LoadedFlipbook = flipbook;
+    LoadedFlipbookEffect = effect;
+    LoadedFlipbookSRV = srv;
 
-        j["billboard_definitions"].push_back(definition);
-    }
+    return true;
+}
 
-    j["geometry_definitions"] = {};
-    for (int i = 0; i < MAX_BILLBOARD_PARTICLE_DEFINITIONS; i++) {
-        auto def = GeometryDefinitions[i];
-        if (def.name.empty())
-            continue;
+// Compiled on the shader cache workers, UpdateShaders swaps it in once it
+// finishes and the old shader stays in use until then
+static void RequestMaterialShader(int index)
+{
+    auto &mat = TrailMaterials[index];
 
-        json definition = {
-            { "name", def.name },
-            { "material_name", def.m_Material->m_MaterialName },
-            { "lifetime", def.lifetime },
-            { "gravity", def.m_Gravity },
-            { "noise_scale", def.m_NoiseScale },
-            { "noise_speed", def.m_NoiseSpeed },
-            { "color", {
-                { "start", { def.m_ColorStart.x, def.m_ColorStart.y, def.m_ColorStart.z, def.m_ColorStart.w } },
-                { "end", { def.m_ColorEnd.x, def.m_ColorEnd.y, def.m_ColorEnd.z, def.m_ColorEnd.w } },
-                { "function", GetEasingName(def.m_ColorEasing) }
-            }},
-            { "deform", {
-                { "start", def.m_DeformFactorStart },
-                { "end", def.m_DeformFactorEnd },
-                { "function", GetEasingName(def.m_DeformEasing) }
-            }},
-            { "deform_speed", def.m_DeformSpeed },
-            { "size", {
-                { "start", def.m_SizeStart },
-                { "end", def.m_SizeEnd },
-                { "function", GetEasingName(def.m_SizeEasing) }
-            }},
-            { "light", {
-                { "color",{
-                    { "start",{ def.m_LightColorStart.x, def.m_LightColorStart.y, def.m_LightColorStart.z, def.m_LightColorStart.w } },
-                    { "end",{ def.m_LightColorEnd.x, def.m_LightColorEnd.y, def.m_LightColorEnd.z, def.m_LightColorEnd.w } },
-                    { "function", GetEasingName(def.m_LightColorEasing) }
-                }} ,
-                { "radius",{
-                    { "start", def.m_LightRadiusStart },
-                    { "end", def.m_LightRadiusEnd },
-                    { "function", GetEasingName(def.m_LightRadiusEasing) }
-                }}
-            }}
-        };
-
-        j["geometry_definitions"].push_back(definition);
-    }
-
-    j["trail_definitions"] = {};
-    for (int i = 0; i < MAX_BILLBOARD_PARTICLE_DEFINITIONS; i++) {
-        auto def = TrailDefinitions[i];
-        if (def.name.empty())
-            continue;
+    MaterialShaders[index] = 0;
+    if (!mat.m_ShaderPath.empty())
+        MaterialShaders[index] = Shaders->Request({ mat.m_ShaderPath, "PS", "ps_5_0" });
+}
+
+static void BeginShaderBatch()
+{
+    // requests made while a batch is running are reported with it
+    if (ShaderBatch)
+        return;
+
+    ShaderBatch = true;
+    ShaderBatchCompiled = 0;
+    ShaderBatchCached = 0;
+    ShaderBatchFailed = 0;
+    ShaderBatchStart = std::chrono::high_resolution_clock::now();
+}
 
-        json definition = {
-            { "name", def.name },
-            { "material_name", def.m_Material->m_MaterialName },
-            { "lifetime", def.lifetime },
-            { "gravity", def.m_Gravity },
-            { "frequency", def.frequency }
-        };
+// Hands the watcher every texture, material shader and shader include, the
+// includes are looked up again since an edit can add or remove them
+static void WatchAssets()
+{
+    std::vector<std::string> files;
 
-        j["trail_definitions"].push_back(definition);
+    for (int i = 0; i < MAX_MATERIAL_TEXTURES; i++) {
+        WatchedTextures[i] = MaterialTextures[i].m_TexturePath;
+        if (!WatchedTextures[i].empty())
+            files.push_back(WatchedTextures[i]);
     }
 
-    j["materials"] = {};
     for (int i = 0; i < MAX_TRAIL_MATERIALS; i++) {
-        auto &mat = TrailMaterials[i];
-        if (mat.m_MaterialName.empty())
-            continue;
-
-        json material = {
-            {"name", mat.m_MaterialName },
-            {"path", mat.m_ShaderPath }
-        };
+        WatchedShaders[i] = TrailMaterials[i].m_ShaderPath;
+        MaterialFiles[i].clear();
+        if (!WatchedShaders[i].empty())
+            Shaders->GetFiles({ WatchedShaders[i], "PS", "ps_5_0" }, MaterialFiles[i]);
 
-        j["materials"].push_back(material);
+        files.insert(files.end(), MaterialFiles[i].begin(), MaterialFiles[i].end());
     }
 
-    j["textures"] = {};
-    for (int i = 0; i < MAX_MATERIAL_TEXTURES; i++) {
-        auto &tex = MaterialTextures[i];
-        if (tex.m_TextureName.empty())
-            continue;
+    Watcher->SetFiles(files);
+}
 
-        json material = {
-            { "name", tex.m_TextureName },
-            { "path", tex.m_TexturePath }
-        };
+void Reload(ID3D11Device *device)
+{
+    TextureBatch = false;
 
-        j["textures"].push_back(material);
+    int texcount = 0;
+    for (int i = 0; i < MAX_MATERIAL_TEXTURES; i++) {
+        MaterialTextureLoads.Cancel(i);
+        if (!MaterialTextures[i].m_TexturePath.empty()) {
+            RequestTexture(i);
+            texcount++;
+        }
     }
 
-    j["fx"] = {};
-    for (auto &fx : EffectDefinitions) {
-        json entries = {};
-        for (int i = 0; i < fx.m_Count; i++) {
-            auto &pentry = fx.m_Entries[i];
-            json entry;
-
-            switch (pentry.type) {
-                case ParticleType::Trail:
-                    entry["type"] = "trail";
-                    entry["name"] = pentry.trail.def->name;
-                    break;
-                case ParticleType::Billboard:
-                    entry["type"] = "billboard";
-                    entry["name"] = pentry.billboard->name;
-                    break;
-                case ParticleType::Geometry: {
-                    entry["type"] = "geometry";
-                    entry["name"] = pentry.geometry->name;
-                } break;
-            }
+    ShaderBatch = false;
 
-            entry["start"] = pentry.start;
-            entry["time"] = pentry.time;
-            bool anchor = pentry.m_Anchor;
-            entry["anchor"] = anchor;
-            entry["spawn"] = {
-                { "start", pentry.m_SpawnStart },
-                { "end", pentry.m_SpawnEnd },
-                { "function", GetEasingName(pentry.m_SpawnEasing) }
-            };
-            entry["start_position"] = {
-                { "min",{ pentry.m_StartPosition.m_Min.x, pentry.m_StartPosition.m_Min.y, pentry.m_StartPosition.m_Min.z } },
-                { "max",{ pentry.m_StartPosition.m_Max.x, pentry.m_StartPosition.m_Max.y, pentry.m_StartPosition.m_Max.z } }
-            };
-            entry["start_velocity"] = {
-                { "min",{ pentry.m_StartVelocity.m_Min.x, pentry.m_StartVelocity.m_Min.y, pentry.m_StartVelocity.m_Min.z } },
-                { "max",{ pentry.m_StartVelocity.m_Max.x, pentry.m_StartVelocity.m_Max.y, pentry.m_StartVelocity.m_Max.z } }
-            };
-            entry["rotation"] = {
-                { "min", pentry.m_RotLimitMin },
-                { "max", pentry.m_RotLimitMax }
-            };
-            entry["rotation_speed"] = {
-                { "min", pentry.m_RotSpeedMin },
-                { "max", pentry.m_RotSpeedMax }
-            };
-
-            entries.push_back(entry);
-        }
-
-        json obj = {
-            {"entries", entries},
-            {"name", fx.name},
-            {"time", fx.time},
-            {"loop", fx.loop},
-            {"light", {
-                {"radius", fx.light.m_LightRadius },
-                {"color", { fx.light.m_LightColor.x, fx.light.m_LightColor.y , fx.light.m_LightColor.z , fx.light.m_LightColor.w }}
-            }}
-        };
-        
-        j["fx"].push_back(obj);
+    int trailmatcount = 0;
+    for (int i = 0; i < MAX_TRAIL_MATERIALS; i++) {
+        RequestMaterialShader(i);
+        if (MaterialShaders[i])
+            trailmatcount++;
     }
 
+    if (trailmatcount > 0)
+        BeginShaderBatch();
 
-    std::ofstream o("editor.json");
-    o << std::setw(4) << j << std::endl;
-}
-
-/*
- * File format:
- *   magic: [char; 4],
- *   texture_count: u32,
- *   texture_paths: [[char; 128]; texture_count],
- *   material_count: u32,
- *   material_paths: [[char; 128]; material_count],
- *   geometry_count: u32,
- *   geometry: [GeometryDefinition; geometry_count],
- *   fx_count: u32,
- *   fx: [ParticleEffect; fx_count]
- *
- * Types:
- *   ParticleType: enum {
- *     Trail = 0,
- *     Billboard = 1,
- *     Geometry = 2,
- *   }
- *
- *   ParticleEase: enum {
- *     Linear = 0,
- *     EaseIn = 1,
- *     EaseOut = 2,
- *   }
- *
- *   GeometryDefinition: struct {
- *     mat_idx: i32,
- *     lifetime: f32,
- *     gravity: f32,
- *     noise_scale: f32,
- *     noise_speed: f32,
- *     deform_easing: ParticleEase,
- *     deform_start: f32,
- *     deform_end: f32,
- *     deform_speed: f32,
- *     size_easing: ParticleEase,
- *     size_start: f32,
- *     size_end: f32,
- *     color_easing: ParticleEase,
- *     color_start: [f32; 4],
- *     color_end: [f32; 4],
- *   }
- *
- *   ParticleEffectEntry: struct {
- *     type: ParticleType,
- *     def_idx: i32,
- *     start: f32,
- *     time: f32,
- *     loop: bool,
- *     start_position: [[f32; 3]; 2],
- *     start_velocity: [[f32; 3]; 2],
- *     spawn_easing: ParticleEase,
- *     spawn_start: f32,
- *     spawn_end: f32,
- *     rot_limit_min: f32,
- *     rot_limit_max: f32,
- *     rot_speed_min: f32,
- *     rot_speed_max: f32,
- *   }
- *
- *   ParticleEffect: {
- *     name: [char; 16],
- *     count: u32,
- *     time: f32,
- *     entry_count: u32,
- *     entries: [ParticleEffectEntry; entry_count],
- *   }
- */
-void CopyFileDst(const char *srcpath, const char *dstpath)
-{
-    std::ifstream source(srcpath, std::ios::binary);
-    std::ofstream dest(dstpath, std::ios::binary);
+    WatchAssets();
 
-    dest << source.rdbuf();
+    ConsoleOutput->AddLog("Loading %d textures, building %d materials\n", texcount, trailmatcount);
 }
 
-void Export(const char *file)
+// Reloads only the textures and materials whose files changed on disk
+static void UpdateWatcher(ID3D11Device *device)
 {
-    fs::path export_dir = fs::path(file).parent_path();
+    // paths edited in the attribute editor are watched from here on, they
+    // are loaded on the next reload like before
+    bool edited = false;
+    for (int i = 0; i < MAX_MATERIAL_TEXTURES; i++)
+        edited |= MaterialTextures[i].m_TexturePath != WatchedTextures[i];
+    for (int i = 0; i < MAX_TRAIL_MATERIALS; i++)
+        edited |= TrailMaterials[i].m_ShaderPath != WatchedShaders[i];
 
-    FILE *f = fopen(file, "wb+");
-    if (!f) {
-        char err[128];
-        strerror_s(err, errno);
-        ConsoleOutput->AddLog("Failed to export particle data to %s (%s)\n", file, err);
-    }
+    if (edited)
+        WatchAssets();
 
-    // magic 4-byte constant
-    char magic[4] = { 'p', 'a', 'r', 't' };
-    fwrite(magic, sizeof(magic), 1, f);
+    std::vector<std::string> changed;
+    Watcher->Poll(changed);
+    if (changed.empty())
+        return;
 
-    uint32_t texture_count = 0;
+    std::set<std::string> files(changed.begin(), changed.end());
 
-    std::vector<std::array<char, 128>> paths;
-    for (; texture_count < MAX_MATERIAL_TEXTURES; texture_count++) {
-        auto &tex = MaterialTextures[texture_count];
-        if (tex.m_TextureName.empty())
-            break;
+    int texcount = 0;
+    for (int i = 0; i < MAX_MATERIAL_TEXTURES; i++) {
+        auto &path = MaterialTextures[i].m_TexturePath;
+        if (!path.empty() && files.count(path)) {
+            RequestTexture(i);
+            texcount++;
+        }
+    }
 
-        auto filepath = fs::path(tex.m_TexturePath).filename().generic_string();
-        std::array<char, 128> path = { '\0' };
-        strcpy_s(path.data(), 128, filepath.c_str());
+    int trailmatcount = 0;
+    for (int i = 0; i < MAX_TRAIL_MATERIALS; i++) {
+        for (auto &file : MaterialFiles[i]) {
+            if (files.count(file)) {
+                RequestMaterialShader(i);
+                trailmatcount++;
+                break;
+            }
+        }
+    }
 
-        paths.push_back(path);
+    if (trailmatcount > 0) {
+        BeginShaderBatch();
+        WatchAssets();
     }
 
-    fwrite(&texture_count, sizeof(uint32_t), 1, f);
-    fwrite(paths.data(), sizeof(char[128]), texture_count, f);
+    for (auto &file : changed)
+        ConsoleOutput->AddLog("  :Changed %s\n", file.c_str());
+    ConsoleOutput->AddLog("Loading %d changed textures, building %d materials\n", texcount, trailmatcount);
+}
 
-    paths.clear();
+static void UpdateShaders(ID3D11Device *device)
+{
+    std::vector<ShaderResult> results;
+    Shaders->Poll(results);
 
-    uint32_t material_count = 0;
-    for (; material_count < MAX_TRAIL_MATERIALS; material_count++) {
-        auto &mat = TrailMaterials[material_count];
-        if (mat.m_MaterialName.empty())
-            break;
+    for (auto &result : results) {
+        int i = 0;
+        while (i < MAX_TRAIL_MATERIALS && MaterialShaders[i] != result.m_Ticket)
+            i++;
 
-        auto filepath = fs::path(mat.m_ShaderPath).filename().generic_string();
-        std::array<char, 128> path = {'\0'};
-        strcpy_s(path.data(), 127, filepath.c_str());
+        // requested by an earlier reload
+        if (i == MAX_TRAIL_MATERIALS)
+            continue;
 
-        paths.push_back(path);
-    }
+        MaterialShaders[i] = 0;
 
-    fwrite(&material_count, sizeof(uint32_t), 1, f);
-    fwrite(paths.data(), sizeof(char[128]), material_count, f);
+        auto &mat = TrailMaterials[i];
+        if (mat.m_ShaderPath != result.m_Desc.m_Path)
+            continue;
 
-    uint32_t geometry_count = 0;
-    for (; geometry_count < MAX_BILLBOARD_PARTICLE_DEFINITIONS; geometry_count++) {
-        auto &def = GeometryDefinitions[geometry_count];
-        if (def.name.empty())
-            break;
-    }
+        if (!result.m_Ok) {
+            ConsoleOutput->AddLog("[error] Failed to compile shader '%s'\n", mat.m_ShaderPath.c_str());
+            ConsoleOutput->AddLog("[error] %s", result.m_Binary.m_Log.c_str());
+            ShaderBatchFailed++;
+            continue;
+        }
 
-    fwrite(&geometry_count, sizeof(uint32_t), 1, f);
+        auto &bytecode = result.m_Binary.m_Bytecode;
 
-    for (int i = 0; i < geometry_count; i++) {
-        auto &def = GeometryDefinitions[i];
-        
-        int32_t mat_idx = (def.m_Material - Editor::TrailMaterials);
-        fwrite(&mat_idx, sizeof(int32_t), 1, f);
-        fwrite(&def.lifetime, sizeof(float), 1, f);
-        fwrite(&def.m_Gravity, sizeof(float), 1, f);
-        fwrite(&def.m_NoiseScale, sizeof(float), 1, f);
-        fwrite(&def.m_NoiseSpeed, sizeof(float), 1, f);
-        fwrite(&def.m_DeformEasing, sizeof(ParticleEase), 1, f);
-        fwrite(&def.m_DeformFactorStart, sizeof(float), 1, f);
-        fwrite(&def.m_DeformFactorEnd, sizeof(float), 1, f);
-        fwrite(&def.m_DeformSpeed, sizeof(float), 1, f);
-        fwrite(&def.m_SizeEasing, sizeof(ParticleEase), 1, f);
-        fwrite(&def.m_SizeStart, sizeof(float), 1, f);
-        fwrite(&def.m_SizeEnd, sizeof(float), 1, f);
-        fwrite(&def.m_ColorEasing, sizeof(ParticleEase), 1, f);
-        fwrite(&def.m_ColorStart, sizeof(SimpleMath::Vector4), 1, f);
-        fwrite(&def.m_ColorEnd, sizeof(SimpleMath::Vector4), 1, f);
-        fwrite(&def.m_LightColorEasing, sizeof(ParticleEase), 1, f);
-        fwrite(&def.m_LightColorStart, sizeof(SimpleMath::Vector4), 1, f);
-        fwrite(&def.m_LightColorEnd, sizeof(SimpleMath::Vector4), 1, f);
-        fwrite(&def.m_LightRadiusEasing, sizeof(ParticleEase), 1, f);
-        fwrite(&def.m_LightRadiusStart, sizeof(float), 1, f);
-        fwrite(&def.m_LightRadiusEnd, sizeof(float), 1, f);
-    }
-
-    uint32_t fx_count = EffectDefinitions.size();
-    fwrite(&fx_count, sizeof(uint32_t), 1, f);
-
-    for (int j = 0; j < fx_count; j++) {
-        auto &fx = EffectDefinitions[j];
-
-        fwrite(&fx.name, sizeof(fx.name), 1, f);
-        fwrite(&fx.m_Count, sizeof(uint32_t), 1, f);
-        fwrite(&fx.time, sizeof(float), 1, f);
-        fwrite(&fx.loop, sizeof(bool), 1, f);
-        fwrite(&fx.light.m_LightRadius, sizeof(fx.light.m_LightRadius), 1, f);
-        fwrite(&fx.light.m_LightColor, sizeof(fx.light.m_LightColor), 1, f);
-
-        uint32_t entry_count = fx.m_Count;
-
-        for (int i = 0; i < entry_count; i++) {
-            auto &entry = fx.m_Entries[i];
+        ID3D11PixelShader *newps = nullptr;
+        if (!SUCCEEDED(device->CreatePixelShader(bytecode.data(), bytecode.size(), nullptr, &newps))) {
+            ConsoleOutput->AddLog("[error] Failed to create pixel shader '%s'\n", mat.m_ShaderPath.c_str());
+            ShaderBatchFailed++;
+            continue;
+        }
 
-            struct BParticleEffectEntry {
-                ParticleType m_Type;
-                int32_t      m_DefinitionIdx;
-                float        m_Start;
-                float        m_Time;
-                int32_t      m_Loop;
-                int32_t      m_Anchor;
-                PosBox       m_StartPosition;
-                VelocityBox  m_StartVelocity;
-                ParticleEase m_SpawnEasing;
-                float        m_SpawnStart;
-                float        m_SpawnEnd;
-                float        m_RotLimitMin;
-                float        m_RotLimitMax;
-                float        m_RotSpeedMin;
-                float        m_RotSpeedMax;
-            };
-
-            BParticleEffectEntry bentry;
-            bentry.m_Type = entry.type;
-            switch (entry.type) {
-                case ParticleType::Geometry: {
-                    int32_t def_idx = entry.geometry - GeometryDefinitions;
-                    bentry.m_DefinitionIdx = def_idx;
-                } break;
-                default:
-                    int32_t temp = 0;
-                    bentry.m_DefinitionIdx = temp;
-                    break;
-            }
+        if (mat.m_PixelShader)
+            ((ID3D11PixelShader*)mat.m_PixelShader)->Release();
+        mat.m_PixelShader = newps;
 
-            bentry.m_Start = entry.start;
-            bentry.m_Time = entry.time;
-            bentry.m_Loop = entry.m_Loop;
-            bentry.m_Anchor = entry.m_Anchor;
-            bentry.m_StartPosition = entry.m_StartPosition;
-            bentry.m_StartVelocity = entry.m_StartVelocity;
-            bentry.m_SpawnEasing = entry.m_SpawnEasing;
-            bentry.m_SpawnStart = entry.m_SpawnStart;
-            bentry.m_SpawnEnd = entry.m_SpawnEnd;
-            bentry.m_RotLimitMin = entry.m_RotLimitMin;
-            bentry.m_RotLimitMax = entry.m_RotLimitMax;
-            bentry.m_RotSpeedMin = entry.m_RotSpeedMin;
-            bentry.m_RotSpeedMax = entry.m_RotSpeedMax;
+        if (result.m_Binary.m_Cached)
+            ShaderBatchCached++;
+        else
+            ShaderBatchCompiled++;
+    }
 
-            fwrite(&bentry, sizeof(BParticleEffectEntry), 1, f);
-        }
+    if (!ShaderBatch)
+        return;
+
+    for (int i = 0; i < MAX_TRAIL_MATERIALS; i++) {
+        if (MaterialShaders[i])
+            return;
     }
 
-    fclose(f);
+    ShaderBatch = false;
 
-    ConsoleOutput->AddLog("Copying textures to export directory:\n");
-    for (auto &mat : MaterialTextures) {
-        if (mat.m_TextureName.empty())
-            break;
+    auto ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - ShaderBatchStart).count();
+    ConsoleOutput->AddLog("Built %u materials, %u compiled, %u from the shader cache, %u failed in %.1fms\n",
+        ShaderBatchCompiled + ShaderBatchCached, ShaderBatchCompiled, ShaderBatchCached, ShaderBatchFailed, ms);
+}
 
-        auto filename = fs::path(mat.m_TexturePath).filename().generic_string();
-        auto export_path = (export_dir.generic_string() + "/" + filename);
-        CopyFileDst(mat.m_TexturePath.c_str(), export_path.c_str());
+void Style();
 
-        ConsoleOutput->AddLog("  :CopyFile %s -> %s\n", mat.m_TexturePath.c_str(), export_path.c_str());
-    }
+// Names in older project files carry the NUL padding of the ImGui edit
+// buffer, the name is what comes before it.
+static std::string_view TrimName(std::string_view str)
+{
+    auto end = str.find('\0');
+    return end == std::string_view::npos ? str : str.substr(0, end);
+}
 
-    ConsoleOutput->AddLog("Copying shaders to export directory:\n");
-    for (auto &mat : TrailMaterials) {
-        if (mat.m_MaterialName.empty())
-            break;
+static void ReadName(JsonReader &reader, std::string &name)
+{
+    std::string_view str;
+    if (reader.ReadString(str))
+        name.assign(TrimName(str));
+}
 
-        auto filename = fs::path(mat.m_ShaderPath).filename().generic_string();
-        auto export_path = (export_dir.generic_string() + "/" + filename);
-        CopyFileDst(mat.m_ShaderPath.c_str(), export_path.c_str());
+static void ReadEasing(JsonReader &reader, ParticleEase &ease)
+{
+    std::string_view str;
+    if (reader.ReadString(str))
+        ease = GetEasingFromString(str);
+}
 
-        ConsoleOutput->AddLog("  :CopyFile %s -> %s\n", mat.m_ShaderPath.c_str(), export_path.c_str());
+// { "start": .., "end": .., "function": .. } with `count` floats per end
+static void ReadCurve(JsonReader &reader, ParticleEase &ease, float *start, float *end, int count)
+{
+    std::string_view key;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "start")
+            count == 1 ? reader.ReadFloat(*start) : reader.ReadFloats(start, count);
+        else if (key == "end")
+            count == 1 ? reader.ReadFloat(*end) : reader.ReadFloats(end, count);
+        else if (key == "function")
+            ReadEasing(reader, ease);
+        else
+            reader.Skip();
     }
+}
 
-    ConsoleOutput->AddLog("Exported particle data to %s\n", file);
+static void ReadRange(JsonReader &reader, float &min, float &max)
+{
+    std::string_view key;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "min")
+            reader.ReadFloat(min);
+        else if (key == "max")
+            reader.ReadFloat(max);
+        else
+            reader.Skip();
+    }
 }
 
-void Run()
+static void ReadBox(JsonReader &reader, SimpleMath::Vector3 &min, SimpleMath::Vector3 &max)
 {
-    EffectDefinitions.reserve(128);
+    std::string_view key;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "min")
+            reader.ReadFloats(&min.x, 3);
+        else if (key == "max")
+            reader.ReadFloats(&max.x, 3);
+        else
+            reader.Skip();
+    }
+}
 
-    Load();
-    Save();
+// Sections can come in any order, json::dump sorts them so "fx" used to come
+// before the definitions it names. Names are resolved once everything is read.
+struct PendingMaterial {
+    TrailParticleMaterial **m_Slot;
+    std::string m_Name;
+};
 
-    ImWindow::ImwWindowManagerDX11 manager;
-    manager.Init();
-    manager.SetMainTitle("Editor");
+struct PendingEntry {
+    size_t m_Effect;
+    unsigned m_Entry;
+    std::string m_Name;
+};
+
+static void ReadGeometryDefinition(JsonReader &reader, GeometryParticleDefinition &def, std::vector<PendingMaterial> &materials)
+{
+    def = {};
+
+    std::string_view key;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "name") {
+            ReadName(reader, def.name);
+        }
+        else if (key == "material_name") {
+            materials.push_back({ &def.m_Material });
+            ReadName(reader, materials.back().m_Name);
+        }
+        else if (key == "lifetime") {
+            reader.ReadFloat(def.lifetime);
+        }
+        else if (key == "gravity") {
+            reader.ReadFloat(def.m_Gravity);
+        }
+        else if (key == "noise_scale") {
+            reader.ReadFloat(def.m_NoiseScale);
+        }
+        else if (key == "noise_speed") {
+            reader.ReadFloat(def.m_NoiseSpeed);
+        }
+        else if (key == "deform_speed") {
+            reader.ReadFloat(def.m_DeformSpeed);
+        }
+        else if (key == "color") {
+            ReadCurve(reader, def.m_ColorEasing, &def.m_ColorStart.x, &def.m_ColorEnd.x, 4);
+        }
+        else if (key == "deform") {
+            ReadCurve(reader, def.m_DeformEasing, &def.m_DeformFactorStart, &def.m_DeformFactorEnd, 1);
+        }
+        else if (key == "size") {
+            ReadCurve(reader, def.m_SizeEasing, &def.m_SizeStart, &def.m_SizeEnd, 1);
+        }
+        else if (key == "light") {
+            reader.BeginObject();
+            while (reader.NextKey(key)) {
+                if (key == "color")
+                    ReadCurve(reader, def.m_LightColorEasing, &def.m_LightColorStart.x, &def.m_LightColorEnd.x, 4);
+                else if (key == "radius")
+                    ReadCurve(reader, def.m_LightRadiusEasing, &def.m_LightRadiusStart, &def.m_LightRadiusEnd, 1);
+                else
+                    reader.Skip();
+            }
+        }
+        else {
+            reader.Skip();
+        }
+    }
+}
+
+static void ReadTrailDefinition(JsonReader &reader, TrailParticleDefinition &def, std::vector<PendingMaterial> &materials)
+{
+    def = {};
+    def.m_Sampling = TrailSampling::Time;
+    def.m_SampleDistance = 0.05f;
+    def.m_SampleAngle = 10.f;
+
+    std::string_view key, str;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "name") {
+            ReadName(reader, def.name);
+        }
+        else if (key == "material_name") {
+            materials.push_back({ &def.m_Material });
+            ReadName(reader, materials.back().m_Name);
+        }
+        else if (key == "lifetime") {
+            reader.ReadFloat(def.lifetime);
+        }
+        else if (key == "frequency") {
+            reader.ReadFloat(def.frequency);
+        }
+        else if (key == "gravity") {
+            reader.ReadFloat(def.m_Gravity);
+        }
+        else if (key == "sampling") {
+            if (reader.ReadString(str))
+                def.m_Sampling = TrailSamplingFromString(str);
+        }
+        else if (key == "sample_distance") {
+            reader.ReadFloat(def.m_SampleDistance);
+        }
+        else if (key == "sample_angle") {
+            reader.ReadFloat(def.m_SampleAngle);
+        }
+        else {
+            reader.Skip();
+        }
+    }
+}
+
+static void ReadEffectEntry(JsonReader &reader, ParticleEffectEntry &ent, std::string &name)
+{
+    ent = {};
+
+    std::string_view key, str;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "type") {
+            if (reader.ReadString(str))
+                ent.type = ParticleTypeFromString(str);
+        }
+        else if (key == "name") {
+            ReadName(reader, name);
+        }
+        else if (key == "start") {
+            reader.ReadFloat(ent.start);
+        }
+        else if (key == "time") {
+            reader.ReadFloat(ent.time);
+        }
+        else if (key == "anchor") {
+            bool anchor;
+            if (reader.ReadBool(anchor))
+                ent.m_Anchor = anchor;
+        }
+        else if (key == "start_position") {
+            ReadBox(reader, ent.m_StartPosition.m_Min, ent.m_StartPosition.m_Max);
+        }
+        else if (key == "start_velocity") {
+            ReadBox(reader, ent.m_StartVelocity.m_Min, ent.m_StartVelocity.m_Max);
+        }
+        else if (key == "spawn") {
+            ReadCurve(reader, ent.m_SpawnEasing, &ent.m_SpawnStart, &ent.m_SpawnEnd, 1);
+        }
+        else if (key == "rotation") {
+            ReadRange(reader, ent.m_RotLimitMin, ent.m_RotLimitMax);
+        }
+        else if (key == "rotation_speed") {
+            ReadRange(reader, ent.m_RotSpeedMin, ent.m_RotSpeedMax);
+        }
+        else if (key == "inherit_velocity") {
+            reader.ReadFloat(ent.m_InheritVelocity);
+        }
+        else if (key == "lod") {
+            reader.BeginObject();
+            while (reader.NextKey(key)) {
+                if (key == "screen_size")
+                    reader.ReadFloat(ent.m_LODScreenSize);
+                else if (key == "min")
+                    reader.ReadFloat(ent.m_LODMinFactor);
+                else if (key == "function")
+                    ReadEasing(reader, ent.m_LODEasing);
+                else
+                    reader.Skip();
+            }
+        }
+        else {
+            reader.Skip();
+        }
+    }
+}
+
+static void ReadEffect(JsonReader &reader, ParticleEffect &fx, size_t index, std::vector<PendingEntry> &entries)
+{
+    std::string_view key, str;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "name") {
+            if (reader.ReadString(str)) {
+                str = TrimName(str);
+                auto len = min(str.size(), sizeof(fx.name) - 1);
+                memcpy(fx.name, str.data(), len);
+                fx.name[len] = '\0';
+            }
+        }
+        else if (key == "time") {
+            reader.ReadFloat(fx.time);
+        }
+        else if (key == "loop") {
+            reader.ReadBool(fx.loop);
+        }
+        else if (key == "light") {
+            reader.BeginObject();
+            while (reader.NextKey(key)) {
+                if (key == "radius")
+                    reader.ReadFloat(fx.light.m_LightRadius);
+                else if (key == "color")
+                    reader.ReadFloats(&fx.light.m_LightColor.x, 4);
+                else
+                    reader.Skip();
+            }
+        }
+        else if (key == "entries") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                if (fx.m_Count == _countof(fx.m_Entries)) {
+                    reader.Skip();
+                    continue;
+                }
+
+                entries.push_back({ index, fx.m_Count });
+                ReadEffectEntry(reader, fx.m_Entries[fx.m_Count++], entries.back().m_Name);
+            }
+        }
+        else {
+            reader.Skip();
+        }
+    }
+}
+
+bool Load(const char *path, std::string *error, uint32_t *generation)
+{
+    MappedFile file;
+    if (!file.Open(path)) {
+        if (error)
+            *error = "could not open file";
+        return false;
+    }
+
+    JsonReader reader((const char*)file.GetData(), (size_t)file.GetSize());
+    std::vector<PendingMaterial> pending_materials;
+    std::vector<PendingEntry> pending_entries;
+
+    // definitions past the fixed size tables are dropped
+    int materials = 0, textures = 0, billboards = 0, geometry = 0, trails = 0;
+
+    std::string_view key;
+    reader.BeginObject();
+    while (reader.NextKey(key)) {
+        if (key == "materials") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                if (materials == MAX_TRAIL_MATERIALS) {
+                    reader.Skip();
+                    continue;
+                }
+
+                auto &mat = TrailMaterials[materials++];
+                mat.m_PixelShader = nullptr;
+
+                reader.BeginObject();
+                while (reader.NextKey(key)) {
+                    if (key == "name")
+                        ReadName(reader, mat.m_MaterialName);
+                    else if (key == "path")
+                        ReadName(reader, mat.m_ShaderPath);
+                    else
+                        reader.Skip();
+                }
+            }
+        }
+        else if (key == "textures") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                if (textures == MAX_MATERIAL_TEXTURES) {
+                    reader.Skip();
+                    continue;
+                }
+
+                MaterialTextureLoads.Clear(textures);
+                auto &tex = MaterialTextures[textures++];
+                tex.m_SRV = nullptr;
+                tex.m_Wrap = false;
+
+                reader.BeginObject();
+                while (reader.NextKey(key)) {
+                    if (key == "name")
+                        ReadName(reader, tex.m_TextureName);
+                    else if (key == "path")
+                        ReadName(reader, tex.m_TexturePath);
+                    else if (key == "wrap")
+                        reader.ReadBool(tex.m_Wrap);
+                    else
+                        reader.Skip();
+                }
+            }
+        }
+        else if (key == "billboard_definitions") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                if (billboards == MAX_BILLBOARD_PARTICLE_DEFINITIONS) {
+                    reader.Skip();
+                    continue;
+                }
+
+                auto &def = BillboardDefinitions[billboards++];
+                def = {};
+
+                reader.BeginObject();
+                while (reader.NextKey(key)) {
+                    if (key == "name") {
+                        ReadName(reader, def.name);
+                    }
+                    else if (key == "material_name") {
+                        pending_materials.push_back({ &def.m_Material });
+                        ReadName(reader, pending_materials.back().m_Name);
+                    }
+                    else if (key == "lifetime") {
+                        reader.ReadFloat(def.lifetime);
+                    }
+                    else {
+                        reader.Skip();
+                    }
+                }
+            }
+        }
+        else if (key == "geometry_definitions") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                if (geometry == MAX_BILLBOARD_PARTICLE_DEFINITIONS)
+                    reader.Skip();
+                else
+                    ReadGeometryDefinition(reader, GeometryDefinitions[geometry++], pending_materials);
+            }
+        }
+        else if (key == "trail_definitions") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                if (trails == MAX_BILLBOARD_PARTICLE_DEFINITIONS)
+                    reader.Skip();
+                else
+                    ReadTrailDefinition(reader, TrailDefinitions[trails++], pending_materials);
+            }
+        }
+        else if (key == "generation") {
+            uint32_t value;
+            if (reader.ReadUInt(value) && generation)
+                *generation = value;
+        }
+        else if (key == "fx") {
+            reader.BeginArray();
+            while (reader.NextElement()) {
+                EffectDefinitions.emplace_back();
+                ReadEffect(reader, EffectDefinitions.back(), EffectDefinitions.size() - 1, pending_entries);
+            }
+        }
+        else {
+            reader.Skip();
+        }
+    }
+
+    if (reader.GetError()) {
+        if (error) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "%s at line %u", reader.GetError(), reader.GetLine());
+            *error = msg;
+        }
+        return false;
+    }
+
+    for (auto &pending : pending_materials)
+        *pending.m_Slot = pending.m_Name.empty() ? nullptr : GetMaterial(pending.m_Name);
+
+    for (auto &pending : pending_entries) {
+        auto &ent = EffectDefinitions[pending.m_Effect].m_Entries[pending.m_Entry];
+        switch (ent.type) {
+            case ParticleType::Billboard:
+                ent.billboard = GetBillboardDef(pending.m_Name);
+                break;
+            case ParticleType::Geometry:
+                ent.geometry = GetGeometryDef(pending.m_Name);
+                break;
+            case ParticleType::Trail:
+                ent.trail = {
+                    GetTrailDef(pending.m_Name),
+                    -1
+                };
+                break;
+        }
+    }
+
+    return true;
+}
+
+// Copy of everything Save writes, with the pointers between definitions
+// moved over to the copies, so it can be written while the editor goes on.
+struct ProjectSnapshot {
+    uint32_t m_Generation;
+    std::vector<MaterialTexture> m_Textures;
+    std::vector<TrailParticleMaterial> m_Materials;
+    std::vector<BillboardParticleDefinition> m_Billboards;
+    std::vector<GeometryParticleDefinition> m_Geometry;
+    std::vector<TrailParticleDefinition> m_Trails;
+    std::vector<ParticleEffect> m_Effects;
+};
+
+template<typename T>
+static T *Rebase(T *ptr, T *from, size_t count, std::vector<T> &to)
+{
+    if (ptr < from || ptr >= from + count)
+        return nullptr;
+
+    return &to[ptr - from];
+}
+
+static ProjectSnapshot CaptureProject()
+{
+    ProjectSnapshot project;
+    project.m_Generation = ProjectGeneration;
+    project.m_Textures.assign(std::begin(MaterialTextures), std::end(MaterialTextures));
+    project.m_Materials.assign(std::begin(TrailMaterials), std::end(TrailMaterials));
+    project.m_Billboards.assign(std::begin(BillboardDefinitions), std::end(BillboardDefinitions));
+    project.m_Geometry.assign(std::begin(GeometryDefinitions), std::end(GeometryDefinitions));
+    project.m_Trails.assign(std::begin(TrailDefinitions), std::end(TrailDefinitions));
+    project.m_Effects = EffectDefinitions;
+
+    for (auto &def : project.m_Billboards)
+        def.m_Material = Rebase(def.m_Material, TrailMaterials, MAX_TRAIL_MATERIALS, project.m_Materials);
+    for (auto &def : project.m_Geometry)
+        def.m_Material = Rebase(def.m_Material, TrailMaterials, MAX_TRAIL_MATERIALS, project.m_Materials);
+    for (auto &def : project.m_Trails)
+        def.m_Material = Rebase(def.m_Material, TrailMaterials, MAX_TRAIL_MATERIALS, project.m_Materials);
+
+    for (auto &fx : project.m_Effects) {
+        for (unsigned i = 0; i < fx.m_Count; i++) {
+            auto &ent = fx.m_Entries[i];
+            switch (ent.type) {
+                case ParticleType::Billboard:
+                    ent.billboard = Rebase(ent.billboard, BillboardDefinitions, MAX_BILLBOARD_PARTICLE_DEFINITIONS, project.m_Billboards);
+                    break;
+                case ParticleType::Geometry:
+                    ent.geometry = Rebase(ent.geometry, GeometryDefinitions, MAX_BILLBOARD_PARTICLE_DEFINITIONS, project.m_Geometry);
+                    break;
+                case ParticleType::Trail:
+                    ent.trail.def = Rebase(ent.trail.def, TrailDefinitions, MAX_BILLBOARD_PARTICLE_DEFINITIONS, project.m_Trails);
+                    break;
+            }
+        }
+    }
+
+    return project;
+}
+
+static void WriteCurve(JsonWriter &writer, const char *name, ParticleEase ease, const float *start, const float *end, int count)
+{
+    writer.Key(name);
+    writer.BeginObject();
+    writer.Key("start");
+    count == 1 ? writer.Float(*start) : writer.Floats(start, count);
+    writer.Key("end");
+    count == 1 ? writer.Float(*end) : writer.Floats(end, count);
+    writer.Key("function");
+    writer.String(GetEasingName(ease));
+    writer.EndObject();
+}
+
+static void WriteRange(JsonWriter &writer, const char *name, float min, float max)
+{
+    writer.Key(name);
+    writer.BeginObject();
+    writer.Key("min");
+    writer.Float(min);
+    writer.Key("max");
+    writer.Float(max);
+    writer.EndObject();
+}
+
+static void WriteBox(JsonWriter &writer, const char *name, const SimpleMath::Vector3 &min, const SimpleMath::Vector3 &max)
+{
+    writer.Key(name);
+    writer.BeginObject();
+    writer.Key("min");
+    writer.Floats(&min.x, 3);
+    writer.Key("max");
+    writer.Floats(&max.x, 3);
+    writer.EndObject();
+}
+
+static const char *GetMaterialName(const TrailParticleMaterial *mat)
+{
+    return mat ? mat->m_MaterialName.c_str() : "";
+}
+
+// Materials and definitions go first so a reader that resolves names as it
+// goes finds them before the effects.
+static bool SaveProject(const ProjectSnapshot &project, const char *path)
+{
+    JsonWriter writer;
+    if (!writer.Open(path))
+        return false;
+
+    writer.BeginObject();
+
+    writer.Key("generation");
+    writer.UInt(project.m_Generation);
+
+    writer.Key("materials");
+    writer.BeginArray();
+    for (auto &mat : project.m_Materials) {
+        if (mat.m_MaterialName.empty())
+            continue;
+
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(mat.m_MaterialName);
+        writer.Key("path");
+        writer.String(mat.m_ShaderPath);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("textures");
+    writer.BeginArray();
+    for (auto &tex : project.m_Textures) {
+        if (tex.m_TextureName.empty())
+            continue;
+
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(tex.m_TextureName);
+        writer.Key("path");
+        writer.String(tex.m_TexturePath);
+        if (tex.m_Wrap) {
+            writer.Key("wrap");
+            writer.Bool(true);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("billboard_definitions");
+    writer.BeginArray();
+    for (auto &def : project.m_Billboards) {
+        if (def.name.empty())
+            continue;
+
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(def.name);
+        writer.Key("material_name");
+        writer.String(GetMaterialName(def.m_Material));
+        writer.Key("lifetime");
+        writer.Float(def.lifetime);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("geometry_definitions");
+    writer.BeginArray();
+    for (auto &def : project.m_Geometry) {
+        if (def.name.empty())
+            continue;
+
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(def.name);
+        writer.Key("material_name");
+        writer.String(GetMaterialName(def.m_Material));
+        writer.Key("lifetime");
+        writer.Float(def.lifetime);
+        writer.Key("gravity");
+        writer.Float(def.m_Gravity);
+        writer.Key("noise_scale");
+        writer.Float(def.m_NoiseScale);
+        writer.Key("noise_speed");
+        writer.Float(def.m_NoiseSpeed);
+        WriteCurve(writer, "color", def.m_ColorEasing, &def.m_ColorStart.x, &def.m_ColorEnd.x, 4);
+        WriteCurve(writer, "deform", def.m_DeformEasing, &def.m_DeformFactorStart, &def.m_DeformFactorEnd, 1);
+        writer.Key("deform_speed");
+        writer.Float(def.m_DeformSpeed);
+        WriteCurve(writer, "size", def.m_SizeEasing, &def.m_SizeStart, &def.m_SizeEnd, 1);
+        writer.Key("light");
+        writer.BeginObject();
+        WriteCurve(writer, "color", def.m_LightColorEasing, &def.m_LightColorStart.x, &def.m_LightColorEnd.x, 4);
+        WriteCurve(writer, "radius", def.m_LightRadiusEasing, &def.m_LightRadiusStart, &def.m_LightRadiusEnd, 1);
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("trail_definitions");
+    writer.BeginArray();
+    for (auto &def : project.m_Trails) {
+        if (def.name.empty())
+            continue;
+
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(def.name);
+        writer.Key("material_name");
+        writer.String(GetMaterialName(def.m_Material));
+        writer.Key("lifetime");
+        writer.Float(def.lifetime);
+        writer.Key("gravity");
+        writer.Float(def.m_Gravity);
+        writer.Key("frequency");
+        writer.Float(def.frequency);
+        writer.Key("sampling");
+        writer.String(GetTrailSamplingName(def.m_Sampling));
+        writer.Key("sample_distance");
+        writer.Float(def.m_SampleDistance);
+        writer.Key("sample_angle");
+        writer.Float(def.m_SampleAngle);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("fx");
+    writer.BeginArray();
+    for (auto &fx : project.m_Effects) {
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(fx.name);
+        writer.Key("time");
+        writer.Float(fx.time);
+        writer.Key("loop");
+        writer.Bool(fx.loop);
+        writer.Key("light");
+        writer.BeginObject();
+        writer.Key("radius");
+        writer.Float(fx.light.m_LightRadius);
+        writer.Key("color");
+        writer.Floats(&fx.light.m_LightColor.x, 4);
+        writer.EndObject();
+
+        writer.Key("entries");
+        writer.BeginArray();
+        for (unsigned i = 0; i < fx.m_Count; i++) {
+            auto &pentry = fx.m_Entries[i];
+
+            writer.BeginObject();
+            switch (pentry.type) {
+                case ParticleType::Trail:
+                    writer.Key("type");
+                    writer.String("trail");
+                    writer.Key("name");
+                    writer.String(pentry.trail.def->name);
+                    break;
+                case ParticleType::Billboard:
+                    writer.Key("type");
+                    writer.String("billboard");
+                    writer.Key("name");
+                    writer.String(pentry.billboard->name);
+                    break;
+                case ParticleType::Geometry:
+                    writer.Key("type");
+                    writer.String("geometry");
+                    writer.Key("name");
+                    writer.String(pentry.geometry->name);
+                    break;
+            }
+
+            writer.Key("start");
+            writer.Float(pentry.start);
+            writer.Key("time");
+            writer.Float(pentry.time);
+            writer.Key("anchor");
+            writer.Bool(pentry.m_Anchor != 0);
+            WriteCurve(writer, "spawn", pentry.m_SpawnEasing, &pentry.m_SpawnStart, &pentry.m_SpawnEnd, 1);
+            WriteBox(writer, "start_position", pentry.m_StartPosition.m_Min, pentry.m_StartPosition.m_Max);
+            WriteBox(writer, "start_velocity", pentry.m_StartVelocity.m_Min, pentry.m_StartVelocity.m_Max);
+            WriteRange(writer, "rotation", pentry.m_RotLimitMin, pentry.m_RotLimitMax);
+            WriteRange(writer, "rotation_speed", pentry.m_RotSpeedMin, pentry.m_RotSpeedMax);
+            writer.Key("inherit_velocity");
+            writer.Float(pentry.m_InheritVelocity);
+            writer.Key("lod");
+            writer.BeginObject();
+            writer.Key("screen_size");
+            writer.Float(pentry.m_LODScreenSize);
+            writer.Key("min");
+            writer.Float(pentry.m_LODMinFactor);
+            writer.Key("function");
+            writer.String(GetEasingName(pentry.m_LODEasing));
+            writer.EndObject();
+            writer.EndObject();
+        }
+        writer.EndArray();
+
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.EndObject();
+
+    return writer.Close();
+}
+
+bool Save(const char *path)
+{
+    return SaveProject(CaptureProject(), path);
+}
+
+// Writes a synthetic project of at least `bytes` to `path` and times the
+// streaming save and load against a json DOM parse and dump of the same file.
+// The DOM numbers leave out copying between the DOM and the definitions, so
+// they are a lower bound for the old path. The open project is swapped out
+// for the duration, pointers into it stay valid.
+bool BenchmarkProjectIO(const char *path, uint64_t bytes, ProjectIOBenchmark &result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto ms = [](Clock::time_point start) { return std::chrono::duration<float, std::milli>(Clock::now() - start).count(); };
+
+    result = {};
+
+    std::vector<ParticleEffect> effects;
+    EffectDefinitions.swap(effects);
+    std::vector<MaterialTexture> textures(std::begin(MaterialTextures), std::end(MaterialTextures));
+    std::vector<TrailParticleMaterial> materials(std::begin(TrailMaterials), std::end(TrailMaterials));
+    std::vector<BillboardParticleDefinition> billboards(std::begin(BillboardDefinitions), std::end(BillboardDefinitions));
+    std::vector<GeometryParticleDefinition> geometry(std::begin(GeometryDefinitions), std::end(GeometryDefinitions));
+    std::vector<TrailParticleDefinition> trails(std::begin(TrailDefinitions), std::end(TrailDefinitions));
+
+    for (auto &tex : MaterialTextures) tex = {};
+    for (auto &mat : TrailMaterials) mat = {};
+    for (auto &def : BillboardDefinitions) def = {};
+    for (auto &def : GeometryDefinitions) def = {};
+    for (auto &def : TrailDefinitions) def = {};
+
+    MaterialTextures[0] = { "bench", "bench.png", nullptr };
+    TrailMaterials[0] = { "bench", "bench.hlsl", nullptr };
+
+    auto &geo = GeometryDefinitions[0];
+    geo.name = "bench";
+    geo.m_Material = &TrailMaterials[0];
+    geo.lifetime = 1.f;
+    geo.m_SizeStart = 0.1f;
+    geo.m_ColorStart = { 1.f, 0.5f, 0.25f, 1.f };
+
+    auto &trail = TrailDefinitions[0];
+    trail.name = "bench";
+    trail.m_Material = &TrailMaterials[0];
+    trail.lifetime = 1.f;
+    trail.frequency = 0.05f;
+    trail.m_SampleDistance = 0.05f;
+    trail.m_SampleAngle = 10.f;
+
+    ParticleEffect fx = {};
+    strcpy_s(fx.name, "bench");
+    fx.time = 1.f;
+    fx.m_Count = _countof(fx.m_Entries);
+    for (unsigned i = 0; i < fx.m_Count; i++) {
+        auto &ent = fx.m_Entries[i];
+        if (i % 2) {
+            ent.type = ParticleType::Trail;
+            ent.trail = { &trail, -1 };
+        }
+        else {
+            ent.type = ParticleType::Geometry;
+            ent.geometry = &geo;
+        }
+
+        // arbitrary values so numbers are written with full precision
+        ent.start = RandomFloat(0.f, 1.f);
+        ent.time = RandomFloat(0.f, 1.f);
+        ent.m_StartPosition = { { RandomFloat(-1.f, 0.f), RandomFloat(-1.f, 0.f), RandomFloat(-1.f, 0.f) }, { RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f) } };
+        ent.m_StartVelocity = { { RandomFloat(-1.f, 0.f), RandomFloat(-1.f, 0.f), RandomFloat(-1.f, 0.f) }, { RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f), RandomFloat(0.f, 1.f) } };
+        ent.m_SpawnStart = RandomFloat(0.f, 100.f);
+        ent.m_SpawnEnd = RandomFloat(0.f, 100.f);
+        ent.m_RotSpeedMax = RandomFloat(0.f, 10.f);
+    }
+
+    // size one effect from a small save, then grow the project to `bytes`
+    bool ok = true;
+    const size_t probe = 64;
+    EffectDefinitions.assign(probe, fx);
+    ok = Save(path);
+
+    std::string dom_path = std::string(path) + ".dom";
+    if (ok) {
+        auto per_effect = max(fs::file_size(path) / probe, (uintmax_t)1);
+        EffectDefinitions.assign((size_t)(bytes / per_effect + 1), fx);
+        result.m_Effects = (uint32_t)EffectDefinitions.size();
+
+        auto timer = Clock::now();
+        ok = Save(path);
+        result.m_SaveMs = ms(timer);
+        result.m_Bytes = fs::file_size(path);
+
+        EffectDefinitions.clear();
+        timer = Clock::now();
+        ok = ok && Load(path);
+        result.m_LoadMs = ms(timer);
+        ok = ok && EffectDefinitions.size() == result.m_Effects;
+    }
+
+    if (ok) {
+        std::ifstream i(path);
+        json data;
+
+        auto timer = Clock::now();
+        i >> data;
+        result.m_DomParseMs = ms(timer);
+
+        std::ofstream o(dom_path);
+        timer = Clock::now();
+        o << std::setw(4) << data << std::endl;
+        result.m_DomDumpMs = ms(timer);
+    }
+
+    std::error_code ec;
+    fs::remove(path, ec);
+    fs::remove(dom_path, ec);
+
+    EffectDefinitions.swap(effects);
+    std::copy(textures.begin(), textures.end(), MaterialTextures);
+    std::copy(materials.begin(), materials.end(), TrailMaterials);
+    std::copy(billboards.begin(), billboards.end(), BillboardDefinitions);
+    std::copy(geometry.begin(), geometry.end(), GeometryDefinitions);
+    std::copy(trails.begin(), trails.end(), TrailDefinitions);
+
+    return ok;
+}
+
+#define JOURNAL_COMPACT_BYTES (256 << 10)
+#define JOURNAL_COMPACT_SECONDS 30
+
+// Bump when fields of the journaled structs are reordered or change type
+// without changing any size or offset hashed below.
+#define JOURNAL_LAYOUT_VERSION 1
+
+// Journals address fields by offset, a build that lays the structs out
+// differently can not read them.
+static uint32_t GetJournalLayout()
+{
+    uint32_t layout[] = {
+        JOURNAL_LAYOUT_VERSION,
+
+        sizeof(MaterialTexture),
+        offsetof(MaterialTexture, m_TextureName),
+        offsetof(MaterialTexture, m_TexturePath),
+        offsetof(MaterialTexture, m_Wrap),
+
+        sizeof(TrailParticleMaterial),
+        offsetof(TrailParticleMaterial, m_MaterialName),
+        offsetof(TrailParticleMaterial, m_ShaderPath),
+
+        sizeof(BillboardParticleDefinition),
+        offsetof(BillboardParticleDefinition, name),
+        offsetof(BillboardParticleDefinition, m_Material),
+
+        sizeof(GeometryParticleDefinition),
+        offsetof(GeometryParticleDefinition, name),
+        offsetof(GeometryParticleDefinition, m_Material),
+
+        sizeof(TrailParticleDefinition),
+        offsetof(TrailParticleDefinition, name),
+        offsetof(TrailParticleDefinition, m_Material),
+
+        sizeof(ParticleEffect),
+        offsetof(ParticleEffect, m_Count),
+        offsetof(ParticleEffect, m_Entries),
+
+        sizeof(ParticleEffectEntry),
+        offsetof(ParticleEffectEntry, start),
+    };
+
+    return Crc32((const uint8_t*)layout, sizeof(layout));
+}
+
+static std::string GetJournalPath(uint32_t generation)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "editor.journal.%u", generation);
+
+    return path;
+}
+
+// Object a record points at, null if it is outside the project. [begin, end)
+// is the part of it that Field records may write, everything but strings
+// and pointers.
+static uint8_t *GetJournalObject(JournalObject object, uint32_t index, size_t &begin, size_t &end)
+{
+    begin = end = 0;
+
+    switch (object) {
+        case JournalObject::Texture:
+            begin = offsetof(MaterialTexture, m_Wrap);
+            end = sizeof(MaterialTexture);
+            return index < MAX_MATERIAL_TEXTURES ? (uint8_t*)&MaterialTextures[index] : nullptr;
+        case JournalObject::Material:
+            return index < MAX_TRAIL_MATERIALS ? (uint8_t*)&TrailMaterials[index] : nullptr;
+        case JournalObject::Billboard:
+            begin = offsetof(BillboardParticleDefinition, m_Material) + sizeof(TrailParticleMaterial*);
+            end = sizeof(BillboardParticleDefinition);
+            return index < MAX_BILLBOARD_PARTICLE_DEFINITIONS ? (uint8_t*)&BillboardDefinitions[index] : nullptr;
+        case JournalObject::Geometry:
+            begin = offsetof(GeometryParticleDefinition, m_Material) + sizeof(TrailParticleMaterial*);
+            end = sizeof(GeometryParticleDefinition);
+            return index < MAX_BILLBOARD_PARTICLE_DEFINITIONS ? (uint8_t*)&GeometryDefinitions[index] : nullptr;
+        case JournalObject::Trail:
+            begin = offsetof(TrailParticleDefinition, m_Material) + sizeof(TrailParticleMaterial*);
+            end = sizeof(TrailParticleDefinition);
+            return index < MAX_BILLBOARD_PARTICLE_DEFINITIONS ? (uint8_t*)&TrailDefinitions[index] : nullptr;
+        case JournalObject::Effect:
+            end = offsetof(ParticleEffect, m_Entries);
+            return index < EffectDefinitions.size() ? (uint8_t*)&EffectDefinitions[index] : nullptr;
+        case JournalObject::Entry: {
+            uint32_t fx = index >> 4;
+            uint32_t entry = index & 15;
+            if (fx >= EffectDefinitions.size() || entry >= EffectDefinitions[fx].m_Count)
+                return nullptr;
+
+            begin = offsetof(ParticleEffectEntry, start);
+            end = sizeof(ParticleEffectEntry);
+            return (uint8_t*)&EffectDefinitions[fx].m_Entries[entry];
+        }
+    }
+
+    return nullptr;
+}
+
+static std::string *GetJournalString(JournalObject object, uint8_t *base, uint32_t offset)
+{
+    std::string *strings[2] = {};
+
+    switch (object) {
+        case JournalObject::Texture:
+            strings[0] = &((MaterialTexture*)base)->m_TextureName;
+            strings[1] = &((MaterialTexture*)base)->m_TexturePath;
+            break;
+        case JournalObject::Material:
+            strings[0] = &((TrailParticleMaterial*)base)->m_MaterialName;
+            strings[1] = &((TrailParticleMaterial*)base)->m_ShaderPath;
+            break;
+        case JournalObject::Billboard:
+            strings[0] = &((BillboardParticleDefinition*)base)->name;
+            break;
+        case JournalObject::Geometry:
+            strings[0] = &((GeometryParticleDefinition*)base)->name;
+            break;
+        case JournalObject::Trail:
+            strings[0] = &((TrailParticleDefinition*)base)->name;
+            break;
+        default:
+            break;
+    }
+
+    for (auto str : strings) {
+        if (str && (uint8_t*)str == base + offset)
+            return str;
+    }
+
+    return nullptr;
+}
+
+static TrailParticleMaterial **GetJournalMaterial(JournalObject object, uint8_t *base, uint32_t offset)
+{
+    TrailParticleMaterial **material = nullptr;
+
+    switch (object) {
+        case JournalObject::Billboard:
+            material = &((BillboardParticleDefinition*)base)->m_Material;
+            break;
+        case JournalObject::Geometry:
+            material = &((GeometryParticleDefinition*)base)->m_Material;
+            break;
+        case JournalObject::Trail:
+            material = &((TrailParticleDefinition*)base)->m_Material;
+            break;
+        default:
+            break;
+    }
+
+    return material && (uint8_t*)material == base + offset ? material : nullptr;
+}
+
+// False if the record does not fit the project, it is then left out.
+static bool ApplyJournalRecord(const JournalRecord &record)
+{
+    switch (record.m_Op) {
+        case JournalOp::AddEffect: {
+            if (record.m_Index != EffectDefinitions.size())
+                return false;
+
+            ParticleEffect effect = {};
+            memcpy(effect.name, record.m_Data, min((size_t)record.m_Size, sizeof(effect.name) - 1));
+            EffectDefinitions.push_back(effect);
+            return true;
+        }
+        case JournalOp::AddEntry: {
+            int32_t def;
+            if (record.m_Size != sizeof(def) || record.m_Index >= EffectDefinitions.size())
+                return false;
+
+            memcpy(&def, record.m_Data, sizeof(def));
+
+            auto &fx = EffectDefinitions[record.m_Index];
+            if (def < 0 || def >= MAX_BILLBOARD_PARTICLE_DEFINITIONS || fx.m_Count >= ARRAYSIZE(fx.m_Entries))
+                return false;
+
+            ParticleEffectEntry entry = {};
+            entry.type = ParticleType::Geometry;
+            entry.geometry = &GeometryDefinitions[def];
+            fx.m_Entries[fx.m_Count++] = entry;
+            return true;
+        }
+        default:
+            break;
+    }
+
+    size_t begin, end;
+    uint8_t *base = GetJournalObject(record.m_Object, record.m_Index, begin, end);
+    if (!base)
+        return false;
+
+    switch (record.m_Op) {
+        case JournalOp::Field: {
+            if (record.m_Offset < begin || record.m_Offset + record.m_Size > end)
+                return false;
+
+            // the entry count is only changed through AddEntry
+            const size_t count = offsetof(ParticleEffect, m_Count);
+            if (record.m_Object == JournalObject::Effect && record.m_Offset < count + sizeof(unsigned int) && record.m_Offset + record.m_Size > count)
+                return false;
+
+            memcpy(base + record.m_Offset, record.m_Data, record.m_Size);
+            return true;
+        }
+        case JournalOp::String: {
+            auto str = GetJournalString(record.m_Object, base, record.m_Offset);
+            if (!str)
+                return false;
+
+            str->assign((const char*)record.m_Data, record.m_Size);
+            return true;
+        }
+        case JournalOp::Material: {
+            auto material = GetJournalMaterial(record.m_Object, base, record.m_Offset);
+            int32_t idx;
+            if (!material || record.m_Size != sizeof(idx))
+                return false;
+
+            memcpy(&idx, record.m_Data, sizeof(idx));
+            if (idx >= MAX_TRAIL_MATERIALS)
+                return false;
+
+            *material = idx < 0 ? nullptr : &TrailMaterials[idx];
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Replays what the journals a crash left behind recorded on top of the
+// loaded snapshot, then folds it into a new one.
+static void RecoverJournals(uint32_t generation)
+{
+    std::error_code ec;
+    ProjectGeneration = generation;
+    SnapshotGeneration = generation;
+
+    // already in the snapshot, a compaction stopped before removing them
+    for (uint32_t i = generation; i-- > 0;) {
+        if (!fs::remove(GetJournalPath(i), ec))
+            break;
+    }
+
+    uint32_t layout = GetJournalLayout();
+    uint32_t last = generation;
+    uint32_t replayed = 0;
+    uint32_t rejected = 0;
+
+    for (uint32_t i = generation; fs::exists(GetJournalPath(i), ec); i++) {
+        auto path = GetJournalPath(i);
+        last = i;
+
+        JournalReplay replay;
+        std::string error;
+        bool ok = EditJournal::Replay(path.c_str(), layout, [&rejected](const JournalRecord &record) {
+            if (!ApplyJournalRecord(record))
+                rejected++;
+        }, replay, &error);
+
+        if (!ok || replay.m_Generation != i) {
+            auto kept = path + ".rejected";
+            ReplaceFileAtomic(path.c_str(), kept.c_str());
+            ConsoleOutput->AddLog("[error] Could not replay %s (%s), kept it as %s\n", path.c_str(), ok ? "wrong generation" : error.c_str(), kept.c_str());
+            continue;
+        }
+
+        if (replay.m_TornBytes)
+            ConsoleOutput->AddLog("[error] Dropped %llu bytes of an interrupted write at the end of %s\n", replay.m_TornBytes, path.c_str());
+
+        replayed += replay.m_Records;
+    }
+
+    if (rejected)
+        ConsoleOutput->AddLog("[error] Skipped %u journal records that do not fit the project\n", rejected);
+
+    if (replayed) {
+        ConsoleOutput->AddLog("Recovered %u unsaved edits from the journal\n", replayed);
+
+        ProjectGeneration = last;
+        CompactJournal();
+        Compactor->Wait();
+        return;
+    }
+
+    for (uint32_t i = generation; i <= last; i++)
+        fs::remove(GetJournalPath(i), ec);
+
+    if (!Journal.Open(GetJournalPath(generation).c_str(), layout, generation))
+        ConsoleOutput->AddLog("[error] Failed to open %s, edits can only be saved with File > Save\n", GetJournalPath(generation).c_str());
+}
+
+bool CompactJournal()
+{
+    if (!ProjectLoaded || Compacting)
+        return false;
+
+    uint32_t generation = ++ProjectGeneration;
+    if (!Journal.Open(GetJournalPath(generation).c_str(), GetJournalLayout(), generation))
+        ConsoleOutput->AddLog("[error] Failed to open %s, edits can only be saved with File > Save\n", GetJournalPath(generation).c_str());
+
+    // captured on this thread, the editor goes on editing the live project
+    auto snapshot = new ProjectSnapshot(CaptureProject());
+    Compacting = true;
+    LastCompaction = std::chrono::high_resolution_clock::now();
+
+    Compactor->Submit([snapshot]() {
+        bool ok = SaveProject(*snapshot, "editor.json.tmp") && ReplaceFileAtomic("editor.json.tmp", "editor.json");
+        if (ok) {
+            std::error_code ec;
+            for (uint32_t i = SnapshotGeneration; i < snapshot->m_Generation; i++)
+                fs::remove(GetJournalPath(i), ec);
+
+            SnapshotGeneration = snapshot->m_Generation;
+        }
+
+        CompactionResult = ok ? 1 : -1;
+        delete snapshot;
+        Compacting = false;
+    });
+
+    return true;
+}
+
+void RequestSave()
+{
+    if (!ProjectLoaded) {
+        ConsoleOutput->AddLog("[error] No project loaded, nothing to save\n");
+        return;
+    }
+
+    if (!CompactJournal()) {
+        ConsoleOutput->AddLog("Saving editor.json once the running save finished\n");
+        SaveQueued = true;
+    }
+}
+
+// Once a frame: hands the frame's edits to the OS and compacts the journal
+// when it grew large or old.
+static void UpdateJournal()
+{
+    if (Journal.IsOpen() && !Journal.Flush())
+        ConsoleOutput->AddLog("[error] Failed to write %s\n", GetJournalPath(Journal.GetGeneration()).c_str());
+
+    if (CompactionResult.exchange(0) < 0)
+        ConsoleOutput->AddLog("[error] Failed to save editor.json, the journal still holds the edits\n");
+
+    // the running compaction captured the project before the save was asked
+    // for, edits made since are only in the journal
+    if (SaveQueued && !Compacting) {
+        SaveQueued = false;
+        CompactJournal();
+    }
+
+    // a failed compaction leaves the snapshot behind until the next one
+    bool behind = Journal.GetRecordCount() > 0 || SnapshotGeneration != ProjectGeneration;
+    UnsavedChanges = behind || !Journal.IsOpen();
+
+    auto age = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - LastCompaction).count();
+    if (behind && !Compacting && (Journal.GetSize() > JOURNAL_COMPACT_BYTES || age > JOURNAL_COMPACT_SECONDS))
+        CompactJournal();
+}
+
+// The export format is described in PartPackage.h. Textures are packed into
+// block compressed atlas pages next to the package, the ones that do not fit
+// and the shaders are copied there through the export cache in ExportCache.h
+void Export(const char *file)
+{
+    fs::path export_dir = fs::path(file).parent_path();
+
+    PartPackageWriter writer;
+
+    // wrapping textures are left out of the atlas, their uvs cannot be
+    // remapped into a cell
+    std::vector<std::string> texture_paths, atlas_paths;
+    for (auto &tex : MaterialTextures) {
+        if (tex.m_TextureName.empty())
+            break;
+
+        texture_paths.push_back(tex.m_TexturePath);
+        atlas_paths.push_back(tex.m_Wrap ? std::string() : tex.m_TexturePath);
+    }
+
+    // textures that made it into an atlas are not exported on their own
+    AtlasSettings atlas_settings;
+    AtlasPacker packer(atlas_settings);
+    if (packer.Pack(atlas_paths)) {
+        auto &stats = packer.GetStats();
+        ConsoleOutput->AddLog("Packed %u of %u textures into %u atlas pages, %.0f%% used: decode %.1fms, pack %.1fms, blit %.1fms\n",
+            stats.m_Packed, stats.m_Textures, stats.m_Pages, stats.m_Coverage * 100.f, stats.m_DecodeMs, stats.m_PackMs, stats.m_BlitMs);
+
+        // block compressed with the mips the atlas gutters were made for
+        TextureCompressSettings compress;
+        compress.m_MaxMips = atlas_settings.m_MipLevels + 1;
+
+        auto &pages = packer.GetPages();
+        auto prefix = (export_dir / fs::path(file).stem()).generic_string() + "_atlas";
+
+        std::vector<TextureCompressStats> page_stats(pages.size());
+        std::vector<char> written(pages.size());
+        ParallelFor(pages.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                CompressedTexture texture;
+                written[i] = CompressTexture(pages[i].m_Width, pages[i].m_Height, pages[i].m_Pixels.data(), compress, texture, page_stats[i]) &&
+                    WriteDDS((prefix + std::to_string(i) + ".dds").c_str(), texture);
+            }
+        });
+
+        for (size_t i = 0; i < pages.size(); i++) {
+            auto path = prefix + std::to_string(i) + ".dds";
+            if (!written[i]) {
+                ConsoleOutput->AddLog("[error] Failed to write texture atlas %s\n", path.c_str());
+                return;
+            }
+
+            auto &page = page_stats[i];
+            ConsoleOutput->AddLog("  :Compress %s %ux%u %s, %u mips, %.1f:1, PSNR %.1f dB, %.1fms\n",
+                path.c_str(), pages[i].m_Width, pages[i].m_Height, GetBlockFormatName(page.m_Format), page.m_Mips,
+                (double)page.m_RawBytes / page.m_CompressedBytes, page.m_PSNR, page.m_Ms);
+
+            writer.AddAtlas(fs::path(path).filename().generic_string().c_str(), pages[i].m_Width, pages[i].m_Height);
+        }
+    }
+
+    auto &placements = packer.GetPlacements();
+    for (size_t i = 0; i < texture_paths.size(); i++) {
+        auto &placement = placements[i];
+        writer.AddTexture(fs::path(texture_paths[i]).filename().generic_string().c_str(), placement.m_Page, placement.m_Page >= 0 ? placement.m_Rect : nullptr);
+    }
+
+    for (auto &mat : TrailMaterials) {
+        if (mat.m_MaterialName.empty())
+            break;
+
+        writer.AddMaterial(fs::path(mat.m_ShaderPath).filename().generic_string().c_str());
+    }
+
+    for (int i = 0; i < MAX_BILLBOARD_PARTICLE_DEFINITIONS; i++) {
+        auto &def = GeometryDefinitions[i];
+        if (def.name.empty())
+            break;
+
+        int32_t mat_idx = def.m_Material ? (int32_t)(def.m_Material - Editor::TrailMaterials) : -1;
+        writer.AddGeometry(def, mat_idx);
+    }
+
+    for (auto &fx : EffectDefinitions) {
+        int32_t definitions[8];
+        for (unsigned i = 0; i < fx.m_Count; i++) {
+            auto &entry = fx.m_Entries[i];
+            definitions[i] = entry.type == ParticleType::Geometry ? (int32_t)(entry.geometry - GeometryDefinitions) : -1;
+        }
+
+        writer.AddEffect(fx, definitions);
+    }
+
+    if (!writer.Write(file)) {
+        char err[128];
+        strerror_s(err, errno);
+        ConsoleOutput->AddLog("[error] Failed to export particle data to %s (%s)\n", file, err);
+        return;
+    }
+
+    // check the file a reader will get, not what we think we wrote
+    PartPackage package;
+    std::string error;
+    if (!package.Open(file) || !ValidatePartPackage(package.GetFile().GetData(), package.GetFile().GetSize(), &error)) {
+        ConsoleOutput->AddLog("[error] Exported package %s does not validate (%s)\n", file, error.c_str());
+        return;
+    }
+    package.Close();
+
+    std::vector<ExportAsset> assets;
+    for (size_t i = 0; i < texture_paths.size(); i++) {
+        if (placements[i].m_Page < 0)
+            assets.push_back({ texture_paths[i], fs::path(texture_paths[i]).filename().generic_string() });
+    }
+
+    for (auto &mat : TrailMaterials) {
+        if (mat.m_MaterialName.empty())
+            break;
+
+        assets.push_back({ mat.m_ShaderPath, fs::path(mat.m_ShaderPath).filename().generic_string() });
+    }
+
+    auto dir = export_dir.generic_string();
+
+    ExportCacheStats stats;
+    SyncExportAssets(dir.c_str(), assets, stats);
+
+    ConsoleOutput->AddLog("Copying assets to export directory:\n");
+    for (auto &asset : assets) {
+        auto export_path = (dir.empty() ? asset.m_Name : dir + "/" + asset.m_Name);
+        if (asset.m_Result == ExportAssetResult::Copied)
+            ConsoleOutput->AddLog("  :CopyFile %s -> %s\n", asset.m_Source.c_str(), export_path.c_str());
+        else if (asset.m_Result == ExportAssetResult::Failed)
+            ConsoleOutput->AddLog("[error] Failed to copy %s -> %s\n", asset.m_Source.c_str(), export_path.c_str());
+    }
+
+    ConsoleOutput->AddLog("Copied %u assets (%.2f MB), skipped %u unchanged (%.2f MB), %u failed in %.1fms\n",
+        stats.m_Copied, stats.m_BytesCopied / (1024.f * 1024.f), stats.m_Skipped, stats.m_BytesSkipped / (1024.f * 1024.f), stats.m_Failed, stats.m_Ms);
+
+    ConsoleOutput->AddLog("Exported particle data to %s\n", file);
+}
+
+void Run()
+{
+    EffectDefinitions.reserve(128);
+
+    std::string load_error;
+    uint32_t generation = 0;
+    bool loaded = Load("editor.json", &load_error, &generation);
+    // never overwrite a project that did not load
+    ProjectLoaded = loaded;
+    Compactor = new JobPool(1);
+
+    // everything built on the last run is built again up front, in parallel,
+    // so the viewport below mostly reads it back from the cache
+    ShaderBackend = new D3D11ShaderCompiler(D3DCOMPILE_DEBUG);
+    Shaders = new ShaderCache("ShaderCache", ShaderBackend);
+    Shaders->Warm();
+    Watcher = new FileWatcher();
+
+    ImWindow::ImwWindowManagerDX11 manager;
+    manager.Init();
+    manager.SetMainTitle("Editor");
+
+    Textures = new TextureLoader();
+    {
+        const uint8_t white[4] = { 255, 255, 255, 255 };
+        PlaceholderSRV = CreateTexture(ImwPlatformWindowDX11::s_pDevice, 1, 1, white);
+    }
 
     Style();
 
@@ -1476,7 +2772,22 @@ void Run()
 
     ConsoleOutput->AddLog("Particle Editor v0.1\n");
     ConsoleOutput->AddLog("LMB to rotate, RMB to drag, MMB to zoom\n");
-    ConsoleOutput->AddLog("Ctrl-R to reload resources\n");
+    ConsoleOutput->AddLog("Ctrl-R to reload resources, changed files are reloaded on their own\n");
+
+    auto shader_stats = Shaders->GetStats();
+    ConsoleOutput->AddLog("Shaders: %u from the cache, %u compiled, %u failed\n", shader_stats.m_Hits, shader_stats.m_Misses, shader_stats.m_Failed);
+
+    auto sphere = FXSystem->m_Sphere;
+    ConsoleOutput->AddLog("Sphere: %u LODs built in %.2fms, ACMR with a %u vertex FIFO\n", (UINT)sphere->m_LODs.size(), sphere->m_BuildMs, MESH_MEASURE_CACHE_SIZE);
+    for (size_t i = 0; i < sphere->m_LODs.size(); i++) {
+        auto &lod = sphere->m_LODs[i];
+        ConsoleOutput->AddLog("  :LOD %u: %u triangles, %u vertices, error %.3f, ACMR %.3f -> %.3f\n", (UINT)i, lod.m_IndexCount / 3, lod.m_VertexCount, lod.m_Error, lod.m_ACMRBefore, lod.m_ACMRAfter);
+    }
+
+    if (loaded)
+        RecoverJournals(generation);
+    else
+        ConsoleOutput->AddLog("[error] Failed to load editor.json (%s)\n", load_error.c_str());
 
     manager.Dock(viewport, E_DOCK_ORIENTATION_CENTER);
     manager.Dock(textures, E_DOCK_ORIENTATION_RIGHT, 0.2f);
@@ -1507,9 +2818,35 @@ void Run()
 
         //ImGui::GetIO().DeltaTime = 0.016f;
 
+        UpdateJournal();
+        UpdateWatcher(ImwPlatformWindowDX11::s_pDevice);
+        UpdateShaders(ImwPlatformWindowDX11::s_pDevice);
+        UpdateTextures(ImwPlatformWindowDX11::s_pDevice);
+
         Sleep(1);
     } while (manager.Run(false) && manager.Run(true));
-    
+
+    // whatever is still only in the journal goes into editor.json on exit
+    Journal.Flush();
+    Compactor->Wait();
+    if (Journal.GetRecordCount() > 0 || SnapshotGeneration != ProjectGeneration)
+        CompactJournal();
+    Compactor->Wait();
+    Journal.Close();
+
+    delete Compactor;
+    Compactor = nullptr;
+
+    delete Watcher;
+    Watcher = nullptr;
+    delete Textures;
+    Textures = nullptr;
+    PlaceholderSRV->Release();
+    PlaceholderSRV = nullptr;
+    delete Shaders;
+    Shaders = nullptr;
+    delete ShaderBackend;
+    ShaderBackend = nullptr;
 }
 
 void Style()
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <d3d11.h>
+#include <imgui.h>
+
 #include "Particle.h"
 #include "Output.h"
+#include "EditJournal.h"
+#include "ShaderCache.h"
 
 #define MAX_TRAIL_MATERIALS 16
 #define MAX_BILLBOARD_MATERIALS 16
@@ -13,6 +18,8 @@
 #define TRAIL_ICON ICON_MD_GRAIN
 #define FX_ICON ICON_MD_PHOTO_FILTER
 
+struct Flipbook;
+
 
 static const ImVec4 FX_COLORS[3] = {
 	ImColor(0xFFBA68C8),
@@ -49,11 +56,14 @@ struct MaterialTexture {
 	std::string m_TextureName;
 	std::string m_TexturePath;
 	ID3D11ShaderResourceView *m_SRV;
+	// sampled with uvs outside [0, 1] and a wrapping sampler, like scrolling
+	// noise; such a texture cannot be remapped into an atlas cell
+	bool m_Wrap;
 };
 
-inline void ComboFunc(const char *label, ParticleEase *ease)
+inline bool ComboFunc(const char *label, ParticleEase *ease)
 {
-	ImGui::Combo(label, (int*)ease, EASE_STRINGS);
+	return ImGui::Combo(label, (int*)ease, EASE_STRINGS);
 }
 
 namespace Editor {;
@@ -80,7 +90,25 @@ extern float Speed;
 
 extern bool Paused;
 extern bool Debug;
+extern bool ShowStats;
+extern bool SpecializedKernels;
+extern bool CompactInstances;
+extern bool BillboardQuads;
+extern bool TrailRibbons;
+extern float TrailRibbonTolerance;
+extern bool TemporalLOD;
+extern bool MeshLOD;
+extern float MeshLODTolerance;
+extern bool ShowSpawnLOD;
+// draw the selected effect from its baked flipbook past the flipbook's LOD
+// distance
+extern bool FlipbookLOD;
+extern bool CaptureReference;
+extern bool RecordCache;
+extern bool PlayCache;
 extern bool UnsavedChanges;
+extern EditJournal Journal;
+extern ShaderCache *Shaders;
 extern AttributeObject SelectedObject;
 
 extern MaterialTexture MaterialTextures[MAX_MATERIAL_TEXTURES];
@@ -93,13 +121,43 @@ extern std::vector<ParticleEffect> EffectDefinitions;
 
 extern ParticleEffect *SelectedEffect;
 extern AnchoredParticleEffect SelectedAnchorEffect;
+
+// last flipbook baked or loaded, null without one
+extern Flipbook *LoadedFlipbook;
+extern std::string LoadedFlipbookEffect;
+extern ID3D11ShaderResourceView *LoadedFlipbookSRV;
+
+// plays `fx` in the viewport, releases what the previous effect left behind
+void SelectEffect(ParticleEffect *fx);
+
 BillboardParticleDefinition *GetBillboardDef(std::string name);
 GeometryParticleDefinition *GetGeometryDef(std::string name);
 TrailParticleDefinition *GetTrailDef(std::string name);
 
 TrailParticleMaterial *GetMaterial(std::string name);
 
-void Save();
+bool Load(const char *path, std::string *error = nullptr, uint32_t *generation = nullptr);
+// loads the `<effect>_flipbook.json` descriptor at `path` and uploads its atlas,
+// replaces the loaded flipbook on success
+bool LoadFlipbook(const char *effect, const char *path);
+bool Save(const char *path = "editor.json");
+
+// Writes editor.json in the background and starts a new journal, returns
+// false if a compaction is already running.
+bool CompactJournal();
+// File > Save, compacts the journal now or right after the running compaction
+void RequestSave();
+
+struct ProjectIOBenchmark {
+	uint32_t m_Effects;
+	uint64_t m_Bytes;
+	float m_SaveMs;
+	float m_LoadMs;
+	float m_DomDumpMs;
+	float m_DomParseMs;
+};
+
+bool BenchmarkProjectIO(const char *path, uint64_t bytes, ProjectIOBenchmark &result);
 
 void Export(const char *file);
 void Reload(ID3D11Device *device);
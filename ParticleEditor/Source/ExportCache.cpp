@@ -0,0 +1,307 @@
+#include "ExportCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <experimental/filesystem>
+#include <unordered_map>
+
+#include "EditJournal.h"
+#include "JobPool.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+struct ExportCacheEntry {
+    uint64_t m_Hash;
+    uint64_t m_Size;
+    uint64_t m_Time;
+    uint64_t m_DestSize;
+    uint64_t m_DestTime;
+};
+
+typedef std::unordered_map<std::string, ExportCacheEntry> ExportManifest;
+
+namespace fs = std::experimental::filesystem;
+
+#ifdef _WIN32
+
+static bool StatFile(const char *path, uint64_t &size, uint64_t &time)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return false;
+
+    size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+    time = (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+
+    return true;
+}
+
+static bool CopyAsset(const char *from, const char *to)
+{
+    // lets the OS do the copy, it can skip the round trip through user space
+    return CopyFileA(from, to, FALSE) != 0;
+}
+
+#else
+
+static bool StatFile(const char *path, uint64_t &size, uint64_t &time)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+
+    size = (uint64_t)info.st_size;
+    time = (uint64_t)info.st_mtim.tv_sec * 1000000000ull + (uint64_t)info.st_mtim.tv_nsec;
+
+    return true;
+}
+
+static bool CopyAsset(const char *from, const char *to)
+{
+    int src = open(from, O_RDONLY);
+    if (src < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(src, &info) != 0) {
+        close(src);
+        return false;
+    }
+
+    int dst = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0) {
+        close(src);
+        return false;
+    }
+
+    off_t left = info.st_size;
+
+#ifdef __linux__
+    // in kernel copies first, copy_file_range can share extents on the same
+    // file system, sendfile works across them
+    while (left > 0) {
+        ssize_t n = copy_file_range(src, nullptr, dst, nullptr, (size_t)left, 0);
+        if (n <= 0)
+            break;
+        left -= n;
+    }
+
+    while (left > 0) {
+        ssize_t n = sendfile(dst, src, nullptr, (size_t)left);
+        if (n <= 0)
+            break;
+        left -= n;
+    }
+#endif
+
+    char buffer[64 << 10];
+    while (left > 0) {
+        ssize_t n = read(src, buffer, sizeof(buffer));
+        if (n <= 0 || write(dst, buffer, (size_t)n) != n)
+            break;
+        left -= n;
+    }
+
+    close(src);
+    return close(dst) == 0 && left == 0;
+}
+
+#endif
+
+static uint64_t HashFile(const char *path, bool &ok)
+{
+    // FNV-1a, 64 bit
+    uint64_t hash = 14695981039346656037ull;
+
+    uint64_t size, time;
+    ok = StatFile(path, size, time);
+    if (!ok || size == 0)
+        return hash;
+
+    MappedFile file;
+    ok = file.Open(path);
+    if (!ok)
+        return hash;
+
+    auto data = file.GetData();
+    for (uint64_t i = 0; i < file.GetSize(); i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static void ReadManifest(const std::string &path, ExportManifest &manifest)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file)
+        return;
+
+    char line[1024];
+    unsigned version = 0;
+    if (!fgets(line, sizeof(line), file) || sscanf(line, "partcache %u", &version) != 1 || version != EXPORT_CACHE_VERSION) {
+        fclose(file);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        ExportCacheEntry entry;
+        unsigned long long values[5];
+        int name = 0;
+        if (sscanf(line, "%llx %llu %llu %llu %llu %n", &values[0], &values[1], &values[2], &values[3], &values[4], &name) != 5 || !name)
+            continue;
+
+        entry.m_Hash = values[0];
+        entry.m_Size = values[1];
+        entry.m_Time = values[2];
+        entry.m_DestSize = values[3];
+        entry.m_DestTime = values[4];
+
+        std::string key = line + name;
+        while (!key.empty() && (key.back() == '\n' || key.back() == '\r'))
+            key.pop_back();
+
+        manifest[key] = entry;
+    }
+
+    fclose(file);
+}
+
+static bool WriteManifest(const std::string &path, const ExportManifest &manifest)
+{
+    auto tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "partcache %u\n", EXPORT_CACHE_VERSION);
+    for (auto &it : manifest) {
+        auto &entry = it.second;
+        fprintf(file, "%016llx %llu %llu %llu %llu %s\n",
+            (unsigned long long)entry.m_Hash, (unsigned long long)entry.m_Size, (unsigned long long)entry.m_Time,
+            (unsigned long long)entry.m_DestSize, (unsigned long long)entry.m_DestTime, it.first.c_str());
+    }
+
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+
+    return ok && ReplaceFileAtomic(tmp.c_str(), path.c_str());
+}
+
+bool SyncExportAssets(const char *dir, std::vector<ExportAsset> &assets, ExportCacheStats &stats)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    stats = {};
+
+    std::string base = dir && dir[0] ? dir : ".";
+    base += "/";
+
+    ExportManifest manifest;
+    ReadManifest(base + EXPORT_CACHE_NAME, manifest);
+
+    std::vector<bool> duplicate(assets.size(), false);
+    std::unordered_map<std::string, size_t> names;
+    for (size_t i = 0; i < assets.size(); i++)
+        duplicate[i] = !names.emplace(assets[i].m_Name, i).second;
+
+    std::vector<ExportCacheEntry> entries(assets.size());
+
+    ParallelFor(assets.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            auto &asset = assets[i];
+            auto &entry = entries[i];
+
+            asset.m_Result = ExportAssetResult::Failed;
+            asset.m_Size = 0;
+
+            if (duplicate[i] || !StatFile(asset.m_Source.c_str(), entry.m_Size, entry.m_Time)) {
+                asset.m_Result = duplicate[i] ? ExportAssetResult::Skipped : ExportAssetResult::Failed;
+                continue;
+            }
+
+            asset.m_Size = entry.m_Size;
+
+            auto cached = manifest.find(asset.m_Name);
+            bool known = cached != manifest.end();
+
+            if (known && cached->second.m_Size == entry.m_Size && cached->second.m_Time == entry.m_Time) {
+                entry.m_Hash = cached->second.m_Hash;
+            }
+            else {
+                bool ok;
+                entry.m_Hash = HashFile(asset.m_Source.c_str(), ok);
+                if (!ok)
+                    continue;
+            }
+
+            auto dest = base + asset.m_Name;
+
+            // exporting next to the sources, copying would truncate them
+            std::error_code ec;
+            if (fs::equivalent(asset.m_Source, dest, ec)) {
+                entry.m_DestSize = entry.m_Size;
+                entry.m_DestTime = entry.m_Time;
+                asset.m_Result = ExportAssetResult::Skipped;
+                continue;
+            }
+
+            uint64_t size, time;
+            if (known && cached->second.m_Hash == entry.m_Hash && StatFile(dest.c_str(), size, time) &&
+                size == cached->second.m_DestSize && time == cached->second.m_DestTime) {
+                entry.m_DestSize = size;
+                entry.m_DestTime = time;
+                asset.m_Result = ExportAssetResult::Skipped;
+                continue;
+            }
+
+            if (!CopyAsset(asset.m_Source.c_str(), dest.c_str()) || !StatFile(dest.c_str(), entry.m_DestSize, entry.m_DestTime))
+                continue;
+
+            asset.m_Result = ExportAssetResult::Copied;
+        }
+    });
+
+    bool ok = true;
+    for (size_t i = 0; i < assets.size(); i++) {
+        auto &asset = assets[i];
+        switch (asset.m_Result) {
+            case ExportAssetResult::Copied:
+                stats.m_Copied++;
+                stats.m_BytesCopied += asset.m_Size;
+                manifest[asset.m_Name] = entries[i];
+                break;
+            case ExportAssetResult::Skipped:
+                if (duplicate[i])
+                    break;
+                stats.m_Skipped++;
+                stats.m_BytesSkipped += asset.m_Size;
+                manifest[asset.m_Name] = entries[i];
+                break;
+            case ExportAssetResult::Failed:
+                stats.m_Failed++;
+                manifest.erase(asset.m_Name);
+                ok = false;
+                break;
+        }
+    }
+
+    // a lost manifest only costs a full copy next time
+    WriteManifest(base + EXPORT_CACHE_NAME, manifest);
+
+    stats.m_Ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return ok;
+}
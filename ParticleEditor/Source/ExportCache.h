@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define EXPORT_CACHE_VERSION 1
+#define EXPORT_CACHE_NAME ".partcache"
+
+/*
+ * Manifest of the assets copied into an export directory, kept next to them
+ * as EXPORT_CACHE_NAME. One text line per asset:
+ *   hash size mtime dest_size dest_mtime name
+ *
+ * hash is the content hash of the source, size and mtime are what the source
+ * looked like when it was hashed. An asset is skipped while the source still
+ * hashes the same and the copy still has the size and mtime it was left with.
+ * Sources with an unchanged size and mtime are not hashed again.
+ */
+enum class ExportAssetResult {
+    Copied,
+    Skipped,
+    Failed,
+};
+
+struct ExportAsset {
+    std::string m_Source;
+    // file name inside the export directory
+    std::string m_Name;
+
+    ExportAssetResult m_Result;
+    uint64_t m_Size;
+};
+
+struct ExportCacheStats {
+    uint32_t m_Copied;
+    uint32_t m_Skipped;
+    uint32_t m_Failed;
+    uint64_t m_BytesCopied;
+    uint64_t m_BytesSkipped;
+    float m_Ms;
+};
+
+// Copies the changed assets into `dir` on the shared JobPool and updates the
+// manifest. Assets with a name used earlier in the list are skipped. False if
+// any copy failed, the manifest then forgets the failed ones.
+bool SyncExportAssets(const char *dir, std::vector<ExportAsset> &assets, ExportCacheStats &stats);
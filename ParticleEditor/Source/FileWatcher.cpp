@@ -0,0 +1,264 @@
+#include "FileWatcher.h"
+
+#include <experimental/filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::experimental::filesystem;
+
+// everything that can leave a file with new content, the rename covers
+// editors that save to a temporary and move it over
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+// how long the watcher thread sleeps at most, bounds how late a quit is seen
+#define WATCHER_WAIT_MS 50
+
+static std::string GetDirectory(const std::string &path)
+{
+    auto dir = fs::path(path).parent_path().generic_string();
+    return dir.empty() ? "." : dir;
+}
+
+static std::string GetEntryKey(const std::string &dir, const std::string &name)
+{
+    return dir + "/" + name;
+}
+
+FileWatcher::FileWatcher(uint32_t poll_ms, uint32_t debounce_ms)
+    : m_PollMs(poll_ms), m_DebounceMs(debounce_ms), m_Inotify(-1), m_Quit(false)
+{
+#ifdef __linux__
+    m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    m_Thread = std::thread(&FileWatcher::WatcherLoop, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+    m_Quit = true;
+    m_Thread.join();
+
+#ifdef __linux__
+    if (m_Inotify >= 0)
+        close(m_Inotify);
+#endif
+}
+
+FileWatcher::FileState FileWatcher::Stat(const std::string &path)
+{
+    FileState state = {};
+
+    std::error_code error;
+    auto size = fs::file_size(path, error);
+    if (error)
+        return state;
+
+    auto time = fs::last_write_time(path, error);
+    if (error)
+        return state;
+
+    state.m_Exists = true;
+    state.m_Size = (uint64_t)size;
+    state.m_Time = (int64_t)time.time_since_epoch().count();
+
+    return state;
+}
+
+void FileWatcher::SetFiles(const std::vector<std::string> &paths)
+{
+    std::set<std::string> files(paths.begin(), paths.end());
+
+    std::set<std::string> dirs;
+    for (auto &path : files)
+        dirs.insert(GetDirectory(path));
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    std::set<std::string> watched;
+
+#ifdef __linux__
+    if (m_Inotify >= 0) {
+        // drop the directories nothing is in any more
+        for (auto it = m_Watches.begin(); it != m_Watches.end();) {
+            auto &names = it->second;
+            for (size_t i = 0; i < names.size();) {
+                if (dirs.count(names[i]) == 0)
+                    names.erase(names.begin() + i);
+                else
+                    watched.insert(names[i++]);
+            }
+
+            if (names.empty()) {
+                inotify_rm_watch(m_Inotify, it->first);
+                it = m_Watches.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        for (auto &dir : dirs) {
+            if (watched.count(dir))
+                continue;
+
+            // the same directory spelled differently gets the same watch back
+            int wd = inotify_add_watch(m_Inotify, dir.c_str(), WATCH_EVENTS);
+            if (wd < 0)
+                continue;
+
+            m_Watches[wd].push_back(dir);
+            watched.insert(dir);
+        }
+    }
+#endif
+
+    std::map<std::string, FileState> polled;
+    for (auto &path : files) {
+        if (watched.count(GetDirectory(path)))
+            continue;
+
+        auto known = m_Polled.find(path);
+        polled[path] = known != m_Polled.end() ? known->second : Stat(path);
+    }
+
+    for (auto it = m_Changed.begin(); it != m_Changed.end();) {
+        if (files.count(it->first) == 0)
+            it = m_Changed.erase(it);
+        else
+            ++it;
+    }
+
+    m_Entries.clear();
+    for (auto &path : files)
+        m_Entries[GetEntryKey(GetDirectory(path), fs::path(path).filename().generic_string())].push_back(path);
+
+    m_Files.swap(files);
+    m_Polled.swap(polled);
+}
+
+void FileWatcher::Poll(std::vector<std::string> &out)
+{
+    auto now = Clock::now();
+    auto debounce = std::chrono::milliseconds(m_DebounceMs);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    for (auto it = m_Changed.begin(); it != m_Changed.end();) {
+        if (now - it->second >= debounce) {
+            out.push_back(it->first);
+            it = m_Changed.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+// called with the lock held
+void FileWatcher::Touch(const std::string &path)
+{
+    m_Changed[path] = Clock::now();
+}
+
+void FileWatcher::WatcherLoop()
+{
+    auto next_poll = Clock::now();
+
+    while (!m_Quit) {
+#ifdef __linux__
+        if (m_Inotify >= 0) {
+            pollfd fd = { m_Inotify, POLLIN, 0 };
+            if (poll(&fd, 1, WATCHER_WAIT_MS) > 0)
+                ReadEvents();
+        }
+        else
+#endif
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WATCHER_WAIT_MS));
+        }
+
+        if (Clock::now() >= next_poll) {
+            PollFiles();
+            next_poll = Clock::now() + std::chrono::milliseconds(m_PollMs);
+        }
+    }
+}
+
+void FileWatcher::ReadEvents()
+{
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16 << 10];
+
+    for (;;) {
+        auto len = read(m_Inotify, buffer, sizeof(buffer));
+        if (len <= 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+
+        for (char *ptr = buffer; ptr < buffer + len;) {
+            auto event = (const inotify_event*)ptr;
+            ptr += sizeof(inotify_event) + event->len;
+
+            // events were dropped, anything in a watched directory may have
+            // changed
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (auto &path : m_Files) {
+                    if (m_Polled.count(path) == 0)
+                        Touch(path);
+                }
+                continue;
+            }
+
+            auto watch = m_Watches.find(event->wd);
+            if (watch == m_Watches.end() || event->len == 0)
+                continue;
+
+            for (auto &dir : watch->second) {
+                auto entry = m_Entries.find(GetEntryKey(dir, event->name));
+                if (entry == m_Entries.end())
+                    continue;
+
+                for (auto &path : entry->second)
+                    Touch(path);
+            }
+        }
+    }
+#endif
+}
+
+void FileWatcher::PollFiles()
+{
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        for (auto &entry : m_Polled)
+            paths.push_back(entry.first);
+    }
+
+    if (paths.empty())
+        return;
+
+    std::vector<FileState> states(paths.size());
+    for (size_t i = 0; i < paths.size(); i++)
+        states[i] = Stat(paths[i]);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    for (size_t i = 0; i < paths.size(); i++) {
+        // dropped by SetFiles in the meantime
+        auto known = m_Polled.find(paths[i]);
+        if (known == m_Polled.end())
+            continue;
+
+        auto &old = known->second;
+        auto &cur = states[i];
+        if (old.m_Exists != cur.m_Exists || old.m_Size != cur.m_Size || old.m_Time != cur.m_Time) {
+            old = cur;
+            Touch(paths[i]);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Watches a set of files from a background thread and reports the ones that
+ * changed. On Linux the directories holding them are watched with inotify,
+ * files it cannot watch and every file on other platforms are polled for
+ * their size and modification time.
+ *
+ * Saving usually comes in bursts (truncate, write, rename over), a file is
+ * only reported once it has been quiet for the debounce time.
+ */
+class FileWatcher {
+public:
+    FileWatcher(uint32_t poll_ms = 250, uint32_t debounce_ms = 100);
+    ~FileWatcher();
+
+    // replaces the watched set, paths are reported back exactly as given
+    void SetFiles(const std::vector<std::string> &paths);
+
+    // moves the files that changed and settled since the last call into `out`
+    void Poll(std::vector<std::string> &out);
+
+    // false while everything is polled
+    bool IsNative() const { return m_Inotify >= 0; }
+
+private:
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct FileState {
+        bool m_Exists;
+        uint64_t m_Size;
+        int64_t m_Time;
+    };
+
+    void WatcherLoop();
+    void ReadEvents();
+    void PollFiles();
+    void Touch(const std::string &path);
+
+    static FileState Stat(const std::string &path);
+
+    uint32_t m_PollMs;
+    uint32_t m_DebounceMs;
+
+    std::mutex m_Lock;
+    std::set<std::string> m_Files;
+    // "<directory>/<name>" -> the watched paths that are that file
+    std::map<std::string, std::vector<std::string>> m_Entries;
+    // polled files and what they looked like last time
+    std::map<std::string, FileState> m_Polled;
+    // changed files and when the last change was seen
+    std::map<std::string, Clock::time_point> m_Changed;
+
+    // inotify descriptor and watch -> directory, -1 when not in use
+    int m_Inotify;
+    std::map<int, std::vector<std::string>> m_Watches;
+
+    std::atomic<bool> m_Quit;
+    std::thread m_Thread;
+};
@@ -0,0 +1,438 @@
+#include "FlipbookBaker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include <External/json.hpp>
+
+#include "ImageIO.h"
+#include "JobPool.h"
+#include "RenderBackend.h"
+
+using json = nlohmann::json;
+
+// an effect that never reaches its time would otherwise spin forever
+#define MAX_FLIPBOOK_STEPS 36000
+
+// matches GLOBAL_LIGHT_COLOR in LightCalc.hlsli
+static const XMFLOAT3 GlobalLightColor = { 0.1f, 0.1f, 0.3f };
+
+// matches the inner color of BillboardParticleSimple.hlsl
+static const XMFLOAT3 BillboardColor = { 1.000f, 0.894f, 0.710f };
+
+enum class SplatKind : uint8_t {
+    Sphere,
+    Soft,
+    Capsule
+};
+
+struct Splat {
+    // capsule end points in cell pixels, equal for discs
+    float x0, y0, x1, y1;
+    float radius;
+    float depth;
+    XMFLOAT4 color;
+    SplatKind kind;
+};
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static float Saturate(float value)
+{
+    return std::min(std::max(value, 0.f), 1.f);
+}
+
+static XMVECTOR ViewDirection(float pitch, float yaw)
+{
+    pitch = XMConvertToRadians(pitch);
+    yaw = XMConvertToRadians(yaw);
+
+    return XMVectorSet(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw), 0.f);
+}
+
+FlipbookBaker::FlipbookBaker(const FlipbookSettings &settings)
+    : m_Settings(settings), m_Stats(), m_Light(), m_SphereRadius(0.5f), m_Duration(0.f), m_Center(), m_Radius(1.f)
+{
+}
+
+FlipbookBaker::~FlipbookBaker()
+{
+}
+
+bool FlipbookBaker::Simulate(const ParticleEffect &effect)
+{
+    if (effect.m_Count == 0 || effect.time <= 0.f || m_Settings.m_FrameCount == 0)
+        return false;
+
+    NullRenderBackend backend;
+    MeshCache meshes(&backend);
+    ParticleSystem system(L"", 2048, 0, 0, &backend, &meshes);
+
+    ParticleEffect fx = effect;
+    fx.age = 0.f;
+    for (unsigned int i = 0; i < fx.m_Count; i++) {
+        fx.m_Entries[i].m_SpawnedParticles = 0.f;
+        if (fx.m_Entries[i].type == ParticleType::Trail)
+            fx.m_Entries[i].trail.trailidx = -1;
+    }
+
+    AnchoredParticleEffect anchored = {};
+    anchored.fx = &fx;
+
+    std::vector<Snapshot> steps;
+    float dt = m_Settings.m_TimeStep;
+
+    // same order of operations as the viewport
+    while (fx.age < fx.time && steps.size() < MAX_FLIPBOOK_STEPS) {
+        if (fx.anchor)
+            system.ProcessAnchoredFX(&anchored, SimpleMath::Matrix::Identity, dt);
+        else
+            system.ProcessFX(&fx, SimpleMath::Matrix::Identity, dt);
+
+        system.update(nullptr, dt);
+
+        auto data = system.GetFrameData();
+        Snapshot snapshot;
+        snapshot.m_Instances.assign(data.m_Instances, data.m_Instances + data.m_InstanceCount);
+        snapshot.m_Billboards.assign(data.m_Billboards, data.m_Billboards + data.m_BillboardCount);
+        snapshot.m_Trails.assign(data.m_Trails, data.m_Trails + data.m_TrailCount);
+        steps.push_back(std::move(snapshot));
+
+        if (steps.size() == 1) {
+            m_Light = data.m_Light;
+
+            m_SphereRadius = 0.f;
+            for (uint32_t i = 0; i < data.m_SphereIndexCount; i++) {
+                auto &v = data.m_SphereVertices[data.m_SphereIndices[i]].position;
+                m_SphereRadius = std::max(m_SphereRadius, std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z));
+            }
+        }
+
+        system.frame();
+    }
+    system.ReleaseAnchoredFX(&anchored);
+
+    m_Stats.m_SimSteps = (uint32_t)steps.size();
+    if (steps.empty())
+        return false;
+
+    m_Duration = fx.age;
+
+    m_Frames.clear();
+    for (uint32_t i = 0; i < m_Settings.m_FrameCount; i++)
+        m_Frames.push_back(steps[(size_t)i * steps.size() / m_Settings.m_FrameCount]);
+
+    // one bounding sphere over every baked frame, so the impostor doesn't
+    // shift or rescale while it plays
+    XMVECTOR lo = XMVectorReplicate(FLT_MAX);
+    XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+    auto grow = [&lo, &hi](XMVECTOR p, float r) {
+        lo = XMVectorMin(lo, p - XMVectorReplicate(r));
+        hi = XMVectorMax(hi, p + XMVectorReplicate(r));
+    };
+
+    for (auto &frame : m_Frames) {
+        for (auto &instance : frame.m_Instances)
+            grow(instance.m_Model.r[3], XMVectorGetX(XMVector3Length(instance.m_Model.r[0])) * m_SphereRadius);
+        for (auto &billboard : frame.m_Billboards)
+            grow(XMLoadFloat3(&billboard.position), std::max(billboard.size.x, billboard.size.y));
+        for (auto &trail : frame.m_Trails) {
+            for (auto &point : trail.points)
+                grow(XMLoadFloat3(&point.m_Position), point.m_Size.x);
+        }
+    }
+
+    if (XMVector3Greater(lo, hi)) {
+        m_Center = { 0.f, 0.f, 0.f };
+        m_Radius = 1.f;
+    }
+    else {
+        XMStoreFloat3(&m_Center, (lo + hi) * 0.5f);
+        m_Radius = std::max(XMVectorGetX(XMVector3Length(hi - lo)) * 0.5f, 0.01f);
+    }
+
+    return true;
+}
+
+uint32_t FlipbookBaker::SplatCell(const Snapshot &snapshot, XMMATRIX view, float *dst, uint32_t stride) const
+{
+    float size = (float)m_Settings.m_FrameSize;
+    float scale = 0.5f * size / m_Radius;
+
+    // orthographic, the bounding sphere fills the cell
+    auto project = [&](XMVECTOR world, float &x, float &y, float &depth) {
+        XMVECTOR v = XMVector3Transform(world, view);
+        x = XMVectorGetX(v) * scale + 0.5f * size;
+        y = 0.5f * size - XMVectorGetY(v) * scale;
+        depth = -XMVectorGetZ(v);
+    };
+
+    std::vector<Splat> splats;
+    splats.reserve(snapshot.m_Instances.size() + snapshot.m_Billboards.size() + snapshot.m_Trails.size() * TRAIL_COUNT);
+
+    for (auto &instance : snapshot.m_Instances) {
+        Splat s = {};
+        project(instance.m_Model.r[3], s.x0, s.y0, s.depth);
+        s.x1 = s.x0;
+        s.y1 = s.y0;
+        s.radius = XMVectorGetX(XMVector3Length(instance.m_Model.r[0])) * m_SphereRadius * scale;
+        XMStoreFloat4(&s.color, instance.m_Color);
+        s.color.w = 1.f;
+        s.kind = SplatKind::Sphere;
+        splats.push_back(s);
+    }
+
+    for (auto &billboard : snapshot.m_Billboards) {
+        Splat s = {};
+        project(XMLoadFloat3(&billboard.position), s.x0, s.y0, s.depth);
+        s.x1 = s.x0;
+        s.y1 = s.y0;
+        s.radius = std::max(billboard.size.x, billboard.size.y) * scale;
+        s.color = { BillboardColor.x, BillboardColor.y, BillboardColor.z, 1.f };
+        s.kind = SplatKind::Soft;
+        splats.push_back(s);
+    }
+
+    // trails become one capsule per segment, fading out like the trail shader
+    for (auto &trail : snapshot.m_Trails) {
+        for (int j = 1; j < TRAIL_COUNT - 2; j++) {
+            Splat s = {};
+            float d0, d1;
+            project(XMLoadFloat3(&trail.points[j].m_Position), s.x0, s.y0, d0);
+            project(XMLoadFloat3(&trail.points[j + 1].m_Position), s.x1, s.y1, d1);
+            s.depth = (d0 + d1) * 0.5f;
+            s.radius = trail.points[j].m_Size.x * scale;
+            s.color = { 1.f, 1.f, 1.f, 1.f - j / (float)TRAIL_COUNT };
+            s.kind = SplatKind::Capsule;
+            splats.push_back(s);
+        }
+    }
+
+    // back to front
+    std::sort(splats.begin(), splats.end(), [](const Splat &a, const Splat &b) {
+        return a.depth > b.depth;
+    });
+
+    XMFLOAT3 light;
+    XMStoreFloat3(&light, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat4(&m_Light.position), view)));
+    XMFLOAT3 ambient = {
+        m_Light.ambient.x + GlobalLightColor.x,
+        m_Light.ambient.y + GlobalLightColor.y,
+        m_Light.ambient.z + GlobalLightColor.z
+    };
+
+    int cell = (int)m_Settings.m_FrameSize;
+    for (auto &s : splats) {
+        if (s.radius <= 0.f)
+            continue;
+
+        int x0 = std::max(0, (int)std::floor(std::min(s.x0, s.x1) - s.radius));
+        int x1 = std::min(cell - 1, (int)std::ceil(std::max(s.x0, s.x1) + s.radius));
+        int y0 = std::max(0, (int)std::floor(std::min(s.y0, s.y1) - s.radius));
+        int y1 = std::min(cell - 1, (int)std::ceil(std::max(s.y0, s.y1) + s.radius));
+
+        float sx = s.x1 - s.x0;
+        float sy = s.y1 - s.y0;
+        float len2 = sx * sx + sy * sy;
+
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                float px = x + 0.5f - s.x0;
+                float py = y + 0.5f - s.y0;
+
+                // distance to the capsule axis, the disc centre otherwise
+                float t = len2 > 0.f ? Saturate((px * sx + py * sy) / len2) : 0.f;
+                float dx = px - t * sx;
+                float dy = py - t * sy;
+                float dist = std::sqrt(dx * dx + dy * dy);
+
+                float alpha = s.color.w * Saturate(s.radius - dist + 0.5f);
+                if (alpha <= 0.f)
+                    continue;
+
+                float r = s.color.x, g = s.color.y, b = s.color.z;
+                if (s.kind == SplatKind::Sphere) {
+                    // shade as the front half of a sphere
+                    float nx = dx / s.radius, ny = -dy / s.radius;
+                    float nz = std::sqrt(std::max(0.f, 1.f - nx * nx - ny * ny));
+                    float ndotl = std::max(0.f, nx * light.x + ny * light.y + nz * light.z);
+
+                    r *= ambient.x + m_Light.color.x * ndotl;
+                    g *= ambient.y + m_Light.color.y * ndotl;
+                    b *= ambient.z + m_Light.color.z * ndotl;
+                }
+                else if (s.kind == SplatKind::Soft) {
+                    alpha *= std::max(0.f, 1.f - dist / s.radius);
+                }
+
+                // premultiplied over, resolved when writing the atlas
+                float *p = &dst[((size_t)y * stride + x) * 4];
+                p[0] = r * alpha + p[0] * (1.f - alpha);
+                p[1] = g * alpha + p[1] * (1.f - alpha);
+                p[2] = b * alpha + p[2] * (1.f - alpha);
+                p[3] = alpha + p[3] * (1.f - alpha);
+            }
+        }
+    }
+
+    return (uint32_t)splats.size();
+}
+
+bool FlipbookBaker::Bake(const ParticleEffect &effect, const char *path)
+{
+    m_Stats = {};
+
+    // the atlas is laid out from frames times yaws cells, none of either
+    // leaves nothing to lay out
+    if (m_Settings.m_Yaws.empty() || m_Settings.m_FrameCount == 0 || m_Settings.m_FrameSize == 0)
+        return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!Simulate(effect))
+        return false;
+    m_Stats.m_SimulateMs = ElapsedMs(start);
+
+    start = std::chrono::high_resolution_clock::now();
+
+    uint32_t frames = m_Settings.m_FrameCount;
+    uint32_t views = (uint32_t)m_Settings.m_Yaws.size();
+    uint32_t cells = frames * views;
+    uint32_t columns = (uint32_t)std::ceil(std::sqrt((float)cells));
+    uint32_t rows = (cells + columns - 1) / columns;
+
+    uint32_t size = m_Settings.m_FrameSize;
+    uint32_t width = columns * size;
+    uint32_t height = rows * size;
+
+    std::vector<float> atlas((size_t)width * height * 4, 0.f);
+    std::vector<uint32_t> splats(cells, 0);
+
+    XMVECTOR center = XMLoadFloat3(&m_Center);
+
+    // every cell owns a disjoint region of the atlas
+    ParallelFor(cells, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t view_idx = (uint32_t)i / frames;
+            uint32_t frame_idx = (uint32_t)i % frames;
+
+            XMVECTOR eye = center + ViewDirection(m_Settings.m_Pitch, m_Settings.m_Yaws[view_idx]) * (m_Radius * 2.f);
+            XMMATRIX view = XMMatrixLookAtRH(eye, center, { 0.f, 1.f, 0.f });
+
+            uint32_t x = ((uint32_t)i % columns) * size;
+            uint32_t y = ((uint32_t)i / columns) * size;
+
+            splats[i] = SplatCell(m_Frames[frame_idx], view, &atlas[((size_t)y * width + x) * 4], width);
+        }
+    });
+
+    for (auto count : splats)
+        m_Stats.m_Splats += count;
+
+    // straight alpha for the billboard blend state
+    std::vector<uint8_t> pixels(atlas.size());
+    for (size_t i = 0; i < atlas.size(); i += 4) {
+        float alpha = atlas[i + 3];
+        float inv = alpha > 0.f ? 1.f / alpha : 0.f;
+
+        for (int c = 0; c < 3; c++)
+            pixels[i + c] = (uint8_t)(Saturate(atlas[i + c] * inv) * 255.f + 0.5f);
+        pixels[i + 3] = (uint8_t)(Saturate(alpha) * 255.f + 0.5f);
+    }
+
+    m_Stats.m_SplatMs = ElapsedMs(start);
+
+    std::string base = path;
+    std::string atlas_path = base + ".png";
+    if (!WritePNG(atlas_path.c_str(), width, height, pixels.data()))
+        return false;
+
+    auto slash = atlas_path.find_last_of("/\\");
+
+    json descriptor = {
+        { "atlas", slash == std::string::npos ? atlas_path : atlas_path.substr(slash + 1) },
+        { "frame_count", frames },
+        { "view_count", views },
+        { "columns", columns },
+        { "rows", rows },
+        { "frame_size", size },
+        { "duration", m_Duration },
+        { "world_size", m_Radius * 2.f },
+        { "center", { m_Center.x, m_Center.y, m_Center.z } },
+        { "pitch", m_Settings.m_Pitch },
+        { "yaws", m_Settings.m_Yaws },
+        { "lod_distance", m_Settings.m_LodDistance }
+    };
+
+    std::ofstream o(base + ".json");
+    if (!o.is_open())
+        return false;
+
+    o << std::setw(4) << descriptor << std::endl;
+
+    return true;
+}
+
+bool Flipbook::Load(const char *path)
+{
+    std::ifstream i(path);
+    if (!i.is_open())
+        return false;
+
+    // a descriptor that is not json or misses a field is just not a flipbook
+    try {
+        json data;
+        i >> data;
+
+        m_Atlas = data.at("atlas").get<std::string>();
+        m_FrameCount = data.at("frame_count");
+        m_ViewCount = data.at("view_count");
+        m_Columns = data.at("columns");
+        m_Rows = data.at("rows");
+        m_Duration = data.at("duration");
+        m_WorldSize = data.at("world_size");
+        m_LodDistance = data.at("lod_distance");
+        m_Pitch = data.at("pitch");
+        auto &center = data.at("center");
+        m_Center = { center.at(0), center.at(1), center.at(2) };
+        m_Yaws = data.at("yaws").get<std::vector<float>>();
+    }
+    catch (const json::exception &) {
+        return false;
+    }
+
+    // GetFrameRect divides by the grid and indexes cells by view and frame
+    return m_FrameCount > 0 && m_ViewCount > 0 && m_Yaws.size() == m_ViewCount &&
+        m_Columns > 0 && m_Rows > 0 && (uint64_t)m_Columns * m_Rows >= (uint64_t)m_FrameCount * m_ViewCount;
+}
+
+XMFLOAT4 Flipbook::GetFrameRect(float age, float yaw) const
+{
+    int frame = m_Duration > 0.f ? (int)(age / m_Duration * m_FrameCount) : 0;
+    frame = std::min(std::max(frame, 0), (int)m_FrameCount - 1);
+
+    uint32_t view = 0;
+    float best = FLT_MAX;
+    for (uint32_t i = 0; i < m_Yaws.size(); i++) {
+        float diff = std::fabs(std::remainder(yaw - m_Yaws[i], 360.f));
+        if (diff < best) {
+            best = diff;
+            view = i;
+        }
+    }
+
+    uint32_t cell = view * m_FrameCount + frame;
+
+    return {
+        (cell % m_Columns) / (float)m_Columns,
+        (cell / m_Columns) / (float)m_Rows,
+        1.f / m_Columns,
+        1.f / m_Rows
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ParticleSystem.h"
+
+struct FlipbookSettings {
+    uint32_t m_FrameCount = 16;
+    uint32_t m_FrameSize = 128;
+
+    // view angles in degrees, every yaw gets its own run of frames
+    float m_Pitch = 20.f;
+    std::vector<float> m_Yaws = { 0.f, 90.f, 180.f, 270.f };
+
+    float m_TimeStep = 1.f / 60.f;
+
+    // distance past which the runtime should switch to the flipbook
+    float m_LodDistance = 20.f;
+};
+
+struct FlipbookStats {
+    uint32_t m_SimSteps;
+    uint32_t m_Splats;
+    float m_SimulateMs;
+    float m_SplatMs;
+};
+
+// Bakes an effect into a sprite sheet of impostor frames. The effect is
+// simulated on a headless ParticleSystem for its whole `time` and the chosen
+// frames are splatted on the CPU, one atlas cell per job.
+class FlipbookBaker {
+public:
+    FlipbookBaker(const FlipbookSettings &settings);
+    ~FlipbookBaker();
+
+    // writes `<path>.png` and the `<path>.json` descriptor
+    bool Bake(const ParticleEffect &effect, const char *path);
+
+    const FlipbookStats &GetStats() const { return m_Stats; }
+
+private:
+    struct Snapshot {
+        std::vector<GeometryParticleInstance> m_Instances;
+        std::vector<BillboardParticle> m_Billboards;
+        std::vector<Trail> m_Trails;
+    };
+
+    bool Simulate(const ParticleEffect &effect);
+    uint32_t SplatCell(const Snapshot &snapshot, XMMATRIX view, float *dst, uint32_t stride) const;
+
+    FlipbookSettings m_Settings;
+    FlipbookStats m_Stats;
+
+    std::vector<Snapshot> m_Frames;
+    DirectionalLight m_Light;
+    float m_SphereRadius;
+    float m_Duration;
+
+    XMFLOAT3 m_Center;
+    float m_Radius;
+};
+
+// Runtime side of a baked flipbook, picks the atlas cell for an instance
+// that is far enough away to be drawn as a single billboard.
+struct Flipbook {
+    std::string m_Atlas;
+
+    uint32_t m_FrameCount;
+    uint32_t m_ViewCount;
+    uint32_t m_Columns;
+    uint32_t m_Rows;
+
+    float m_Duration;
+    float m_WorldSize;
+    float m_LodDistance;
+    float m_Pitch;
+    XMFLOAT3 m_Center;
+    std::vector<float> m_Yaws;
+
+    bool Load(const char *path);
+
+    bool ShouldUse(float distance) const { return distance >= m_LodDistance; }
+
+    // uv rectangle (x, y, width, height) for the effect age and view yaw
+    XMFLOAT4 GetFrameRect(float age, float yaw) const;
+};
@@ -0,0 +1,670 @@
+#include "ImageIO.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void PutU32BE(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back((value >> 24) & 0xff);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+template<typename T>
+static void PutLE(std::vector<uint8_t> &out, T value)
+{
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void PutString(std::vector<uint8_t> &out, const char *str)
+{
+    out.insert(out.end(), str, str + strlen(str) + 1);
+}
+
+static bool WriteFile(const char *path, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+
+    return ok;
+}
+
+struct Crc32Table {
+    uint32_t m_Entries[256];
+
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            m_Entries[i] = c;
+        }
+    }
+};
+
+uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc)
+{
+    // called from worker threads, the initialization of a function local
+    // static is guaranteed to run once
+    static const Crc32Table table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table.m_Entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static void PutChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+{
+    PutU32BE(out, (uint32_t)data.size());
+
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+
+    PutU32BE(out, Crc32(&out[start], out.size() - start));
+}
+
+bool WritePNG(const char *path, uint32_t width, uint32_t height, const uint8_t *rgba)
+{
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    std::vector<uint8_t> header;
+    PutU32BE(header, width);
+    PutU32BE(header, height);
+    header.push_back(8); // bit depth
+    header.push_back(6); // RGBA
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    PutChunk(png, "IHDR", header);
+
+    // every scanline is prefixed with filter type 0
+    std::vector<uint8_t> raw;
+    raw.reserve((width * 4 + 1) * height);
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * width * 4, rgba + (y + 1) * width * 4);
+    }
+
+    // zlib stream made of stored deflate blocks
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    size_t offset = 0;
+    do {
+        size_t len = raw.size() - offset;
+        if (len > 0xffff)
+            len = 0xffff;
+
+        bool last = offset + len == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        PutLE<uint16_t>(zlib, (uint16_t)len);
+        PutLE<uint16_t>(zlib, (uint16_t)~len);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + len);
+
+        offset += len;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (auto byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutU32BE(zlib, (b << 16) | a);
+
+    PutChunk(png, "IDAT", zlib);
+    PutChunk(png, "IEND", {});
+
+    return WriteFile(path, png);
+}
+
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff)
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7c00);
+
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return (uint16_t)sign;
+
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;
+
+    return (uint16_t)half;
+}
+
+static void PutAttribute(std::vector<uint8_t> &out, const char *name, const char *type, const std::vector<uint8_t> &value)
+{
+    PutString(out, name);
+    PutString(out, type);
+    PutLE<int32_t>(out, (int32_t)value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool WriteEXR(const char *path, uint32_t width, uint32_t height, const float *rgba)
+{
+    std::vector<uint8_t> exr;
+    PutLE<uint32_t>(exr, 20000630); // magic
+    PutLE<uint32_t>(exr, 2);        // version 2, scanline
+
+    // channels have to be stored in alphabetical order
+    static const char *channels[] = { "A", "B", "G", "R" };
+    static const int components[] = { 3, 2, 1, 0 };
+
+    std::vector<uint8_t> chlist;
+    for (auto name : channels) {
+        PutString(chlist, name);
+        PutLE<int32_t>(chlist, 1); // HALF
+        PutLE<uint32_t>(chlist, 0);
+        PutLE<int32_t>(chlist, 1);
+        PutLE<int32_t>(chlist, 1);
+    }
+    chlist.push_back(0);
+    PutAttribute(exr, "channels", "chlist", chlist);
+
+    PutAttribute(exr, "compression", "compression", { 0 });
+
+    std::vector<uint8_t> box;
+    PutLE<int32_t>(box, 0);
+    PutLE<int32_t>(box, 0);
+    PutLE<int32_t>(box, (int32_t)width - 1);
+    PutLE<int32_t>(box, (int32_t)height - 1);
+    PutAttribute(exr, "dataWindow", "box2i", box);
+    PutAttribute(exr, "displayWindow", "box2i", box);
+
+    PutAttribute(exr, "lineOrder", "lineOrder", { 0 });
+
+    std::vector<uint8_t> one;
+    PutLE<float>(one, 1.f);
+    PutAttribute(exr, "pixelAspectRatio", "float", one);
+
+    std::vector<uint8_t> center;
+    PutLE<float>(center, 0.f);
+    PutLE<float>(center, 0.f);
+    PutAttribute(exr, "screenWindowCenter", "v2f", center);
+    PutAttribute(exr, "screenWindowWidth", "float", one);
+
+    exr.push_back(0);
+
+    uint32_t line_size = 8 + width * 4 * sizeof(uint16_t);
+    uint64_t offset = exr.size() + height * sizeof(uint64_t);
+    for (uint32_t y = 0; y < height; y++)
+        PutLE<uint64_t>(exr, offset + (uint64_t)y * line_size);
+
+    for (uint32_t y = 0; y < height; y++) {
+        PutLE<int32_t>(exr, (int32_t)y);
+        PutLE<uint32_t>(exr, width * 4 * sizeof(uint16_t));
+
+        const float *row = rgba + (size_t)y * width * 4;
+        for (int c = 0; c < 4; c++) {
+            for (uint32_t x = 0; x < width; x++)
+                PutLE<uint16_t>(exr, FloatToHalf(row[x * 4 + components[c]]));
+        }
+    }
+
+    return WriteFile(path, exr);
+}
+
+// Bit reader and canonical huffman decoding for inflate, RFC 1951.
+struct InflateState {
+    const uint8_t *m_Data;
+    size_t m_Size;
+    size_t m_Pos;
+    uint32_t m_Bits;
+    uint32_t m_BitCount;
+    bool m_Overrun;
+
+    uint32_t Get(uint32_t count)
+    {
+        while (m_BitCount < count) {
+            if (m_Pos >= m_Size) {
+                m_Overrun = true;
+                return 0;
+            }
+            m_Bits |= (uint32_t)m_Data[m_Pos++] << m_BitCount;
+            m_BitCount += 8;
+        }
+
+        uint32_t value = m_Bits & ((1u << count) - 1);
+        m_Bits >>= count;
+        m_BitCount -= count;
+
+        return value;
+    }
+};
+
+struct Huffman {
+    uint16_t m_Counts[16];
+    uint16_t m_Symbols[288];
+};
+
+static bool BuildHuffman(Huffman &h, const uint8_t *lengths, uint32_t count)
+{
+    memset(h.m_Counts, 0, sizeof(h.m_Counts));
+    for (uint32_t i = 0; i < count; i++)
+        h.m_Counts[lengths[i]]++;
+    h.m_Counts[0] = 0;
+
+    uint16_t offsets[16];
+    int left = 1;
+    offsets[1] = 0;
+    for (int len = 1; len < 16; len++) {
+        left = (left << 1) - h.m_Counts[len];
+        if (left < 0)
+            return false;
+        if (len < 15)
+            offsets[len + 1] = offsets[len] + h.m_Counts[len];
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (lengths[i])
+            h.m_Symbols[offsets[lengths[i]]++] = (uint16_t)i;
+    }
+
+    return true;
+}
+
+static int DecodeSymbol(InflateState &s, const Huffman &h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= (int)s.Get(1);
+        int count = h.m_Counts[len];
+        if (code - first < count)
+            return h.m_Symbols[index + code - first];
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+static bool InflateBlock(InflateState &s, const Huffman &lit, const Huffman &dist, std::vector<uint8_t> &out)
+{
+    static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    for (;;) {
+        int symbol = DecodeSymbol(s, lit);
+        if (symbol < 0 || s.m_Overrun)
+            return false;
+
+        if (symbol < 256) {
+            out.push_back((uint8_t)symbol);
+            continue;
+        }
+        if (symbol == 256)
+            return true;
+
+        symbol -= 257;
+        if (symbol >= 29)
+            return false;
+        uint32_t length = LENGTH_BASE[symbol] + s.Get(LENGTH_EXTRA[symbol]);
+
+        int code = DecodeSymbol(s, dist);
+        if (code < 0 || code >= 30)
+            return false;
+        uint32_t distance = DIST_BASE[code] + s.Get(DIST_EXTRA[code]);
+        if (distance > out.size() || s.m_Overrun)
+            return false;
+
+        size_t from = out.size() - distance;
+        for (uint32_t i = 0; i < length; i++)
+            out.push_back(out[from + i]);
+    }
+}
+
+struct FixedHuffman {
+    Huffman m_Lit;
+    Huffman m_Dist;
+
+    FixedHuffman()
+    {
+        uint8_t lengths[288];
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        BuildHuffman(m_Lit, lengths, 288);
+
+        memset(lengths, 5, 30);
+        BuildHuffman(m_Dist, lengths, 30);
+    }
+};
+
+static const FixedHuffman &GetFixedHuffman()
+{
+    static FixedHuffman fixed;
+    return fixed;
+}
+
+// zlib stream, the adler checksum is not checked
+static bool Inflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+    if (size < 2 || (data[0] & 0x0f) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20))
+        return false;
+
+    InflateState s = { data, size, 2, 0, 0, false };
+
+    uint32_t last;
+    do {
+        last = s.Get(1);
+        uint32_t type = s.Get(2);
+
+        if (type == 0) {
+            s.m_Bits = s.m_BitCount = 0;
+            if (s.m_Pos + 4 > s.m_Size)
+                return false;
+
+            uint32_t len = data[s.m_Pos] | (data[s.m_Pos + 1] << 8);
+            uint32_t nlen = data[s.m_Pos + 2] | (data[s.m_Pos + 3] << 8);
+            s.m_Pos += 4;
+            if ((len ^ 0xffff) != nlen || s.m_Pos + len > s.m_Size)
+                return false;
+
+            out.insert(out.end(), data + s.m_Pos, data + s.m_Pos + len);
+            s.m_Pos += len;
+        }
+        else if (type == 1) {
+            auto &fixed = GetFixedHuffman();
+            if (!InflateBlock(s, fixed.m_Lit, fixed.m_Dist, out))
+                return false;
+        }
+        else if (type == 2) {
+            static const uint8_t ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+            uint32_t nlit = s.Get(5) + 257;
+            uint32_t ndist = s.Get(5) + 1;
+            uint32_t ncode = s.Get(4) + 4;
+            if (nlit > 286 || ndist > 30)
+                return false;
+
+            uint8_t lengths[288 + 32] = {};
+            for (uint32_t i = 0; i < ncode; i++)
+                lengths[ORDER[i]] = (uint8_t)s.Get(3);
+
+            Huffman codes;
+            if (!BuildHuffman(codes, lengths, 19))
+                return false;
+
+            memset(lengths, 0, 19);
+            for (uint32_t i = 0; i < nlit + ndist;) {
+                int symbol = DecodeSymbol(s, codes);
+                if (symbol < 0 || s.m_Overrun)
+                    return false;
+
+                if (symbol < 16) {
+                    lengths[i++] = (uint8_t)symbol;
+                    continue;
+                }
+
+                uint8_t value = 0;
+                uint32_t repeat;
+                if (symbol == 16) {
+                    if (i == 0)
+                        return false;
+                    value = lengths[i - 1];
+                    repeat = 3 + s.Get(2);
+                }
+                else if (symbol == 17) {
+                    repeat = 3 + s.Get(3);
+                }
+                else {
+                    repeat = 11 + s.Get(7);
+                }
+
+                if (i + repeat > nlit + ndist)
+                    return false;
+                while (repeat--)
+                    lengths[i++] = value;
+            }
+
+            Huffman lit, dist;
+            if (!BuildHuffman(lit, lengths, nlit) || !BuildHuffman(dist, lengths + nlit, ndist))
+                return false;
+
+            if (!InflateBlock(s, lit, dist, out))
+                return false;
+        }
+        else {
+            return false;
+        }
+
+        if (s.m_Overrun)
+            return false;
+    } while (!last);
+
+    return true;
+}
+
+static uint32_t GetU32BE(const uint8_t *data)
+{
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+static uint8_t Paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return (uint8_t)a;
+
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+static bool ReadPNG(const uint8_t *data, size_t size, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgba)
+{
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    if (size < 8 || memcmp(data, SIGNATURE, 8) != 0)
+        return false;
+
+    uint32_t depth = 0, color = 0, interlace = 0;
+    std::vector<uint8_t> idat;
+    uint8_t palette[256 * 4];
+    memset(palette, 0xff, sizeof(palette));
+
+    size_t pos = 8;
+    while (pos + 12 <= size) {
+        uint32_t len = GetU32BE(data + pos);
+        const uint8_t *type = data + pos + 4;
+        const uint8_t *chunk = data + pos + 8;
+        if (len > size - pos - 12)
+            return false;
+
+        if (memcmp(type, "IHDR", 4) == 0 && len >= 13) {
+            width = GetU32BE(chunk);
+            height = GetU32BE(chunk + 4);
+            depth = chunk[8];
+            color = chunk[9];
+            interlace = chunk[12];
+        }
+        else if (memcmp(type, "PLTE", 4) == 0) {
+            for (uint32_t i = 0; i < len / 3 && i < 256; i++)
+                memcpy(palette + i * 4, chunk + i * 3, 3);
+        }
+        else if (memcmp(type, "tRNS", 4) == 0 && color == 3) {
+            for (uint32_t i = 0; i < len && i < 256; i++)
+                palette[i * 4 + 3] = chunk[i];
+        }
+        else if (memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), chunk, chunk + len);
+        }
+        else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+
+        pos += 12 + len;
+    }
+
+    // 8 bit, not interlaced, which is what every tool writes by default
+    uint32_t channels;
+    switch (color) {
+        case 0: channels = 1; break;
+        case 2: channels = 3; break;
+        case 3: channels = 1; break;
+        case 4: channels = 2; break;
+        case 6: channels = 4; break;
+        default: return false;
+    }
+    if (depth != 8 || interlace != 0 || width == 0 || height == 0 || width > 16384 || height > 16384)
+        return false;
+
+    std::vector<uint8_t> raw;
+    raw.reserve(((size_t)width * channels + 1) * height);
+    if (!Inflate(idat.data(), idat.size(), raw))
+        return false;
+
+    size_t stride = (size_t)width * channels;
+    if (raw.size() < (stride + 1) * height)
+        return false;
+
+    // undo the filters in place, row by row
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *row = &raw[y * (stride + 1) + 1];
+        const uint8_t *prev = y ? row - stride - 1 : nullptr;
+        uint8_t filter = row[-1];
+
+        for (size_t x = 0; x < stride; x++) {
+            int a = x >= channels ? row[x - channels] : 0;
+            int b = prev ? prev[x] : 0;
+            int c = prev && x >= channels ? prev[x - channels] : 0;
+
+            switch (filter) {
+                case 0: break;
+                case 1: row[x] += (uint8_t)a; break;
+                case 2: row[x] += (uint8_t)b; break;
+                case 3: row[x] += (uint8_t)((a + b) >> 1); break;
+                case 4: row[x] += Paeth(a, b, c); break;
+                default: return false;
+            }
+        }
+    }
+
+    rgba.resize((size_t)width * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *src = &raw[y * (stride + 1) + 1];
+        uint8_t *dst = &rgba[(size_t)y * width * 4];
+
+        for (uint32_t x = 0; x < width; x++, dst += 4, src += channels) {
+            switch (color) {
+                case 0: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 0xff; break;
+                case 2: memcpy(dst, src, 3); dst[3] = 0xff; break;
+                case 3: memcpy(dst, palette + src[0] * 4, 4); break;
+                case 4: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+                case 6: memcpy(dst, src, 4); break;
+            }
+        }
+    }
+
+    return true;
+}
+
+// uncompressed and RLE true color, 24 or 32 bit
+static bool ReadTGA(const uint8_t *data, size_t size, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgba)
+{
+    if (size < 18)
+        return false;
+
+    uint32_t id_len = data[0];
+    uint32_t type = data[2];
+    width = data[12] | (data[13] << 8);
+    height = data[14] | (data[15] << 8);
+    uint32_t bpp = data[16] / 8;
+    bool top_down = (data[17] & 0x20) != 0;
+
+    if ((type != 2 && type != 10) || data[1] != 0 || (bpp != 3 && bpp != 4) || width == 0 || height == 0)
+        return false;
+
+    size_t pos = 18 + id_len;
+    size_t count = (size_t)width * height;
+    rgba.resize(count * 4);
+
+    auto put = [&](size_t i, const uint8_t *src) {
+        size_t y = i / width, x = i % width;
+        uint8_t *dst = &rgba[((top_down ? y : height - 1 - y) * width + x) * 4];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = bpp == 4 ? src[3] : 0xff;
+    };
+
+    for (size_t i = 0; i < count;) {
+        uint32_t run = 1;
+        bool packet = false;
+        if (type == 10) {
+            if (pos >= size)
+                return false;
+            packet = (data[pos] & 0x80) != 0;
+            run = (data[pos] & 0x7f) + 1;
+            pos++;
+        }
+
+        if (i + run > count)
+            return false;
+
+        for (uint32_t k = 0; k < run; k++, i++) {
+            if (pos + bpp > size)
+                return false;
+            put(i, data + pos);
+            if (!packet)
+                pos += bpp;
+        }
+        if (packet)
+            pos += bpp;
+    }
+
+    return true;
+}
+
+bool ReadImage(const char *path, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgba)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[64 << 10];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+
+    width = height = 0;
+    if (ReadPNG(data.data(), data.size(), width, height, rgba))
+        return true;
+
+    return ReadTGA(data.data(), data.size(), width, height, rgba);
+}
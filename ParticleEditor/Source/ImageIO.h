@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal image readers and writers with no external dependencies. PNG output
+// is stored (uncompressed) deflate, EXR output is uncompressed half float RGBA.
+
+bool WritePNG(const char *path, uint32_t width, uint32_t height, const uint8_t *rgba);
+bool WriteEXR(const char *path, uint32_t width, uint32_t height, const float *rgba);
+
+// 8 bit non interlaced PNG and true color TGA, expanded to RGBA8
+bool ReadImage(const char *path, uint32_t &width, uint32_t &height, std::vector<uint8_t> &rgba);
+
+uint16_t FloatToHalf(float value);
+uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc = 0);
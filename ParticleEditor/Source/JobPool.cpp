@@ -0,0 +1,137 @@
+#include "JobPool.h"
+
+#include <algorithm>
+#include <memory>
+
+JobPool::JobPool(unsigned threads)
+    : m_Pending(0), m_Quit(false)
+{
+    if (threads == 0) {
+        unsigned hw = std::thread::hardware_concurrency();
+        threads = hw > 1 ? hw - 1 : 1;
+    }
+
+    for (unsigned i = 0; i < threads; i++)
+        m_Threads.emplace_back(&JobPool::WorkerLoop, this);
+}
+
+JobPool::~JobPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Quit = true;
+    }
+    m_JobReady.notify_all();
+
+    for (auto &thread : m_Threads)
+        thread.join();
+}
+
+void JobPool::Submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Jobs.push_back(std::move(job));
+        m_Pending++;
+    }
+    m_JobReady.notify_one();
+}
+
+void JobPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_JobDone.wait(lock, [this] { return m_Pending == 0; });
+}
+
+JobPool &JobPool::Shared()
+{
+    static JobPool pool;
+    return pool;
+}
+
+void JobPool::WorkerLoop()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_JobReady.wait(lock, [this] { return m_Quit || !m_Jobs.empty(); });
+
+            if (m_Quit && m_Jobs.empty())
+                return;
+
+            job = std::move(m_Jobs.front());
+            m_Jobs.pop_front();
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Pending--;
+        }
+        m_JobDone.notify_all();
+    }
+}
+
+struct ParallelForState {
+    std::atomic<size_t> m_Next;
+    std::atomic<size_t> m_Done;
+    size_t m_Count;
+    size_t m_Grain;
+    std::function<void(size_t, size_t)> m_Func;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Finished;
+};
+
+static void RunRanges(ParallelForState &state)
+{
+    for (;;) {
+        size_t begin = state.m_Next.fetch_add(state.m_Grain);
+        if (begin >= state.m_Count)
+            break;
+
+        size_t end = std::min(begin + state.m_Grain, state.m_Count);
+        state.m_Func(begin, end);
+
+        if (state.m_Done.fetch_add(end - begin) + (end - begin) == state.m_Count) {
+            std::lock_guard<std::mutex> lock(state.m_Lock);
+            state.m_Finished.notify_all();
+        }
+    }
+}
+
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn)
+{
+    if (count == 0)
+        return;
+
+    grain = std::max<size_t>(grain, 1);
+
+    auto &pool = JobPool::Shared();
+    size_t ranges = (count + grain - 1) / grain;
+
+    if (ranges == 1 || pool.GetThreadCount() == 0) {
+        fn(0, count);
+        return;
+    }
+
+    // helpers that only get scheduled after all ranges are claimed simply
+    // find nothing left to do, so the state has to outlive this call
+    auto state = std::make_shared<ParallelForState>();
+    state->m_Next = 0;
+    state->m_Done = 0;
+    state->m_Count = count;
+    state->m_Grain = grain;
+    state->m_Func = fn;
+
+    size_t helpers = std::min<size_t>(ranges - 1, pool.GetThreadCount());
+    for (size_t i = 0; i < helpers; i++)
+        pool.Submit([state] { RunRanges(*state); });
+
+    RunRanges(*state);
+
+    std::unique_lock<std::mutex> lock(state->m_Lock);
+    state->m_Finished.wait(lock, [&state] { return state->m_Done.load() == state->m_Count; });
+}
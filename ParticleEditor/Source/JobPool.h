@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs from a shared queue.
+class JobPool {
+public:
+    // 0 threads picks one per hardware thread, minus the calling thread
+    JobPool(unsigned threads = 0);
+    ~JobPool();
+
+    void Submit(std::function<void()> job);
+
+    // blocks until every job submitted so far has finished
+    void Wait();
+
+    unsigned GetThreadCount() const { return (unsigned)m_Threads.size(); }
+
+    static JobPool &Shared();
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> m_Threads;
+    std::deque<std::function<void()>> m_Jobs;
+
+    std::mutex m_Lock;
+    std::condition_variable m_JobReady;
+    std::condition_variable m_JobDone;
+
+    size_t m_Pending;
+    bool m_Quit;
+};
+
+// Splits [0, count) into ranges of `grain` items and runs `fn(begin, end)` on
+// the shared pool. The calling thread helps out, so it is safe to call from
+// inside a job as well.
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn);
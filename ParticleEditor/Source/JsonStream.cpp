@@ -0,0 +1,567 @@
+#include "JsonStream.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#define JSON_WRITE_BUFFER (64 * 1024)
+
+JsonReader::JsonReader(const char *data, size_t size)
+    : m_Begin(data), m_Cur(data), m_End(data + size), m_First(true), m_Error(nullptr)
+{
+}
+
+uint32_t JsonReader::GetLine() const
+{
+    uint32_t line = 1;
+    for (auto c = m_Begin; c < m_Cur; c++)
+        line += *c == '\n';
+
+    return line;
+}
+
+bool JsonReader::Fail(const char *error)
+{
+    if (!m_Error)
+        m_Error = error;
+
+    // nothing after the first error can succeed
+    m_End = m_Cur;
+    return false;
+}
+
+void JsonReader::SkipWhitespace()
+{
+    while (m_Cur < m_End && (*m_Cur == ' ' || *m_Cur == '\n' || *m_Cur == '\r' || *m_Cur == '\t'))
+        m_Cur++;
+}
+
+bool JsonReader::Expect(char c)
+{
+    SkipWhitespace();
+    if (m_Cur == m_End || *m_Cur != c)
+        return Fail(c == ':' ? "expected ':'" : c == ',' ? "expected ','" : c == '{' ? "expected object" : c == '[' ? "expected array" : "unexpected character");
+
+    m_Cur++;
+    return true;
+}
+
+bool JsonReader::BeginObject()
+{
+    if (!Expect('{'))
+        return false;
+
+    m_First = true;
+    return true;
+}
+
+bool JsonReader::NextKey(std::string_view &key)
+{
+    SkipWhitespace();
+    if (m_Cur < m_End && *m_Cur == '}') {
+        m_Cur++;
+        m_First = false;
+        return false;
+    }
+    if (!m_First && !Expect(','))
+        return false;
+
+    SkipWhitespace();
+    if (!ParseString(key) || !Expect(':'))
+        return false;
+
+    return true;
+}
+
+bool JsonReader::BeginArray()
+{
+    if (!Expect('['))
+        return false;
+
+    m_First = true;
+    return true;
+}
+
+bool JsonReader::NextElement()
+{
+    SkipWhitespace();
+    if (m_Cur < m_End && *m_Cur == ']') {
+        m_Cur++;
+        m_First = false;
+        return false;
+    }
+    if (!m_First && !Expect(','))
+        return false;
+
+    return m_Cur < m_End;
+}
+
+static void PutUTF8(std::string &out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        out.push_back((char)cp);
+    }
+    else if (cp < 0x800) {
+        out.push_back((char)(0xc0 | (cp >> 6)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    }
+    else if (cp < 0x10000) {
+        out.push_back((char)(0xe0 | (cp >> 12)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    }
+    else {
+        out.push_back((char)(0xf0 | (cp >> 18)));
+        out.push_back((char)(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    }
+}
+
+static bool ParseHex4(const char *str, uint32_t &out)
+{
+    out = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = str[i];
+        out <<= 4;
+        if (c >= '0' && c <= '9') out |= c - '0';
+        else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+        else return false;
+    }
+
+    return true;
+}
+
+bool JsonReader::ParseString(std::string_view &out)
+{
+    if (m_Cur == m_End || *m_Cur != '"')
+        return Fail("expected string");
+
+    auto start = ++m_Cur;
+    while (m_Cur < m_End && *m_Cur != '"' && *m_Cur != '\\')
+        m_Cur++;
+
+    if (m_Cur == m_End)
+        return Fail("unterminated string");
+
+    if (*m_Cur == '"') {
+        out = std::string_view(start, m_Cur - start);
+        m_Cur++;
+        return true;
+    }
+
+    // slow path, decode from the first escape on
+    m_Scratch.assign(start, m_Cur);
+    while (m_Cur < m_End && *m_Cur != '"') {
+        if (*m_Cur != '\\') {
+            m_Scratch.push_back(*m_Cur++);
+            continue;
+        }
+
+        if (++m_Cur == m_End)
+            break;
+
+        switch (*m_Cur++) {
+            case '"': m_Scratch.push_back('"'); break;
+            case '\\': m_Scratch.push_back('\\'); break;
+            case '/': m_Scratch.push_back('/'); break;
+            case 'b': m_Scratch.push_back('\b'); break;
+            case 'f': m_Scratch.push_back('\f'); break;
+            case 'n': m_Scratch.push_back('\n'); break;
+            case 'r': m_Scratch.push_back('\r'); break;
+            case 't': m_Scratch.push_back('\t'); break;
+            case 'u': {
+                uint32_t cp;
+                if (m_End - m_Cur < 4 || !ParseHex4(m_Cur, cp))
+                    return Fail("invalid unicode escape");
+                m_Cur += 4;
+
+                // surrogate pair
+                uint32_t low;
+                if (cp >= 0xd800 && cp < 0xdc00 && m_End - m_Cur >= 6 && m_Cur[0] == '\\' && m_Cur[1] == 'u' &&
+                    ParseHex4(m_Cur + 2, low) && low >= 0xdc00 && low < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    m_Cur += 6;
+                }
+
+                PutUTF8(m_Scratch, cp);
+            } break;
+            default:
+                return Fail("invalid escape");
+        }
+    }
+
+    if (m_Cur == m_End)
+        return Fail("unterminated string");
+
+    m_Cur++;
+    out = m_Scratch;
+    return true;
+}
+
+bool JsonReader::ReadString(std::string_view &out)
+{
+    SkipWhitespace();
+    if (!ParseString(out))
+        return false;
+
+    m_First = false;
+    return true;
+}
+
+bool JsonReader::ReadFloat(float &out)
+{
+    SkipWhitespace();
+
+    // json::dump writes non finite numbers as null
+    if (m_End - m_Cur >= 4 && memcmp(m_Cur, "null", 4) == 0) {
+        m_Cur += 4;
+        m_First = false;
+        out = 0.f;
+        return true;
+    }
+
+    // the document is not NUL terminated, copy the number out for strtof
+    char number[64];
+    size_t len = 0;
+    while (m_Cur + len < m_End && len < sizeof(number) - 1) {
+        char c = m_Cur[len];
+        if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        number[len++] = c;
+    }
+    number[len] = '\0';
+
+    char *end;
+    out = strtof(number, &end);
+    if (len == 0 || end != number + len)
+        return Fail("expected number");
+
+    m_Cur += len;
+    m_First = false;
+    return true;
+}
+
+bool JsonReader::ReadUInt(uint32_t &out)
+{
+    SkipWhitespace();
+
+    uint64_t value = 0;
+    auto start = m_Cur;
+    while (m_Cur < m_End && *m_Cur >= '0' && *m_Cur <= '9' && value <= UINT32_MAX)
+        value = value * 10 + (*m_Cur++ - '0');
+
+    if (m_Cur == start || value > UINT32_MAX)
+        return Fail("expected unsigned integer");
+
+    out = (uint32_t)value;
+    m_First = false;
+    return true;
+}
+
+bool JsonReader::ReadBool(bool &out)
+{
+    SkipWhitespace();
+
+    if (m_End - m_Cur >= 4 && memcmp(m_Cur, "true", 4) == 0) {
+        m_Cur += 4;
+        out = true;
+    }
+    else if (m_End - m_Cur >= 5 && memcmp(m_Cur, "false", 5) == 0) {
+        m_Cur += 5;
+        out = false;
+    }
+    else {
+        return Fail("expected boolean");
+    }
+
+    m_First = false;
+    return true;
+}
+
+bool JsonReader::ReadFloats(float *out, int count)
+{
+    if (!BeginArray())
+        return false;
+
+    int i = 0;
+    while (NextElement()) {
+        if (i < count) {
+            if (!ReadFloat(out[i++]))
+                return false;
+        }
+        else if (!Skip()) {
+            return false;
+        }
+    }
+
+    if (i != count)
+        return Fail("number array too short");
+
+    return !m_Error;
+}
+
+bool JsonReader::Skip()
+{
+    SkipWhitespace();
+    if (m_Cur == m_End)
+        return Fail("unexpected end of document");
+
+    switch (*m_Cur) {
+        case '{': {
+            BeginObject();
+            std::string_view key;
+            while (NextKey(key))
+                Skip();
+        } break;
+        case '[':
+            BeginArray();
+            while (NextElement())
+                Skip();
+            break;
+        case '"': {
+            std::string_view str;
+            ReadString(str);
+        } break;
+        case 't':
+        case 'f': {
+            bool b;
+            ReadBool(b);
+        } break;
+        default: {
+            float f;
+            ReadFloat(f);
+        } break;
+    }
+
+    return !m_Error;
+}
+
+JsonWriter::JsonWriter()
+    : m_File(nullptr), m_Buffer(JSON_WRITE_BUFFER), m_Used(0), m_Bytes(0), m_Depth(0), m_First(true), m_AfterKey(false), m_Failed(false)
+{
+}
+
+JsonWriter::~JsonWriter()
+{
+    if (m_File)
+        Close();
+}
+
+bool JsonWriter::Open(const char *path)
+{
+    m_File = fopen(path, "wb");
+    m_Used = 0;
+    m_Bytes = 0;
+    m_Depth = 0;
+    m_First = true;
+    m_AfterKey = false;
+    m_Failed = false;
+
+    return m_File != nullptr;
+}
+
+bool JsonWriter::Close()
+{
+    if (!m_File)
+        return false;
+
+    Put('\n');
+    Flush();
+
+    bool ok = fclose(m_File) == 0 && !m_Failed;
+    m_File = nullptr;
+
+    return ok;
+}
+
+void JsonWriter::Flush()
+{
+    if (m_Used && fwrite(m_Buffer.data(), 1, m_Used, m_File) != m_Used)
+        m_Failed = true;
+
+    m_Used = 0;
+}
+
+void JsonWriter::Put(const char *str, size_t len)
+{
+    m_Bytes += len;
+
+    if (m_Used + len > m_Buffer.size()) {
+        Flush();
+        if (len > m_Buffer.size()) {
+            if (fwrite(str, 1, len, m_File) != len)
+                m_Failed = true;
+            return;
+        }
+    }
+
+    memcpy(m_Buffer.data() + m_Used, str, len);
+    m_Used += len;
+}
+
+void JsonWriter::Put(char c)
+{
+    if (m_Used == m_Buffer.size())
+        Flush();
+
+    m_Buffer[m_Used++] = c;
+    m_Bytes++;
+}
+
+void JsonWriter::PutIndent()
+{
+    static const char spaces[] = "\n                                                                ";
+
+    const int width = sizeof(spaces) - 2;
+
+    Put(spaces, 1);
+    for (int indent = m_Depth * 4; indent > 0; indent -= width)
+        Put(spaces + 1, indent < width ? indent : width);
+}
+
+void JsonWriter::BeginValue()
+{
+    if (m_AfterKey) {
+        m_AfterKey = false;
+        return;
+    }
+    if (m_Depth == 0)
+        return;
+
+    if (!m_First)
+        Put(',');
+    m_First = false;
+
+    PutIndent();
+}
+
+void JsonWriter::BeginObject()
+{
+    BeginValue();
+    Put('{');
+    m_Depth++;
+    m_First = true;
+}
+
+void JsonWriter::EndObject()
+{
+    m_Depth--;
+    if (!m_First)
+        PutIndent();
+    Put('}');
+    m_First = false;
+}
+
+void JsonWriter::BeginArray()
+{
+    BeginValue();
+    Put('[');
+    m_Depth++;
+    m_First = true;
+}
+
+void JsonWriter::EndArray()
+{
+    m_Depth--;
+    if (!m_First)
+        PutIndent();
+    Put(']');
+    m_First = false;
+}
+
+void JsonWriter::Key(const char *key)
+{
+    BeginValue();
+    PutString(key);
+    Put(": ", 2);
+    m_AfterKey = true;
+}
+
+void JsonWriter::String(const char *str)
+{
+    BeginValue();
+    PutString(str);
+}
+
+void JsonWriter::PutString(const char *str)
+{
+    Put('"');
+
+    auto run = str;
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        Put(run, str - run);
+        run = str + 1;
+
+        switch (c) {
+            case '"': Put("\\\"", 2); break;
+            case '\\': Put("\\\\", 2); break;
+            case '\n': Put("\\n", 2); break;
+            case '\r': Put("\\r", 2); break;
+            case '\t': Put("\\t", 2); break;
+            default: {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                Put(escape, 6);
+            } break;
+        }
+    }
+    Put(run, str - run);
+
+    Put('"');
+}
+
+void JsonWriter::Float(float value)
+{
+    BeginValue();
+
+    if (!std::isfinite(value)) {
+        Put("null", 4);
+        return;
+    }
+
+    // 7 digits keep hand typed values like 0.1 short, 9 always read back as
+    // the same float
+    char number[32];
+    int len = snprintf(number, sizeof(number), "%.7g", value);
+    if (strtof(number, nullptr) != value)
+        len = snprintf(number, sizeof(number), "%.9g", value);
+
+    Put(number, len);
+
+    // keep it a float to anything that reads the file, like json::dump does
+    if (!strpbrk(number, ".eE"))
+        Put(".0", 2);
+}
+
+void JsonWriter::UInt(uint32_t value)
+{
+    BeginValue();
+
+    char number[16];
+    int len = snprintf(number, sizeof(number), "%u", value);
+    Put(number, len);
+}
+
+void JsonWriter::Bool(bool value)
+{
+    BeginValue();
+
+    if (value)
+        Put("true", 4);
+    else
+        Put("false", 5);
+}
+
+void JsonWriter::Floats(const float *values, int count)
+{
+    BeginArray();
+    for (int i = 0; i < count; i++)
+        Float(values[i]);
+    EndArray();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Pull parser over a JSON document that is entirely in memory, usually a
+// MappedFile. Nothing is built up, the caller walks the document and decides
+// where every value goes:
+//
+//   reader.BeginObject();
+//   while (reader.NextKey(key)) {
+//       if (key == "time") reader.ReadFloat(fx.time);
+//       else reader.Skip();
+//   }
+//
+// Strings without escapes are handed out as views into the document, the
+// rest are decoded into a scratch buffer that is valid until the next read.
+// The first error stops the parse, every call after it returns false so the
+// loops above unwind on their own.
+class JsonReader {
+public:
+    JsonReader(const char *data, size_t size);
+
+    bool BeginObject();
+    // false once the closing brace is consumed
+    bool NextKey(std::string_view &key);
+
+    bool BeginArray();
+    // false once the closing bracket is consumed
+    bool NextElement();
+
+    bool ReadString(std::string_view &out);
+    bool ReadFloat(float &out);
+    bool ReadUInt(uint32_t &out);
+    bool ReadBool(bool &out);
+    // reads a number array into `out`, extra elements are skipped
+    bool ReadFloats(float *out, int count);
+
+    bool Skip();
+
+    const char *GetError() const { return m_Error; }
+    // 1 based line of the error, or of where the reader is at
+    uint32_t GetLine() const;
+
+private:
+    bool Fail(const char *error);
+    bool Expect(char c);
+    void SkipWhitespace();
+    bool ParseString(std::string_view &out);
+
+    const char *m_Begin;
+    const char *m_Cur;
+    const char *m_End;
+
+    // set by BeginObject/BeginArray, cleared once a value in it is read
+    bool m_First;
+    const char *m_Error;
+
+    std::string m_Scratch;
+};
+
+// Streams pretty printed JSON, four space indents like json::dump(4),
+// straight to a file through a fixed size buffer.
+class JsonWriter {
+public:
+    JsonWriter();
+    ~JsonWriter();
+
+    bool Open(const char *path);
+    // flushes, false if anything failed to write
+    bool Close();
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    void Key(const char *key);
+
+    // stops at the first NUL, the editor keeps names NUL padded
+    void String(const char *str);
+    void String(const std::string &str) { String(str.c_str()); }
+    // shortest form that reads back as the same float
+    void Float(float value);
+    void UInt(uint32_t value);
+    void Bool(bool value);
+    void Floats(const float *values, int count);
+
+    uint64_t GetBytes() const { return m_Bytes; }
+
+private:
+    void BeginValue();
+    void PutString(const char *str);
+    void PutIndent();
+    void Put(const char *str, size_t len);
+    void Put(char c);
+    void Flush();
+
+    FILE *m_File;
+    std::vector<char> m_Buffer;
+    size_t m_Used;
+    uint64_t m_Bytes;
+
+    int m_Depth;
+    bool m_First;
+    bool m_AfterKey;
+    bool m_Failed;
+};
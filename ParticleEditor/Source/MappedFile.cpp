@@ -0,0 +1,117 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : m_File(INVALID_HANDLE_VALUE), m_Mapping(nullptr), m_Data(nullptr), m_Size(0)
+{
+}
+
+bool MappedFile::Open(const char *path)
+{
+    Close();
+
+    m_File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_Mapping) {
+        Close();
+        return false;
+    }
+
+    m_Data = (const uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_Data) {
+        Close();
+        return false;
+    }
+
+    m_Size = (uint64_t)size.QuadPart;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_Data)
+        UnmapViewOfFile(m_Data);
+    if (m_Mapping)
+        CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE)
+        CloseHandle(m_File);
+
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = nullptr;
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+#else
+
+MappedFile::MappedFile()
+    : m_File(-1), m_Data(nullptr), m_Size(0)
+{
+}
+
+bool MappedFile::Open(const char *path)
+{
+    Close();
+
+    m_File = open(path, O_RDONLY);
+    if (m_File < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(m_File, &info) != 0 || info.st_size == 0) {
+        Close();
+        return false;
+    }
+
+    void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, m_File, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    m_Data = (const uint8_t*)data;
+    m_Size = (uint64_t)info.st_size;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_Data)
+        munmap((void*)m_Data, (size_t)m_Size);
+    if (m_File >= 0)
+        close(m_File);
+
+    m_File = -1;
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const char *path);
+    void Close();
+
+    bool IsOpen() const { return m_Data != nullptr; }
+
+    const uint8_t *GetData() const { return m_Data; }
+    uint64_t GetSize() const { return m_Size; }
+
+private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+#ifdef _WIN32
+    void *m_File;
+    void *m_Mapping;
+#else
+    int m_File;
+#endif
+
+    const uint8_t *m_Data;
+    uint64_t m_Size;
+};
@@ -0,0 +1,672 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "ImageIO.h"
+
+// no LOD is simplified below this, a sphere has no silhouette left
+#define MESH_LOD_MIN_TRIANGLES 16
+
+// Forsyth's constants, the cache modelled while optimizing is larger than the
+// one measured against, as the paper suggests
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+float GetACMR(const uint16_t *indices, size_t count, uint32_t vertex_count, uint32_t cache_size)
+{
+    if (count < 3)
+        return 0.f;
+
+    // a FIFO evicts by the time a vertex went in, a vertex is cached while
+    // fewer than cache_size others went in after it
+    std::vector<uint32_t> entered(vertex_count, 0);
+    uint32_t time = cache_size + 1;
+    uint32_t misses = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        auto v = indices[i];
+        if (time - entered[v] > cache_size) {
+            entered[v] = time++;
+            misses++;
+        }
+    }
+
+    return misses / (float)(count / 3);
+}
+
+static float GetForsythScore(int cache_position, uint32_t remaining)
+{
+    // nothing left to draw with it
+    if (remaining == 0)
+        return -1.f;
+
+    float score = 0.f;
+    if (cache_position >= 0) {
+        // the last triangle's vertices get a fixed score so the next triangle
+        // does not just reuse the same edge over and over
+        if (cache_position < 3) {
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        }
+        else {
+            float scale = 1.f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.f - (cache_position - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+
+    // finish off vertices with few triangles left before they are evicted
+    score += FORSYTH_VALENCE_BOOST_SCALE * powf((float)remaining, -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+void OptimizeVertexCache(uint16_t *indices, size_t count, uint32_t vertex_count)
+{
+    auto triangles = count / 3;
+    if (triangles < 2)
+        return;
+
+    // triangles not emitted yet per vertex, as ranges of one array
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t i = 0; i < triangles * 3; i++)
+        remaining[indices[i]]++;
+
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (uint32_t v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<uint32_t> adjacency(triangles * 3);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangles * 3; i++)
+            adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+    }
+
+    std::vector<int> position(vertex_count, -1);
+    std::vector<float> scores(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++)
+        scores[v] = GetForsythScore(-1, remaining[v]);
+
+    std::vector<bool> emitted(triangles, false);
+    std::vector<uint16_t> output;
+    output.reserve(triangles * 3);
+
+    std::vector<uint16_t> cache;
+    std::vector<uint16_t> next;
+
+    auto get_score = [&](size_t t) {
+        return scores[indices[t * 3 + 0]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    };
+
+    int best = -1;
+    while (output.size() < triangles * 3) {
+        // nothing in the cache has a triangle left, start over at the best
+        // triangle anywhere
+        if (best < 0) {
+            float best_score = -1e30f;
+            for (size_t t = 0; t < triangles; t++) {
+                if (!emitted[t] && get_score(t) > best_score) {
+                    best_score = get_score(t);
+                    best = (int)t;
+                }
+            }
+        }
+
+        emitted[best] = true;
+
+        next.clear();
+        for (int k = 0; k < 3; k++) {
+            auto v = indices[best * 3 + k];
+            output.push_back(v);
+            next.push_back(v);
+
+            auto first = adjacency.begin() + offsets[v];
+            auto last = first + remaining[v];
+            auto it = std::find(first, last, (uint32_t)best);
+            std::iter_swap(it, last - 1);
+            remaining[v]--;
+        }
+
+        for (auto v : cache) {
+            if (std::find(next.begin(), next.begin() + 3, v) == next.begin() + 3)
+                next.push_back(v);
+        }
+
+        for (size_t i = 0; i < next.size(); i++) {
+            auto v = next[i];
+            position[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+            scores[v] = GetForsythScore(position[v], remaining[v]);
+        }
+
+        if (next.size() > FORSYTH_CACHE_SIZE)
+            next.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(next);
+
+        best = -1;
+        float best_score = -1e30f;
+        for (auto v : cache) {
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                auto t = adjacency[offsets[v] + i];
+                if (get_score(t) > best_score) {
+                    best_score = get_score(t);
+                    best = (int)t;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+struct Quadric {
+    double m_A2, m_AB, m_AC, m_AD;
+    double m_B2, m_BC, m_BD;
+    double m_C2, m_CD;
+    double m_D2;
+};
+
+static void AddQuadric(Quadric &q, const Quadric &other)
+{
+    q.m_A2 += other.m_A2; q.m_AB += other.m_AB; q.m_AC += other.m_AC; q.m_AD += other.m_AD;
+    q.m_B2 += other.m_B2; q.m_BC += other.m_BC; q.m_BD += other.m_BD;
+    q.m_C2 += other.m_C2; q.m_CD += other.m_CD;
+    q.m_D2 += other.m_D2;
+}
+
+// squared distance of `p` to every plane in the quadric, summed
+static double EvaluateQuadric(const Quadric &q, const float *p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    return q.m_A2 * x * x + q.m_B2 * y * y + q.m_C2 * z * z
+        + 2.0 * (q.m_AB * x * y + q.m_AC * x * z + q.m_BC * y * z)
+        + 2.0 * (q.m_AD * x + q.m_BD * y + q.m_CD * z)
+        + q.m_D2;
+}
+
+static void Cross(const float *a, const float *b, const float *c, float *out)
+{
+    float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    out[0] = u[1] * v[2] - u[2] * v[1];
+    out[1] = u[2] * v[0] - u[0] * v[2];
+    out[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static float Length(const float *v)
+{
+    return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+/*
+ * Half edge collapses driven by the quadric error (Garland and Heckbert) with
+ * the vertex that stays kept where it is. Vertices are welded by position
+ * first, a position with more than one vertex is on a UV seam and a position
+ * on an open edge is on a border; neither is ever collapsed away so seams and
+ * borders stay where they are.
+ */
+class MeshSimplifier {
+public:
+    MeshSimplifier(const MeshFileVertex *vertices, uint32_t vertex_count, const uint16_t *indices, uint32_t index_count)
+        : m_Vertices(vertices), m_Indices(indices, indices + index_count)
+    {
+        std::map<std::array<float, 3>, uint32_t> welded;
+        m_Welded.resize(vertex_count);
+        for (uint32_t v = 0; v < vertex_count; v++) {
+            std::array<float, 3> key = { vertices[v].m_Position[0], vertices[v].m_Position[1], vertices[v].m_Position[2] };
+            auto it = welded.insert(std::make_pair(key, v)).first;
+            m_Welded[v] = it->second;
+        }
+
+        m_Wedges.assign(vertex_count, 0);
+        for (uint32_t v = 0; v < vertex_count; v++)
+            m_Wedges[m_Welded[v]]++;
+
+        m_Quadrics.assign(vertex_count, Quadric());
+        for (size_t t = 0; t < m_Indices.size(); t += 3) {
+            auto a = GetPosition(m_Indices[t + 0]);
+            auto b = GetPosition(m_Indices[t + 1]);
+            auto c = GetPosition(m_Indices[t + 2]);
+
+            float n[3];
+            Cross(a, b, c, n);
+            float len = Length(n);
+            if (len <= 0.f)
+                continue;
+
+            // weighted by area so small triangles do not hold up collapses
+            // across large flat ones
+            double pa = n[0] / len, pb = n[1] / len, pc = n[2] / len;
+            double pd = -(pa * a[0] + pb * a[1] + pc * a[2]);
+            double w = len * 0.5;
+            Quadric plane = { w * pa * pa, w * pa * pb, w * pa * pc, w * pa * pd, w * pb * pb, w * pb * pc, w * pb * pd, w * pc * pc, w * pc * pd, w * pd * pd };
+
+            for (int k = 0; k < 3; k++)
+                AddQuadric(m_Quadrics[m_Welded[m_Indices[t + k]]], plane);
+        }
+    }
+
+    // collapses until at most `target` triangles are left or nothing can go
+    void Simplify(size_t target)
+    {
+        while (m_Indices.size() / 3 > target && Collapse());
+    }
+
+    const std::vector<uint16_t> &GetIndices() const { return m_Indices; }
+
+private:
+    struct Candidate {
+        double m_Cost;
+        uint32_t m_From;
+        uint32_t m_To;
+
+        bool operator<(const Candidate &other) const { return m_Cost < other.m_Cost; }
+    };
+
+    const float *GetPosition(uint32_t v) const { return m_Vertices[v].m_Position; }
+
+    bool Collapse()
+    {
+        // triangles around every position and how often every edge is used
+        m_Triangles.assign(m_Welded.size(), std::vector<uint32_t>());
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> edges;
+        for (uint32_t t = 0; t < m_Indices.size() / 3; t++) {
+            for (int k = 0; k < 3; k++) {
+                auto a = m_Welded[m_Indices[t * 3 + k]];
+                auto b = m_Welded[m_Indices[t * 3 + (k + 1) % 3]];
+                m_Triangles[a].push_back(t);
+                edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+            }
+        }
+
+        std::vector<bool> locked(m_Welded.size(), false);
+        for (uint32_t v = 0; v < m_Welded.size(); v++)
+            locked[v] = m_Wedges[v] > 1;
+        for (auto &edge : edges) {
+            if (edge.second != 2) {
+                locked[edge.first.first] = true;
+                locked[edge.first.second] = true;
+            }
+        }
+
+        std::vector<Candidate> candidates;
+        for (auto &edge : edges) {
+            uint32_t ends[2] = { edge.first.first, edge.first.second };
+            for (int k = 0; k < 2; k++) {
+                auto from = ends[k];
+                auto to = ends[1 - k];
+                if (locked[from])
+                    continue;
+
+                Quadric q = m_Quadrics[from];
+                AddQuadric(q, m_Quadrics[to]);
+                candidates.push_back({ EvaluateQuadric(q, GetPosition(to)), from, to });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (auto &candidate : candidates) {
+            uint16_t to;
+            if (!CanCollapse(candidate.m_From, candidate.m_To, to))
+                continue;
+
+            Apply(candidate.m_From, candidate.m_To, to);
+            AddQuadric(m_Quadrics[candidate.m_To], m_Quadrics[candidate.m_From]);
+            return true;
+        }
+
+        return false;
+    }
+
+    int FindCorner(uint32_t t, uint32_t position) const
+    {
+        for (int k = 0; k < 3; k++) {
+            if (m_Welded[m_Indices[t * 3 + k]] == position)
+                return k;
+        }
+        return -1;
+    }
+
+    // `to_vertex` is the vertex at `to` on the side of the edge `from` is on
+    bool CanCollapse(uint32_t from, uint32_t to, uint16_t &to_vertex) const
+    {
+        auto &triangles = m_Triangles[from];
+
+        std::vector<uint32_t> from_ring, to_ring;
+        for (auto t : triangles) {
+            for (int k = 0; k < 3; k++)
+                from_ring.push_back(m_Welded[m_Indices[t * 3 + k]]);
+        }
+        for (auto t : m_Triangles[to]) {
+            for (int k = 0; k < 3; k++)
+                to_ring.push_back(m_Welded[m_Indices[t * 3 + k]]);
+        }
+        std::sort(from_ring.begin(), from_ring.end());
+        from_ring.erase(std::unique(from_ring.begin(), from_ring.end()), from_ring.end());
+        std::sort(to_ring.begin(), to_ring.end());
+        to_ring.erase(std::unique(to_ring.begin(), to_ring.end()), to_ring.end());
+
+        // the only positions next to both are the two across the edge,
+        // anything else would pinch the surface
+        std::vector<uint32_t> shared;
+        std::set_intersection(from_ring.begin(), from_ring.end(), to_ring.begin(), to_ring.end(), std::back_inserter(shared));
+        if (shared.size() != 4)
+            return false;
+
+        int collapsed = 0;
+        for (auto t : triangles) {
+            int corner = FindCorner(t, to);
+            if (corner >= 0) {
+                auto vertex = m_Indices[t * 3 + corner];
+                if (collapsed++ && vertex != to_vertex)
+                    return false;
+                to_vertex = vertex;
+                continue;
+            }
+
+            // what is left around `from` must not fold over
+            const float *p[3];
+            for (int k = 0; k < 3; k++)
+                p[k] = GetPosition(m_Indices[t * 3 + k]);
+
+            float before[3], after[3];
+            Cross(p[0], p[1], p[2], before);
+            p[FindCorner(t, from)] = GetPosition(to);
+            Cross(p[0], p[1], p[2], after);
+
+            float len = Length(before) * Length(after);
+            if (len <= 0.f || (before[0] * after[0] + before[1] * after[1] + before[2] * after[2]) / len < 0.5f)
+                return false;
+        }
+
+        return collapsed == 2;
+    }
+
+    void Apply(uint32_t from, uint32_t to, uint16_t to_vertex)
+    {
+        std::vector<bool> removed(m_Indices.size() / 3, false);
+        for (auto t : m_Triangles[from]) {
+            if (FindCorner(t, to) >= 0)
+                removed[t] = true;
+            else
+                m_Indices[t * 3 + FindCorner(t, from)] = to_vertex;
+        }
+
+        size_t written = 0;
+        for (size_t t = 0; t < removed.size(); t++) {
+            if (removed[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+                m_Indices[written++] = m_Indices[t * 3 + k];
+        }
+        m_Indices.resize(written);
+    }
+
+    const MeshFileVertex *m_Vertices;
+    std::vector<uint16_t> m_Indices;
+
+    // first vertex at the same position, and how many share it
+    std::vector<uint32_t> m_Welded;
+    std::vector<uint32_t> m_Wedges;
+    std::vector<Quadric> m_Quadrics;
+    std::vector<std::vector<uint32_t>> m_Triangles;
+};
+
+// closest point on the triangle abc to p, Ericson, "Real-Time Collision
+// Detection" 5.1.5
+static float GetDistance(const float *p, const float *a, const float *b, const float *c)
+{
+    auto dot = [](const float *u, const float *v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; };
+
+    float ab[3], ac[3], ap[3], bp[3], cp[3];
+    for (int k = 0; k < 3; k++) {
+        ab[k] = b[k] - a[k];
+        ac[k] = c[k] - a[k];
+        ap[k] = p[k] - a[k];
+        bp[k] = p[k] - b[k];
+        cp[k] = p[k] - c[k];
+    }
+
+    float q[3];
+    auto closest = [&](const float *origin, float s, const float *u, float t, const float *v) {
+        for (int k = 0; k < 3; k++)
+            q[k] = origin[k] + s * u[k] + t * v[k];
+        float d[3] = { p[0] - q[0], p[1] - q[1], p[2] - q[2] };
+        return Length(d);
+    };
+
+    float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0.f && d2 <= 0.f)
+        return Length(ap);
+
+    float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0.f && d4 <= d3)
+        return Length(bp);
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+        return closest(a, d1 / (d1 - d3), ab, 0.f, ac);
+
+    float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0.f && d5 <= d6)
+        return Length(cp);
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+        return closest(a, 0.f, ab, d2 / (d2 - d6), ac);
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f) {
+        float bc[3] = { c[0] - b[0], c[1] - b[1], c[2] - b[2] };
+        return closest(b, (d4 - d3) / ((d4 - d3) + (d5 - d6)), bc, 0.f, bc);
+    }
+
+    float denom = 1.f / (va + vb + vc);
+    return closest(a, vb * denom, ab, vc * denom, ac);
+}
+
+// largest distance from any point of `from` (corners, edge midpoints and
+// centers of its triangles) to the surface of `to`
+static float GetDeviation(const MeshFileVertex *vertices, const std::vector<uint16_t> &from, const std::vector<uint16_t> &to)
+{
+    float worst = 0.f;
+    for (size_t t = 0; t < from.size(); t += 3) {
+        const float *corner[3] = { vertices[from[t]].m_Position, vertices[from[t + 1]].m_Position, vertices[from[t + 2]].m_Position };
+
+        float samples[7][3];
+        for (int k = 0; k < 3; k++) {
+            for (int c = 0; c < 3; c++) {
+                samples[k][c] = corner[k][c];
+                samples[3 + k][c] = (corner[k][c] + corner[(k + 1) % 3][c]) * 0.5f;
+            }
+        }
+        for (int c = 0; c < 3; c++)
+            samples[6][c] = (corner[0][c] + corner[1][c] + corner[2][c]) / 3.f;
+
+        for (auto &sample : samples) {
+            float nearest = FLT_MAX;
+            for (size_t u = 0; u < to.size() && nearest > worst; u += 3)
+                nearest = std::min(nearest, GetDistance(sample, vertices[to[u]].m_Position, vertices[to[u + 1]].m_Position, vertices[to[u + 2]].m_Position));
+            worst = std::max(worst, nearest);
+        }
+    }
+
+    return worst;
+}
+
+static int8_t QuantizeSNorm(float value)
+{
+    return (int8_t)lroundf(std::max(-1.f, std::min(1.f, value)) * 127.f);
+}
+
+// appends `indices` (into the source vertices) as the next LOD
+static bool AddLOD(Mesh &mesh, std::vector<uint16_t> indices, float error)
+{
+    MeshLOD lod = {};
+    lod.m_StartIndex = (uint32_t)mesh.m_Indices.size();
+    lod.m_IndexCount = (uint32_t)indices.size();
+    lod.m_Error = error;
+    lod.m_ACMRBefore = GetACMR(indices.data(), indices.size(), mesh.m_SourceVertexCount);
+
+    OptimizeVertexCache(indices.data(), indices.size(), mesh.m_SourceVertexCount);
+    lod.m_ACMRAfter = GetACMR(indices.data(), indices.size(), mesh.m_SourceVertexCount);
+
+    // vertices in the order the triangles first use them, fetches then walk
+    // the vertex buffer front to back
+    std::vector<uint32_t> remap(mesh.m_SourceVertexCount, UINT32_MAX);
+    std::vector<uint32_t> order;
+    for (auto &index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = (uint32_t)(mesh.m_Vertices.size() + order.size());
+            order.push_back(index);
+        }
+        index = (uint16_t)remap[index];
+    }
+
+    if (mesh.m_Vertices.size() + order.size() > UINT16_MAX)
+        return false;
+
+    for (auto v : order) {
+        auto &src = mesh.m_SourceVertices[v];
+
+        float len = Length(src.m_Normal);
+        float scale = len > 0.f ? 1.f / len : 0.f;
+
+        MeshVertex vertex;
+        for (int k = 0; k < 3; k++) {
+            vertex.m_Position[k] = FloatToHalf(src.m_Position[k]);
+            vertex.m_Normal[k] = QuantizeSNorm(src.m_Normal[k] * scale);
+        }
+        vertex.m_Position[3] = FloatToHalf(1.f);
+        vertex.m_Normal[3] = 0;
+        vertex.m_UV[0] = FloatToHalf(src.m_UV[0]);
+        vertex.m_UV[1] = FloatToHalf(src.m_UV[1]);
+        mesh.m_Vertices.push_back(vertex);
+    }
+
+    lod.m_VertexCount = (uint32_t)order.size();
+    mesh.m_Indices.insert(mesh.m_Indices.end(), indices.begin(), indices.end());
+    mesh.m_LODs.push_back(lod);
+
+    return true;
+}
+
+MeshCache::MeshCache(RenderBackend *backend)
+    : m_Backend(backend)
+{
+}
+
+MeshCache::~MeshCache()
+{
+    for (auto &mesh : m_Meshes)
+        delete mesh.second;
+}
+
+const Mesh *MeshCache::Load(const char *path)
+{
+    auto cached = m_Meshes.find(path);
+    if (cached != m_Meshes.end())
+        return cached->second;
+
+    auto timer = std::chrono::high_resolution_clock::now();
+
+    auto mesh = new Mesh();
+    mesh->m_Path = path;
+
+    // u32 vertex count, u32 index count, the vertices, u16 indices
+    auto &file = mesh->m_File;
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    if (!file.Open(path) || file.GetSize() < 2 * sizeof(uint32_t)) {
+        delete mesh;
+        return nullptr;
+    }
+
+    memcpy(&vertex_count, file.GetData(), sizeof(uint32_t));
+    memcpy(&index_count, file.GetData() + sizeof(uint32_t), sizeof(uint32_t));
+
+    uint64_t size = 2 * sizeof(uint32_t) + (uint64_t)vertex_count * sizeof(MeshFileVertex) + (uint64_t)index_count * sizeof(uint16_t);
+    if (!vertex_count || !index_count || index_count % 3 || vertex_count > UINT16_MAX || file.GetSize() < size) {
+        delete mesh;
+        return nullptr;
+    }
+
+    mesh->m_SourceVertices = (const MeshFileVertex*)(file.GetData() + 2 * sizeof(uint32_t));
+    mesh->m_SourceIndices = (const uint16_t*)(mesh->m_SourceVertices + vertex_count);
+    mesh->m_SourceVertexCount = vertex_count;
+    mesh->m_SourceIndexCount = index_count;
+
+    for (uint32_t i = 0; i < index_count; i++) {
+        if (mesh->m_SourceIndices[i] >= vertex_count) {
+            delete mesh;
+            return nullptr;
+        }
+    }
+
+    mesh->m_Radius = 0.f;
+    for (uint32_t v = 0; v < vertex_count; v++)
+        mesh->m_Radius = std::max(mesh->m_Radius, Length(mesh->m_SourceVertices[v].m_Position));
+
+    std::vector<uint16_t> indices(mesh->m_SourceIndices, mesh->m_SourceIndices + index_count);
+    AddLOD(*mesh, indices, 0.f);
+
+    // every LOD goes on from the one before with half the triangles, the
+    // quadrics carry over and no LOD claims less error than the one before
+    MeshSimplifier simplifier(mesh->m_SourceVertices, vertex_count, mesh->m_SourceIndices, index_count);
+    auto triangles = index_count / 3;
+    float error = 0.f;
+    while (mesh->m_LODs.size() < MESH_LOD_MAX) {
+        triangles /= 2;
+        if (triangles < MESH_LOD_MIN_TRIANGLES)
+            break;
+
+        auto before = simplifier.GetIndices().size();
+        simplifier.Simplify(triangles);
+        if (simplifier.GetIndices().size() == before)
+            break;
+
+        // both ways, the LOD cuts inside the full mesh and the corners it
+        // kept stick out of what is left around them
+        auto &lod_indices = simplifier.GetIndices();
+        float deviation = std::max(GetDeviation(mesh->m_SourceVertices, indices, lod_indices), GetDeviation(mesh->m_SourceVertices, lod_indices, indices));
+        error = std::max(error, mesh->m_Radius > 0.f ? deviation / mesh->m_Radius : 0.f);
+        if (!AddLOD(*mesh, lod_indices, error))
+            break;
+
+        // stuck on seams and borders
+        if (simplifier.GetIndices().size() / 3 > triangles)
+            break;
+    }
+
+    mesh->m_VertexBuffer = INVALID_RENDER_BUFFER;
+    mesh->m_IndexBuffer = INVALID_RENDER_BUFFER;
+    if (m_Backend) {
+        mesh->m_VertexBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Immutable, sizeof(MeshVertex), (uint32_t)mesh->m_Vertices.size(), mesh->m_Vertices.data());
+        mesh->m_IndexBuffer = m_Backend->CreateBuffer(RenderBufferType::Index, RenderBufferUsage::Immutable, sizeof(uint16_t), (uint32_t)mesh->m_Indices.size(), mesh->m_Indices.data());
+    }
+
+    mesh->m_BuildMs = ElapsedMs(timer);
+    m_Meshes[path] = mesh;
+
+    return mesh;
+}
+
+uint32_t MeshCache::PickLOD(const Mesh &mesh, float size, float tolerance)
+{
+    uint32_t lod = 0;
+    while (lod + 1 < mesh.m_LODs.size() && mesh.m_LODs[lod + 1].m_Error * size <= tolerance)
+        lod++;
+
+    return lod;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "RenderBackend.h"
+
+#define MESH_LOD_MAX 4
+// post transform cache the ACMR numbers are measured against, a FIFO of this
+// many vertices is what most hardware behaves like at worst
+#define MESH_MEASURE_CACHE_SIZE 16
+
+// .dat vertex, what the file stores
+struct MeshFileVertex {
+    float m_Position[3];
+    float m_Normal[3];
+    float m_UV[2];
+};
+
+// What the GPU reads: half position (w is 1), snorm normal, half uv. Half of
+// MeshFileVertex, bind with MESH_VERTEX_ELEMENTS.
+struct MeshVertex {
+    uint16_t m_Position[4];
+    int8_t m_Normal[4];
+    uint16_t m_UV[2];
+};
+static_assert(sizeof(MeshVertex) == 16, "mesh vertex layout must match MESH_VERTEX_ELEMENTS");
+
+#define MESH_VERTEX_ELEMENTS \
+    { "POSITION", 0, RenderFormat::R16G16B16A16Float, 0, false }, \
+    { "NORMAL",   0, RenderFormat::R8G8B8A8SNorm,     0, false }, \
+    { "TEXCOORD", 0, RenderFormat::R16G16Float,       0, false }
+
+struct MeshLOD {
+    // into the mesh index buffer, the indices are absolute so every LOD draws
+    // from the shared vertex buffer with a base vertex of 0
+    uint32_t m_StartIndex;
+    uint32_t m_IndexCount;
+    uint32_t m_VertexCount;
+
+    // how far the surface may be from the full mesh, over the mesh radius
+    float m_Error;
+
+    // vertices transformed per triangle, in the order the LOD came out of
+    // simplification and after vertex cache optimization
+    float m_ACMRBefore;
+    float m_ACMRAfter;
+};
+
+struct Mesh {
+    std::string m_Path;
+    MappedFile m_File;
+
+    // point into the mapping, LOD 0 exactly as stored
+    const MeshFileVertex *m_SourceVertices;
+    const uint16_t *m_SourceIndices;
+    uint32_t m_SourceVertexCount;
+    uint32_t m_SourceIndexCount;
+
+    // around the origin
+    float m_Radius;
+
+    // every LOD, finest first
+    std::vector<MeshLOD> m_LODs;
+    std::vector<MeshVertex> m_Vertices;
+    std::vector<uint16_t> m_Indices;
+
+    RenderBufferID m_VertexBuffer;
+    RenderBufferID m_IndexBuffer;
+
+    float m_BuildMs;
+};
+
+// Instances drawn per LOD and the vertex shader invocations that took, next
+// to what drawing all of them at LOD 0 in file order would have taken.
+struct MeshLODStats {
+    uint32_t m_Instances[MESH_LOD_MAX];
+    uint64_t m_Vertices;
+    uint64_t m_BaselineVertices;
+};
+
+/*
+ * Meshes by path. The first Load of a file maps it, builds the LOD chain and
+ * uploads one vertex and one index buffer holding every LOD, later loads hand
+ * back the same Mesh so everything drawing it shares the buffers.
+ *
+ * LODs are made by collapsing edges onto existing vertices in order of their
+ * quadric error, so the coarse LODs keep the UVs of the full mesh. Every LOD
+ * then has its triangles reordered for the post transform cache and its
+ * vertices for fetch.
+ */
+class MeshCache {
+public:
+    // without a backend nothing is uploaded and the buffers stay invalid
+    MeshCache(RenderBackend *backend);
+    ~MeshCache();
+
+    // null if the file is missing or not a .dat mesh
+    const Mesh *Load(const char *path);
+
+    // coarsest LOD of `mesh` whose error stays under `tolerance` when the mesh
+    // covers `size` (radius over screen height)
+    static uint32_t PickLOD(const Mesh &mesh, float size, float tolerance);
+
+private:
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    RenderBackend *m_Backend;
+    std::map<std::string, Mesh*> m_Meshes;
+};
+
+// average cache miss ratio of a triangle list with a FIFO cache
+float GetACMR(const uint16_t *indices, size_t count, uint32_t vertex_count, uint32_t cache_size = MESH_MEASURE_CACHE_SIZE);
+
+// reorders the triangles of `indices` for the post transform cache (Forsyth,
+// "Linear-Speed Vertex Cache Optimisation")
+void OptimizeVertexCache(uint16_t *indices, size_t count, uint32_t vertex_count);
@@ -0,0 +1,540 @@
+#include "PartPackage.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const char PART_MAGIC[4] = { 'p', 'a', 'r', 't' };
+
+uint32_t PartPackageHash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint64_t AlignUp(uint64_t value)
+{
+    return (value + PART_PACKAGE_ALIGNMENT - 1) & ~(uint64_t)(PART_PACKAGE_ALIGNMENT - 1);
+}
+
+static uint32_t GetNameIndexSize(uint32_t effects)
+{
+    // at most half full, so probes stay short
+    uint32_t size = 4;
+    while (size < effects * 2)
+        size *= 2;
+
+    return size;
+}
+
+PartPackageWriter::PartPackageWriter()
+{
+    // offset 0 is the empty string
+    m_Strings.push_back('\0');
+}
+
+uint32_t PartPackageWriter::AddString(const char *str)
+{
+    auto offset = (uint32_t)m_Strings.size();
+    m_Strings.insert(m_Strings.end(), str, str + strlen(str) + 1);
+
+    return offset;
+}
+
+uint32_t PartPackageWriter::AddAtlas(const char *path, uint32_t width, uint32_t height)
+{
+    PartAtlas atlas = {};
+    atlas.m_Path = AddString(path);
+    atlas.m_Width = width;
+    atlas.m_Height = height;
+    m_Atlases.push_back(atlas);
+
+    return (uint32_t)m_Atlases.size() - 1;
+}
+
+uint32_t PartPackageWriter::AddTexture(const char *path, int32_t atlas, const float *rect)
+{
+    PartTexture texture = {};
+    texture.m_Path = AddString(path);
+    texture.m_Atlas = rect ? atlas : -1;
+    if (rect)
+        texture.m_AtlasRect = XMFLOAT4(rect);
+    m_Textures.push_back(texture);
+
+    return (uint32_t)m_Textures.size() - 1;
+}
+
+uint32_t PartPackageWriter::AddMaterial(const char *shader)
+{
+    PartMaterial material = {};
+    material.m_Shader = AddString(shader);
+    m_Materials.push_back(material);
+
+    return (uint32_t)m_Materials.size() - 1;
+}
+
+uint32_t PartPackageWriter::AddGeometry(const GeometryParticleDefinition &def, int32_t material)
+{
+    PartGeometry geometry = {};
+    geometry.m_Name = AddString(def.name.c_str());
+    geometry.m_Material = material;
+    geometry.m_Lifetime = def.lifetime;
+    geometry.m_Gravity = def.m_Gravity;
+    geometry.m_NoiseScale = def.m_NoiseScale;
+    geometry.m_NoiseSpeed = def.m_NoiseSpeed;
+    geometry.m_DeformSpeed = def.m_DeformSpeed;
+    geometry.m_DeformEasing = def.m_DeformEasing;
+    geometry.m_DeformStart = def.m_DeformFactorStart;
+    geometry.m_DeformEnd = def.m_DeformFactorEnd;
+    geometry.m_SizeEasing = def.m_SizeEasing;
+    geometry.m_SizeStart = def.m_SizeStart;
+    geometry.m_SizeEnd = def.m_SizeEnd;
+    geometry.m_ColorEasing = def.m_ColorEasing;
+    geometry.m_ColorStart = def.m_ColorStart;
+    geometry.m_ColorEnd = def.m_ColorEnd;
+    geometry.m_LightColorEasing = def.m_LightColorEasing;
+    geometry.m_LightColorStart = def.m_LightColorStart;
+    geometry.m_LightColorEnd = def.m_LightColorEnd;
+    geometry.m_LightRadiusEasing = def.m_LightRadiusEasing;
+    geometry.m_LightRadiusStart = def.m_LightRadiusStart;
+    geometry.m_LightRadiusEnd = def.m_LightRadiusEnd;
+    m_Geometry.push_back(geometry);
+
+    return (uint32_t)m_Geometry.size() - 1;
+}
+
+uint32_t PartPackageWriter::AddEffect(const ParticleEffect &fx, const int32_t *definitions)
+{
+    PartEffect effect = {};
+    effect.m_Name = AddString(fx.name);
+    effect.m_FirstEntry = (uint32_t)m_Entries.size();
+    effect.m_EntryCount = fx.m_Count;
+    effect.m_Time = fx.time;
+    effect.m_Loop = fx.loop;
+    effect.m_Anchor = fx.anchor;
+    effect.m_LightRadius = fx.light.m_LightRadius;
+    effect.m_LightColor = fx.light.m_LightColor;
+    m_Effects.push_back(effect);
+
+    for (unsigned i = 0; i < fx.m_Count; i++) {
+        auto &entry = fx.m_Entries[i];
+
+        PartEntry part = {};
+        part.m_Type = entry.type;
+        part.m_Definition = definitions[i];
+        part.m_Start = entry.start;
+        part.m_Time = entry.time;
+        part.m_Loop = entry.m_Loop;
+        part.m_Anchor = entry.m_Anchor;
+        part.m_StartPositionMin = entry.m_StartPosition.m_Min;
+        part.m_StartPositionMax = entry.m_StartPosition.m_Max;
+        part.m_StartVelocityMin = entry.m_StartVelocity.m_Min;
+        part.m_StartVelocityMax = entry.m_StartVelocity.m_Max;
+        part.m_SpawnEasing = entry.m_SpawnEasing;
+        part.m_SpawnStart = entry.m_SpawnStart;
+        part.m_SpawnEnd = entry.m_SpawnEnd;
+        part.m_RotLimitMin = entry.m_RotLimitMin;
+        part.m_RotLimitMax = entry.m_RotLimitMax;
+        part.m_RotSpeedMin = entry.m_RotSpeedMin;
+        part.m_RotSpeedMax = entry.m_RotSpeedMax;
+        part.m_InheritVelocity = entry.m_InheritVelocity;
+        part.m_LODEasing = entry.m_LODEasing;
+        part.m_LODScreenSize = entry.m_LODScreenSize;
+        part.m_LODMinFactor = entry.m_LODMinFactor;
+        m_Entries.push_back(part);
+    }
+
+    return (uint32_t)m_Effects.size() - 1;
+}
+
+bool PartPackageWriter::Write(const char *path) const
+{
+    // effect names go into the index, a name that is already there keeps
+    // pointing at the first effect with it
+    auto index_size = GetNameIndexSize((uint32_t)m_Effects.size());
+    std::vector<uint32_t> index(index_size, 0);
+    for (uint32_t i = 0; i < m_Effects.size(); i++) {
+        auto name = &m_Strings[m_Effects[i].m_Name];
+        auto slot = PartPackageHash(name) & (index_size - 1);
+        while (index[slot] && strcmp(&m_Strings[m_Effects[index[slot] - 1].m_Name], name) != 0)
+            slot = (slot + 1) & (index_size - 1);
+        if (!index[slot])
+            index[slot] = i + 1;
+    }
+
+    struct Blob {
+        PartSection type;
+        uint32_t count;
+        const void *data;
+        uint64_t size;
+    };
+
+    Blob blobs[] = {
+        { PartSection::Strings,   (uint32_t)m_Strings.size(),   m_Strings.data(),   m_Strings.size() },
+        { PartSection::Textures,  (uint32_t)m_Textures.size(),  m_Textures.data(),  m_Textures.size() * sizeof(PartTexture) },
+        { PartSection::Atlases,   (uint32_t)m_Atlases.size(),   m_Atlases.data(),   m_Atlases.size() * sizeof(PartAtlas) },
+        { PartSection::Materials, (uint32_t)m_Materials.size(), m_Materials.data(), m_Materials.size() * sizeof(PartMaterial) },
+        { PartSection::Geometry,  (uint32_t)m_Geometry.size(),  m_Geometry.data(),  m_Geometry.size() * sizeof(PartGeometry) },
+        { PartSection::Effects,   (uint32_t)m_Effects.size(),   m_Effects.data(),   m_Effects.size() * sizeof(PartEffect) },
+        { PartSection::Entries,   (uint32_t)m_Entries.size(),   m_Entries.data(),   m_Entries.size() * sizeof(PartEntry) },
+        { PartSection::NameIndex, index_size,                   index.data(),       index.size() * sizeof(uint32_t) },
+    };
+    const uint32_t section_count = sizeof(blobs) / sizeof(blobs[0]);
+
+    PartPackageHeader header = {};
+    memcpy(header.m_Magic, PART_MAGIC, sizeof(PART_MAGIC));
+    header.m_Version = PART_PACKAGE_VERSION;
+    header.m_SectionCount = section_count;
+
+    PartPackageSection sections[section_count] = {};
+    uint64_t offset = AlignUp(sizeof(header) + sizeof(sections));
+    for (uint32_t i = 0; i < section_count; i++) {
+        sections[i].m_Type = blobs[i].type;
+        sections[i].m_Count = blobs[i].count;
+        sections[i].m_Offset = offset;
+        sections[i].m_Size = blobs[i].size;
+        offset = AlignUp(offset + blobs[i].size);
+    }
+    header.m_FileSize = offset;
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    static const uint8_t zeros[PART_PACKAGE_ALIGNMENT] = {};
+    uint64_t written = 0;
+    auto write = [&](const void *data, uint64_t size) {
+        if (size && fwrite(data, 1, (size_t)size, f) != size)
+            return false;
+        written += size;
+        return true;
+    };
+    auto pad = [&]() {
+        return write(zeros, AlignUp(written) - written);
+    };
+
+    bool ok = write(&header, sizeof(header)) && write(sections, sizeof(sections)) && pad();
+    for (uint32_t i = 0; ok && i < section_count; i++)
+        ok = write(blobs[i].data, blobs[i].size) && pad();
+
+    ok = fclose(f) == 0 && ok;
+
+    return ok;
+}
+
+static bool Fail(std::string *error, const char *reason)
+{
+    if (error)
+        *error = reason;
+
+    return false;
+}
+
+// Section table lookup shared by the validator and the reader, checks only
+// what is needed to touch the section at all.
+static const PartPackageSection *FindSection(const uint8_t *data, uint64_t size, PartSection type, size_t element, std::string *error)
+{
+    auto header = (const PartPackageHeader*)data;
+    auto sections = (const PartPackageSection*)(data + sizeof(PartPackageHeader));
+
+    for (uint32_t i = 0; i < header->m_SectionCount; i++) {
+        auto &section = sections[i];
+        if (section.m_Type != type)
+            continue;
+
+        if (section.m_Offset % PART_PACKAGE_ALIGNMENT != 0) {
+            Fail(error, "section is not 16 byte aligned");
+            return nullptr;
+        }
+        if (section.m_Offset > size || section.m_Size > size - section.m_Offset) {
+            Fail(error, "section out of bounds");
+            return nullptr;
+        }
+        if (section.m_Size != (uint64_t)section.m_Count * element) {
+            Fail(error, "section size does not match its count");
+            return nullptr;
+        }
+
+        return &section;
+    }
+
+    Fail(error, "section missing");
+    return nullptr;
+}
+
+static bool CheckHeader(const uint8_t *data, uint64_t size, std::string *error)
+{
+    if (size < sizeof(PartPackageHeader))
+        return Fail(error, "file too small");
+
+    auto header = (const PartPackageHeader*)data;
+    if (memcmp(header->m_Magic, PART_MAGIC, sizeof(PART_MAGIC)) != 0)
+        return Fail(error, "not a part package");
+    if (header->m_Version != PART_PACKAGE_VERSION)
+        return Fail(error, "unsupported version");
+    if (header->m_FileSize != size)
+        return Fail(error, "file size does not match the header");
+    if (header->m_SectionCount > (size - sizeof(PartPackageHeader)) / sizeof(PartPackageSection))
+        return Fail(error, "section table out of bounds");
+
+    return true;
+}
+
+bool ValidatePartPackage(const uint8_t *data, uint64_t size, std::string *error)
+{
+    if (!CheckHeader(data, size, error))
+        return false;
+
+    const PartPackageSection *strings, *textures, *atlases, *materials, *geometry, *effects, *entries, *index;
+    if (!(strings = FindSection(data, size, PartSection::Strings, 1, error)) ||
+        !(textures = FindSection(data, size, PartSection::Textures, sizeof(PartTexture), error)) ||
+        !(atlases = FindSection(data, size, PartSection::Atlases, sizeof(PartAtlas), error)) ||
+        !(materials = FindSection(data, size, PartSection::Materials, sizeof(PartMaterial), error)) ||
+        !(geometry = FindSection(data, size, PartSection::Geometry, sizeof(PartGeometry), error)) ||
+        !(effects = FindSection(data, size, PartSection::Effects, sizeof(PartEffect), error)) ||
+        !(entries = FindSection(data, size, PartSection::Entries, sizeof(PartEntry), error)) ||
+        !(index = FindSection(data, size, PartSection::NameIndex, sizeof(uint32_t), error)))
+        return false;
+
+    auto string_data = (const char*)(data + strings->m_Offset);
+    auto string_size = strings->m_Size;
+    if (string_size == 0 || string_data[string_size - 1] != '\0')
+        return Fail(error, "string table is not terminated");
+
+    auto check_string = [&](uint32_t offset) { return offset < string_size; };
+
+    auto atlas_data = (const PartAtlas*)(data + atlases->m_Offset);
+    for (uint32_t i = 0; i < atlases->m_Count; i++) {
+        if (!check_string(atlas_data[i].m_Path))
+            return Fail(error, "atlas path out of bounds");
+    }
+
+    auto texture_data = (const PartTexture*)(data + textures->m_Offset);
+    for (uint32_t i = 0; i < textures->m_Count; i++) {
+        auto &texture = texture_data[i];
+        if (!check_string(texture.m_Path))
+            return Fail(error, "texture path out of bounds");
+        if (texture.m_Atlas < -1 || texture.m_Atlas >= (int32_t)atlases->m_Count)
+            return Fail(error, "texture atlas out of range");
+
+        auto &rect = texture.m_AtlasRect;
+        if (texture.m_Atlas >= 0 && !(rect.x >= 0.f && rect.y >= 0.f && rect.z <= 1.f && rect.w <= 1.f && rect.x < rect.z && rect.y < rect.w))
+            return Fail(error, "texture atlas rect out of range");
+    }
+
+    auto material_data = (const PartMaterial*)(data + materials->m_Offset);
+    for (uint32_t i = 0; i < materials->m_Count; i++) {
+        if (!check_string(material_data[i].m_Shader))
+            return Fail(error, "material shader out of bounds");
+    }
+
+    auto geometry_data = (const PartGeometry*)(data + geometry->m_Offset);
+    for (uint32_t i = 0; i < geometry->m_Count; i++) {
+        auto &def = geometry_data[i];
+        if (!check_string(def.m_Name))
+            return Fail(error, "geometry name out of bounds");
+        if (def.m_Material < -1 || def.m_Material >= (int32_t)materials->m_Count)
+            return Fail(error, "geometry material out of range");
+        if ((uint32_t)def.m_SizeEasing >= (uint32_t)ParticleEase::None ||
+            (uint32_t)def.m_DeformEasing >= (uint32_t)ParticleEase::None ||
+            (uint32_t)def.m_ColorEasing >= (uint32_t)ParticleEase::None ||
+            (uint32_t)def.m_LightColorEasing >= (uint32_t)ParticleEase::None ||
+            (uint32_t)def.m_LightRadiusEasing >= (uint32_t)ParticleEase::None)
+            return Fail(error, "geometry easing out of range");
+    }
+
+    auto entry_data = (const PartEntry*)(data + entries->m_Offset);
+    for (uint32_t i = 0; i < entries->m_Count; i++) {
+        auto &entry = entry_data[i];
+        if ((uint32_t)entry.m_Type > (uint32_t)ParticleType::Geometry)
+            return Fail(error, "entry type out of range");
+        if (entry.m_Type == ParticleType::Geometry && (entry.m_Definition < 0 || entry.m_Definition >= (int32_t)geometry->m_Count))
+            return Fail(error, "entry definition out of range");
+        if ((uint32_t)entry.m_SpawnEasing >= (uint32_t)ParticleEase::None || (uint32_t)entry.m_LODEasing >= (uint32_t)ParticleEase::None)
+            return Fail(error, "entry easing out of range");
+    }
+
+    auto effect_data = (const PartEffect*)(data + effects->m_Offset);
+    for (uint32_t i = 0; i < effects->m_Count; i++) {
+        auto &fx = effect_data[i];
+        if (!check_string(fx.m_Name))
+            return Fail(error, "effect name out of bounds");
+        if (fx.m_FirstEntry > entries->m_Count || fx.m_EntryCount > entries->m_Count - fx.m_FirstEntry)
+            return Fail(error, "effect entries out of range");
+    }
+
+    auto slots = (const uint32_t*)(data + index->m_Offset);
+    auto slot_count = index->m_Count;
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 || slot_count < effects->m_Count)
+        return Fail(error, "name index size is not a power of two");
+
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (slots[i] > effects->m_Count)
+            return Fail(error, "name index slot out of range");
+        used += slots[i] != 0;
+    }
+    if (used == slot_count)
+        return Fail(error, "name index is full");
+
+    // every effect must be reachable, either itself or an earlier effect
+    // with the same name
+    for (uint32_t i = 0; i < effects->m_Count; i++) {
+        auto name = string_data + effect_data[i].m_Name;
+        auto slot = PartPackageHash(name) & (slot_count - 1);
+        while (slots[slot] && strcmp(string_data + effect_data[slots[slot] - 1].m_Name, name) != 0)
+            slot = (slot + 1) & (slot_count - 1);
+        if (!slots[slot] || slots[slot] - 1 > i)
+            return Fail(error, "effect missing from the name index");
+    }
+
+    return true;
+}
+
+PartPackage::PartPackage()
+    : m_Strings(nullptr), m_Textures(nullptr), m_Atlases(nullptr), m_Materials(nullptr), m_Geometry(nullptr),
+      m_Effects(nullptr), m_Entries(nullptr), m_NameIndex(nullptr),
+      m_TextureCount(0), m_AtlasCount(0), m_MaterialCount(0), m_GeometryCount(0), m_EffectCount(0), m_NameIndexSize(0)
+{
+}
+
+bool PartPackage::Open(const char *path)
+{
+    Close();
+
+    if (!m_File.Open(path))
+        return false;
+
+    auto data = m_File.GetData();
+    auto size = m_File.GetSize();
+
+    const PartPackageSection *strings, *textures, *atlases, *materials, *geometry, *effects, *entries, *index;
+    if (!CheckHeader(data, size, nullptr) ||
+        !(strings = FindSection(data, size, PartSection::Strings, 1, nullptr)) ||
+        !(textures = FindSection(data, size, PartSection::Textures, sizeof(PartTexture), nullptr)) ||
+        !(atlases = FindSection(data, size, PartSection::Atlases, sizeof(PartAtlas), nullptr)) ||
+        !(materials = FindSection(data, size, PartSection::Materials, sizeof(PartMaterial), nullptr)) ||
+        !(geometry = FindSection(data, size, PartSection::Geometry, sizeof(PartGeometry), nullptr)) ||
+        !(effects = FindSection(data, size, PartSection::Effects, sizeof(PartEffect), nullptr)) ||
+        !(entries = FindSection(data, size, PartSection::Entries, sizeof(PartEntry), nullptr)) ||
+        !(index = FindSection(data, size, PartSection::NameIndex, sizeof(uint32_t), nullptr)) ||
+        index->m_Count == 0 || (index->m_Count & (index->m_Count - 1)) != 0) {
+        Close();
+        return false;
+    }
+
+    m_Strings = (const char*)(data + strings->m_Offset);
+    m_Textures = (const PartTexture*)(data + textures->m_Offset);
+    m_Atlases = (const PartAtlas*)(data + atlases->m_Offset);
+    m_Materials = (const PartMaterial*)(data + materials->m_Offset);
+    m_Geometry = (const PartGeometry*)(data + geometry->m_Offset);
+    m_Effects = (const PartEffect*)(data + effects->m_Offset);
+    m_Entries = (const PartEntry*)(data + entries->m_Offset);
+    m_NameIndex = (const uint32_t*)(data + index->m_Offset);
+
+    m_TextureCount = textures->m_Count;
+    m_AtlasCount = atlases->m_Count;
+    m_MaterialCount = materials->m_Count;
+    m_GeometryCount = geometry->m_Count;
+    m_EffectCount = effects->m_Count;
+    m_NameIndexSize = index->m_Count;
+
+    return true;
+}
+
+void PartPackage::Close()
+{
+    m_File.Close();
+
+    m_Strings = nullptr;
+    m_Textures = nullptr;
+    m_Atlases = nullptr;
+    m_Materials = nullptr;
+    m_Geometry = nullptr;
+    m_Effects = nullptr;
+    m_Entries = nullptr;
+    m_NameIndex = nullptr;
+
+    m_TextureCount = m_AtlasCount = m_MaterialCount = m_GeometryCount = m_EffectCount = m_NameIndexSize = 0;
+}
+
+const PartEffect *PartPackage::FindEffect(const char *name) const
+{
+    if (!m_NameIndexSize)
+        return nullptr;
+
+    auto mask = m_NameIndexSize - 1;
+    for (auto slot = PartPackageHash(name) & mask; m_NameIndex[slot]; slot = (slot + 1) & mask) {
+        auto &fx = m_Effects[m_NameIndex[slot] - 1];
+        if (strcmp(m_Strings + fx.m_Name, name) == 0)
+            return &fx;
+    }
+
+    return nullptr;
+}
+
+bool BenchmarkPartPackage(const char *path, uint32_t effects, PartPackageBenchmark &result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto ms = [](Clock::time_point start) { return std::chrono::duration<float, std::milli>(Clock::now() - start).count(); };
+
+    result = {};
+    result.m_Effects = effects;
+
+    auto timer = Clock::now();
+
+    PartPackageWriter writer;
+    writer.AddTexture("bench.png");
+    writer.AddMaterial("bench.hlsl");
+
+    GeometryParticleDefinition def = {};
+    def.name = "bench";
+    def.lifetime = 1.f;
+    def.m_SizeStart = def.m_SizeEnd = 0.1f;
+    writer.AddGeometry(def, 0);
+
+    ParticleEffect fx = {};
+    fx.time = 1.f;
+    fx.m_Count = 4;
+    for (unsigned i = 0; i < fx.m_Count; i++) {
+        fx.m_Entries[i].type = ParticleType::Geometry;
+        fx.m_Entries[i].time = 1.f;
+    }
+    int32_t definitions[4] = {};
+
+    std::vector<std::string> names(effects);
+    for (uint32_t i = 0; i < effects; i++) {
+        names[i] = "fx" + std::to_string(i);
+        snprintf(fx.name, sizeof(fx.name), "%s", names[i].c_str());
+        writer.AddEffect(fx, definitions);
+    }
+
+    if (!writer.Write(path))
+        return false;
+    result.m_WriteMs = ms(timer);
+
+    timer = Clock::now();
+    PartPackage package;
+    if (!package.Open(path))
+        return false;
+    result.m_OpenMs = ms(timer);
+    result.m_Bytes = package.GetFile().GetSize();
+
+    timer = Clock::now();
+    if (!ValidatePartPackage(package.GetFile().GetData(), package.GetFile().GetSize()))
+        return false;
+    result.m_ValidateMs = ms(timer);
+
+    timer = Clock::now();
+    uint32_t found = 0;
+    for (auto &name : names)
+        found += package.FindEffect(name.c_str()) != nullptr;
+    result.m_LookupMs = ms(timer);
+
+    return found == effects;
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Particle.h"
+
+#define PART_PACKAGE_VERSION 3
+#define PART_PACKAGE_ALIGNMENT 16
+
+/*
+ * File format, little endian, every section starts on a 16 byte boundary:
+ *   header: PartPackageHeader,
+ *   sections: [PartPackageSection; header.section_count],
+ *   data: the sections, in any order
+ *
+ * Sections:
+ *   Strings:   [char], zero terminated, everything names a string by offset
+ *   Textures:  [PartTexture]
+ *   Atlases:   [PartAtlas], pages textures were packed into at export
+ *   Materials: [PartMaterial]
+ *   Geometry:  [PartGeometry]
+ *   Effects:   [PartEffect], each owns a run of the entries
+ *   Entries:   [PartEntry]
+ *   NameIndex: [u32; power of two], open addressed by PartPackageHash of the
+ *              effect name, linear probing, effect index + 1, 0 is empty
+ *
+ * Indices between sections are plain u32, -1 where nothing is referenced.
+ * Nothing needs fixing up after the file is mapped, PartPackage hands out
+ * pointers straight into the mapping.
+ */
+struct PartPackageHeader {
+    char m_Magic[4];
+    uint32_t m_Version;
+    uint32_t m_SectionCount;
+    uint32_t m_Reserved;
+    uint64_t m_FileSize;
+    uint64_t m_Reserved2;
+};
+
+enum class PartSection : uint32_t {
+    Strings,
+    Textures,
+    Atlases,
+    Materials,
+    Geometry,
+    Effects,
+    Entries,
+    NameIndex,
+    Count
+};
+
+struct PartPackageSection {
+    PartSection m_Type;
+    uint32_t m_Count;
+    uint64_t m_Offset;
+    uint64_t m_Size;
+    uint64_t m_Reserved;
+};
+
+struct PartTexture {
+    // area of the atlas page holding the texture: min u, min v, max u, max v,
+    // a texture uv maps to lerp(min, max, uv)
+    XMFLOAT4 m_AtlasRect;
+
+    uint32_t m_Path;
+    // index into the atlases, -1 if the texture is a file of its own
+    int32_t m_Atlas;
+    uint32_t m_Reserved[2];
+};
+
+struct PartAtlas {
+    uint32_t m_Path;
+    uint32_t m_Width;
+    uint32_t m_Height;
+    uint32_t m_Reserved;
+};
+
+struct PartMaterial {
+    uint32_t m_Shader;
+    uint32_t m_Reserved[3];
+};
+
+struct PartGeometry {
+    XMFLOAT4 m_ColorStart;
+    XMFLOAT4 m_ColorEnd;
+    XMFLOAT4 m_LightColorStart;
+    XMFLOAT4 m_LightColorEnd;
+
+    uint32_t m_Name;
+    int32_t m_Material;
+    float m_Lifetime;
+    float m_Gravity;
+
+    float m_NoiseScale;
+    float m_NoiseSpeed;
+    float m_DeformSpeed;
+    ParticleEase m_DeformEasing;
+
+    float m_DeformStart;
+    float m_DeformEnd;
+    ParticleEase m_SizeEasing;
+    float m_SizeStart;
+
+    float m_SizeEnd;
+    ParticleEase m_ColorEasing;
+    ParticleEase m_LightColorEasing;
+    ParticleEase m_LightRadiusEasing;
+
+    float m_LightRadiusStart;
+    float m_LightRadiusEnd;
+    uint32_t m_Reserved[2];
+};
+
+struct PartEffect {
+    XMFLOAT4 m_LightColor;
+
+    uint32_t m_Name;
+    uint32_t m_FirstEntry;
+    uint32_t m_EntryCount;
+    float m_Time;
+
+    float m_LightRadius;
+    uint32_t m_Loop;
+    uint32_t m_Anchor;
+    uint32_t m_Reserved;
+};
+
+struct PartEntry {
+    XMFLOAT3 m_StartPositionMin;
+    float m_Start;
+    XMFLOAT3 m_StartPositionMax;
+    float m_Time;
+    XMFLOAT3 m_StartVelocityMin;
+    float m_SpawnStart;
+    XMFLOAT3 m_StartVelocityMax;
+    float m_SpawnEnd;
+
+    ParticleType m_Type;
+    // geometry index for geometry entries, -1 for the rest
+    int32_t m_Definition;
+    uint32_t m_Loop;
+    uint32_t m_Anchor;
+
+    ParticleEase m_SpawnEasing;
+    float m_RotLimitMin;
+    float m_RotLimitMax;
+    float m_RotSpeedMin;
+
+    float m_RotSpeedMax;
+    float m_InheritVelocity;
+    ParticleEase m_LODEasing;
+    float m_LODScreenSize;
+
+    float m_LODMinFactor;
+    uint32_t m_Reserved[3];
+};
+
+static_assert(sizeof(PartPackageHeader) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part header");
+static_assert(sizeof(PartPackageSection) % 8 == 0, "misaligned part section");
+static_assert(sizeof(PartTexture) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part texture");
+static_assert(sizeof(PartAtlas) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part atlas");
+static_assert(sizeof(PartMaterial) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part material");
+static_assert(sizeof(PartGeometry) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part geometry");
+static_assert(sizeof(PartEffect) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part effect");
+static_assert(sizeof(PartEntry) % PART_PACKAGE_ALIGNMENT == 0, "misaligned part entry");
+
+// FNV-1a of a zero terminated name
+uint32_t PartPackageHash(const char *name);
+
+// Collects everything in memory and writes the package in one go.
+class PartPackageWriter {
+public:
+    PartPackageWriter();
+
+    uint32_t AddString(const char *str);
+    uint32_t AddAtlas(const char *path, uint32_t width, uint32_t height);
+    // `rect` is the texture's area of atlas page `atlas`, ignored for -1
+    uint32_t AddTexture(const char *path, int32_t atlas = -1, const float *rect = nullptr);
+    uint32_t AddMaterial(const char *shader);
+    uint32_t AddGeometry(const GeometryParticleDefinition &def, int32_t material);
+
+    // `definitions` holds the geometry index of every entry, -1 for entries
+    // that are not geometry
+    uint32_t AddEffect(const ParticleEffect &fx, const int32_t *definitions);
+
+    bool Write(const char *path) const;
+
+private:
+    std::vector<char> m_Strings;
+    std::vector<PartTexture> m_Textures;
+    std::vector<PartAtlas> m_Atlases;
+    std::vector<PartMaterial> m_Materials;
+    std::vector<PartGeometry> m_Geometry;
+    std::vector<PartEffect> m_Effects;
+    std::vector<PartEntry> m_Entries;
+};
+
+// Checks everything a reader relies on: header, section bounds and
+// alignment, string offsets, indices between sections and that every effect
+// can be found through the name index. Returns false with a reason in `error`.
+bool ValidatePartPackage(const uint8_t *data, uint64_t size, std::string *error = nullptr);
+
+// Memory mapped package, used in place. Open() only checks the header and
+// the section table, run ValidatePartPackage on files from untrusted places.
+class PartPackage {
+public:
+    PartPackage();
+
+    bool Open(const char *path);
+    void Close();
+
+    const char *GetString(uint32_t offset) const { return m_Strings + offset; }
+
+    uint32_t GetTextureCount() const { return m_TextureCount; }
+    const PartTexture *GetTextures() const { return m_Textures; }
+
+    uint32_t GetAtlasCount() const { return m_AtlasCount; }
+    const PartAtlas *GetAtlases() const { return m_Atlases; }
+
+    uint32_t GetMaterialCount() const { return m_MaterialCount; }
+    const PartMaterial *GetMaterials() const { return m_Materials; }
+
+    uint32_t GetGeometryCount() const { return m_GeometryCount; }
+    const PartGeometry *GetGeometry() const { return m_Geometry; }
+
+    uint32_t GetEffectCount() const { return m_EffectCount; }
+    const PartEffect *GetEffects() const { return m_Effects; }
+    const PartEntry *GetEntries(const PartEffect &fx) const { return m_Entries + fx.m_FirstEntry; }
+
+    const PartEffect *FindEffect(const char *name) const;
+
+    const MappedFile &GetFile() const { return m_File; }
+
+private:
+    MappedFile m_File;
+
+    const char *m_Strings;
+    const PartTexture *m_Textures;
+    const PartAtlas *m_Atlases;
+    const PartMaterial *m_Materials;
+    const PartGeometry *m_Geometry;
+    const PartEffect *m_Effects;
+    const PartEntry *m_Entries;
+    const uint32_t *m_NameIndex;
+
+    uint32_t m_TextureCount;
+    uint32_t m_AtlasCount;
+    uint32_t m_MaterialCount;
+    uint32_t m_GeometryCount;
+    uint32_t m_EffectCount;
+    uint32_t m_NameIndexSize;
+};
+
+struct PartPackageBenchmark {
+    uint32_t m_Effects;
+    uint64_t m_Bytes;
+    float m_WriteMs;
+    float m_OpenMs;
+    float m_ValidateMs;
+    float m_LookupMs; // finding every effect by name once
+};
+
+// Writes a synthetic package with `effects` effects to `path` and times
+// opening, validating and looking up every effect in it.
+bool BenchmarkPartPackage(const char *path, uint32_t effects, PartPackageBenchmark &result);
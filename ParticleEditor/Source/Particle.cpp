@@ -1,5 +1,25 @@
 #include "Particle.h"
 
+#include <External/Helpers.h>
+
+SimpleMath::Vector3 VelocityBox::GetVelocity() const
+{
+    return SimpleMath::Vector3(
+        RandomFloat(m_Min.x, m_Max.x),
+        RandomFloat(m_Min.y, m_Max.y),
+        RandomFloat(m_Min.z, m_Max.z)
+    );
+}
+
+SimpleMath::Vector3 PosBox::GetPosition() const
+{
+    return SimpleMath::Vector3(
+        RandomFloat(m_Min.x, m_Max.x),
+        RandomFloat(m_Min.y, m_Max.y),
+        RandomFloat(m_Min.z, m_Max.z)
+    );
+}
+
 old::EaseFunc ease_funcs[] = {
 	ease::Lerp,
 	ease::EaseIn,
@@ -2,14 +2,15 @@
 
 #include <cstdio>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
 #include "Ease.h"
-#include <d3d11.h>
+#include "RenderBackend.h"
+#include "TransformHierarchy.h"
 #include <SimpleMath.h>
-#include <External\Helpers.h>
-#include "Ease.h"
 
 using namespace DirectX;
 
@@ -18,6 +19,11 @@ using namespace DirectX;
 #define TRAIL_COUNT 32
 #define TRAIL_PARTICLE_COUNT 16
 
+// Store geometry particles in 28 bytes instead of 64, see GeometryParticle.
+// Undefine to go back to the full layout, which keeps the per particle random
+// values instead of hashing them from a seed.
+#define COMPACT_GEOMETRY_PARTICLES
+
 
 using ParticleShaderID = uint64_t;
 
@@ -25,32 +31,30 @@ struct VelocityBox {
     SimpleMath::Vector3 m_Min;
     SimpleMath::Vector3 m_Max;
 
-    SimpleMath::Vector3 GetVelocity() const {
-        return SimpleMath::Vector3(
-            RandomFloat(m_Min.x, m_Max.x),
-            RandomFloat(m_Min.y, m_Max.y),
-            RandomFloat(m_Min.z, m_Max.z)
-        );
-    }
+    SimpleMath::Vector3 GetVelocity() const;
 };
 
 struct PosBox {
     SimpleMath::Vector3 m_Min;
     SimpleMath::Vector3 m_Max;
 
-    SimpleMath::Vector3 GetPosition() const {
-        return SimpleMath::Vector3(
-            RandomFloat(m_Min.x, m_Max.x),
-            RandomFloat(m_Min.y, m_Max.y),
-            RandomFloat(m_Min.z, m_Max.z)
-        );
-    }
+    SimpleMath::Vector3 GetPosition() const;
 };
 
 struct TrailParticleMaterial {
     std::string m_MaterialName;
     std::string m_ShaderPath;
-    ID3D11PixelShader *m_PixelShader;
+    RenderShader m_PixelShader;
+};
+
+// How a trail decides when to lay down a new point behind its head.
+//   Time:     every `frequency` seconds, however far the head moved
+//   Distance: whenever the head moved `m_SampleDistance` from the last point
+//             or bent more than `m_SampleAngle` degrees, fast heads get
+//             several points interpolated along the frame's movement
+enum class TrailSampling : uint32_t {
+    Time,
+    Distance
 };
 
 struct TrailParticleDefinition {
@@ -66,6 +70,10 @@ struct TrailParticleDefinition {
     float m_Gravity;
     float lifetime;
     float frequency;
+
+    TrailSampling m_Sampling;
+    float m_SampleDistance;
+    float m_SampleAngle;
 };
 
 struct TrailParticleEffect {
@@ -159,13 +167,14 @@ enum class ParticleType : uint32_t {
     Geometry,
 };
 
-inline ParticleEase GetEasingFromString(std::string str)
+inline ParticleEase GetEasingFromString(std::string_view str)
 {
     if (str == "linear") return ParticleEase::Linear;
     if (str == "easein") return ParticleEase::EaseIn;
     if (str == "easeout") return ParticleEase::EaseOut;
 
     assert(false);
+    return ParticleEase::Linear;
 }
 
 inline std::string GetEasingName(ParticleEase ease) {
@@ -181,13 +190,31 @@ inline std::string GetEasingName(ParticleEase ease) {
     }
 }
 
-inline ParticleType ParticleTypeFromString(std::string str)
+inline TrailSampling TrailSamplingFromString(std::string_view str)
+{
+    if (str == "distance") return TrailSampling::Distance;
+
+    return TrailSampling::Time;
+}
+
+inline std::string GetTrailSamplingName(TrailSampling sampling)
+{
+    switch (sampling) {
+        case TrailSampling::Distance:
+            return "distance";
+        default:
+            return "time";
+    }
+}
+
+inline ParticleType ParticleTypeFromString(std::string_view str)
 {
     if (str == "trail") return ParticleType::Trail;
     if (str == "billboard") return ParticleType::Billboard;
     if (str == "geometry") return ParticleType::Geometry;
     
     assert(false);
+    return ParticleType::Geometry;
 }
 
 struct ParticleEffectEntry {
@@ -214,6 +241,16 @@ struct ParticleEffectEntry {
     float m_RotLimitMax;
     float m_RotSpeedMin;
     float m_RotSpeedMax;
+
+    // fraction of the emitter velocity added to the start velocity
+    float m_InheritVelocity;
+
+    // Spawn LOD, 0 screen size turns it off. Once the entry covers less than
+    // m_LODScreenSize of the screen height, spawn rate eases down towards
+    // m_LODMinFactor and particles grow so the covered area stays the same.
+    ParticleEase m_LODEasing;
+    float m_LODScreenSize;
+    float m_LODMinFactor;
 };
 
 struct ParticleEffect {
@@ -234,22 +271,88 @@ struct BillboardParticle {
     int idx;
 };
 
-struct GeometryParticle {
+// Only what changes per frame or cannot be recomputed is stored. Velocity is
+// the start velocity in half precision, the current one follows from gravity
+// and age. The rotation axis, speed and phase are hashed from the seed within
+// the rotation ranges of the pool.
+struct GeometryParticleCompact {
+    XMFLOAT3 pos;
+    float age;
+    PackedVector::HALF velocity[3];
+    PackedVector::HALF scale;
+    uint32_t seed;
+};
+static_assert(sizeof(GeometryParticleCompact) <= 32, "compact geometry particle too large");
+
+struct GeometryParticleFull {
     XMFLOAT3 pos;
     XMFLOAT3 anchor;
     XMFLOAT3 velocity;
     float rotvel;
     float rotprog;
     XMFLOAT3 rot;
-    GeometryParticleDefinition *def;
     float age;
+    // size multiplier from the spawn LOD
+    float scale;
+};
+
+// Both layouts are always built, the benchmark compares them, the define
+// picks the one the editor simulates.
+#ifdef COMPACT_GEOMETRY_PARTICLES
+typedef GeometryParticleCompact GeometryParticle;
+#else
+typedef GeometryParticleFull GeometryParticle;
+#endif
+
+// Live particles sharing one definition and rotation ranges. The definition
+// and its material are looked up once per pool instead of once per particle,
+// and the instances of a pool end up next to each other for rendering.
+template <typename Particle>
+struct GeometryParticlePoolOf {
+    GeometryParticleDefinition *def;
     int idx;
+
+    // rotation ranges of the spawning entries
+    float rotmin, rotmax;
+    float rotspeedmin, rotspeedmax;
+
+    std::vector<Particle> particles;
 };
+typedef GeometryParticlePoolOf<GeometryParticle> GeometryParticlePool;
 
 struct AnchoredParticleEffect {
     ParticleEffect *fx;
-    XMFLOAT3 pos;
-    std::vector<GeometryParticle> children;
+    // node of the effect itself that the children follow, TRANSFORM_NONE
+    // until first processed. It hangs off `parent`, or is a root node while
+    // that is TRANSFORM_NONE, and is owned by the effect, see
+    // ParticleSystem::ReleaseAnchoredFX.
+    TransformID transform;
+    TransformID parent;
+    // slot in ParticleSystem::m_TemporalLODCaches + 1, 0 until scheduled. The
+    // slot is only ours while its m_Owner points back here.
+    uint32_t lod;
+    std::vector<GeometryParticlePool> children;
+};
+
+// Parent transform applied to a pool while it is written out, decomposed once
+// per pool. Positions get the full matrix, instance rotation and scale are
+// combined with the parent's, non-uniform scale is reduced to its largest axis.
+struct ParticleAnchor {
+    XMMATRIX m_World;
+    XMVECTOR m_Rotation;
+    float m_Scale;
+
+    static ParticleAnchor FromMatrix(FXMMATRIX world)
+    {
+        XMVECTOR scale, rotation, translation;
+        if (!XMMatrixDecompose(&scale, &rotation, &translation, world)) {
+            scale = XMVectorReplicate(1.f);
+            rotation = XMQuaternionIdentity();
+        }
+
+        auto largest = XMVectorMax(XMVectorMax(XMVectorSplatX(scale), XMVectorSplatY(scale)), XMVectorSplatZ(scale));
+        return { world, rotation, XMVectorGetX(largest) };
+    }
 };
 
 struct GeometryParticleInstance {
@@ -263,6 +366,18 @@ struct GeometryParticleInstance {
     float m_NoiseSpeed;
 };
 
+// 40 byte alternative to GeometryParticleInstance, the model matrix is
+// rebuilt from position, scale and rotation in VSCompact.
+struct GeometryParticleInstanceCompact {
+    XMFLOAT3 m_Position;
+    PackedVector::HALF m_Scale;
+    PackedVector::HALF m_NoiseSpeed;
+    PackedVector::XMSHORTN4 m_Rotation; // quaternion
+    PackedVector::XMHALF4 m_Color;
+    PackedVector::XMHALF4 m_Params;     // age, deform, deform speed, noise scale
+};
+static_assert(sizeof(GeometryParticleInstanceCompact) == 40, "compact instance layout must match VSCompact");
+
 
 namespace old {
 #define EMITTER_STRINGS "Static\0Box\0Sphere\0"
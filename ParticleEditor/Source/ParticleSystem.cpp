@@ -2,89 +2,333 @@
 
 #include <d3d11.h>
 #include <algorithm>
-#include <fstream>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+#include <utility>
 
 #include "External/dxerr.h"
 #include "External/Helpers.h"
 #include "External/DirectXTK.h"
+#include "Camera.h"
 #include "Editor.h"
 #include "Ease.h"
+#include "BillboardQuads.h"
+#include "FlipbookBaker.h"
 
-ParticleSystem::ParticleSystem(const wchar_t *file, UINT capacity, UINT width, UINT height, ID3D11Device *device, ID3D11DeviceContext *cxt)
-    : capacity(capacity), device(device), cxt(cxt)
+ParticleSystem::ParticleSystem(const wchar_t *file, UINT capacity, UINT width, UINT height, RenderBackend *backend, MeshCache *meshes)
+    : capacity(capacity), m_Meshes(meshes), m_Sphere(nullptr), m_GeometryInstanceCount(0), m_GeometryPoolCount(0), m_GeometryUpdateMs(0.f), m_GeometrySimulatedCount(0), m_SpecializedKernels(true), m_CompactInstances(false), m_CompactStaged(false), m_CompactExpanded(false), m_DrawCompact(false), m_BillboardQuads(false), m_BillboardExpandMs(0.f), m_TrailRibbons(false), m_TrailRibbonTolerance(0.002f), m_TrailRibbonStats(), m_TrailRibbonMs(0.f), m_TemporalLOD(false), m_TemporalLODSettings(), m_TemporalLODStats(), m_TemporalLODStagger(0), m_MeshLOD(false), m_MeshLODTolerance(0.001f), m_MeshLODStats(), m_Frame(0), m_LODView(), m_LODFocal(0.f), m_Backend(backend)
 {
     //if (file)
     //    DeserializeParticles(file, effect_definitions, particle_definitions);
 
-    D3D11_BLEND_DESC state = {};
-    ZeroMemory(&state, sizeof(D3D11_BLEND_DESC));
-    state.RenderTarget[0].BlendEnable = TRUE;
-    state.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
-    state.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
-    state.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
-    state.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_SRC_ALPHA;
-    state.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
-    state.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-    state.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-    DXCALL(device->CreateBlendState(&state, &m_ParticleBlend));
-
-    ID3DBlob *blob = compile_shader(L"Resources/Shaders/BillboardParticleSimple.hlsl", "VS", "vs_5_0", device);
-    DXCALL(device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_DefaultBillboardVS));
-
-    D3D11_INPUT_ELEMENT_DESC billboard_desc[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "SIZE",     0, DXGI_FORMAT_R32G32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "AGE",      0, DXGI_FORMAT_R32_FLOAT,       0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "IDX",      0, DXGI_FORMAT_R32_SINT,        0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    RenderInputElement billboard_desc[] = {
+        { "POSITION", 0, RenderFormat::R32G32B32Float, 0, false },
+        { "SIZE",     0, RenderFormat::R32G32Float,    0, false },
+        { "AGE",      0, RenderFormat::R32Float,       0, false },
+        { "IDX",      0, RenderFormat::R32SInt,        0, false },
     };
-    m_DefaultBillboardLayout = create_input_layout(billboard_desc, ARRAYSIZE(billboard_desc), blob->GetBufferPointer(), blob->GetBufferSize(), device);
-
-    blob = compile_shader(L"Resources/Shaders/BillboardParticleSimple.hlsl", "GS", "gs_5_0", device);
-    DXCALL(device->CreateGeometryShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_DefaultBillboardGS));
+    m_DefaultBillboardVS = m_Backend->CreateShader(RenderShaderStage::Vertex, L"Resources/Shaders/BillboardParticleSimple.hlsl", "VS", billboard_desc, ARRAYSIZE(billboard_desc), &m_DefaultBillboardLayout);
+    m_DefaultBillboardGS = m_Backend->CreateShader(RenderShaderStage::Geometry, L"Resources/Shaders/BillboardParticleSimple.hlsl", "GS");
 
     m_BillboardParticles.reserve(capacity);
-    m_BillboardBuffer = new VertexBuffer<BillboardParticle>(device, BufferUsageDynamic, BufferAccessWrite, capacity);
+    m_BillboardBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(BillboardParticle), capacity);
 
-    m_TrailBuffer = new VertexBuffer<TrailParticle>(device, BufferUsageDynamic, BufferAccessWrite, TRAIL_COUNT * TRAIL_PARTICLE_COUNT);
-    //m_TrailParticles.push_back({});
+    // the quad path shares one static index buffer between all frames
+    {
+        UINT quads = min(capacity, (UINT)BILLBOARD_QUAD_MAX);
 
-    blob = compile_shader(L"Resources/Shaders/TrailParticleSimple.hlsl", "VS", "vs_5_0", device);
-    DXCALL(device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &trail_vs));
+        std::vector<uint16_t> indices(quads * 6);
+        BuildBillboardQuadIndices(indices.data(), quads);
 
-    D3D11_INPUT_ELEMENT_DESC input_desc[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "VELOCITY", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT,        0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-    };
-    trail_layout = create_input_layout(input_desc, ARRAYSIZE(input_desc), blob->GetBufferPointer(), blob->GetBufferSize(), device);
+        m_BillboardQuadBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(BillboardVertex), quads * 4);
+        m_BillboardQuadIndexBuffer = m_Backend->CreateBuffer(RenderBufferType::Index, RenderBufferUsage::Immutable, sizeof(uint16_t), quads * 6, indices.data());
 
-    blob = compile_shader(L"Resources/Shaders/TrailParticleSimple.hlsl", "GS", "gs_5_0", device);
-    DXCALL(device->CreateGeometryShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &trail_gs));
+        RenderInputElement quad_desc[] = {
+            { "POSITION", 0, RenderFormat::R32G32B32Float, 0, false },
+            { "TEXCOORD", 0, RenderFormat::R32G32Float,    0, false },
+            { "AGE",      0, RenderFormat::R32Float,       0, false },
+        };
+        m_BillboardQuadVS = m_Backend->CreateShader(RenderShaderStage::Vertex, L"Resources/Shaders/BillboardParticleSimple.hlsl", "VSQuad", quad_desc, ARRAYSIZE(quad_desc), &m_BillboardQuadLayout);
 
-    blob = compile_shader(L"Resources/Shaders/TrailParticleSimple.hlsl", "PS", "ps_5_0", device);
-    DXCALL(device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &trail_ps));
+        // flipbooks are quads too, with the atlas cell as their uvs
+        m_FlipbookBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(BillboardVertex), FLIPBOOK_SPRITE_MAX * 4);
+        m_FlipbookPS = m_Backend->CreateShader(RenderShaderStage::Pixel, L"Resources/Shaders/BillboardParticleSimple.hlsl", "PSFlipbook");
+    }
+
+    m_TrailBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(TrailParticle), TRAIL_COUNT * TRAIL_PARTICLE_COUNT);
+    m_TrailRibbonBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(TrailRibbonVertex), TRAIL_RIBBON_MAX_VERTICES * TRAIL_PARTICLE_COUNT);
+    //m_TrailParticles.push_back({});
+
+    RenderInputElement input_desc[] = {
+        { "POSITION", 0, RenderFormat::R32G32B32Float, 0, false },
+        { "VELOCITY", 0, RenderFormat::R32G32B32Float, 0, false },
+        { "SIZE",     0, RenderFormat::R32G32Float,    0, false },
+    };
+    trail_vs = m_Backend->CreateShader(RenderShaderStage::Vertex, L"Resources/Shaders/TrailParticleSimple.hlsl", "VS", input_desc, ARRAYSIZE(input_desc), &trail_layout);
+    trail_gs = m_Backend->CreateShader(RenderShaderStage::Geometry, L"Resources/Shaders/TrailParticleSimple.hlsl", "GS");
+    trail_ps = m_Backend->CreateShader(RenderShaderStage::Pixel, L"Resources/Shaders/TrailParticleSimple.hlsl", "PS");
+
+    RenderInputElement ribbon_desc[] = {
+        { "POSITION", 0, RenderFormat::R32G32B32Float, 0, false },
+        { "TEXCOORD", 0, RenderFormat::R32G32Float,    0, false },
+    };
+    m_TrailRibbonVS = m_Backend->CreateShader(RenderShaderStage::Vertex, L"Resources/Shaders/TrailParticleSimple.hlsl", "VSRibbon", ribbon_desc, ARRAYSIZE(ribbon_desc), &m_TrailRibbonLayout);
 
     ReadSphereModel();
 
-    DirectionalLight light = {
+    m_DirectionalLightData = {
         {0.f,  50.f, 0.5f, 1.f},
         {0.1f, 0.1f, 0.3f},
         {0.2f, 0.2f, 0.2f}
     };
-    m_DirectionalLight = new ConstantBuffer<DirectionalLight>(device, BufferUsageDynamic, BufferAccessWrite, 1, &light);
-    m_Lights = new ConstantBuffer<LightBuffer>(device, BufferUsageDynamic, BufferAccessWrite, 1);
+    m_DirectionalLight = m_Backend->CreateBuffer(RenderBufferType::Constant, RenderBufferUsage::Dynamic, sizeof(DirectionalLight), 1, &m_DirectionalLightData);
+    m_Lights = m_Backend->CreateBuffer(RenderBufferType::Constant, RenderBufferUsage::Dynamic, sizeof(LightBuffer), 1);
+    m_CameraBuffer = m_Backend->CreateBuffer(RenderBufferType::Constant, RenderBufferUsage::Dynamic, sizeof(CameraValues), 1);
 
     m_ParticleLights.LightCount = 0;
 }
 
 ParticleSystem::~ParticleSystem()
 {
-    delete m_BillboardBuffer;
+}
+
+// Finds or creates the pool for an entry, empty pools are dropped at the
+// end of update() so a removed definition is never looked at again.
+template <typename Particle>
+static GeometryParticlePoolOf<Particle> &GetPool(std::vector<GeometryParticlePoolOf<Particle>> &pools, const ParticleEffectEntry &entry)
+{
+    for (auto &pool : pools) {
+        if (pool.def == entry.geometry &&
+            pool.rotmin == entry.m_RotLimitMin && pool.rotmax == entry.m_RotLimitMax &&
+            pool.rotspeedmin == entry.m_RotSpeedMin && pool.rotspeedmax == entry.m_RotSpeedMax)
+            return pool;
+    }
+
+    GeometryParticlePoolOf<Particle> pool;
+    pool.def = entry.geometry;
+    pool.idx = (int)(entry.geometry->m_Material - Editor::TrailMaterials);
+    pool.rotmin = entry.m_RotLimitMin;
+    pool.rotmax = entry.m_RotLimitMax;
+    pool.rotspeedmin = entry.m_RotSpeedMin;
+    pool.rotspeedmax = entry.m_RotSpeedMax;
+    pools.push_back(pool);
+
+    return pools.back();
+}
+
+// uniform value in [lo, hi) for one of the random values of a seed
+static float SeedFloat(uint32_t seed, uint32_t salt, float lo, float hi)
+{
+    uint32_t h = seed + salt * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+
+    return lo + (hi - lo) * ((h >> 8) * (1.f / 16777216.f));
+}
+
+static void InitParticle(GeometryParticleCompact &p, const ParticleEffectEntry &entry, const SimpleMath::Matrix &model, FXMVECTOR inherited, float scale)
+{
+    static uint32_t seed = 0;
+
+    XMFLOAT3 velocity = entry.m_StartVelocity.GetVelocity() + SimpleMath::Vector3(inherited);
+
+    p = {};
+    p.pos = SimpleMath::Vector3::Transform(entry.m_StartPosition.GetPosition(), model);
+    p.velocity[0] = PackedVector::XMConvertFloatToHalf(velocity.x);
+    p.velocity[1] = PackedVector::XMConvertFloatToHalf(velocity.y);
+    p.velocity[2] = PackedVector::XMConvertFloatToHalf(velocity.z);
+    p.scale = PackedVector::XMConvertFloatToHalf(scale);
+    p.seed = seed++;
+}
+
+static void InitParticle(GeometryParticleFull &p, const ParticleEffectEntry &entry, const SimpleMath::Matrix &model, FXMVECTOR inherited, float scale)
+{
+    p = {};
+    p.scale = scale;
+    p.pos = SimpleMath::Vector3::Transform(entry.m_StartPosition.GetPosition(), model);
+    p.anchor = SimpleMath::Vector3::Transform({}, model);
+    p.velocity = entry.m_StartVelocity.GetVelocity() + SimpleMath::Vector3(inherited);
+    p.rot = {
+        RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
+        RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
+        RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax)
+    };
+    p.rotvel = RandomFloat(entry.m_RotSpeedMin, entry.m_RotSpeedMax);
+    p.rotprog = RandomFloat(-180, 180);
+}
+
+template <typename Particle = GeometryParticle>
+static Particle SpawnGeometryParticle(const ParticleEffectEntry &entry, const SimpleMath::Matrix &model, FXMVECTOR inherited = XMVectorZero(), float scale = 1.f)
+{
+    Particle p;
+    InitParticle(p, entry, model, inherited, scale);
+
+    return p;
+}
+
+static float GetScale(const GeometryParticleCompact &p)
+{
+    return PackedVector::XMConvertHalfToFloat(p.scale);
+}
+
+template <typename Pool>
+static XMVECTOR GetVelocity(const Pool &pool, const GeometryParticleCompact &p)
+{
+    auto start = XMVectorSet(
+        PackedVector::XMConvertHalfToFloat(p.velocity[0]),
+        PackedVector::XMConvertHalfToFloat(p.velocity[1]),
+        PackedVector::XMConvertHalfToFloat(p.velocity[2]),
+        0.f
+    );
+
+    return start + XMVECTOR{ 0, pool.def->m_Gravity, 0 } * p.age;
+}
+
+template <typename Pool>
+static void GetRotation(const Pool &pool, const GeometryParticleCompact &p, XMVECTOR &axis, float &angle)
+{
+    axis = XMVECTOR{ 0.1f } + XMVectorSet(
+        SeedFloat(p.seed, 0, pool.rotmin, pool.rotmax),
+        SeedFloat(p.seed, 1, pool.rotmin, pool.rotmax),
+        SeedFloat(p.seed, 2, pool.rotmin, pool.rotmax),
+        0.f
+    );
+    auto speed = SeedFloat(p.seed, 3, pool.rotspeedmin, pool.rotspeedmax);
+
+    // the progress starts at a random phase and advances with the age
+    auto progress = SeedFloat(p.seed, 4, -180, 180) + p.age;
+
+    angle = (progress + p.age) * speed;
+}
+
+template <typename Pool>
+static void AdvanceParticle(const Pool &pool, GeometryParticleCompact &p, float dt)
+{
+    p.age += dt;
+
+    XMStoreFloat3(&p.pos, XMLoadFloat3(&p.pos) + GetVelocity(pool, p) * dt);
+}
+
+static float GetScale(const GeometryParticleFull &p)
+{
+    return p.scale;
+}
+
+template <typename Pool>
+static XMVECTOR GetVelocity(const Pool & /*pool*/, const GeometryParticleFull &p)
+{
+    return XMLoadFloat3(&p.velocity);
+}
+
+template <typename Pool>
+static void GetRotation(const Pool & /*pool*/, const GeometryParticleFull &p, XMVECTOR &axis, float &angle)
+{
+    axis = XMVECTOR{ 0.1f } + XMLoadFloat3(&p.rot);
+    angle = (p.rotprog + p.age) * p.rotvel;
+}
+
+template <typename Pool>
+static void AdvanceParticle(const Pool &pool, GeometryParticleFull &p, float dt)
+{
+    p.age += dt;
+    p.rotprog += dt;
+
+    XMStoreFloat3(&p.velocity, XMLoadFloat3(&p.velocity) + XMVECTOR{ 0, pool.def->m_Gravity, 0 } * dt);
+    XMStoreFloat3(&p.pos, XMLoadFloat3(&p.pos) + XMLoadFloat3(&p.velocity) * dt);
+}
+
+// Pushes every point of the trail one step back and puts `point` right
+// behind the head, dead points collapse onto the oldest living one.
+static void EmitTrailPoint(Trail &trail, const TrailParticleDefinition &def, const TrailParticle &point, float dt)
+{
+    auto particles = trail.points;
+
+    if (trail.age >= def.lifetime) {
+
+        if (trail.dead >= TRAIL_COUNT - 2) {
+            // delete trail
+        }
+        else {
+            trail.dead++;
+        }
+    }
+
+    TrailParticle particle = particles[1];
+    particle.m_Position += particle.m_Velocity;
+    particle.m_Position.y += def.m_Gravity;
+
+    for (int i = TRAIL_COUNT - 2; i > 1; i--) {
+        auto p = particles[i - 1];
+        p.m_Position += particle.m_Velocity * dt;
+        p.m_Position.y += def.m_Gravity * dt;
+        particles[i] = p;
+    }
+
+    for (int i = 0; i < trail.dead; i++) {
+        particles[i] = particles[trail.dead];
+    }
+
+    particles[1] = point;
+    particles[TRAIL_COUNT - 1] = particles[TRAIL_COUNT - 2];
 }
 
 void ParticleSystem::ProcessAnchoredFX(AnchoredParticleEffect * afx, SimpleMath::Matrix model, float dt)
 {
-    afx->pos = SimpleMath::Vector3::Transform({}, model);
+    if (afx->transform != TRANSFORM_NONE && afx->parent != TRANSFORM_NONE) {
+        m_Transforms.Destroy(afx->transform);
+        afx->transform = TRANSFORM_NONE;
+    }
+
+    if (afx->transform == TRANSFORM_NONE) {
+        afx->transform = m_Transforms.Create();
+        afx->parent = TRANSFORM_NONE;
+    }
+    m_Transforms.SetLocal(afx->transform, model);
+
+    SpawnAnchoredFX(afx, model, dt);
+}
+
+void ParticleSystem::ProcessAnchoredFX(AnchoredParticleEffect * afx, TransformID parent, float dt)
+{
+    // the effect keeps a node of its own below the parent, destroying it
+    // never touches the parent
+    if (afx->transform != TRANSFORM_NONE && afx->parent != parent) {
+        m_Transforms.Destroy(afx->transform);
+        afx->transform = TRANSFORM_NONE;
+    }
+
+    if (afx->transform == TRANSFORM_NONE) {
+        afx->transform = m_Transforms.Create(parent);
+        afx->parent = parent;
+    }
+
+    SpawnAnchoredFX(afx, m_Transforms.GetWorld(parent), dt);
+}
+
+void ParticleSystem::ReleaseAnchoredFX(AnchoredParticleEffect * afx)
+{
+    if (afx->transform != TRANSFORM_NONE)
+        m_Transforms.Destroy(afx->transform);
+    afx->transform = TRANSFORM_NONE;
+    afx->parent = TRANSFORM_NONE;
+    afx->children.clear();
+
+    // the cache slot would otherwise be freed at the next schedule, after
+    // the effect may already be reused
+    if (afx->lod && afx->lod <= m_TemporalLODCaches.size() && m_TemporalLODCaches[afx->lod - 1].m_Owner == afx)
+        m_TemporalLODCaches[afx->lod - 1] = {};
+    afx->lod = 0;
+
+    m_AnchoredEffects.erase(std::remove(m_AnchoredEffects.begin(), m_AnchoredEffects.end(), afx), m_AnchoredEffects.end());
+}
+
+void ParticleSystem::SpawnAnchoredFX(AnchoredParticleEffect * afx, const SimpleMath::Matrix &model, float dt)
+{
     auto &fx = afx->fx;
     for (int i = 0; i < fx->m_Count; i++) {
         auto &entry = fx->m_Entries[i];
@@ -106,52 +350,27 @@ void ParticleSystem::ProcessAnchoredFX(AnchoredParticleEffect * afx, SimpleMath:
 
         switch (entry.type) {
             case ParticleType::Geometry: {
-                auto def = *entry.geometry;
-
                 auto factor = (fx->age - entry.start) / entry.time;
                 auto ease_spawn = GetEaseFunc(entry.m_SpawnEasing);
                 auto spawn = entry.m_Loop ? entry.m_SpawnStart : ease_spawn(entry.m_SpawnStart, entry.m_SpawnEnd, factor);
 
+                // anchored particles live in the space of the transform node
+                // and follow it, the rest are left behind in world space
+                auto &spawn_space = entry.m_Anchor ? SimpleMath::Matrix::Identity : model;
+
+                auto lod = GetSpawnLOD(entry, model);
+                spawn *= lod;
+
                 if (entry.m_SpawnStart == 0.f && entry.m_SpawnEnd == 0.f && entry.m_SpawnedParticles >= 1.f) {
-                    GeometryParticle p = {}; p.pos = SimpleMath::Vector3::Transform(entry.m_StartPosition.GetPosition(), model);
-                    p.anchor = SimpleMath::Vector3::Transform({}, model);
-                    p.velocity = entry.m_StartVelocity.GetVelocity();
-                    p.rot = {
-                        RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                        RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                        RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax)
-                    };
-                    p.rotvel = RandomFloat(entry.m_RotSpeedMin, entry.m_RotSpeedMax);
-                    p.rotprog = RandomFloat(-180, 180);
-                    p.def = entry.geometry;
-                    p.idx = (int)(def.m_Material - Editor::TrailMaterials);
-
-                    if (entry.m_Anchor)
-                        afx->children.push_back(p);
-                    else
-                        m_GeometryParticles.push_back(p);
+                    auto p = SpawnGeometryParticle(entry, spawn_space, XMVectorZero(), 1.f / sqrtf(lod));
+                    GetPool(entry.m_Anchor ? afx->children : m_GeometryParticles, entry).particles.push_back(p);
 
                     entry.m_SpawnedParticles -= 1.f;
                 }
                 else {
                     for (entry.m_SpawnedParticles += spawn * dt; entry.m_SpawnedParticles >= 1.f; entry.m_SpawnedParticles -= 1.f) {
-                        GeometryParticle p = {};
-                        p.pos = entry.m_StartPosition.GetPosition();
-                        p.velocity = entry.m_StartVelocity.GetVelocity();
-                        p.rot = {
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax)
-                        };
-                        p.rotvel = RandomFloat(entry.m_RotSpeedMin, entry.m_RotSpeedMax);
-                        p.rotprog = RandomFloat(-180, 180);
-                        p.def = entry.geometry;
-                        p.idx = (int)(def.m_Material - Editor::TrailMaterials);
-
-                        if (entry.m_Anchor)
-                            afx->children.push_back(p);
-                        else
-                            m_GeometryParticles.push_back(p);
+                        auto p = SpawnGeometryParticle(entry, spawn_space, XMVectorZero(), 1.f / sqrtf(lod));
+                        GetPool(entry.m_Anchor ? afx->children : m_GeometryParticles, entry).particles.push_back(p);
                     }
                 }
             } break;
@@ -165,6 +384,12 @@ void ParticleSystem::ProcessAnchoredFX(AnchoredParticleEffect * afx, SimpleMath:
 
 void ParticleSystem::ProcessFX(ParticleEffect *fx, SimpleMath::Matrix model, float dt)
 {
+    ProcessFX(*fx, model, XMVectorZero(), dt);
+}
+
+void ParticleSystem::ProcessFX(ParticleEffect & effect, XMMATRIX model, XMVECTOR velocity, float dt)
+{
+    auto fx = &effect;
     for (int i = 0; i < fx->m_Count; i++) {
         auto &entry = fx->m_Entries[i];
 
@@ -198,52 +423,36 @@ void ParticleSystem::ProcessFX(ParticleEffect *fx, SimpleMath::Matrix model, flo
                 m_BillboardParticles.push_back(particle);
             } break;
             case ParticleType::Geometry: {
-                auto def = *entry.geometry;
-
                 auto factor = (fx->age - entry.start) / entry.time;
                 auto ease_spawn = GetEaseFunc(entry.m_SpawnEasing);
 
+                // fewer but larger particles once the entry is small on screen
+                auto lod = GetSpawnLOD(entry, model);
+                auto lod_scale = 1.f / sqrtf(lod);
+
                 if (entry.m_SpawnStart == 0.f && entry.m_SpawnEnd == 0.f) {
                     if (entry.m_SpawnedParticles <= 0.f) {
                     
-                        GeometryParticle p = {}; p.pos = SimpleMath::Vector3::Transform(entry.m_StartPosition.GetPosition(), model);
-                        p.anchor = SimpleMath::Vector3::Transform({}, model);
-                        p.velocity = entry.m_StartVelocity.GetVelocity();
-                        p.rot = {
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax)
-                        };
-                        p.rotvel = RandomFloat(entry.m_RotSpeedMin, entry.m_RotSpeedMax);
-                        p.rotprog = RandomFloat(-180, 180);
-                        p.def = entry.geometry;
-                        p.idx = (int)(def.m_Material - Editor::TrailMaterials);
-
-
-                        m_GeometryParticles.push_back(p);
+                        auto p = SpawnGeometryParticle(entry, model, velocity * entry.m_InheritVelocity, lod_scale);
+                        GetPool(m_GeometryParticles, entry).particles.push_back(p);
                         
                         entry.m_SpawnedParticles += 1.f;
                     }
                 }
                 else {
-                    auto spawn = entry.m_Loop ? entry.m_SpawnStart : ease_spawn(entry.m_SpawnStart, entry.m_SpawnEnd, factor);
+                    auto spawn = lod * (entry.m_Loop ? entry.m_SpawnStart : ease_spawn(entry.m_SpawnStart, entry.m_SpawnEnd, factor));
 
                     for (entry.m_SpawnedParticles += spawn * dt; entry.m_SpawnedParticles >= 1.f; entry.m_SpawnedParticles -= 1.f) {
-                        GeometryParticle p = {}; p.pos = SimpleMath::Vector3::Transform(entry.m_StartPosition.GetPosition(), model);
-                        p.anchor = SimpleMath::Vector3::Transform({}, model);
-                        p.velocity = entry.m_StartVelocity.GetVelocity();
-                        p.rot = {
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
-                            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax)
-                        };
-                        p.rotvel = RandomFloat(entry.m_RotSpeedMin, entry.m_RotSpeedMax);
-                        p.rotprog = RandomFloat(-180, 180);
-                        p.def = entry.geometry;
-                        p.idx = (int)(def.m_Material - Editor::TrailMaterials);
-
-
-                        m_GeometryParticles.push_back(p);
+                        // the count went past a whole particle `late` seconds
+                        // before the end of the frame, the emitter was that
+                        // far back along its path
+                        auto late = min((entry.m_SpawnedParticles - 1.f) / spawn, dt);
+                        auto emitter = model * XMMatrixTranslationFromVector(velocity * -late);
+
+                        auto &pool = GetPool(m_GeometryParticles, entry);
+                        auto p = SpawnGeometryParticle(entry, emitter, velocity * entry.m_InheritVelocity, lod_scale);
+                        AdvanceParticle(pool, p, late);
+                        pool.particles.push_back(p);
                     }
                 }
             } break;
@@ -251,12 +460,25 @@ void ParticleSystem::ProcessFX(ParticleEffect *fx, SimpleMath::Matrix model, flo
                 auto &trailfx = entry.trail;
                 auto def = *trailfx.def;
 
+                // trail points live in world space, the points left behind
+                // stay where the emitter was when they were emitted
+                TrailParticle head = {
+                    SimpleMath::Vector3::Transform(def.m_StartPosition.GetPosition(), model),
+                    def.m_StartVelocity.GetVelocity(),
+                    SimpleMath::Vector2(0.13, 1.0)
+                };
+
                 if (trailfx.trailidx == -1) {
                     trailfx.trailidx = m_TrailParticles.size();
                     
                     m_TrailParticles.push_back({});
                     m_TrailParticles[trailfx.trailidx].def = trailfx.def;
                     m_TrailParticles[trailfx.trailidx].idx = (int)(def.m_Material - Editor::TrailMaterials);
+
+                    // a new trail starts collapsed on its head, not streaking
+                    // in from the origin
+                    for (auto &point : m_TrailParticles[trailfx.trailidx].points)
+                        point = head;
                 }
 
                 auto &trail = m_TrailParticles[trailfx.trailidx];
@@ -266,21 +488,29 @@ void ParticleSystem::ProcessFX(ParticleEffect *fx, SimpleMath::Matrix model, flo
                     // remove
                 }
 
-                if (trail.spawn >= def.frequency) {
-                    particles[0] = {
-                        def.m_StartPosition.GetPosition(),// RandomFloat(-0.01, 0.01), 0, RandomFloat(-0.01, 0.01)),
-                        def.m_StartVelocity.GetVelocity(),
-                        SimpleMath::Vector2(0.13, 1.0)
-                    };
+                // with distance sampling the head follows the emitter every
+                // frame, update decides when it has moved far enough to leave
+                // a point behind
+                if (def.m_Sampling == TrailSampling::Distance || trail.spawn >= def.frequency) {
+                    particles[0] = head;
                 }
             } break;
         }
     }
 }
 
-void ParticleSystem::ProcessFX(ParticleEffect & fx, XMMATRIX model, XMVECTOR velocity, float dt)
+void ParticleSystem::ProcessFlipbook(const Flipbook *flipbook, RenderTexture atlas, XMMATRIX model, float age)
 {
+    if (m_FlipbookSprites.size() >= FLIPBOOK_SPRITE_MAX)
+        return;
+
+    FlipbookSprite sprite = {};
+    sprite.m_Flipbook = flipbook;
+    sprite.m_Atlas = atlas;
+    XMStoreFloat4x4(&sprite.m_Model, model);
+    sprite.m_Age = age;
 
+    m_FlipbookSprites.push_back(sprite);
 }
 
 void ParticleSystem::AddFX(std::string name, XMMATRIX model)
@@ -301,135 +531,620 @@ ParticleEffect ParticleSystem::GetFX(std::string name)
     return *result;
 }
 
-GeometryParticleInstance *ParticleSystem::UpdateParticles(XMVECTOR anchor, std::vector<GeometryParticle> &particles, float dt, GeometryParticleInstance *output, GeometryParticleInstance *max)
+static void WriteInstance(GeometryParticleInstance *out, XMVECTOR position, XMVECTOR rotation, float scale, XMVECTOR color, float age, float deform, const GeometryParticleDefinition &def)
 {
-    auto it = particles.begin();
-    while (it != particles.end() && output < max) {
-        auto &particle = *it;
-        auto def = *particle.def;
+    out->m_Model = XMMatrixRotationQuaternion(rotation) * XMMatrixScaling(scale, scale, scale) * XMMatrixTranslationFromVector(position);
+    out->m_Age = age;
+
+    out->m_Color = color;
+    out->m_Deform = deform;
+    out->m_DeformSpeed = def.m_DeformSpeed;
+    out->m_NoiseScale = def.m_NoiseScale;
+    out->m_NoiseSpeed = def.m_NoiseSpeed;
+}
 
-        if (particle.age > def.lifetime) {
-            it = particles.erase(it);
-            continue;
-        }
+static void WriteInstance(GeometryParticleInstanceCompact *out, XMVECTOR position, XMVECTOR rotation, float scale, XMVECTOR color, float age, float deform, const GeometryParticleDefinition &def)
+{
+    XMStoreFloat3(&out->m_Position, position);
+    out->m_Scale = PackedVector::XMConvertFloatToHalf(scale);
+    out->m_NoiseSpeed = PackedVector::XMConvertFloatToHalf(def.m_NoiseSpeed);
 
-        auto factor = particle.age / def.lifetime;
+    PackedVector::XMStoreShortN4(&out->m_Rotation, rotation);
+    PackedVector::XMStoreHalf4(&out->m_Color, color);
+    PackedVector::XMStoreHalf4(&out->m_Params, XMVectorSet(age, deform, def.m_DeformSpeed, def.m_NoiseScale));
+}
 
-        auto ease_color = GetEaseFuncV(def.m_ColorEasing);
-        auto ease_deform = GetEaseFunc(def.m_DeformEasing);
-        auto ease_size = GetEaseFunc(def.m_SizeEasing);
+static void ExpandInstance(const GeometryParticleInstanceCompact &in, GeometryParticleInstance *out)
+{
+    auto params = PackedVector::XMLoadHalf4(&in.m_Params);
+    auto scale = PackedVector::XMConvertHalfToFloat(in.m_Scale);
+
+    out->m_Model = XMMatrixRotationQuaternion(XMQuaternionNormalize(PackedVector::XMLoadShortN4(&in.m_Rotation))) * XMMatrixScaling(scale, scale, scale) * XMMatrixTranslationFromVector(XMLoadFloat3(&in.m_Position));
+    out->m_Color = PackedVector::XMLoadHalf4(&in.m_Color);
+    out->m_Age = XMVectorGetX(params);
+    out->m_Deform = XMVectorGetY(params);
+    out->m_DeformSpeed = XMVectorGetZ(params);
+    out->m_NoiseScale = XMVectorGetW(params);
+    out->m_NoiseSpeed = PackedVector::XMConvertHalfToFloat(in.m_NoiseSpeed);
+}
 
-        auto scale = ease_size(def.m_SizeStart, def.m_SizeEnd, factor);
+static XMVECTOR GetInstancePosition(const GeometryParticleInstance &instance)
+{
+    return instance.m_Model.r[3];
+}
 
-        output->m_Model = XMMatrixRotationAxis(XMVECTOR{ 0.1f }+XMLoadFloat3(&particle.rot), (particle.rotprog + particle.age) * particle.rotvel)  * XMMatrixScaling(scale, scale, scale) * XMMatrixTranslationFromVector(anchor + XMLoadFloat3(&particle.pos));
-        output->m_Age = factor;
+static XMVECTOR GetInstancePosition(const GeometryParticleInstanceCompact &instance)
+{
+    return XMLoadFloat3(&instance.m_Position);
+}
 
-        output->m_Color = ease_color(def.m_ColorStart, def.m_ColorEnd, factor);
-        output->m_Deform = ease_deform(def.m_DeformFactorStart, def.m_DeformFactorEnd, factor);
-        output->m_DeformSpeed = def.m_DeformSpeed;
-        output->m_NoiseScale = def.m_NoiseScale;
-        output->m_NoiseSpeed = def.m_NoiseSpeed;
+static void OffsetInstance(GeometryParticleInstance &instance, XMVECTOR offset)
+{
+    instance.m_Model.r[3] += XMVectorSetW(offset, 0.f);
+}
 
-        particle.age += dt;
-        particle.rotprog += dt;
+static void OffsetInstance(GeometryParticleInstanceCompact &instance, XMVECTOR offset)
+{
+    XMStoreFloat3(&instance.m_Position, XMLoadFloat3(&instance.m_Position) + offset);
+}
 
-        XMStoreFloat3(&particle.velocity, XMLoadFloat3(&particle.velocity) + XMVECTOR{ 0, def.m_Gravity, 0 } *dt);
-        XMStoreFloat3(&particle.pos, XMLoadFloat3(&particle.pos) + XMLoadFloat3(&particle.velocity) * dt);
+// Easing looked up per pool through the ease_funcs tables, every call is
+// indirect.
+struct DynamicEasing {
+    DynamicEasing(const GeometryParticleDefinition &def)
+        : m_Size(GetEaseFunc(def.m_SizeEasing)),
+          m_Deform(GetEaseFunc(def.m_DeformEasing)),
+          m_Color(GetEaseFuncV(def.m_ColorEasing)),
+          m_LightRadius(GetEaseFunc(def.m_LightRadiusEasing)),
+          m_LightColor(GetEaseFuncV(def.m_LightColorEasing))
+    {
+    }
 
-        auto ease_light_color = GetEaseFuncV(def.m_LightColorEasing);
-        auto ease_light_radius = GetEaseFunc(def.m_LightRadiusEasing);
+    float Size(float start, float end, float t) const { return m_Size(start, end, t); }
+    float Deform(float start, float end, float t) const { return m_Deform(start, end, t); }
+    XMVECTOR Color(XMVECTOR start, XMVECTOR end, float t) const { return m_Color(start, end, t); }
+    float LightRadius(float start, float end, float t) const { return m_LightRadius(start, end, t); }
+    XMVECTOR LightColor(XMVECTOR start, XMVECTOR end, float t) const { return m_LightColor(start, end, t); }
+
+    EaseFunc m_Size;
+    EaseFunc m_Deform;
+    EaseFuncV m_Color;
+    EaseFunc m_LightRadius;
+    EaseFuncV m_LightColor;
+};
+
+// Easing fixed at compile time, inlined into the kernel.
+template <ParticleEase SizeEase, ParticleEase DeformEase, ParticleEase ColorEase, ParticleEase LightRadiusEase, ParticleEase LightColorEase>
+struct FixedEasing {
+    float Size(float start, float end, float t) const { return StaticEase<SizeEase>::Apply(start, end, t); }
+    float Deform(float start, float end, float t) const { return StaticEase<DeformEase>::Apply(start, end, t); }
+    XMVECTOR Color(XMVECTOR start, XMVECTOR end, float t) const { return StaticEase<ColorEase>::Apply(start, end, t); }
+    float LightRadius(float start, float end, float t) const { return StaticEase<LightRadiusEase>::Apply(start, end, t); }
+    XMVECTOR LightColor(XMVECTOR start, XMVECTOR end, float t) const { return StaticEase<LightColorEase>::Apply(start, end, t); }
+};
+
+template <typename Instance, typename Easing, typename Pool>
+static Instance *UpdatePoolWith(const ParticleAnchor &anchor, Pool &pool, float dt, Instance *output, Instance *max, XMFLOAT3 *velocities, LightBuffer &lights, const Easing &easing)
+{
+    auto &def = *pool.def;
+    auto &particles = pool.particles;
 
-        auto radius = ease_light_radius(def.m_LightRadiusStart, def.m_LightRadiusEnd, factor);
-        if (radius != 0.f && m_ParticleLights.LightCount < 128) {
-            auto light_color = ease_light_color(def.m_LightColorStart, def.m_LightColorEnd, factor);
+    // dead particles are compacted away in the same pass, particles that do
+    // not fit in the output are kept as they are
+    size_t alive = 0;
+    size_t i = 0;
+    for (; i < particles.size() && output < max; i++) {
+        auto particle = particles[i];
+
+        if (particle.age > def.lifetime)
+            continue;
+
+        auto factor = particle.age / def.lifetime;
+        auto scale = easing.Size(def.m_SizeStart, def.m_SizeEnd, factor);
+
+        XMVECTOR axis;
+        float angle;
+        GetRotation(pool, particle, axis, angle);
+
+        auto color = easing.Color(def.m_ColorStart, def.m_ColorEnd, factor);
+        auto deform = easing.Deform(def.m_DeformFactorStart, def.m_DeformFactorEnd, factor);
+
+        auto position = XMVector3Transform(XMLoadFloat3(&particle.pos), anchor.m_World);
+        auto rotation = XMQuaternionMultiply(XMQuaternionRotationAxis(axis, angle), anchor.m_Rotation);
+
+        WriteInstance(output, position, rotation, scale * GetScale(particle) * anchor.m_Scale, color, factor, deform, def);
+        if (velocities)
+            XMStoreFloat3(velocities++, XMVector3TransformNormal(GetVelocity(pool, particle), anchor.m_World));
+
+        AdvanceParticle(pool, particle, dt);
+
+        auto radius = easing.LightRadius(def.m_LightRadiusStart, def.m_LightRadiusEnd, factor);
+        if (radius != 0.f && lights.LightCount < 128) {
+            auto light_color = easing.LightColor(def.m_LightColorStart, def.m_LightColorEnd, factor);
 
             Light light;
-            light.position = particle.pos;
-            XMStoreFloat3(&light.position, anchor + XMLoadFloat3(&particle.pos));
+            XMStoreFloat3(&light.position, position);
             light.range = radius;
             XMStoreFloat3(&light.color, light_color);
             light.intensity = XMVectorGetW(light_color);
 
-            m_ParticleLights.Lights[m_ParticleLights.LightCount++] = light;
+            lights.Lights[lights.LightCount++] = light;
         }
 
-        it++;
+        particles[alive++] = particle;
         output++;
     }
 
+    for (; i < particles.size(); i++)
+        particles[alive++] = particles[i];
+    particles.resize(alive);
+
     return output;
 }
 
-void ParticleSystem::update(Camera *cam, float dt)
+template <typename Instance>
+using PoolKernel = Instance *(*)(const ParticleAnchor &anchor, GeometryParticlePool &pool, float dt, Instance *output, Instance *max, XMFLOAT3 *velocities, LightBuffer &lights);
+
+// Linear, EaseIn and EaseOut for size, deform, color, light radius and light
+// color, None has no function and is never specialized.
+#define POOL_EASE_COUNT 3
+#define POOL_KERNEL_COUNT (POOL_EASE_COUNT * POOL_EASE_COUNT * POOL_EASE_COUNT * POOL_EASE_COUNT * POOL_EASE_COUNT)
+
+template <typename Instance, size_t I>
+static Instance *FixedPoolKernel(const ParticleAnchor &anchor, GeometryParticlePool &pool, float dt, Instance *output, Instance *max, XMFLOAT3 *velocities, LightBuffer &lights)
 {
-    {
-        BillboardParticle *ptr = m_BillboardBuffer->Map(cxt);
-        for (auto particle : m_BillboardParticles) {
-            *ptr++ = particle;
-        }
-        m_BillboardBuffer->Unmap(cxt);
+    typedef FixedEasing<
+        (ParticleEase)(I % POOL_EASE_COUNT),
+        (ParticleEase)(I / POOL_EASE_COUNT % POOL_EASE_COUNT),
+        (ParticleEase)(I / (POOL_EASE_COUNT * POOL_EASE_COUNT) % POOL_EASE_COUNT),
+        (ParticleEase)(I / (POOL_EASE_COUNT * POOL_EASE_COUNT * POOL_EASE_COUNT) % POOL_EASE_COUNT),
+        (ParticleEase)(I / (POOL_EASE_COUNT * POOL_EASE_COUNT * POOL_EASE_COUNT * POOL_EASE_COUNT))
+    > Easing;
+
+    return UpdatePoolWith(anchor, pool, dt, output, max, velocities, lights, Easing());
+}
+
+template <typename Instance, size_t... I>
+static std::array<PoolKernel<Instance>, sizeof...(I)> MakePoolKernels(std::index_sequence<I...>)
+{
+    return {{ FixedPoolKernel<Instance, I>... }};
+}
+
+template <typename Instance>
+static PoolKernel<Instance> GetPoolKernel(const GeometryParticleDefinition &def)
+{
+    static const std::array<PoolKernel<Instance>, POOL_KERNEL_COUNT> kernels = MakePoolKernels<Instance>(std::make_index_sequence<POOL_KERNEL_COUNT>());
+
+    ParticleEase eases[] = {
+        def.m_SizeEasing,
+        def.m_DeformEasing,
+        def.m_ColorEasing,
+        def.m_LightRadiusEasing,
+        def.m_LightColorEasing
+    };
+
+    size_t index = 0;
+    for (int i = ARRAYSIZE(eases) - 1; i >= 0; i--) {
+        if ((uint32_t)eases[i] >= POOL_EASE_COUNT)
+            return nullptr;
+        index = index * POOL_EASE_COUNT + (size_t)eases[i];
     }
 
-    {
-        GeometryParticleInstance *ptr = m_GeometryInstanceBuffer->Map(cxt);
-        auto max = ptr + 256;
-        UpdateParticles({}, m_GeometryParticles, dt, ptr, max);
-        for (auto fx : m_AnchoredEffects) {
-            ptr = UpdateParticles(XMLoadFloat3(&fx->pos), fx->children, dt, ptr, max);
+    return kernels[index];
+}
+
+template <typename Instance>
+Instance *ParticleSystem::UpdatePool(const ParticleAnchor &anchor, GeometryParticlePool &pool, float dt, Instance *output, Instance *max, XMFLOAT3 *velocities)
+{
+    if (m_SpecializedKernels) {
+        auto kernel = GetPoolKernel<Instance>(*pool.def);
+        if (kernel)
+            return kernel(anchor, pool, dt, output, max, velocities, m_ParticleLights);
+    }
+
+    return UpdatePoolWith(anchor, pool, dt, output, max, velocities, m_ParticleLights, DynamicEasing(*pool.def));
+}
+
+template <typename Instance>
+UINT ParticleSystem::UpdatePools(std::vector<Instance> &instances, float dt)
+{
+    Instance *start = instances.data();
+    auto max = start + instances.size();
+    auto ptr = start;
+
+    // instances of a pool come out contiguous with one material, which
+    // lets render() draw them with a single call
+    auto simulate = [&](const ParticleAnchor &anchor, GeometryParticlePool &pool, float step, XMFLOAT3 *velocities) {
+        auto first = ptr;
+        ptr = UpdatePool(anchor, pool, step, ptr, max, velocities);
+        std::fill(m_GeometryInstanceMaterials.begin() + (first - start), m_GeometryInstanceMaterials.begin() + (ptr - start), pool.idx);
+        m_GeometrySimulatedCount += (uint32_t)(ptr - first);
+    };
+
+    m_GeometryPoolCount = 0;
+    m_GeometrySimulatedCount = 0;
+    auto world = ParticleAnchor::FromMatrix(XMMatrixIdentity());
+    for (auto &pool : m_GeometryParticles) {
+        simulate(world, pool, dt, nullptr);
+        m_GeometryPoolCount++;
+    }
+
+    for (auto fx : m_AnchoredEffects) {
+        auto anchor = ParticleAnchor::FromMatrix(m_Transforms.GetWorld(fx->transform));
+
+        if (!m_TemporalLOD) {
+            for (auto &pool : fx->children) {
+                simulate(anchor, pool, dt, nullptr);
+                m_GeometryPoolCount++;
+            }
+            continue;
         }
-        m_GeometryInstanceBuffer->Unmap(cxt);
+
+        auto &cache = GetTemporalLODCache(fx);
+        auto bucket = cache.m_LOD.m_Bucket;
+        cache.m_LOD.m_Elapsed += dt;
+
+        // a cache from the other instance layout cannot be replayed
+        if (cache.m_Valid && cache.m_Compact == std::is_same<Instance, GeometryParticleInstanceCompact>::value && !cache.m_LOD.ShouldTick(m_Frame)) {
+            // the effect moved on with its node, the particles along the
+            // velocities they had at the last tick
+            auto moved = anchor.m_World.r[3] - XMLoadFloat3(&cache.m_Origin);
+            auto elapsed = cache.m_LOD.m_Elapsed;
+
+            auto count = min(cache.m_Instances.size() / sizeof(Instance), (size_t)(max - ptr));
+            auto first = ptr;
+            memcpy(ptr, cache.m_Instances.data(), count * sizeof(Instance));
+            for (size_t i = 0; i < count; i++, ptr++)
+                OffsetInstance(*ptr, moved + XMLoadFloat3(&cache.m_Velocities[i]) * elapsed);
+            std::copy(cache.m_Materials.begin(), cache.m_Materials.begin() + count, m_GeometryInstanceMaterials.begin() + (first - start));
+
+            // the lights keep no velocity, they only follow the node
+            for (auto &light : cache.m_Lights) {
+                if (m_ParticleLights.LightCount >= 128)
+                    break;
+                auto &out = m_ParticleLights.Lights[m_ParticleLights.LightCount++];
+                out = light;
+                XMStoreFloat3(&out.position, XMLoadFloat3(&light.position) + moved);
+            }
+
+            m_TemporalLODStats.m_SavedParticles[bucket] += (uint32_t)count;
+            continue;
+        }
+
+        size_t particles = 0;
+        for (auto &pool : fx->children)
+            particles += pool.particles.size();
+        cache.m_Velocities.resize(particles);
+
+        auto first = ptr;
+        auto first_light = m_ParticleLights.LightCount;
+        for (auto &pool : fx->children) {
+            simulate(anchor, pool, cache.m_LOD.m_Elapsed, cache.m_Velocities.data() + (ptr - first));
+            m_GeometryPoolCount++;
+        }
+
+        auto count = (size_t)(ptr - first);
+        auto origin = anchor.m_World.r[3];
+        auto extent = XMVectorZero();
+        for (auto instance = first; instance < ptr; instance++)
+            extent = XMVectorMax(extent, XMVector3LengthEst(GetInstancePosition(*instance) - origin));
+
+        cache.m_Instances.assign((const uint8_t*)first, (const uint8_t*)ptr);
+        cache.m_Materials.assign(m_GeometryInstanceMaterials.begin() + (first - start), m_GeometryInstanceMaterials.begin() + (ptr - start));
+        cache.m_Velocities.resize(count);
+        cache.m_Lights.assign(m_ParticleLights.Lights + first_light, m_ParticleLights.Lights + m_ParticleLights.LightCount);
+        cache.m_Radius = XMVectorGetX(extent);
+        XMStoreFloat3(&cache.m_Origin, origin);
+        cache.m_Compact = std::is_same<Instance, GeometryParticleInstanceCompact>::value;
+        cache.m_Valid = true;
+        cache.m_LOD.m_Elapsed = 0.f;
+
+        m_TemporalLODStats.m_Ticked[bucket]++;
+    }
+
+    return (UINT)(ptr - start);
+}
+
+TemporalLODCache &ParticleSystem::GetTemporalLODCache(AnchoredParticleEffect *fx)
+{
+    // the slot may have been freed and handed to another effect since
+    if (fx->lod == 0 || fx->lod > m_TemporalLODCaches.size() || m_TemporalLODCaches[fx->lod - 1].m_Owner != fx) {
+        auto slot = std::find_if(m_TemporalLODCaches.begin(), m_TemporalLODCaches.end(), [](TemporalLODCache &cache) {
+            return cache.m_Owner == nullptr;
+        });
+        if (slot == m_TemporalLODCaches.end())
+            slot = m_TemporalLODCaches.insert(slot, TemporalLODCache());
+
+        *slot = {};
+        slot->m_Owner = fx;
+        fx->lod = (uint32_t)(slot - m_TemporalLODCaches.begin()) + 1;
+    }
+
+    auto &cache = m_TemporalLODCaches[fx->lod - 1];
+    cache.m_Frame = m_Frame;
+
+    return cache;
+}
+
+void ParticleSystem::ReleaseTemporalLODCaches()
+{
+    // effects are processed every frame they are alive, one that was not
+    // this frame is gone or hidden and ticks from scratch if it comes back
+    for (auto &cache : m_TemporalLODCaches) {
+        if (cache.m_Owner && cache.m_Frame != m_Frame)
+            cache = {};
+    }
+
+    while (!m_TemporalLODCaches.empty() && !m_TemporalLODCaches.back().m_Owner)
+        m_TemporalLODCaches.pop_back();
+}
+
+float ParticleSystem::GetProjectedSize(FXMVECTOR position, float radius) const
+{
+    if (m_LODFocal == 0.f)
+        return 1.f;
+
+    // the view is right handed, what is in front has a negative z
+    auto depth = -XMVectorGetZ(XMVector3Transform(position, XMLoadFloat4x4(&m_LODView)));
+    return radius * m_LODFocal / max(depth, 0.01f) * 0.5f;
+}
+
+float ParticleSystem::GetSpawnLOD(const ParticleEffectEntry &entry, const SimpleMath::Matrix &model)
+{
+    if (entry.m_LODScreenSize <= 0.f || m_LODFocal == 0.f)
+        return 1.f;
+
+    // the start position box and the largest particle stand in for the
+    // bounds of what the entry spawns
+    auto &box = entry.m_StartPosition;
+    auto center = SimpleMath::Vector3::Transform((box.m_Min + box.m_Max) * 0.5f, model);
+    auto radius = (box.m_Max - box.m_Min).Length() * 0.5f + max(entry.geometry->m_SizeStart, entry.geometry->m_SizeEnd);
+
+    auto coverage = GetProjectedSize(center, radius) / entry.m_LODScreenSize;
+    auto factor = GetEaseFunc(entry.m_LODEasing)(entry.m_LODMinFactor, 1.f, min(coverage, 1.f));
+    factor = max(factor, 0.01f);
+
+    m_SpawnLODDebug.push_back({ center, factor });
+
+    return factor;
+}
+
+void ParticleSystem::ScheduleTemporalLOD(Camera *cam)
+{
+    m_TemporalLODStats = {};
+
+    // without a camera, or with the LOD off, everything ticks every frame
+    // and nothing recorded earlier may be replayed later
+    if (!m_TemporalLOD || !cam) {
+        m_TemporalLODCaches.clear();
+        m_TemporalLODStats.m_Effects[0] = (uint32_t)m_AnchoredEffects.size();
+        return;
+    }
+
+    for (auto fx : m_AnchoredEffects) {
+        auto &cache = GetTemporalLODCache(fx);
+
+        // from the extent of the last tick, an effect that has not ticked
+        // yet counts as large
+        auto size = cache.m_Valid ? GetProjectedSize(m_Transforms.GetWorld(fx->transform).r[3], cache.m_Radius) : 1.f;
+
+        cache.m_LOD.SetScreenSize(size, m_TemporalLODSettings, m_TemporalLODStagger);
+        m_TemporalLODStats.m_Effects[cache.m_LOD.m_Bucket]++;
+    }
+
+    ReleaseTemporalLODCaches();
+}
+
+void ParticleSystem::update(Camera *cam, float dt)
+{
+    // world matrices of everything anchored effects hang off, moved since
+    // the last frame or not
+    m_Transforms.Update();
+
+    m_Frame++;
+    if (cam) {
+        XMStoreFloat4x4(&m_LODView, cam->GetView());
+        m_LODFocal = XMVectorGetY(cam->GetProjection().r[1]);
     }
+    else {
+        m_LODFocal = 0.f;
+    }
+    ScheduleTemporalLOD(cam);
+
+    {
+        // simulate into the CPU staging copy, mapped memory is write-only
+        auto timer = std::chrono::high_resolution_clock::now();
+
+        m_CompactStaged = m_CompactInstances;
+        m_CompactExpanded = false;
+        if (m_CompactStaged)
+            m_GeometryInstanceCount = UpdatePools(m_GeometryCompactInstances, dt);
+        else
+            m_GeometryInstanceCount = UpdatePools(m_GeometryInstances, dt);
 
-    *m_Lights->Map(cxt) = m_ParticleLights;
-    m_Lights->Unmap(cxt);
+        auto empty = [](GeometryParticlePool &pool) { return pool.particles.empty(); };
+        m_GeometryParticles.erase(std::remove_if(m_GeometryParticles.begin(), m_GeometryParticles.end(), empty), m_GeometryParticles.end());
+        for (auto fx : m_AnchoredEffects)
+            fx->children.erase(std::remove_if(fx->children.begin(), fx->children.end(), empty), fx->children.end());
+
+        m_GeometryUpdateMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timer).count();
+    }
 
     {
         for (auto &trail : m_TrailParticles) {
             auto particles = trail.points;
             auto &def = *trail.def;
 
-            while (trail.spawn >= def.frequency) {
-                trail.spawn -= def.frequency;
-
-                if (trail.age >= def.lifetime) {
-
-                    if (trail.dead >= TRAIL_COUNT - 2) {
-                        // delete trail
+            // dying trails keep collapsing on the time interval even when
+            // the head has stopped moving
+            if (def.m_Sampling == TrailSampling::Distance && trail.age < def.lifetime) {
+                auto step = max(def.m_SampleDistance, 0.0001f);
+                auto head = particles[0];
+                auto last = particles[1].m_Position;
+                auto delta = head.m_Position - last;
+                auto moved = delta.Length();
+
+                if (moved >= step) {
+                    // one point per `step` along the frame's movement, so a
+                    // fast head does not leave a single long segment
+                    int count = min((int)(moved / step), TRAIL_COUNT - 3);
+                    for (int i = 1; i <= count; i++) {
+                        auto point = head;
+                        point.m_Position = last + delta * ((float)i / count);
+                        EmitTrailPoint(trail, def, point, dt / count);
                     }
-                    else {
-                        trail.dead++;
+                }
+                else if (moved >= step * 0.25f) {
+                    auto previous = last - particles[2].m_Position;
+                    auto length = previous.Length();
+                    if (length > 0.0001f && previous.Dot(delta) / (length * moved) < cosf(XMConvertToRadians(def.m_SampleAngle))) {
+                        EmitTrailPoint(trail, def, head, dt);
                     }
                 }
 
-                TrailParticle particle = particles[1];
-                particle.m_Position += particle.m_Velocity;
-                particle.m_Position.y += def.m_Gravity;
+                trail.spawn = 0.f;
+            }
+            else {
+                while (trail.spawn >= def.frequency) {
+                    trail.spawn -= def.frequency;
+                    EmitTrailPoint(trail, def, particles[0], dt);
+                }
+            }
+
+            trail.age += dt;
+            trail.spawn += dt;
+        }
+    }
+
+    upload(GetFrameData(false));
+}
+
+void ParticleSystem::upload(const ParticleFrameData &data)
+{
+    {
+        auto count = min(data.m_BillboardCount, capacity);
+
+        BillboardParticle *ptr = (BillboardParticle*)m_Backend->Map(m_BillboardBuffer);
+        memcpy(ptr, data.m_Billboards, count * sizeof(BillboardParticle));
+        m_Backend->Unmap(m_BillboardBuffer, count * sizeof(BillboardParticle));
 
-                for (int i = TRAIL_COUNT - 2; i > 1; i--) {
-                    auto p = particles[i - 1];
-                    p.m_Position += particle.m_Velocity * dt;
-                    p.m_Position.y += def.m_Gravity * dt;
-                    particles[i] = p;
+        m_BillboardDrawMaterials.resize(count);
+        for (UINT i = 0; i < count; i++)
+            m_BillboardDrawMaterials[i] = data.m_Billboards[i].idx;
+
+        // The quads depend on the camera and are expanded in render(). The
+        // copy is kept while the geometry shader draws too, so the frame the
+        // CPU quads are turned on, paused or not, draws what was uploaded.
+        m_BillboardDrawParticles.assign(data.m_Billboards, data.m_Billboards + min(count, (UINT)BILLBOARD_QUAD_MAX));
+    }
+
+    {
+        auto count = min(data.m_InstanceCount, (UINT)m_GeometryInstances.size());
+
+        m_DrawCompact = data.m_CompactInstances != nullptr;
+
+        // sphere LOD of every instance from its projected size
+        auto &lods = m_GeometryInstanceLODs;
+        lods.assign(count, 0);
+        if (m_MeshLOD) {
+            for (UINT i = 0; i < count; i++) {
+                XMVECTOR position;
+                float scale;
+                if (m_DrawCompact) {
+                    position = XMLoadFloat3(&data.m_CompactInstances[i].m_Position);
+                    scale = PackedVector::XMConvertHalfToFloat(data.m_CompactInstances[i].m_Scale);
+                }
+                else {
+                    auto &model = data.m_Instances[i].m_Model;
+                    position = model.r[3];
+                    scale = XMVectorGetX(XMVectorMax(XMVector3Length(model.r[0]), XMVectorMax(XMVector3Length(model.r[1]), XMVector3Length(model.r[2]))));
                 }
 
-                for (int i = 0; i < trail.dead; i++) {
-                    particles[i] = particles[trail.dead];
+                lods[i] = (uint8_t)MeshCache::PickLOD(*m_Sphere, GetProjectedSize(position, scale * m_Sphere->m_Radius), m_MeshLODTolerance);
+            }
+        }
+
+        // every run of a material is split up by LOD, in order within a LOD
+        // so the draw order only changes between LODs
+        auto &order = m_GeometryDrawOrder;
+        order.resize(count);
+        m_GeometryDraws.clear();
+        for (UINT i = 0; i < count;) {
+            auto material = data.m_InstanceMaterials[i];
+
+            UINT run = 1;
+            while (i + run < count && data.m_InstanceMaterials[i + run] == material)
+                run++;
+
+            UINT written = i;
+            for (uint32_t lod = 0; lod < (uint32_t)m_Sphere->m_LODs.size(); lod++) {
+                UINT first = written;
+                for (UINT j = i; j < i + run; j++) {
+                    if (lods[j] == lod)
+                        order[written++] = j;
                 }
 
-                particles[1] = particles[0];
-                particles[TRAIL_COUNT - 1] = particles[TRAIL_COUNT - 2];
+                if (written > first)
+                    m_GeometryDraws.push_back({ material, lod, first, written - first });
             }
 
-            trail.age += dt;
-            trail.spawn += dt;
+            i += run;
+        }
+
+        auto stride = m_DrawCompact ? sizeof(GeometryParticleInstanceCompact) : sizeof(GeometryParticleInstance);
+        auto src = m_DrawCompact ? (const uint8_t*)data.m_CompactInstances : (const uint8_t*)data.m_Instances;
+        auto buffer = m_DrawCompact ? m_GeometryCompactInstanceBuffer : m_GeometryInstanceBuffer;
+
+        auto dst = (uint8_t*)m_Backend->Map(buffer);
+        if (m_MeshLOD) {
+            for (UINT i = 0; i < count; i++)
+                memcpy(dst + i * stride, src + order[i] * stride, stride);
+        }
+        else {
+            memcpy(dst, src, count * stride);
         }
+        m_Backend->Unmap(buffer, count * stride);
+
+        // vertex shader runs as the FIFO the ACMR is measured with would see
+        // them, next to every instance drawing the full sphere in file order
+        m_MeshLODStats = {};
+        auto &full = m_Sphere->m_LODs[0];
+        for (auto &draw : m_GeometryDraws) {
+            auto &lod = m_Sphere->m_LODs[draw.m_LOD];
+            m_MeshLODStats.m_Instances[draw.m_LOD] += draw.m_InstanceCount;
+            m_MeshLODStats.m_Vertices += (uint64_t)(lod.m_ACMRAfter * lod.m_IndexCount / 3 + 0.5f) * draw.m_InstanceCount;
+            m_MeshLODStats.m_BaselineVertices += (uint64_t)(full.m_ACMRBefore * full.m_IndexCount / 3 + 0.5f) * draw.m_InstanceCount;
+        }
+
+        m_GeometryInstanceCount = count;
+    }
+
+    {
+        auto count = min(data.m_LightCount, (UINT)ARRAYSIZE(m_ParticleLights.Lights));
 
-        TrailParticle *ptr = m_TrailBuffer->Map(cxt);
-        for (auto particle : m_TrailParticles) {
-            memcpy(ptr, particle.points, TRAIL_COUNT * sizeof(TrailParticle));
-            ptr += TRAIL_COUNT * sizeof(TrailParticle);
+        LightBuffer *ptr = (LightBuffer*)m_Backend->Map(m_Lights);
+        ptr->LightCount = count;
+        memcpy(ptr->Lights, data.m_Lights, count * sizeof(Light));
+        m_Backend->Unmap(m_Lights, sizeof(LightBuffer));
+    }
+
+    {
+        auto count = min(data.m_TrailCount, (UINT)TRAIL_PARTICLE_COUNT);
+
+        TrailParticle *ptr = (TrailParticle*)m_Backend->Map(m_TrailBuffer);
+        m_TrailDrawMaterials.resize(count);
+        for (UINT i = 0; i < count; i++) {
+            memcpy(ptr, data.m_Trails[i].points, TRAIL_COUNT * sizeof(TrailParticle));
+            ptr += TRAIL_COUNT;
+
+            m_TrailDrawMaterials[i] = data.m_Trails[i].idx;
         }
-        m_TrailBuffer->Unmap(cxt);
+        m_Backend->Unmap(m_TrailBuffer, count * TRAIL_COUNT * sizeof(TrailParticle));
+
+        // Ribbons face the camera and are built in render(). Copied while
+        // the geometry shader draws too, like the billboards, so turning
+        // ribbons on while paused draws what was uploaded.
+        m_TrailDrawTrails.assign(data.m_Trails, data.m_Trails + count);
     }
 }
 
@@ -438,173 +1153,527 @@ void ParticleSystem::frame()
     m_ParticleLights.LightCount = 0;
     m_BillboardParticles.clear();
     m_AnchoredEffects.clear();
+    m_SpawnLODDebug.clear();
+    m_FlipbookSprites.clear();
+
+    m_Backend->EndFrame();
+}
+
+ParticleFrameData ParticleSystem::GetFrameData() const
+{
+    return GetFrameData(true);
+}
+
+ParticleFrameData ParticleSystem::GetFrameData(bool expand) const
+{
+    ParticleFrameData data = {};
+    if (m_CompactStaged && !expand) {
+        data.m_CompactInstances = m_GeometryCompactInstances.data();
+    }
+    else {
+        // compact instances are only expanded when something reads them back
+        if (m_CompactStaged && !m_CompactExpanded) {
+            for (UINT i = 0; i < m_GeometryInstanceCount; i++)
+                ExpandInstance(m_GeometryCompactInstances[i], &m_GeometryInstances[i]);
+            m_CompactExpanded = true;
+        }
+        data.m_Instances = m_GeometryInstances.data();
+    }
+    data.m_InstanceMaterials = m_GeometryInstanceMaterials.data();
+    data.m_InstanceCount = m_GeometryInstanceCount;
+    data.m_Lights = m_ParticleLights.Lights;
+    data.m_LightCount = m_ParticleLights.LightCount;
+    data.m_Billboards = m_BillboardParticles.data();
+    data.m_BillboardCount = (UINT)m_BillboardParticles.size();
+    data.m_Trails = m_TrailParticles.data();
+    data.m_TrailCount = (UINT)min(m_TrailParticles.size(), (size_t)TRAIL_PARTICLE_COUNT);
+    data.m_SphereVertices = (const SphereVertex*)m_Sphere->m_SourceVertices;
+    data.m_SphereIndices = m_Sphere->m_SourceIndices;
+    data.m_SphereIndexCount = m_Sphere->m_SourceIndexCount;
+    data.m_Light = m_DirectionalLightData;
+
+    return data;
 }
 
 void ParticleSystem::ReadSphereModel()
 {
-    std::ifstream meshfile("Resources/Mesh/sphere.dat", std::ifstream::in | std::ifstream::binary);
-    if (!meshfile.is_open())
-        throw "Can't load sky dome mesh";
+    m_Sphere = m_Meshes->Load("Resources/Mesh/sphere.dat");
+    if (!m_Sphere)
+        throw "Can't load sphere mesh";
+
+    m_GeometryInstances.resize(256);
+    m_GeometryInstanceMaterials.resize(m_GeometryInstances.size());
+    m_GeometryInstanceBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(GeometryParticleInstance), (uint32_t)m_GeometryInstances.size());
+
+    m_GeometryCompactInstances.resize(m_GeometryInstances.size());
+    m_GeometryCompactInstanceBuffer = m_Backend->CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Dynamic, sizeof(GeometryParticleInstanceCompact), (uint32_t)m_GeometryCompactInstances.size());
+
+    RenderInputElement input_desc[] = {
+        MESH_VERTEX_ELEMENTS,
+
+        { "MODEL",       0, RenderFormat::R32G32B32A32Float, 1, true },
+        { "MODEL",       1, RenderFormat::R32G32B32A32Float, 1, true },
+        { "MODEL",       2, RenderFormat::R32G32B32A32Float, 1, true },
+        { "MODEL",       3, RenderFormat::R32G32B32A32Float, 1, true },
+        { "COLOR",       0, RenderFormat::R32G32B32A32Float, 1, true },
+        { "AGE",         0, RenderFormat::R32Float,          1, true },
+        { "DEFORM",      0, RenderFormat::R32Float,          1, true },
+        { "DEFORMSPEED", 0, RenderFormat::R32Float,          1, true },
+        { "NOISESCALE",  0, RenderFormat::R32Float,          1, true },
+        { "NOISESPEED",  0, RenderFormat::R32Float,          1, true },
+    };
+    m_DefaultGeometryVS = m_Backend->CreateShader(RenderShaderStage::Vertex, L"Resources/Shaders/GeometryParticle.hlsl", "VS", input_desc, ARRAYSIZE(input_desc), &m_DefaultGeometryLayout);
 
-    uint32_t vertexcount = 0;
-    uint32_t indexcount = 0;
+    RenderInputElement compact_desc[] = {
+        MESH_VERTEX_ELEMENTS,
 
-    meshfile.read(reinterpret_cast<char*>(&vertexcount), sizeof(uint32_t));
-    if (!vertexcount)
-        throw "Parse error";
+        { "OFFSET",      0, RenderFormat::R32G32B32Float,    1, true },
+        { "SCALE",       0, RenderFormat::R16G16Float,       1, true },
+        { "ROTATION",    0, RenderFormat::R16G16B16A16SNorm, 1, true },
+        { "COLOR",       0, RenderFormat::R16G16B16A16Float, 1, true },
+        { "PARAMS",      0, RenderFormat::R16G16B16A16Float, 1, true },
+    };
+    m_CompactGeometryVS = m_Backend->CreateShader(RenderShaderStage::Vertex, L"Resources/Shaders/GeometryParticle.hlsl", "VSCompact", compact_desc, ARRAYSIZE(compact_desc), &m_CompactGeometryLayout);
+}
 
-    meshfile.read(reinterpret_cast<char*>(&indexcount), sizeof(uint32_t));
-    if (!indexcount)
-        throw "Parse error";
+static BillboardAxes GetBillboardAxes(FXMMATRIX view)
+{
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, view);
 
-    std::vector<SphereVertex> vertices;
-    std::vector<UINT16> indices;
+    return GetBillboardAxes(m.m);
+}
 
-    vertices.resize(vertexcount);
-    meshfile.read(reinterpret_cast<char*>(&vertices.front()), sizeof(SphereVertex) * vertexcount);
+void ParticleSystem::render(Camera *cam, RenderTarget dst_dsv, RenderTarget dst_rtv, bool debug)
+{
+    auto camera = cam->GetValues();
+    memcpy(m_Backend->Map(m_CameraBuffer), &camera, sizeof(CameraValues));
+    m_Backend->Unmap(m_CameraBuffer, sizeof(CameraValues));
 
-    indices.resize(indexcount);
-    meshfile.read(reinterpret_cast<char*>(&indices.front()), sizeof(UINT16) * indexcount);
+    m_Backend->BindConstantBuffer(RenderShaderStage::Vertex, 0, m_CameraBuffer);
+    m_Backend->BindConstantBuffer(RenderShaderStage::Geometry, 0, m_CameraBuffer);
+    m_Backend->BindConstantBuffer(RenderShaderStage::Pixel, 0, m_CameraBuffer);
 
-    m_GeometryIndices = indexcount;
-    m_GeometryBuffer = new VertexBuffer<SphereVertex>(device, BufferUsageImmutable, BufferAccessNone, vertexcount, &vertices[0]);
-    m_GeometryIndexBuffer = new IndexBuffer<UINT16>(device, BufferUsageImmutable, BufferAccessNone, indexcount, &indices[0]);
+    m_Backend->BindSamplers();
+    m_Backend->SetBlendState(RenderBlendState::NonPremultiplied);
 
-    m_GeometryInstanceBuffer = new VertexBuffer<GeometryParticleInstance>(device, BufferUsageDynamic, BufferAccessWrite, 256);
+    // spheres
+    {
+        RenderBufferID buffers[] = {
+            m_Sphere->m_VertexBuffer,
+            m_DrawCompact ? m_GeometryCompactInstanceBuffer : m_GeometryInstanceBuffer
+        };
 
-    ID3DBlob *blob = compile_shader(L"Resources/Shaders/GeometryParticle.hlsl", "VS", "vs_5_0", device);
-    DXCALL(device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_DefaultGeometryVS));
+        m_Backend->BindInputLayout(m_DrawCompact ? m_CompactGeometryLayout : m_DefaultGeometryLayout);
+        m_Backend->BindVertexBuffers(buffers, 2);
+        m_Backend->BindIndexBuffer(m_Sphere->m_IndexBuffer);
+        m_Backend->SetTopology(RenderTopology::TriangleList);
 
-    D3D11_INPUT_ELEMENT_DESC input_desc[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,                            D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        m_Backend->BindShader(RenderShaderStage::Vertex, m_DrawCompact ? m_CompactGeometryVS : m_DefaultGeometryVS);
+        m_Backend->BindConstantBuffer(RenderShaderStage::Pixel, 1, m_DirectionalLight);
+        m_Backend->BindConstantBuffer(RenderShaderStage::Pixel, 2, m_Lights);
 
-        { "MODEL",       0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,                            D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "MODEL",       1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "MODEL",       2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "MODEL",       3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "COLOR",       0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "AGE",         0, DXGI_FORMAT_R32_FLOAT,          1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "DEFORM",      0, DXGI_FORMAT_R32_FLOAT,          1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "DEFORMSPEED", 0, DXGI_FORMAT_R32_FLOAT,          1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "NOISESCALE",  0, DXGI_FORMAT_R32_FLOAT,          1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-        { "NOISESPEED",  0, DXGI_FORMAT_R32_FLOAT,          1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
-    };
-    m_DefaultGeometryLayout = create_input_layout(input_desc, ARRAYSIZE(input_desc), blob->GetBufferPointer(), blob->GetBufferSize(), device);
-}
+        m_Backend->SetDepthState(RenderDepthState::Default);
+        m_Backend->BindRenderTargets(dst_rtv, dst_dsv);
+        m_Backend->SetRasterState(debug ? RenderRasterState::Wireframe : RenderRasterState::CullNone);
 
-void ParticleSystem::render(Camera *cam, CommonStates *states, ID3D11DepthStencilView *dst_dsv, ID3D11RenderTargetView *dst_rtv, bool debug)
-{
+        // one draw per run of instances sharing a material and LOD
+        int bound = -1;
+        for (auto &draw : m_GeometryDraws) {
+            auto &lod = m_Sphere->m_LODs[draw.m_LOD];
 
-    ID3D11SamplerState *samplers[] = {
-        states->LinearClamp(),
-        states->LinearWrap(),
-        states->PointClamp(),
-        states->PointWrap()
-    };
-    cxt->VSSetSamplers(0, 4, samplers);
-    cxt->PSSetSamplers(0, 4, samplers);
+            if (draw.m_Material != bound) {
+                m_Backend->BindShader(RenderShaderStage::Pixel, Editor::TrailMaterials[draw.m_Material].m_PixelShader);
+                bound = draw.m_Material;
+            }
+            m_Backend->DrawIndexedInstanced(lod.m_IndexCount, draw.m_InstanceCount, lod.m_StartIndex, draw.m_StartInstance);
+        }
+    }
 
-    float blend[4] = { 1, 1, 1, 1 };
-    cxt->OMSetBlendState(m_ParticleBlend, nullptr, 0xffffffff);
+    m_Backend->SetRasterState(RenderRasterState::CullCounterClockwise);
 
-    // spheres
-    {
-        UINT strides[2] = {
-            (UINT)sizeof(SphereVertex),
-            (UINT)sizeof(GeometryParticleInstance)
-        };
+    // trails, built on the CPU
+    if (m_TrailRibbons) {
+        auto timer = std::chrono::high_resolution_clock::now();
 
-        UINT offsets[2] = {
-            0,
-            0
-        };
+        UINT counts[TRAIL_PARTICLE_COUNT];
+        m_TrailRibbonStats = {};
 
-        ID3D11Buffer *buffers[] = {
-            *m_GeometryBuffer,
-            *m_GeometryInstanceBuffer
-        };
+        auto vertices = (TrailRibbonVertex*)m_Backend->Map(m_TrailRibbonBuffer);
+        UINT written = 0;
+        for (size_t i = 0; i < m_TrailDrawTrails.size(); i++) {
+            counts[i] = BuildTrailRibbon(m_TrailDrawTrails[i], cam->GetView(), m_TrailRibbonTolerance, vertices + written, &m_TrailRibbonStats);
+            written += counts[i];
+        }
+        m_Backend->Unmap(m_TrailRibbonBuffer, written * sizeof(TrailRibbonVertex));
 
-        cxt->IASetInputLayout(m_DefaultGeometryLayout);
-        cxt->IASetVertexBuffers(0, 2, buffers, strides, offsets);
-        cxt->IASetIndexBuffer(*m_GeometryIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-        cxt->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        m_TrailRibbonMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timer).count();
 
-        cxt->VSSetShader(m_DefaultGeometryVS, nullptr, 0);
-        cxt->VSSetConstantBuffers(0, 1, *cam->GetBuffer());
+        m_Backend->BindVertexBuffers(&m_TrailRibbonBuffer, 1);
+        m_Backend->BindInputLayout(m_TrailRibbonLayout);
+        m_Backend->SetTopology(RenderTopology::TriangleStrip);
+        m_Backend->BindShader(RenderShaderStage::Vertex, m_TrailRibbonVS);
 
-        ID3D11Buffer *psbuffers[] = {
-            *cam->GetBuffer(),
-            *m_DirectionalLight,
-            *m_Lights
-        };
-        cxt->PSSetConstantBuffers(0, 3, psbuffers); 
+        m_Backend->SetRasterState(RenderRasterState::CullNone);
 
-        cxt->OMSetDepthStencilState(states->DepthDefault(), 0);
-        cxt->OMSetRenderTargets(1, &dst_rtv, dst_dsv);
+        UINT start = 0;
+        for (size_t i = 0; i < m_TrailDrawTrails.size(); i++) {
+            if (counts[i]) {
+                m_Backend->BindShader(RenderShaderStage::Pixel, Editor::TrailMaterials[m_TrailDrawMaterials[i]].m_PixelShader);
+                m_Backend->Draw(counts[i], start);
+            }
+            start += counts[i];
+        }
 
-        if (debug)
-            cxt->RSSetState(states->Wireframe());
-        else
-            cxt->RSSetState(states->CullNone());
+        m_Backend->SetRasterState(RenderRasterState::CullCounterClockwise);
+    }
+    // trails, widened by the geometry shader
+    else {
+        m_Backend->BindVertexBuffers(&m_TrailBuffer, 1);
+        m_Backend->BindInputLayout(trail_layout);
+        m_Backend->SetTopology(RenderTopology::LineStripAdj);
+        m_Backend->BindShader(RenderShaderStage::Vertex, trail_vs);
+        m_Backend->BindShader(RenderShaderStage::Geometry, trail_gs);
+        m_Backend->BindShader(RenderShaderStage::Pixel, trail_ps);
+
+        for (int i = 0; i < m_TrailDrawMaterials.size(); i++) {
+            m_Backend->BindShader(RenderShaderStage::Pixel, Editor::TrailMaterials[m_TrailDrawMaterials[i]].m_PixelShader);
+            m_Backend->Draw(TRAIL_COUNT, i * TRAIL_COUNT);
+        }
+
+        m_Backend->BindShader(RenderShaderStage::Geometry, nullptr);
+    }
+
+    // billboards, expanded on the CPU
+    if (m_BillboardQuads) {
+        auto timer = std::chrono::high_resolution_clock::now();
+
+        auto count = (UINT)m_BillboardDrawParticles.size();
+
+        auto axes = GetBillboardAxes(cam->GetView());
+        auto vertices = (BillboardVertex*)m_Backend->Map(m_BillboardQuadBuffer);
+        for (UINT i = 0; i < count; i++) {
+            auto &particle = m_BillboardDrawParticles[i];
+            ExpandBillboardQuad(&particle.position.x, &particle.size.x, particle.age, axes, vertices + i * 4);
+        }
+        m_Backend->Unmap(m_BillboardQuadBuffer, count * 4 * sizeof(BillboardVertex));
+
+        m_BillboardExpandMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timer).count();
+
+        m_Backend->BindInputLayout(m_BillboardQuadLayout);
+        m_Backend->BindVertexBuffers(&m_BillboardQuadBuffer, 1);
+        m_Backend->BindIndexBuffer(m_BillboardQuadIndexBuffer);
+        m_Backend->SetTopology(RenderTopology::TriangleList);
+
+        m_Backend->BindShader(RenderShaderStage::Vertex, m_BillboardQuadVS);
+
+        m_Backend->SetDepthState(RenderDepthState::Read);
+        m_Backend->BindRenderTargets(dst_rtv, nullptr);
+
+        // one draw per run of quads sharing a material
+        for (UINT i = 0; i < count;) {
+            auto material = m_BillboardDrawMaterials[i];
+
+            UINT run = 1;
+            while (i + run < count && m_BillboardDrawMaterials[i + run] == material)
+                run++;
+
+            m_Backend->BindShader(RenderShaderStage::Pixel, Editor::TrailMaterials[material].m_PixelShader);
+            m_Backend->DrawIndexedInstanced(run * 6, 1, i * 6, 0);
+            i += run;
+        }
+    }
+    // billboards, expanded by the geometry shader
+    else {
+        m_Backend->BindInputLayout(m_DefaultBillboardLayout);
+        m_Backend->BindVertexBuffers(&m_BillboardBuffer, 1);
+        m_Backend->SetTopology(RenderTopology::PointList);
+
+        m_Backend->BindShader(RenderShaderStage::Vertex, m_DefaultBillboardVS);
+        m_Backend->BindShader(RenderShaderStage::Geometry, m_DefaultBillboardGS);
+
+        m_Backend->SetDepthState(RenderDepthState::Read);
+        m_Backend->BindRenderTargets(dst_rtv, nullptr);
 
-        for (int i = 0; i < m_GeometryParticles.size(); i++) {
-            cxt->PSSetShader(Editor::TrailMaterials[m_GeometryParticles[i].idx].m_PixelShader, nullptr, 0);
-            cxt->DrawIndexedInstanced(m_GeometryIndices, 1, 0, 0, i);
+        for (int i = 0; i < m_BillboardDrawMaterials.size(); i++) {
+            m_Backend->BindShader(RenderShaderStage::Pixel, Editor::TrailMaterials[m_BillboardDrawMaterials[i]].m_PixelShader);
+            m_Backend->Draw(1, i);
         }
 
-        for (auto fx : m_AnchoredEffects) {
-            for (int i = 0; i < fx->children.size(); i++) {
-                cxt->PSSetShader(Editor::TrailMaterials[fx->children[i].idx].m_PixelShader, nullptr, 0);
-                cxt->DrawIndexedInstanced(m_GeometryIndices, 1, 0, 0, i);
+        m_Backend->BindShader(RenderShaderStage::Geometry, nullptr);
+    }
+
+    // baked effects, one quad each with the flipbook cell for its age and
+    // the direction it is seen from
+    if (!m_FlipbookSprites.empty()) {
+        auto count = (UINT)m_FlipbookSprites.size();
+
+        auto axes = GetBillboardAxes(cam->GetView());
+        auto vertices = (BillboardVertex*)m_Backend->Map(m_FlipbookBuffer);
+        for (UINT i = 0; i < count; i++) {
+            auto &sprite = m_FlipbookSprites[i];
+            auto flipbook = sprite.m_Flipbook;
+            auto model = XMLoadFloat4x4(&sprite.m_Model);
+
+            // the views were baked around the effect's own axes
+            auto eye = XMVector3Transform(camera.m_Position, XMMatrixInverse(nullptr, model)) - XMLoadFloat3(&flipbook->m_Center);
+            auto yaw = XMConvertToDegrees(atan2f(XMVectorGetX(eye), XMVectorGetZ(eye)));
+            auto rect = flipbook->GetFrameRect(sprite.m_Age, yaw);
+
+            // the baked bounding sphere fills the cell
+            auto size = flipbook->m_WorldSize * 0.5f * XMVectorGetX(XMVector3Length(model.r[0]));
+
+            XMFLOAT3 center;
+            XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&flipbook->m_Center), model));
+            float sizes[2] = { size, size };
+            ExpandBillboardQuad(&center.x, sizes, sprite.m_Age, axes, vertices + i * 4);
+
+            // billboard uvs run right to left, the cells left to right
+            for (int c = 0; c < 4; c++) {
+                auto uv = vertices[i * 4 + c].m_UV;
+                uv[0] = rect.x + (1.f - uv[0]) * rect.z;
+                uv[1] = rect.y + uv[1] * rect.w;
             }
         }
+        m_Backend->Unmap(m_FlipbookBuffer, count * 4 * sizeof(BillboardVertex));
+
+        m_Backend->BindInputLayout(m_BillboardQuadLayout);
+        m_Backend->BindVertexBuffers(&m_FlipbookBuffer, 1);
+        m_Backend->BindIndexBuffer(m_BillboardQuadIndexBuffer);
+        m_Backend->SetTopology(RenderTopology::TriangleList);
+
+        m_Backend->BindShader(RenderShaderStage::Vertex, m_BillboardQuadVS);
+        m_Backend->BindShader(RenderShaderStage::Pixel, m_FlipbookPS);
+
+        m_Backend->SetDepthState(RenderDepthState::Read);
+        m_Backend->BindRenderTargets(dst_rtv, nullptr);
+
+        for (UINT i = 0; i < count; i++) {
+            m_Backend->BindTexture(RenderShaderStage::Pixel, 0, m_FlipbookSprites[i].m_Atlas);
+            m_Backend->DrawIndexedInstanced(6, 1, i * 6, 0);
+        }
+
+        m_Backend->BindTexture(RenderShaderStage::Pixel, 0, nullptr);
     }
+}
 
-    cxt->RSSetState(states->CullCounterClockwise());
-    
-    //Trail
-    {
-        UINT stride = sizeof(TrailParticle);
-        UINT offset = 0;// 1 * sizeof(TrailParticle);
-
-        cxt->IASetVertexBuffers(0, 1, *m_TrailBuffer, &stride, &offset);
-        cxt->IASetInputLayout(trail_layout);
-        cxt->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ);
-        cxt->VSSetShader(trail_vs, nullptr, 0);
-        cxt->GSSetShader(trail_gs, nullptr, 0);
-        cxt->PSSetShader(trail_ps, nullptr, 0);
-
-        for (int i = 0; i < m_TrailParticles.size(); i++) {
-            cxt->PSSetShader(Editor::TrailMaterials[m_TrailParticles[i].idx].m_PixelShader, nullptr, 0);
-            cxt->Draw(TRAIL_COUNT, i * TRAIL_COUNT);
+// Particle layout and update loop from before the pools: every particle
+// points at its definition and looks up the easing functions itself. Only
+// kept as the baseline of BenchmarkGeometryUpdate.
+struct MixedGeometryParticle {
+    XMFLOAT3 pos;
+    XMFLOAT3 anchor;
+    XMFLOAT3 velocity;
+    float rotvel;
+    float rotprog;
+    XMFLOAT3 rot;
+    GeometryParticleDefinition *def;
+    float age;
+    int idx;
+};
+
+static GeometryParticleInstance *UpdateMixedParticles(std::vector<MixedGeometryParticle> &particles, float dt, GeometryParticleInstance *output, GeometryParticleInstance *max, LightBuffer &lights)
+{
+    auto it = particles.begin();
+    while (it != particles.end() && output < max) {
+        auto &particle = *it;
+        auto def = *particle.def;
+
+        if (particle.age > def.lifetime) {
+            it = particles.erase(it);
+            continue;
         }
 
-        cxt->GSSetShader(nullptr, nullptr, 0);
+        auto factor = particle.age / def.lifetime;
+
+        auto ease_color = GetEaseFuncV(def.m_ColorEasing);
+        auto ease_deform = GetEaseFunc(def.m_DeformEasing);
+        auto ease_size = GetEaseFunc(def.m_SizeEasing);
+
+        auto scale = ease_size(def.m_SizeStart, def.m_SizeEnd, factor);
+
+        output->m_Model = XMMatrixRotationAxis(XMVECTOR{ 0.1f } + XMLoadFloat3(&particle.rot), (particle.rotprog + particle.age) * particle.rotvel) * XMMatrixScaling(scale, scale, scale) * XMMatrixTranslationFromVector(XMLoadFloat3(&particle.pos));
+        output->m_Age = factor;
+
+        output->m_Color = ease_color(def.m_ColorStart, def.m_ColorEnd, factor);
+        output->m_Deform = ease_deform(def.m_DeformFactorStart, def.m_DeformFactorEnd, factor);
+        output->m_DeformSpeed = def.m_DeformSpeed;
+        output->m_NoiseScale = def.m_NoiseScale;
+        output->m_NoiseSpeed = def.m_NoiseSpeed;
+
+        particle.age += dt;
+        particle.rotprog += dt;
+
+        XMStoreFloat3(&particle.velocity, XMLoadFloat3(&particle.velocity) + XMVECTOR{ 0, def.m_Gravity, 0 } * dt);
+        XMStoreFloat3(&particle.pos, XMLoadFloat3(&particle.pos) + XMLoadFloat3(&particle.velocity) * dt);
+
+        auto ease_light_color = GetEaseFuncV(def.m_LightColorEasing);
+        auto ease_light_radius = GetEaseFunc(def.m_LightRadiusEasing);
+
+        auto radius = ease_light_radius(def.m_LightRadiusStart, def.m_LightRadiusEnd, factor);
+        if (radius != 0.f && lights.LightCount < 128) {
+            auto light_color = ease_light_color(def.m_LightColorStart, def.m_LightColorEnd, factor);
+
+            Light light;
+            light.position = particle.pos;
+            light.range = radius;
+            XMStoreFloat3(&light.color, light_color);
+            light.intensity = XMVectorGetW(light_color);
+
+            lights.Lights[lights.LightCount++] = light;
+        }
+
+        it++;
+        output++;
     }
 
-    // billboards
-    {
-        auto stride = (UINT)sizeof(BillboardParticle);
-        auto offset = 0u;
+    return output;
+}
 
-        cxt->IASetInputLayout(m_DefaultBillboardLayout);
-        cxt->IASetVertexBuffers(0, 1, *m_BillboardBuffer, &stride, &offset);
-        cxt->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+bool BenchmarkGeometryUpdate(uint32_t particles, uint32_t definitions, uint32_t frames, GeometryUpdateBenchmark &result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto ms = [](Clock::time_point start) { return std::chrono::duration<float, std::milli>(Clock::now() - start).count(); };
+
+    result = {};
+    result.m_Particles = particles;
+    result.m_Definitions = definitions;
+    result.m_Frames = frames;
+    result.m_FullInstanceBytes = sizeof(GeometryParticleInstance);
+    result.m_CompactInstanceBytes = sizeof(GeometryParticleInstanceCompact);
+    result.m_FullParticleBytes = 2 * sizeof(GeometryParticleFull);
+    result.m_CompactParticleBytes = 2 * sizeof(GeometryParticleCompact);
+
+    if (particles == 0 || definitions == 0 || frames == 0)
+        return false;
+
+    const float dt = 1.f / 60.f;
+
+    // nothing dies during the run, every frame simulates every particle
+    std::vector<GeometryParticleDefinition> defs(definitions);
+    std::vector<ParticleEffectEntry> entries(definitions);
+    for (uint32_t i = 0; i < definitions; i++) {
+        auto &def = defs[i];
+        def.m_Material = &Editor::TrailMaterials[i % MAX_TRAIL_MATERIALS];
+        def.lifetime = 2.f * frames * dt;
+        def.m_Gravity = -1.f;
+        def.m_SizeStart = 0.1f;
+        def.m_SizeEnd = 0.05f;
+        def.m_DeformFactorEnd = 1.f;
+        def.m_ColorStart = { 1.f, 1.f, 1.f, 1.f };
+        def.m_ColorEnd = { 1.f, 0.5f, 0.f, 0.f };
+        def.m_SizeEasing = (ParticleEase)(i % 3);
+        def.m_DeformEasing = (ParticleEase)(i / 3 % 3);
+        def.m_ColorEasing = (ParticleEase)(i / 9 % 3);
+
+        auto &entry = entries[i];
+        entry.type = ParticleType::Geometry;
+        entry.geometry = &def;
+        entry.m_StartVelocity.m_Min = { -1.f, 0.f, -1.f };
+        entry.m_StartVelocity.m_Max = { 1.f, 2.f, 1.f };
+        entry.m_RotLimitMin = -1.f;
+        entry.m_RotLimitMax = 1.f;
+        entry.m_RotSpeedMin = 0.5f;
+        entry.m_RotSpeedMax = 2.f;
+    }
 
-        cxt->VSSetShader(m_DefaultBillboardVS, nullptr, 0);
-        cxt->GSSetShader(m_DefaultBillboardGS, nullptr, 0);
-        cxt->GSSetConstantBuffers(0, 1, *cam->GetBuffer());
+    // particle k spawns from entry k % definitions, so neighbours in the
+    // mixed vector never share a definition. Seeded so every run simulates
+    // the same particles.
+    srand(1);
+    std::vector<MixedGeometryParticle> mixed(particles);
+    for (uint32_t k = 0; k < particles; k++) {
+        auto &entry = entries[k % definitions];
+        auto &p = mixed[k];
+        p = {};
+        p.def = entry.geometry;
+        p.idx = (int)(p.def->m_Material - Editor::TrailMaterials);
+        p.velocity = entry.m_StartVelocity.GetVelocity();
+        p.rot = {
+            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
+            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax),
+            RandomFloat(entry.m_RotLimitMin, entry.m_RotLimitMax)
+        };
+        p.rotvel = RandomFloat(entry.m_RotSpeedMin, entry.m_RotSpeedMax);
+        p.rotprog = RandomFloat(-180, 180);
+    }
+
+    NullRenderBackend backend;
+    MeshCache meshes(&backend);
+    ParticleSystem system(L"", 16, 0, 0, &backend, &meshes);
+    system.m_GeometryInstances.resize(particles);
+    system.m_GeometryCompactInstances.resize(particles);
+    system.m_GeometryInstanceMaterials.resize(particles);
+
+    srand(1);
+    for (uint32_t k = 0; k < particles; k++) {
+        auto &entry = entries[k % definitions];
+        GetPool(system.m_GeometryParticles, entry).particles.push_back(SpawnGeometryParticle(entry, SimpleMath::Matrix::Identity));
+    }
+    auto pools = system.m_GeometryParticles;
+
+    bool ok = true;
+
+    // every pooled run starts over from the same seeded particles
+    auto run_pools = [&](auto &out) {
+        system.m_GeometryParticles = pools;
 
-        cxt->OMSetDepthStencilState(states->DepthRead(), 0);
-        cxt->OMSetRenderTargets(1, &dst_rtv, nullptr);
+        auto timer = Clock::now();
+        for (uint32_t f = 0; f < frames; f++)
+            ok = ok && system.UpdatePools(out, dt) == particles;
+        return ms(timer) / frames;
+    };
 
-        for (int i = 0; i < m_BillboardParticles.size(); i++) {
-            cxt->PSSetShader(Editor::TrailMaterials[m_BillboardParticles[i].idx].m_PixelShader, nullptr, 0);
-            cxt->Draw(1, i);
+    std::vector<GeometryParticleInstance> instances(particles);
+    LightBuffer lights;
+    auto timer = Clock::now();
+    for (uint32_t f = 0; f < frames; f++) {
+        lights.LightCount = 0;
+        ok = ok && UpdateMixedParticles(mixed, dt, instances.data(), instances.data() + particles, lights) == instances.data() + particles;
+    }
+    result.m_MixedMs = ms(timer) / frames;
+
+    result.m_PooledMs = run_pools(system.m_GeometryInstances);
+
+    system.m_SpecializedKernels = false;
+    result.m_GenericMs = run_pools(system.m_GeometryInstances);
+    system.m_SpecializedKernels = true;
+    result.m_SpecializedMs = run_pools(system.m_GeometryInstances);
+
+    result.m_CompactMs = run_pools(system.m_GeometryCompactInstances);
+
+    // the particle state alone, both layouts through the same generic kernel
+    // into full instances
+    auto run_layout = [&](auto &layout_pools) {
+        auto world = ParticleAnchor::FromMatrix(XMMatrixIdentity());
+        auto out = system.m_GeometryInstances.data();
+
+        auto timer = Clock::now();
+        for (uint32_t f = 0; f < frames; f++) {
+            auto ptr = out;
+            lights.LightCount = 0;
+            for (auto &pool : layout_pools)
+                ptr = UpdatePoolWith(world, pool, dt, ptr, out + particles, nullptr, lights, DynamicEasing(*pool.def));
+            ok = ok && ptr == out + particles;
         }
+        return ms(timer) / frames;
+    };
 
-        cxt->GSSetShader(nullptr, nullptr, 0);
+    std::vector<GeometryParticlePoolOf<GeometryParticleFull>> full_pools;
+    std::vector<GeometryParticlePoolOf<GeometryParticleCompact>> compact_pools;
+    srand(1);
+    for (uint32_t k = 0; k < particles; k++) {
+        auto &entry = entries[k % definitions];
+        GetPool(full_pools, entry).particles.push_back(SpawnGeometryParticle<GeometryParticleFull>(entry, SimpleMath::Matrix::Identity));
     }
+    srand(1);
+    for (uint32_t k = 0; k < particles; k++) {
+        auto &entry = entries[k % definitions];
+        GetPool(compact_pools, entry).particles.push_back(SpawnGeometryParticle<GeometryParticleCompact>(entry, SimpleMath::Matrix::Identity));
+    }
+
+    result.m_FullParticleMs = run_layout(full_pools);
+    result.m_CompactParticleMs = run_layout(compact_pools);
+
+    return ok;
 }
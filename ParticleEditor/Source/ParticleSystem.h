@@ -4,16 +4,22 @@
 #include <string>
 #include <vector>
 
-#include "Camera.h"
 #include "Ease.h"
+#include "MeshCache.h"
 #include "Particle.h"
+#include "RenderBackend.h"
+#include "TemporalLOD.h"
+#include "TrailRibbon.h"
 #include <DirectXMath.h>
 
-#include <External\Helpers.h>
-#include <External\DirectXTK.h>
-
 using namespace DirectX;
 
+class Camera;
+struct Flipbook;
+
+// flipbook quads drawn per frame, past that baked effects are dropped
+#define FLIPBOOK_SPRITE_MAX 64
+
 struct ParticleEffectInstance {
 	XMVECTOR position;
 	ParticleEffect effect;
@@ -24,6 +30,7 @@ struct SphereVertex {
 	XMFLOAT3 normal;
 	XMFLOAT2 uv;
 };
+static_assert(sizeof(SphereVertex) == sizeof(MeshFileVertex), "sphere vertices are read straight from the mapped mesh");
 
 struct DirectionalLight
 {
@@ -49,66 +56,272 @@ struct LightBuffer {
 };
 static int a = sizeof(LightBuffer);
 
+struct SpawnLODDebug {
+	XMFLOAT3 m_Position;
+	float m_Factor;
+};
+
+// A run of uploaded instances drawn with one material and sphere LOD.
+struct GeometryDraw {
+	int m_Material;
+	uint32_t m_LOD;
+	uint32_t m_StartInstance;
+	uint32_t m_InstanceCount;
+};
+
+// A baked effect drawn as a single quad from its flipbook atlas, the frame
+// and view are picked when it is drawn.
+struct FlipbookSprite {
+	const Flipbook *m_Flipbook;
+	RenderTexture m_Atlas;
+	XMFLOAT4X4 m_Model;
+	float m_Age;
+};
+
+// Output of the last tick of an anchored effect, replayed on the frames its
+// temporal LOD skips. Instances are kept as raw bytes since they are either
+// GeometryParticleInstance or GeometryParticleInstanceCompact.
+struct TemporalLODCache {
+	// null while the slot is free, it is freed on the first frame its effect
+	// is not processed
+	AnchoredParticleEffect *m_Owner;
+	uint64_t m_Frame;
+
+	TemporalLOD m_LOD;
+	bool m_Valid;
+	bool m_Compact;
+
+	// instance extent around the origin, the origin of the last tick
+	float m_Radius;
+	XMFLOAT3 m_Origin;
+
+	std::vector<uint8_t> m_Instances;
+	std::vector<int> m_Materials;
+	std::vector<XMFLOAT3> m_Velocities;
+	std::vector<Light> m_Lights;
+};
+
+// CPU side view of everything update() produced for the current frame, valid
+// until frame() is called. Consumed by the reference renderer and tools that
+// need the simulated instances without reading back GPU buffers.
+struct ParticleFrameData {
+	const GeometryParticleInstance *m_Instances;
+	// set instead of m_Instances when update() hands compact instances to upload()
+	const GeometryParticleInstanceCompact *m_CompactInstances;
+	const int *m_InstanceMaterials;
+	uint32_t m_InstanceCount;
+	const Light *m_Lights;
+	uint32_t m_LightCount;
+	const BillboardParticle *m_Billboards;
+	uint32_t m_BillboardCount;
+	const Trail *m_Trails;
+	uint32_t m_TrailCount;
+
+	const SphereVertex *m_SphereVertices;
+	const uint16_t *m_SphereIndices;
+	uint32_t m_SphereIndexCount;
+
+	DirectionalLight m_Light;
+};
+
 class ParticleSystem {
 public:
-	ParticleSystem(const wchar_t *file, UINT capacity, UINT width, UINT height, ID3D11Device *device, ID3D11DeviceContext *cxt);
+	// Everything goes through `backend`, a null or recording one runs it
+	// headless. `meshes` has to upload through `backend`, the sphere buffers
+	// come from there.
+	ParticleSystem(const wchar_t *file, uint32_t capacity, uint32_t width, uint32_t height, RenderBackend *backend, MeshCache *meshes);
 	~ParticleSystem();
 
+	// the matrix overload gives the effect a root node of its own, the other
+	// one a node below `parent`, which the caller keeps up to date through
+	// m_Transforms. update() refreshes the world matrices before simulating.
 	void ProcessAnchoredFX(AnchoredParticleEffect *fx, SimpleMath::Matrix model, float dt);
+	void ProcessAnchoredFX(AnchoredParticleEffect *fx, TransformID parent, float dt);
+	// destroys the node of an effect that is gone and drops its particles,
+	// has to come before its parent node is destroyed
+	void ReleaseAnchoredFX(AnchoredParticleEffect *fx);
 	void ProcessFX(ParticleEffect *fx, SimpleMath::Matrix model, float dt);
+	// `model` is where the emitter ends up this frame and `velocity` how fast
+	// it got there, particles due earlier in the frame are spawned back along
+	// that path and aged by the time they would have been alive
 	void ProcessFX(ParticleEffect &fx, XMMATRIX model, XMVECTOR velocity, float dt);
+	// draws `flipbook` at `model` this frame instead of simulating its effect,
+	// `atlas` has to stay alive until render()
+	void ProcessFlipbook(const Flipbook *flipbook, RenderTexture atlas, XMMATRIX model, float age);
 	void AddFX(std::string name, XMMATRIX model);
 	ParticleEffect GetFX(std::string name);
 
 	void update(Camera *cam, float dt);
-	void render(Camera *cam, CommonStates *states, ID3D11DepthStencilView *dst_dsv, ID3D11RenderTargetView *dst_rtv, bool debug);
+	// uploads a frame for rendering, update() uploads its own simulation
+	// output, cache playback hands in recorded frames instead
+	void upload(const ParticleFrameData &data);
+	void render(Camera *cam, RenderTarget dst_dsv, RenderTarget dst_rtv, bool debug);
 	void frame();
-    GeometryParticleInstance *UpdateParticles(XMVECTOR anchor, std::vector<GeometryParticle> &particles, float dt, GeometryParticleInstance *output, GeometryParticleInstance *max);
+	ParticleFrameData GetFrameData() const;
+	ParticleFrameData GetFrameData(bool expand) const;
+    template <typename Instance>
+    Instance *UpdatePool(const ParticleAnchor &anchor, GeometryParticlePool &pool, float dt, Instance *output, Instance *max, XMFLOAT3 *velocities = nullptr);
+    template <typename Instance>
+    uint32_t UpdatePools(std::vector<Instance> &instances, float dt);
 
 	void ReadSphereModel();
 
+	void SpawnAnchoredFX(AnchoredParticleEffect *fx, const SimpleMath::Matrix &model, float dt);
+	// picks the temporal LOD bucket of every anchored effect from its
+	// projected size
+	void ScheduleTemporalLOD(Camera *cam);
+	// radius over the screen height, 1 without a camera
+	float GetProjectedSize(FXMVECTOR position, float radius) const;
+	float GetSpawnLOD(const ParticleEffectEntry &entry, const SimpleMath::Matrix &model);
+	TemporalLODCache &GetTemporalLODCache(AnchoredParticleEffect *fx);
+	void ReleaseTemporalLODCaches();
+
 //private:
-	UINT capacity;
+	uint32_t capacity;
 
 	std::vector<ParticleEffect> m_ParticleEffectDefinitions;
 
 	std::vector<ParticleEffectInstance> m_ParticleEffects;
 	std::vector<AnchoredParticleEffect*> m_AnchoredEffects;
+	TransformHierarchy m_Transforms;
 
 	std::vector<BillboardParticle> m_BillboardParticles;
-	std::vector<GeometryParticle> m_GeometryParticles;
+	std::vector<GeometryParticlePool> m_GeometryParticles;
 	std::vector<Trail> m_TrailParticles;
+	std::vector<FlipbookSprite> m_FlipbookSprites;
 
     LightBuffer m_ParticleLights;
+    DirectionalLight m_DirectionalLightData;
+
+	// expanded from the compact instances on demand by GetFrameData()
+	mutable std::vector<GeometryParticleInstance> m_GeometryInstances;
+	std::vector<GeometryParticleInstanceCompact> m_GeometryCompactInstances;
+	std::vector<int> m_GeometryInstanceMaterials;
+
+	// sphere draws of the last uploaded frame, the instances were uploaded
+	// in the order of m_GeometryDrawOrder so every draw is one range
+	std::vector<GeometryDraw> m_GeometryDraws;
+	std::vector<uint32_t> m_GeometryDrawOrder;
+	std::vector<uint8_t> m_GeometryInstanceLODs;
+	// material per draw of the last uploaded frame
+	std::vector<int> m_TrailDrawMaterials;
+	std::vector<int> m_BillboardDrawMaterials;
+	std::vector<BillboardParticle> m_BillboardDrawParticles;
+	std::vector<Trail> m_TrailDrawTrails;
 
-    ConstantBuffer<DirectionalLight> *m_DirectionalLight;
-    ConstantBuffer<LightBuffer> *m_Lights;
-	int m_GeometryIndices;
-	VertexBuffer<SphereVertex> *m_GeometryBuffer;
-	IndexBuffer<UINT16> *m_GeometryIndexBuffer;
-	VertexBuffer<GeometryParticleInstance> *m_GeometryInstanceBuffer;
-	VertexBuffer<BillboardParticle> *m_BillboardBuffer;
-	VertexBuffer<TrailParticle> *m_TrailBuffer;
+	MeshCache *m_Meshes;
+	const Mesh *m_Sphere;
 
-	ID3D11BlendState *m_ParticleBlend;
-	ID3D11InputLayout *m_DefaultBillboardLayout;
-	ID3D11VertexShader *m_DefaultBillboardVS;
+    RenderBufferID m_DirectionalLight;
+    RenderBufferID m_Lights;
+    RenderBufferID m_CameraBuffer;
+	uint32_t m_GeometryInstanceCount;
+	// pools simulated and time spent in the last update()
+	uint32_t m_GeometryPoolCount;
+	float m_GeometryUpdateMs;
+	// particles simulated in the last update(), without the ones temporal
+	// LOD replayed
+	uint32_t m_GeometrySimulatedCount;
+	// use the update kernels specialized on the definition easing
+	bool m_SpecializedKernels;
+	// simulate into GeometryParticleInstanceCompact and draw with VSCompact
+	bool m_CompactInstances;
+	bool m_CompactStaged;
+	mutable bool m_CompactExpanded;
+	bool m_DrawCompact;
+	// expand billboards into quads on the CPU instead of in the GS
+	bool m_BillboardQuads;
+	float m_BillboardExpandMs;
+	// build trail ribbons on the CPU instead of in the GS, points closer
+	// than tolerance times their view distance to the line are dropped
+	bool m_TrailRibbons;
+	float m_TrailRibbonTolerance;
+	TrailRibbonStats m_TrailRibbonStats;
+	float m_TrailRibbonMs;
+	// tick far away anchored effects less often and replay their last
+	// output in between
+	bool m_TemporalLOD;
+	TemporalLODSettings m_TemporalLODSettings;
+	TemporalLODStats m_TemporalLODStats;
+	std::vector<TemporalLODCache> m_TemporalLODCaches;
+	uint32_t m_TemporalLODStagger;
+	// draw every sphere at the coarsest LOD that is off by no more than
+	// tolerance times the screen height
+	bool m_MeshLOD;
+	float m_MeshLODTolerance;
+	MeshLODStats m_MeshLODStats;
+	uint64_t m_Frame;
+	// camera of the last update(), spawning happens before the update of the
+	// frame so the spawn LOD always looks one frame back
+	XMFLOAT4X4 m_LODView;
+	float m_LODFocal;
+	// spawn LOD factor per spawning entry this frame, for the viewport
+	std::vector<SpawnLODDebug> m_SpawnLODDebug;
+	RenderBufferID m_GeometryInstanceBuffer;
+	RenderBufferID m_GeometryCompactInstanceBuffer;
+	RenderBufferID m_BillboardBuffer;
+	RenderBufferID m_BillboardQuadBuffer;
+	RenderBufferID m_BillboardQuadIndexBuffer;
+	RenderBufferID m_TrailBuffer;
+	RenderBufferID m_TrailRibbonBuffer;
+	RenderBufferID m_FlipbookBuffer;
 
-	ID3D11InputLayout *m_DefaultGeometryLayout;
-	ID3D11VertexShader *m_DefaultGeometryVS;
+	RenderInputLayout m_DefaultBillboardLayout;
+	RenderShader m_DefaultBillboardVS;
 
-	ID3D11GeometryShader *m_DefaultBillboardGS;
+	RenderInputLayout m_DefaultGeometryLayout;
+	RenderShader m_DefaultGeometryVS;
 
+	RenderInputLayout m_CompactGeometryLayout;
+	RenderShader m_CompactGeometryVS;
 
-	ID3D11VertexShader   *trail_vs;
-	ID3D11GeometryShader *trail_gs;
-	ID3D11PixelShader    *trail_ps;
-	ID3D11InputLayout *trail_layout;
+	RenderShader m_DefaultBillboardGS;
 
+	RenderInputLayout m_BillboardQuadLayout;
+	RenderShader m_BillboardQuadVS;
+	RenderShader m_FlipbookPS;
 
-	
-	ID3D11Device *device;
-	ID3D11DeviceContext *cxt;
+
+	RenderShader trail_vs;
+	RenderShader trail_gs;
+	RenderShader trail_ps;
+	RenderInputLayout trail_layout;
+	RenderInputLayout m_TrailRibbonLayout;
+	RenderShader m_TrailRibbonVS;
+
+
+	RenderBackend *m_Backend;
 };
 
 extern ParticleSystem *FXSystem;
+
+struct GeometryUpdateBenchmark {
+	uint32_t m_Particles;
+	uint32_t m_Definitions;
+	uint32_t m_Frames;
+	// per frame, one vector with a definition pointer per particle
+	float m_MixedMs;
+	// per frame, the pools update() simulates, into full and compact instances
+	float m_PooledMs;
+	float m_CompactMs;
+	// per frame, the pools through the generic kernel that looks the easing
+	// up per call and through the ones specialized on the easing
+	float m_GenericMs;
+	float m_SpecializedMs;
+	// per frame, the full and the compact GeometryParticle layout simulated
+	// through the same kernel, and the particle state bytes each reads and
+	// writes back per particle and frame
+	float m_FullParticleMs;
+	float m_CompactParticleMs;
+	uint32_t m_FullParticleBytes;
+	uint32_t m_CompactParticleBytes;
+	uint32_t m_FullInstanceBytes;
+	uint32_t m_CompactInstanceBytes;
+};
+
+// Simulates `particles` geometry particles spread over `definitions`
+// definitions for `frames` frames, once stored the way they were before
+// pooling and once through the pools with each instance layout and kernel.
+// The particles are seeded, runs with the same arguments simulate the same
+// ones.
+bool BenchmarkGeometryUpdate(uint32_t particles, uint32_t definitions, uint32_t frames, GeometryUpdateBenchmark &result);
@@ -0,0 +1,224 @@
+#include "RenderBackend.h"
+
+#include <cstring>
+
+NullRenderBackend::NullRenderBackend()
+    : m_ShaderCount(0)
+{
+}
+
+RenderBufferID NullRenderBackend::CreateBuffer(RenderBufferType /*type*/, RenderBufferUsage /*usage*/, uint32_t stride, uint32_t count, const void *data)
+{
+    std::vector<uint8_t> storage(stride * count);
+    if (data)
+        memcpy(storage.data(), data, storage.size());
+
+    m_Buffers.push_back(std::move(storage));
+
+    return (RenderBufferID)m_Buffers.size() - 1;
+}
+
+void *NullRenderBackend::Map(RenderBufferID buffer)
+{
+    return m_Buffers[buffer].data();
+}
+
+RenderShader NullRenderBackend::CreateShader(RenderShaderStage /*stage*/, const wchar_t * /*file*/, const char * /*function*/, const RenderInputElement * /*layout*/, size_t /*layout_count*/, RenderInputLayout *out_layout)
+{
+    // handles only need to be unique and non-null
+    if (out_layout)
+        *out_layout = (RenderInputLayout)++m_ShaderCount;
+
+    return (RenderShader)++m_ShaderCount;
+}
+
+const void *NullRenderBackend::GetBufferData(RenderBufferID buffer) const
+{
+    return m_Buffers[buffer].data();
+}
+
+size_t NullRenderBackend::GetBufferSize(RenderBufferID buffer) const
+{
+    return m_Buffers[buffer].size();
+}
+
+RecordingRenderBackend::RecordingRenderBackend(RenderBackend *inner)
+    : m_Inner(inner), m_OwnsInner(inner == nullptr), m_Stats({}), m_LastStats({})
+{
+    if (!m_Inner)
+        m_Inner = new NullRenderBackend();
+}
+
+RecordingRenderBackend::~RecordingRenderBackend()
+{
+    if (m_OwnsInner)
+        delete m_Inner;
+}
+
+void RecordingRenderBackend::Record(RenderCommandType type, RenderBufferID buffer, size_t bytes, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    RenderCommand cmd = {};
+    cmd.m_Type = type;
+    cmd.m_Buffer = buffer;
+    cmd.m_Args[0] = a;
+    cmd.m_Args[1] = b;
+    cmd.m_Args[2] = c;
+    cmd.m_Args[3] = d;
+    cmd.m_Bytes = bytes;
+
+    m_Commands.push_back(cmd);
+}
+
+RenderBufferID RecordingRenderBackend::CreateBuffer(RenderBufferType type, RenderBufferUsage usage, uint32_t stride, uint32_t count, const void *data)
+{
+    auto id = m_Inner->CreateBuffer(type, usage, stride, count, data);
+
+    if (id >= (RenderBufferID)m_BufferSizes.size())
+        m_BufferSizes.resize(id + 1);
+    m_BufferSizes[id] = (size_t)stride * count;
+
+    // initial data counts as an upload
+    size_t bytes = data ? m_BufferSizes[id] : 0;
+    m_Stats.m_UploadBytes += bytes;
+    Record(RenderCommandType::CreateBuffer, id, bytes, (uint32_t)type, (uint32_t)usage, stride, count);
+
+    return id;
+}
+
+void *RecordingRenderBackend::Map(RenderBufferID buffer)
+{
+    m_Stats.m_Maps++;
+    Record(RenderCommandType::Map, buffer, m_BufferSizes[buffer]);
+
+    return m_Inner->Map(buffer);
+}
+
+void RecordingRenderBackend::Unmap(RenderBufferID buffer, size_t written)
+{
+    m_Stats.m_UploadBytes += written;
+    Record(RenderCommandType::Unmap, buffer, written);
+
+    m_Inner->Unmap(buffer, written);
+}
+
+RenderShader RecordingRenderBackend::CreateShader(RenderShaderStage stage, const wchar_t *file, const char *function, const RenderInputElement *layout, size_t layout_count, RenderInputLayout *out_layout)
+{
+    return m_Inner->CreateShader(stage, file, function, layout, layout_count, out_layout);
+}
+
+void RecordingRenderBackend::BindShader(RenderShaderStage stage, RenderShader shader)
+{
+    m_Stats.m_ShaderBinds++;
+    Record(RenderCommandType::BindShader, INVALID_RENDER_BUFFER, 0, (uint32_t)stage);
+
+    m_Inner->BindShader(stage, shader);
+}
+
+void RecordingRenderBackend::BindInputLayout(RenderInputLayout layout)
+{
+    Record(RenderCommandType::BindInputLayout, INVALID_RENDER_BUFFER, 0);
+
+    m_Inner->BindInputLayout(layout);
+}
+
+void RecordingRenderBackend::BindVertexBuffers(const RenderBufferID *buffers, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        Record(RenderCommandType::BindVertexBuffers, buffers[i], 0, i);
+
+    m_Inner->BindVertexBuffers(buffers, count);
+}
+
+void RecordingRenderBackend::BindIndexBuffer(RenderBufferID buffer)
+{
+    Record(RenderCommandType::BindIndexBuffer, buffer, 0);
+
+    m_Inner->BindIndexBuffer(buffer);
+}
+
+void RecordingRenderBackend::BindConstantBuffer(RenderShaderStage stage, uint32_t slot, RenderBufferID buffer)
+{
+    Record(RenderCommandType::BindConstantBuffer, buffer, 0, (uint32_t)stage, slot);
+
+    m_Inner->BindConstantBuffer(stage, slot, buffer);
+}
+
+void RecordingRenderBackend::BindTexture(RenderShaderStage stage, uint32_t slot, RenderTexture texture)
+{
+    Record(RenderCommandType::BindTexture, INVALID_RENDER_BUFFER, 0, (uint32_t)stage, slot, texture != nullptr);
+
+    m_Inner->BindTexture(stage, slot, texture);
+}
+
+void RecordingRenderBackend::SetTopology(RenderTopology topology)
+{
+    Record(RenderCommandType::SetTopology, INVALID_RENDER_BUFFER, 0, (uint32_t)topology);
+
+    m_Inner->SetTopology(topology);
+}
+
+void RecordingRenderBackend::SetBlendState(RenderBlendState state)
+{
+    Record(RenderCommandType::SetBlendState, INVALID_RENDER_BUFFER, 0, (uint32_t)state);
+
+    m_Inner->SetBlendState(state);
+}
+
+void RecordingRenderBackend::SetDepthState(RenderDepthState state)
+{
+    Record(RenderCommandType::SetDepthState, INVALID_RENDER_BUFFER, 0, (uint32_t)state);
+
+    m_Inner->SetDepthState(state);
+}
+
+void RecordingRenderBackend::SetRasterState(RenderRasterState state)
+{
+    Record(RenderCommandType::SetRasterState, INVALID_RENDER_BUFFER, 0, (uint32_t)state);
+
+    m_Inner->SetRasterState(state);
+}
+
+void RecordingRenderBackend::BindSamplers()
+{
+    Record(RenderCommandType::BindSamplers, INVALID_RENDER_BUFFER, 0);
+
+    m_Inner->BindSamplers();
+}
+
+void RecordingRenderBackend::BindRenderTargets(RenderTarget color, RenderTarget depth)
+{
+    Record(RenderCommandType::BindRenderTargets, INVALID_RENDER_BUFFER, 0, color != nullptr, depth != nullptr);
+
+    m_Inner->BindRenderTargets(color, depth);
+}
+
+void RecordingRenderBackend::Draw(uint32_t vertex_count, uint32_t start_vertex)
+{
+    m_Stats.m_DrawCalls++;
+    m_Stats.m_Instances++;
+    m_Stats.m_Vertices += vertex_count;
+    Record(RenderCommandType::Draw, INVALID_RENDER_BUFFER, 0, vertex_count, start_vertex);
+
+    m_Inner->Draw(vertex_count, start_vertex);
+}
+
+void RecordingRenderBackend::DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t start_index, uint32_t start_instance)
+{
+    m_Stats.m_DrawCalls++;
+    m_Stats.m_Instances += instance_count;
+    m_Stats.m_Vertices += index_count * instance_count;
+    Record(RenderCommandType::DrawIndexedInstanced, INVALID_RENDER_BUFFER, 0, index_count, instance_count, start_index, start_instance);
+
+    m_Inner->DrawIndexedInstanced(index_count, instance_count, start_index, start_instance);
+}
+
+void RecordingRenderBackend::EndFrame()
+{
+    m_LastStats = m_Stats;
+    m_Stats = {};
+
+    m_LastCommands.swap(m_Commands);
+    m_Commands.clear();
+
+    m_Inner->EndFrame();
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Thin rendering interface used by the particle system. Only covers what the
+// particle renderer needs: buffer create/map/unmap, shader binding, the few
+// fixed function states it switches between and draws.
+
+enum class RenderBufferType : uint32_t {
+    Vertex,
+    Index,
+    Constant
+};
+
+enum class RenderBufferUsage : uint32_t {
+    Immutable,
+    Dynamic
+};
+
+enum class RenderShaderStage : uint32_t {
+    Vertex,
+    Geometry,
+    Pixel
+};
+
+enum class RenderTopology : uint32_t {
+    TriangleList,
+    TriangleStrip,
+    PointList,
+    LineStripAdj
+};
+
+enum class RenderFormat : uint32_t {
+    R32Float,
+    R32G32Float,
+    R32G32B32Float,
+    R32G32B32A32Float,
+    R32SInt,
+    R16G16Float,
+    R16G16B16A16Float,
+    R16G16B16A16SNorm,
+    R8G8B8A8SNorm
+};
+
+enum class RenderBlendState : uint32_t {
+    Opaque,
+    // straight alpha, what every particle shader writes
+    NonPremultiplied,
+    Additive
+};
+
+enum class RenderDepthState : uint32_t {
+    Default,
+    Read,
+    None
+};
+
+enum class RenderRasterState : uint32_t {
+    CullNone,
+    CullCounterClockwise,
+    Wireframe
+};
+
+struct RenderInputElement {
+    const char  *m_Semantic;
+    uint32_t     m_SemanticIndex;
+    RenderFormat m_Format;
+    uint32_t     m_Slot;
+    bool         m_PerInstance;
+};
+
+using RenderBufferID = int32_t;
+using RenderShader = void *;
+using RenderInputLayout = void *;
+// render target or depth stencil view of the device, null unbinds
+using RenderTarget = void *;
+// shader resource view of the device, the caller keeps it alive
+using RenderTexture = void *;
+
+#define INVALID_RENDER_BUFFER -1
+
+class RenderBackend {
+public:
+    virtual ~RenderBackend() {}
+
+    virtual RenderBufferID CreateBuffer(RenderBufferType type, RenderBufferUsage usage, uint32_t stride, uint32_t count, const void *data = nullptr) = 0;
+    virtual void *Map(RenderBufferID buffer) = 0;
+    virtual void Unmap(RenderBufferID buffer, size_t written) = 0;
+
+    // `layout` is only used for vertex shaders, the input layout is created
+    // against the compiled bytecode and returned through `out_layout`
+    virtual RenderShader CreateShader(RenderShaderStage stage, const wchar_t *file, const char *function, const RenderInputElement *layout = nullptr, size_t layout_count = 0, RenderInputLayout *out_layout = nullptr) = 0;
+
+    virtual void BindShader(RenderShaderStage stage, RenderShader shader) = 0;
+    virtual void BindInputLayout(RenderInputLayout layout) = 0;
+    virtual void BindVertexBuffers(const RenderBufferID *buffers, uint32_t count) = 0;
+    virtual void BindIndexBuffer(RenderBufferID buffer) = 0;
+    virtual void BindConstantBuffer(RenderShaderStage stage, uint32_t slot, RenderBufferID buffer) = 0;
+    virtual void BindTexture(RenderShaderStage stage, uint32_t slot, RenderTexture texture) = 0;
+    virtual void SetTopology(RenderTopology topology) = 0;
+
+    virtual void SetBlendState(RenderBlendState state) = 0;
+    virtual void SetDepthState(RenderDepthState state) = 0;
+    virtual void SetRasterState(RenderRasterState state) = 0;
+    // linear clamp, linear wrap, point clamp and point wrap at slots 0-3 of
+    // the vertex and pixel stage
+    virtual void BindSamplers() = 0;
+    virtual void BindRenderTargets(RenderTarget color, RenderTarget depth) = 0;
+
+    virtual void Draw(uint32_t vertex_count, uint32_t start_vertex) = 0;
+    virtual void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t start_index, uint32_t start_instance) = 0;
+
+    virtual void EndFrame() {}
+
+    // escape hatch for code that still talks to the device directly
+    virtual void *GetNativeBuffer(RenderBufferID /*buffer*/) { return nullptr; }
+};
+
+// Keeps buffers in system memory and drops every command. Lets the simulation
+// and upload path run without a device.
+class NullRenderBackend : public RenderBackend {
+public:
+    NullRenderBackend();
+
+    virtual RenderBufferID CreateBuffer(RenderBufferType type, RenderBufferUsage usage, uint32_t stride, uint32_t count, const void *data = nullptr) override;
+    virtual void *Map(RenderBufferID buffer) override;
+    virtual void Unmap(RenderBufferID /*buffer*/, size_t /*written*/) override {}
+
+    virtual RenderShader CreateShader(RenderShaderStage stage, const wchar_t *file, const char *function, const RenderInputElement *layout = nullptr, size_t layout_count = 0, RenderInputLayout *out_layout = nullptr) override;
+
+    virtual void BindShader(RenderShaderStage /*stage*/, RenderShader /*shader*/) override {}
+    virtual void BindInputLayout(RenderInputLayout /*layout*/) override {}
+    virtual void BindVertexBuffers(const RenderBufferID * /*buffers*/, uint32_t /*count*/) override {}
+    virtual void BindIndexBuffer(RenderBufferID /*buffer*/) override {}
+    virtual void BindConstantBuffer(RenderShaderStage /*stage*/, uint32_t /*slot*/, RenderBufferID /*buffer*/) override {}
+    virtual void BindTexture(RenderShaderStage /*stage*/, uint32_t /*slot*/, RenderTexture /*texture*/) override {}
+    virtual void SetTopology(RenderTopology /*topology*/) override {}
+
+    virtual void SetBlendState(RenderBlendState /*state*/) override {}
+    virtual void SetDepthState(RenderDepthState /*state*/) override {}
+    virtual void SetRasterState(RenderRasterState /*state*/) override {}
+    virtual void BindSamplers() override {}
+    virtual void BindRenderTargets(RenderTarget /*color*/, RenderTarget /*depth*/) override {}
+
+    virtual void Draw(uint32_t /*vertex_count*/, uint32_t /*start_vertex*/) override {}
+    virtual void DrawIndexedInstanced(uint32_t /*index_count*/, uint32_t /*instance_count*/, uint32_t /*start_index*/, uint32_t /*start_instance*/) override {}
+
+    const void *GetBufferData(RenderBufferID buffer) const;
+    size_t GetBufferSize(RenderBufferID buffer) const;
+
+private:
+    std::vector<std::vector<uint8_t>> m_Buffers;
+    uintptr_t m_ShaderCount;
+};
+
+enum class RenderCommandType : uint32_t {
+    CreateBuffer,
+    Map,
+    Unmap,
+    BindShader,
+    BindInputLayout,
+    BindVertexBuffers,
+    BindIndexBuffer,
+    BindConstantBuffer,
+    BindTexture,
+    SetTopology,
+    SetBlendState,
+    SetDepthState,
+    SetRasterState,
+    BindSamplers,
+    BindRenderTargets,
+    Draw,
+    DrawIndexedInstanced
+};
+
+struct RenderCommand {
+    RenderCommandType m_Type;
+    RenderBufferID    m_Buffer;
+    uint32_t          m_Args[4];
+    size_t            m_Bytes;
+};
+
+struct RenderFrameStats {
+    uint32_t m_DrawCalls;
+    uint32_t m_Instances;
+    uint32_t m_Vertices;
+    uint32_t m_ShaderBinds;
+    uint32_t m_Maps;
+    size_t   m_UploadBytes;
+};
+
+// Records the command stream with byte sizes and forwards every call to
+// `inner`. Without an inner backend it records on top of a NullRenderBackend,
+// which is what headless runs use.
+class RecordingRenderBackend : public RenderBackend {
+public:
+    RecordingRenderBackend(RenderBackend *inner = nullptr);
+    ~RecordingRenderBackend();
+
+    virtual RenderBufferID CreateBuffer(RenderBufferType type, RenderBufferUsage usage, uint32_t stride, uint32_t count, const void *data = nullptr) override;
+    virtual void *Map(RenderBufferID buffer) override;
+    virtual void Unmap(RenderBufferID buffer, size_t written) override;
+
+    virtual RenderShader CreateShader(RenderShaderStage stage, const wchar_t *file, const char *function, const RenderInputElement *layout = nullptr, size_t layout_count = 0, RenderInputLayout *out_layout = nullptr) override;
+
+    virtual void BindShader(RenderShaderStage stage, RenderShader shader) override;
+    virtual void BindInputLayout(RenderInputLayout layout) override;
+    virtual void BindVertexBuffers(const RenderBufferID *buffers, uint32_t count) override;
+    virtual void BindIndexBuffer(RenderBufferID buffer) override;
+    virtual void BindConstantBuffer(RenderShaderStage stage, uint32_t slot, RenderBufferID buffer) override;
+    virtual void BindTexture(RenderShaderStage stage, uint32_t slot, RenderTexture texture) override;
+    virtual void SetTopology(RenderTopology topology) override;
+
+    virtual void SetBlendState(RenderBlendState state) override;
+    virtual void SetDepthState(RenderDepthState state) override;
+    virtual void SetRasterState(RenderRasterState state) override;
+    virtual void BindSamplers() override;
+    virtual void BindRenderTargets(RenderTarget color, RenderTarget depth) override;
+
+    virtual void Draw(uint32_t vertex_count, uint32_t start_vertex) override;
+    virtual void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t start_index, uint32_t start_instance) override;
+
+    virtual void EndFrame() override;
+
+    virtual void *GetNativeBuffer(RenderBufferID buffer) override { return m_Inner->GetNativeBuffer(buffer); }
+
+    RenderBackend *GetInner() const { return m_Inner; }
+
+    // command stream and totals of the last completed frame
+    const std::vector<RenderCommand> &GetCommands() const { return m_LastCommands; }
+    const RenderFrameStats &GetFrameStats() const { return m_LastStats; }
+
+private:
+    void Record(RenderCommandType type, RenderBufferID buffer, size_t bytes, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+
+    RenderBackend *m_Inner;
+    bool m_OwnsInner;
+
+    std::vector<RenderCommand> m_Commands;
+    std::vector<RenderCommand> m_LastCommands;
+    std::vector<size_t> m_BufferSizes;
+
+    RenderFrameStats m_Stats;
+    RenderFrameStats m_LastStats;
+};
@@ -0,0 +1,374 @@
+#include "RenderBackendD3D11.h"
+
+#include <cstdio>
+
+#include <d3dcompiler.h>
+
+#include "External/dxerr.h"
+#include "External/Helpers.h"
+
+D3D11ShaderCompiler::D3D11ShaderCompiler(UINT flags)
+    : m_Flags(flags)
+{
+    char id[64];
+    snprintf(id, sizeof(id), "d3dcompiler_%d %x", D3D_COMPILER_VERSION, flags);
+    m_Id = id;
+}
+
+bool D3D11ShaderCompiler::Compile(const ShaderDesc &desc, std::vector<uint8_t> &bytecode, std::string &log)
+{
+    std::vector<D3D_SHADER_MACRO> macros;
+    std::vector<std::string> names(desc.m_Defines.size());
+    for (size_t i = 0; i < desc.m_Defines.size(); i++) {
+        auto &define = desc.m_Defines[i];
+        auto split = define.find('=');
+
+        names[i] = define.substr(0, split);
+        macros.push_back({ names[i].c_str(), split == std::string::npos ? "1" : define.c_str() + split + 1 });
+    }
+    macros.push_back({ nullptr, nullptr });
+
+    ID3DBlob *blob = nullptr;
+    ID3DBlob *error = nullptr;
+
+    std::wstring file = ConvertToWString(desc.m_Path);
+    auto res = D3DCompileFromFile(
+        file.c_str(),
+        macros.data(),
+        D3D_COMPILE_STANDARD_FILE_INCLUDE,
+        desc.m_Entry.c_str(),
+        desc.m_Profile.c_str(),
+        m_Flags,
+        0,
+        &blob,
+        &error
+    );
+
+    if (error) {
+        log.assign((char*)error->GetBufferPointer(), error->GetBufferSize());
+        while (!log.empty() && log.back() == '\0')
+            log.pop_back();
+        error->Release();
+    }
+    else if (!SUCCEEDED(res)) {
+        char err[256];
+        WinErrorMsg(res, err, 256);
+        log = err;
+    }
+
+    if (!SUCCEEDED(res) || !blob) {
+        if (blob)
+            blob->Release();
+        return false;
+    }
+
+    auto data = (const uint8_t*)blob->GetBufferPointer();
+    bytecode.assign(data, data + blob->GetBufferSize());
+    blob->Release();
+
+    return true;
+}
+
+void BuildShader(ShaderCache *cache, const char *file, const char *entry, const char *profile, ShaderBinary &out)
+{
+    if (!cache->Build({ file, entry, profile }, out)) {
+        OutputDebugStringA(out.m_Log.c_str());
+        throw "Failed to compile shader";
+    }
+}
+
+static std::string ConvertToString(const wchar_t *str)
+{
+    std::string out;
+    int size = WideCharToMultiByte(CP_ACP, 0, str, -1, nullptr, 0, nullptr, nullptr);
+    if (size > 1) {
+        out.resize(size - 1);
+        WideCharToMultiByte(CP_ACP, 0, str, -1, &out[0], size, nullptr, nullptr);
+    }
+
+    return out;
+}
+
+static DXGI_FORMAT GetFormat(RenderFormat format)
+{
+    switch (format) {
+        case RenderFormat::R32Float:          return DXGI_FORMAT_R32_FLOAT;
+        case RenderFormat::R32G32Float:       return DXGI_FORMAT_R32G32_FLOAT;
+        case RenderFormat::R32G32B32Float:    return DXGI_FORMAT_R32G32B32_FLOAT;
+        case RenderFormat::R32G32B32A32Float: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        case RenderFormat::R32SInt:           return DXGI_FORMAT_R32_SINT;
+        case RenderFormat::R16G16Float:       return DXGI_FORMAT_R16G16_FLOAT;
+        case RenderFormat::R16G16B16A16Float: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+        case RenderFormat::R16G16B16A16SNorm: return DXGI_FORMAT_R16G16B16A16_SNORM;
+        case RenderFormat::R8G8B8A8SNorm:     return DXGI_FORMAT_R8G8B8A8_SNORM;
+        default:
+            return DXGI_FORMAT_UNKNOWN;
+    }
+}
+
+static D3D11_PRIMITIVE_TOPOLOGY GetTopology(RenderTopology topology)
+{
+    switch (topology) {
+        case RenderTopology::TriangleList:  return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        case RenderTopology::TriangleStrip: return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+        case RenderTopology::PointList:     return D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+        case RenderTopology::LineStripAdj:  return D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP_ADJ;
+        default:
+            return D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    }
+}
+
+D3D11RenderBackend::D3D11RenderBackend(ID3D11Device *device, ID3D11DeviceContext *cxt, ShaderCache *shaders)
+    : m_Shaders(shaders), m_States(new DirectX::CommonStates(device)), device(device), cxt(cxt)
+{
+}
+
+D3D11RenderBackend::~D3D11RenderBackend()
+{
+    delete m_States;
+
+    for (auto &entry : m_Buffers) {
+        if (entry.m_Buffer)
+            entry.m_Buffer->Release();
+    }
+}
+
+RenderBufferID D3D11RenderBackend::CreateBuffer(RenderBufferType type, RenderBufferUsage usage, uint32_t stride, uint32_t count, const void *data)
+{
+    D3D11_BUFFER_DESC desc = {};
+    switch (type) {
+        case RenderBufferType::Vertex:   desc.BindFlags = D3D11_BIND_VERTEX_BUFFER; break;
+        case RenderBufferType::Index:    desc.BindFlags = D3D11_BIND_INDEX_BUFFER; break;
+        case RenderBufferType::Constant: desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; break;
+    }
+    desc.ByteWidth = max(16, stride * count);
+
+    if (usage == RenderBufferUsage::Dynamic) {
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    }
+    else {
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+    }
+
+    ID3D11Buffer *buffer = nullptr;
+    if (data) {
+        D3D11_SUBRESOURCE_DATA init = {};
+        init.pSysMem = data;
+
+        DXCALL(device->CreateBuffer(&desc, &init, &buffer));
+    }
+    else {
+        DXCALL(device->CreateBuffer(&desc, nullptr, &buffer));
+    }
+
+    m_Buffers.push_back({ buffer, stride });
+
+    return (RenderBufferID)m_Buffers.size() - 1;
+}
+
+void *D3D11RenderBackend::Map(RenderBufferID buffer)
+{
+    D3D11_MAPPED_SUBRESOURCE data = {};
+    cxt->Map(m_Buffers[buffer].m_Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &data);
+
+    return data.pData;
+}
+
+void D3D11RenderBackend::Unmap(RenderBufferID buffer, size_t /*written*/)
+{
+    cxt->Unmap(m_Buffers[buffer].m_Buffer, 0);
+}
+
+RenderShader D3D11RenderBackend::CreateShader(RenderShaderStage stage, const wchar_t *file, const char *function, const RenderInputElement *layout, size_t layout_count, RenderInputLayout *out_layout)
+{
+    std::string path = ConvertToString(file);
+    ShaderBinary binary;
+
+    switch (stage) {
+        case RenderShaderStage::Vertex: {
+            ID3D11VertexShader *shader = nullptr;
+            BuildShader(m_Shaders, path.c_str(), function, "vs_5_0", binary);
+            DXCALL(device->CreateVertexShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &shader));
+
+            if (layout && out_layout) {
+                std::vector<D3D11_INPUT_ELEMENT_DESC> desc(layout_count);
+                for (size_t i = 0; i < layout_count; i++) {
+                    auto &element = layout[i];
+                    desc[i] = {
+                        element.m_Semantic,
+                        element.m_SemanticIndex,
+                        GetFormat(element.m_Format),
+                        element.m_Slot,
+                        D3D11_APPEND_ALIGNED_ELEMENT,
+                        element.m_PerInstance ? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA,
+                        element.m_PerInstance ? 1u : 0u
+                    };
+                }
+
+                *out_layout = create_input_layout(desc.data(), desc.size(), binary.m_Bytecode.data(), binary.m_Bytecode.size(), device);
+            }
+
+            return shader;
+        }
+        case RenderShaderStage::Geometry: {
+            ID3D11GeometryShader *shader = nullptr;
+            BuildShader(m_Shaders, path.c_str(), function, "gs_5_0", binary);
+            DXCALL(device->CreateGeometryShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &shader));
+
+            return shader;
+        }
+        case RenderShaderStage::Pixel: {
+            ID3D11PixelShader *shader = nullptr;
+            BuildShader(m_Shaders, path.c_str(), function, "ps_5_0", binary);
+            DXCALL(device->CreatePixelShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &shader));
+
+            return shader;
+        }
+    }
+
+    return nullptr;
+}
+
+void D3D11RenderBackend::BindShader(RenderShaderStage stage, RenderShader shader)
+{
+    switch (stage) {
+        case RenderShaderStage::Vertex:
+            cxt->VSSetShader((ID3D11VertexShader*)shader, nullptr, 0);
+            break;
+        case RenderShaderStage::Geometry:
+            cxt->GSSetShader((ID3D11GeometryShader*)shader, nullptr, 0);
+            break;
+        case RenderShaderStage::Pixel:
+            cxt->PSSetShader((ID3D11PixelShader*)shader, nullptr, 0);
+            break;
+    }
+}
+
+void D3D11RenderBackend::BindInputLayout(RenderInputLayout layout)
+{
+    cxt->IASetInputLayout((ID3D11InputLayout*)layout);
+}
+
+void D3D11RenderBackend::BindVertexBuffers(const RenderBufferID *buffers, uint32_t count)
+{
+    ID3D11Buffer *native[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    UINT strides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    UINT offsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = {};
+
+    for (uint32_t i = 0; i < count; i++) {
+        native[i] = m_Buffers[buffers[i]].m_Buffer;
+        strides[i] = m_Buffers[buffers[i]].m_Stride;
+    }
+
+    cxt->IASetVertexBuffers(0, count, native, strides, offsets);
+}
+
+void D3D11RenderBackend::BindIndexBuffer(RenderBufferID buffer)
+{
+    auto &entry = m_Buffers[buffer];
+    cxt->IASetIndexBuffer(entry.m_Buffer, entry.m_Stride == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+}
+
+void D3D11RenderBackend::BindConstantBuffer(RenderShaderStage stage, uint32_t slot, RenderBufferID buffer)
+{
+    auto native = m_Buffers[buffer].m_Buffer;
+
+    switch (stage) {
+        case RenderShaderStage::Vertex:
+            cxt->VSSetConstantBuffers(slot, 1, &native);
+            break;
+        case RenderShaderStage::Geometry:
+            cxt->GSSetConstantBuffers(slot, 1, &native);
+            break;
+        case RenderShaderStage::Pixel:
+            cxt->PSSetConstantBuffers(slot, 1, &native);
+            break;
+    }
+}
+
+void D3D11RenderBackend::BindTexture(RenderShaderStage stage, uint32_t slot, RenderTexture texture)
+{
+    auto native = (ID3D11ShaderResourceView*)texture;
+
+    switch (stage) {
+        case RenderShaderStage::Vertex:
+            cxt->VSSetShaderResources(slot, 1, &native);
+            break;
+        case RenderShaderStage::Geometry:
+            cxt->GSSetShaderResources(slot, 1, &native);
+            break;
+        case RenderShaderStage::Pixel:
+            cxt->PSSetShaderResources(slot, 1, &native);
+            break;
+    }
+}
+
+void D3D11RenderBackend::SetTopology(RenderTopology topology)
+{
+    cxt->IASetPrimitiveTopology(GetTopology(topology));
+}
+
+void D3D11RenderBackend::SetBlendState(RenderBlendState state)
+{
+    ID3D11BlendState *native = nullptr;
+    switch (state) {
+        case RenderBlendState::Opaque:           native = m_States->Opaque(); break;
+        case RenderBlendState::NonPremultiplied: native = m_States->NonPremultiplied(); break;
+        case RenderBlendState::Additive:         native = m_States->Additive(); break;
+    }
+
+    cxt->OMSetBlendState(native, nullptr, 0xffffffff);
+}
+
+void D3D11RenderBackend::SetDepthState(RenderDepthState state)
+{
+    ID3D11DepthStencilState *native = nullptr;
+    switch (state) {
+        case RenderDepthState::Default: native = m_States->DepthDefault(); break;
+        case RenderDepthState::Read:    native = m_States->DepthRead(); break;
+        case RenderDepthState::None:    native = m_States->DepthNone(); break;
+    }
+
+    cxt->OMSetDepthStencilState(native, 0);
+}
+
+void D3D11RenderBackend::SetRasterState(RenderRasterState state)
+{
+    ID3D11RasterizerState *native = nullptr;
+    switch (state) {
+        case RenderRasterState::CullNone:             native = m_States->CullNone(); break;
+        case RenderRasterState::CullCounterClockwise: native = m_States->CullCounterClockwise(); break;
+        case RenderRasterState::Wireframe:            native = m_States->Wireframe(); break;
+    }
+
+    cxt->RSSetState(native);
+}
+
+void D3D11RenderBackend::BindSamplers()
+{
+    ID3D11SamplerState *samplers[] = {
+        m_States->LinearClamp(),
+        m_States->LinearWrap(),
+        m_States->PointClamp(),
+        m_States->PointWrap()
+    };
+    cxt->VSSetSamplers(0, 4, samplers);
+    cxt->PSSetSamplers(0, 4, samplers);
+}
+
+void D3D11RenderBackend::BindRenderTargets(RenderTarget color, RenderTarget depth)
+{
+    auto rtv = (ID3D11RenderTargetView*)color;
+    cxt->OMSetRenderTargets(rtv ? 1 : 0, rtv ? &rtv : nullptr, (ID3D11DepthStencilView*)depth);
+}
+
+void D3D11RenderBackend::Draw(uint32_t vertex_count, uint32_t start_vertex)
+{
+    cxt->Draw(vertex_count, start_vertex);
+}
+
+void D3D11RenderBackend::DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t start_index, uint32_t start_instance)
+{
+    cxt->DrawIndexedInstanced(index_count, instance_count, start_index, 0, start_instance);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include <d3d11.h>
+
+#include "External/DirectXTK.h"
+
+#include "RenderBackend.h"
+#include "ShaderCache.h"
+
+// D3DCompileFromFile with the standard include handler
+class D3D11ShaderCompiler : public ShaderCompiler {
+public:
+    D3D11ShaderCompiler(UINT flags);
+
+    virtual const char *GetId() const override { return m_Id.c_str(); }
+    virtual bool Compile(const ShaderDesc &desc, std::vector<uint8_t> &bytecode, std::string &log) override;
+
+private:
+    UINT m_Flags;
+    std::string m_Id;
+};
+
+// Builds through the cache for shaders that have to exist before the caller
+// can go on, the compiler output goes to the debugger and failing throws.
+void BuildShader(ShaderCache *cache, const char *file, const char *entry, const char *profile, ShaderBinary &out);
+
+class D3D11RenderBackend : public RenderBackend {
+public:
+    D3D11RenderBackend(ID3D11Device *device, ID3D11DeviceContext *cxt, ShaderCache *shaders);
+    ~D3D11RenderBackend();
+
+    virtual RenderBufferID CreateBuffer(RenderBufferType type, RenderBufferUsage usage, uint32_t stride, uint32_t count, const void *data = nullptr) override;
+    virtual void *Map(RenderBufferID buffer) override;
+    virtual void Unmap(RenderBufferID buffer, size_t written) override;
+
+    virtual RenderShader CreateShader(RenderShaderStage stage, const wchar_t *file, const char *function, const RenderInputElement *layout = nullptr, size_t layout_count = 0, RenderInputLayout *out_layout = nullptr) override;
+
+    virtual void BindShader(RenderShaderStage stage, RenderShader shader) override;
+    virtual void BindInputLayout(RenderInputLayout layout) override;
+    virtual void BindVertexBuffers(const RenderBufferID *buffers, uint32_t count) override;
+    virtual void BindIndexBuffer(RenderBufferID buffer) override;
+    virtual void BindConstantBuffer(RenderShaderStage stage, uint32_t slot, RenderBufferID buffer) override;
+    virtual void BindTexture(RenderShaderStage stage, uint32_t slot, RenderTexture texture) override;
+    virtual void SetTopology(RenderTopology topology) override;
+
+    virtual void SetBlendState(RenderBlendState state) override;
+    virtual void SetDepthState(RenderDepthState state) override;
+    virtual void SetRasterState(RenderRasterState state) override;
+    virtual void BindSamplers() override;
+    virtual void BindRenderTargets(RenderTarget color, RenderTarget depth) override;
+
+    virtual void Draw(uint32_t vertex_count, uint32_t start_vertex) override;
+    virtual void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t start_index, uint32_t start_instance) override;
+
+    virtual void *GetNativeBuffer(RenderBufferID buffer) override { return m_Buffers[buffer].m_Buffer; }
+
+private:
+    struct BufferEntry {
+        ID3D11Buffer *m_Buffer;
+        uint32_t m_Stride;
+    };
+
+    std::vector<BufferEntry> m_Buffers;
+
+    ShaderCache *m_Shaders;
+    DirectX::CommonStates *m_States;
+
+    ID3D11Device *device;
+    ID3D11DeviceContext *cxt;
+};
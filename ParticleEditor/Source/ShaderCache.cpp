@@ -0,0 +1,447 @@
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <experimental/filesystem>
+
+#include "EditJournal.h"
+#include "ImageIO.h"
+
+namespace fs = std::experimental::filesystem;
+
+static const char BINARY_MAGIC[4] = { 'p', 's', 'h', 'c' };
+
+struct ShaderBinaryHeader {
+    char m_Magic[4];
+    uint32_t m_Version;
+    uint64_t m_Hash;
+    uint32_t m_Size;
+    uint32_t m_Crc;
+};
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// FNV-1a, 64 bit
+static void HashBytes(uint64_t &hash, const void *data, size_t size)
+{
+    auto bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+static void HashString(uint64_t &hash, const std::string &str)
+{
+    // the terminator keeps "ab" + "c" apart from "a" + "bc"
+    HashBytes(hash, str.c_str(), str.size() + 1);
+}
+
+static bool ReadText(const std::string &path, std::string &out)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    out.clear();
+
+    char buffer[16 << 10];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        out.append(buffer, n);
+
+    bool ok = !ferror(file);
+    fclose(file);
+
+    return ok;
+}
+
+// Names of the #include directives in `source`, in order. Ones inside block
+// comments or disabled #if branches are picked up too, that only costs a
+// miss when they change.
+static void FindIncludes(const std::string &source, std::vector<std::string> &out)
+{
+    size_t pos = 0;
+    while (pos < source.size()) {
+        auto end = source.find('\n', pos);
+        if (end == std::string::npos)
+            end = source.size();
+
+        auto cur = pos;
+        while (cur < end && (source[cur] == ' ' || source[cur] == '\t'))
+            cur++;
+
+        if (cur < end && source[cur] == '#') {
+            cur++;
+            while (cur < end && (source[cur] == ' ' || source[cur] == '\t'))
+                cur++;
+
+            if (source.compare(cur, 7, "include") == 0) {
+                cur += 7;
+                while (cur < end && (source[cur] == ' ' || source[cur] == '\t'))
+                    cur++;
+
+                if (cur < end && (source[cur] == '"' || source[cur] == '<')) {
+                    char close = source[cur] == '"' ? '"' : '>';
+                    auto name_end = source.find(close, cur + 1);
+                    if (name_end != std::string::npos && name_end < end)
+                        out.push_back(source.substr(cur + 1, name_end - cur - 1));
+                }
+            }
+        }
+
+        pos = end + 1;
+    }
+}
+
+// Hashes `path` and, depth first, everything it includes. Includes resolve
+// like D3D_COMPILE_STANDARD_FILE_INCLUDE: next to the including file first,
+// then next to the shader.
+static void HashSource(uint64_t &hash, const fs::path &path, const fs::path &root, std::set<std::string> &visited)
+{
+    auto key = path.generic_string();
+    if (!visited.insert(key).second)
+        return;
+
+    HashString(hash, key);
+
+    std::string source;
+    if (!ReadText(key, source)) {
+        // missing files hash as missing, the compiler reports them
+        HashString(hash, "<missing>");
+        return;
+    }
+
+    HashBytes(hash, source.data(), source.size());
+
+    std::vector<std::string> includes;
+    FindIncludes(source, includes);
+
+    for (auto &name : includes) {
+        auto local = path.parent_path() / name;
+
+        std::error_code error;
+        if (!fs::exists(local, error))
+            local = root / name;
+
+        HashSource(hash, local, root, visited);
+    }
+}
+
+// One index line per shader, tab separated: path, entry, profile, then the
+// defines
+static std::string GetIndexLine(const ShaderDesc &desc)
+{
+    auto line = desc.m_Path + "\t" + desc.m_Entry + "\t" + desc.m_Profile;
+    for (auto &define : desc.m_Defines)
+        line += "\t" + define;
+
+    return line;
+}
+
+static bool ParseIndexLine(const std::string &line, ShaderDesc &desc)
+{
+    size_t field = 0, pos = 0;
+    while (pos <= line.size()) {
+        auto end = line.find('\t', pos);
+        if (end == std::string::npos)
+            end = line.size();
+
+        auto value = line.substr(pos, end - pos);
+        switch (field++) {
+            case 0: desc.m_Path = value; break;
+            case 1: desc.m_Entry = value; break;
+            case 2: desc.m_Profile = value; break;
+            default: desc.m_Defines.push_back(value); break;
+        }
+
+        pos = end + 1;
+    }
+
+    return field >= 3;
+}
+
+ShaderCache::ShaderCache(const char *dir, ShaderCompiler *compiler, unsigned threads)
+    : m_Dir(dir), m_Compiler(compiler), m_Pool(threads), m_IndexDirty(false), m_NextTicket(1), m_Pending(0), m_NextTemp(0), m_Hits(0), m_Misses(0), m_Failed(0)
+{
+    std::error_code error;
+    fs::create_directories(m_Dir, error);
+
+    LoadIndex();
+}
+
+ShaderCache::~ShaderCache()
+{
+    m_Pool.Wait();
+    SaveIndex();
+}
+
+uint64_t ShaderCache::Hash(const ShaderDesc &desc) const
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    uint32_t version = SHADER_CACHE_VERSION;
+    HashBytes(hash, &version, sizeof(version));
+    HashString(hash, m_Compiler->GetId());
+    HashString(hash, desc.m_Entry);
+    HashString(hash, desc.m_Profile);
+
+    uint32_t defines = (uint32_t)desc.m_Defines.size();
+    HashBytes(hash, &defines, sizeof(defines));
+    for (auto &define : desc.m_Defines)
+        HashString(hash, define);
+
+    fs::path path(desc.m_Path);
+    std::set<std::string> visited;
+    HashSource(hash, path, path.parent_path(), visited);
+
+    return hash;
+}
+
+void ShaderCache::GetFiles(const ShaderDesc &desc, std::vector<std::string> &files) const
+{
+    uint64_t hash = 0;
+
+    fs::path path(desc.m_Path);
+    std::set<std::string> visited;
+    HashSource(hash, path, path.parent_path(), visited);
+
+    files.assign(visited.begin(), visited.end());
+}
+
+std::string ShaderCache::GetBinaryPath(uint64_t hash) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cso", (unsigned long long)hash);
+
+    return m_Dir + "/" + name;
+}
+
+bool ShaderCache::ReadBinary(uint64_t hash, std::vector<uint8_t> &bytecode) const
+{
+    std::string data;
+    if (!ReadText(GetBinaryPath(hash), data))
+        return false;
+
+    ShaderBinaryHeader header;
+    if (data.size() < sizeof(header))
+        return false;
+
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.m_Magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 || header.m_Version != SHADER_CACHE_VERSION ||
+        header.m_Hash != hash || header.m_Size != data.size() - sizeof(header))
+        return false;
+
+    auto bytes = (const uint8_t*)data.data() + sizeof(header);
+    if (header.m_Crc != Crc32(bytes, header.m_Size))
+        return false;
+
+    bytecode.assign(bytes, bytes + header.m_Size);
+
+    return true;
+}
+
+bool ShaderCache::WriteBinary(uint64_t hash, const std::vector<uint8_t> &bytecode)
+{
+    ShaderBinaryHeader header = {};
+    memcpy(header.m_Magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.m_Version = SHADER_CACHE_VERSION;
+    header.m_Hash = hash;
+    header.m_Size = (uint32_t)bytecode.size();
+    header.m_Crc = Crc32(bytecode.data(), bytecode.size());
+
+    // two workers can build the same shader, each writes its own file and
+    // the last one to finish wins
+    auto path = GetBinaryPath(hash);
+    auto temp = path + ".tmp" + std::to_string(m_NextTemp++);
+
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(bytecode.data(), 1, bytecode.size(), file) == bytecode.size();
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || !ReplaceFileAtomic(temp.c_str(), path.c_str())) {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool ShaderCache::Build(const ShaderDesc &desc, ShaderBinary &out)
+{
+    auto timer = std::chrono::high_resolution_clock::now();
+
+    out.m_Bytecode.clear();
+    out.m_Log.clear();
+    out.m_Hash = Hash(desc);
+    out.m_Cached = false;
+
+    Remember(desc);
+
+    if (ReadBinary(out.m_Hash, out.m_Bytecode)) {
+        out.m_Cached = true;
+        out.m_Ms = ElapsedMs(timer);
+        m_Hits++;
+        return true;
+    }
+
+    if (!m_Compiler->Compile(desc, out.m_Bytecode, out.m_Log) || out.m_Bytecode.empty()) {
+        out.m_Bytecode.clear();
+        out.m_Ms = ElapsedMs(timer);
+        m_Failed++;
+        return false;
+    }
+
+    // The compiler reads the files again, an edit saved in between means the
+    // bytecode may not belong to the hash. Keep it for this build, but only
+    // cache it when the sources still hash the same.
+    if (Hash(desc) == out.m_Hash) {
+        // a failed write only costs a compile next time
+        WriteBinary(out.m_Hash, out.m_Bytecode);
+    }
+
+    out.m_Ms = ElapsedMs(timer);
+    m_Misses++;
+
+    return true;
+}
+
+ShaderTicket ShaderCache::Request(const ShaderDesc &desc)
+{
+    ShaderTicket ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        ticket = m_NextTicket++;
+        if (m_NextTicket == 0)
+            m_NextTicket = 1;
+    }
+
+    m_Pending++;
+    m_Pool.Submit([this, ticket, desc]() {
+        ShaderResult result;
+        result.m_Ticket = ticket;
+        result.m_Desc = desc;
+        result.m_Ok = Build(desc, result.m_Binary);
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Done.push_back(std::move(result));
+        m_Pending--;
+    });
+
+    return ticket;
+}
+
+void ShaderCache::Poll(std::vector<ShaderResult> &out)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    for (auto &result : m_Done)
+        out.push_back(std::move(result));
+
+    m_Done.clear();
+}
+
+void ShaderCache::Warm()
+{
+    std::vector<ShaderDesc> descs;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        for (auto &line : m_Index) {
+            ShaderDesc desc;
+            if (ParseIndexLine(line, desc))
+                descs.push_back(desc);
+        }
+    }
+
+    for (auto &desc : descs) {
+        m_Pool.Submit([this, desc]() {
+            ShaderBinary binary;
+            if (Build(desc, binary))
+                return;
+
+            // gone or broken, it comes back the next time it builds
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Index.erase(GetIndexLine(desc));
+            m_IndexDirty = true;
+        });
+    }
+
+    m_Pool.Wait();
+}
+
+void ShaderCache::Wait()
+{
+    m_Pool.Wait();
+}
+
+ShaderCacheStats ShaderCache::GetStats() const
+{
+    ShaderCacheStats stats;
+    stats.m_Hits = m_Hits;
+    stats.m_Misses = m_Misses;
+    stats.m_Failed = m_Failed;
+
+    return stats;
+}
+
+void ShaderCache::Remember(const ShaderDesc &desc)
+{
+    auto line = GetIndexLine(desc);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (m_Index.insert(line).second)
+        m_IndexDirty = true;
+}
+
+void ShaderCache::LoadIndex()
+{
+    std::string data;
+    if (!ReadText(m_Dir + "/" SHADER_CACHE_INDEX, data))
+        return;
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        auto end = data.find('\n', pos);
+        if (end == std::string::npos)
+            end = data.size();
+
+        auto line = data.substr(pos, end - pos);
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty())
+            m_Index.insert(line);
+
+        pos = end + 1;
+    }
+}
+
+void ShaderCache::SaveIndex()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (!m_IndexDirty)
+        return;
+
+    auto path = m_Dir + "/" SHADER_CACHE_INDEX;
+    auto temp = path + ".tmp";
+
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file)
+        return;
+
+    bool ok = true;
+    for (auto &line : m_Index)
+        ok = fprintf(file, "%s\n", line.c_str()) >= 0 && ok;
+    ok = fclose(file) == 0 && ok;
+
+    if (ok && ReplaceFileAtomic(temp.c_str(), path.c_str()))
+        m_IndexDirty = false;
+    else
+        remove(temp.c_str());
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "JobPool.h"
+
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_INDEX "shaders.list"
+
+struct ShaderDesc {
+    std::string m_Path;
+    std::string m_Entry;
+    std::string m_Profile;
+    // NAME or NAME=VALUE
+    std::vector<std::string> m_Defines;
+};
+
+struct ShaderBinary {
+    std::vector<uint8_t> m_Bytecode;
+    // compiler output, warnings included
+    std::string m_Log;
+
+    uint64_t m_Hash;
+    bool m_Cached;
+    float m_Ms;
+};
+
+// The part that turns HLSL into bytecode, D3D11ShaderCompiler on Windows.
+// Everything else in the cache only ever sees this interface.
+class ShaderCompiler {
+public:
+    virtual ~ShaderCompiler() {}
+
+    // goes into every hash, a different compiler or different flags must
+    // not pick up bytecode built by this one
+    virtual const char *GetId() const = 0;
+
+    // called from several worker threads at once
+    virtual bool Compile(const ShaderDesc &desc, std::vector<uint8_t> &bytecode, std::string &log) = 0;
+};
+
+// 0 is never handed out
+typedef uint32_t ShaderTicket;
+
+struct ShaderResult {
+    ShaderTicket m_Ticket;
+    ShaderDesc m_Desc;
+    bool m_Ok;
+    ShaderBinary m_Binary;
+};
+
+struct ShaderCacheStats {
+    uint32_t m_Hits;
+    uint32_t m_Misses;
+    uint32_t m_Failed;
+};
+
+/*
+ * Bytecode cache keyed by the content of a shader: the source, every file it
+ * includes, the entry point, profile, defines and the compiler id are hashed
+ * together and the bytecode is kept in `<dir>/<hash>.cso`. Editing any of them
+ * is a miss, everything else is a file read.
+ *
+ * Misses compile on the cache's own worker threads. Request/Poll is for the UI
+ * thread, which swaps shaders in as they come out of Poll; Build is for code
+ * that needs the shader before it can go on.
+ *
+ * Every shader built is remembered in SHADER_CACHE_INDEX, Warm builds those on
+ * all workers at once so startup only compiles in parallel.
+ */
+class ShaderCache {
+public:
+    // 0 threads picks one per hardware thread, see JobPool
+    ShaderCache(const char *dir, ShaderCompiler *compiler, unsigned threads = 0);
+    ~ShaderCache();
+
+    // builds on the calling thread, safe to call from any thread
+    bool Build(const ShaderDesc &desc, ShaderBinary &out);
+
+    ShaderTicket Request(const ShaderDesc &desc);
+    // moves the requests that finished since the last call into `out`
+    void Poll(std::vector<ShaderResult> &out);
+    uint32_t GetPending() const { return m_Pending; }
+
+    // builds every shader in the index in parallel and waits for them
+    void Warm();
+    // blocks until every request has finished, they still go through Poll
+    void Wait();
+
+    // of the source and everything it includes, the cache key
+    uint64_t Hash(const ShaderDesc &desc) const;
+    // the source and every file it includes, the files Hash reads
+    void GetFiles(const ShaderDesc &desc, std::vector<std::string> &files) const;
+
+    ShaderCacheStats GetStats() const;
+
+private:
+    ShaderCache(const ShaderCache &) = delete;
+    ShaderCache &operator=(const ShaderCache &) = delete;
+
+    std::string GetBinaryPath(uint64_t hash) const;
+    bool ReadBinary(uint64_t hash, std::vector<uint8_t> &bytecode) const;
+    bool WriteBinary(uint64_t hash, const std::vector<uint8_t> &bytecode);
+
+    void Remember(const ShaderDesc &desc);
+    void LoadIndex();
+    void SaveIndex();
+
+    std::string m_Dir;
+    ShaderCompiler *m_Compiler;
+    JobPool m_Pool;
+
+    mutable std::mutex m_Lock;
+    std::vector<ShaderResult> m_Done;
+    std::set<std::string> m_Index;
+    bool m_IndexDirty;
+
+    ShaderTicket m_NextTicket;
+    std::atomic<uint32_t> m_Pending;
+    std::atomic<uint32_t> m_NextTemp;
+
+    std::atomic<uint32_t> m_Hits;
+    std::atomic<uint32_t> m_Misses;
+    std::atomic<uint32_t> m_Failed;
+};
@@ -0,0 +1,581 @@
+#include "SimulationCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <DirectXPackedVector.h>
+
+using namespace DirectX::PackedVector;
+
+static const char SimulationCacheMagic[4] = { 'P', 'S', 'I', 'M' };
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void PutVarint(std::vector<uint8_t> &out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static uint32_t Zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static void PutZigzag(std::vector<uint8_t> &out, int32_t value)
+{
+    PutVarint(out, Zigzag(value));
+}
+
+static uint32_t VarintSize(uint32_t value)
+{
+    uint32_t size = 1;
+    for (; value >= 0x80; value >>= 7)
+        size++;
+    return size;
+}
+
+static void PutHalf(std::vector<uint8_t> &out, float value)
+{
+    HALF half = XMConvertFloatToHalf(value);
+    out.push_back(half & 0xff);
+    out.push_back(half >> 8);
+}
+
+static void PutRaw(std::vector<uint8_t> &out, const void *data, size_t size)
+{
+    auto bytes = (const uint8_t*)data;
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+struct CacheCursor {
+    const uint8_t *m_Ptr;
+    const uint8_t *m_End;
+    bool m_Ok;
+
+    uint32_t Varint()
+    {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (m_Ptr >= m_End) {
+                m_Ok = false;
+                return 0;
+            }
+
+            uint8_t byte = *m_Ptr++;
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+
+        m_Ok = false;
+        return 0;
+    }
+
+    int32_t Zigzag()
+    {
+        uint32_t value = Varint();
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    float Half()
+    {
+        if (m_End - m_Ptr < 2) {
+            m_Ok = false;
+            return 0.f;
+        }
+
+        HALF half = (HALF)(m_Ptr[0] | (m_Ptr[1] << 8));
+        m_Ptr += 2;
+
+        return XMConvertHalfToFloat(half);
+    }
+
+    void Raw(void *dst, size_t size)
+    {
+        if ((size_t)(m_End - m_Ptr) < size) {
+            m_Ok = false;
+            return;
+        }
+
+        memcpy(dst, m_Ptr, size);
+        m_Ptr += size;
+    }
+};
+
+static int32_t Quantize(float value, float step)
+{
+    return (int32_t)std::lround(value / step);
+}
+
+ParticleFrameData SimulationCacheFrame::GetFrameData() const
+{
+    ParticleFrameData data = {};
+    data.m_Instances = m_Instances.data();
+    data.m_InstanceMaterials = m_Materials.data();
+    data.m_InstanceCount = (uint32_t)m_Instances.size();
+    data.m_Lights = m_Lights.data();
+    data.m_LightCount = (uint32_t)m_Lights.size();
+    data.m_Billboards = m_Billboards.data();
+    data.m_BillboardCount = (uint32_t)m_Billboards.size();
+    data.m_Trails = m_Trails.data();
+    data.m_TrailCount = (uint32_t)m_Trails.size();
+
+    return data;
+}
+
+SimulationCacheWriter::SimulationCacheWriter(uint32_t keyframe_interval, float quantization)
+    : m_File(nullptr), m_KeyframeInterval(std::max(keyframe_interval, 1u)), m_Quantization(quantization), m_Offset(0), m_Failed(false), m_Stats()
+{
+}
+
+SimulationCacheWriter::~SimulationCacheWriter()
+{
+    Close();
+}
+
+bool SimulationCacheWriter::Open(const char *path)
+{
+    Close();
+
+    m_File = fopen(path, "wb");
+    if (!m_File)
+        return false;
+
+    // frames are written as they come in, a larger buffer keeps the number
+    // of writes down on long recordings
+    setvbuf(m_File, nullptr, _IOFBF, 1 << 20);
+
+    // patched by Close() once the index is known
+    SimulationCacheHeader header = {};
+    if (fwrite(&header, sizeof(header), 1, m_File) != 1) {
+        fclose(m_File);
+        m_File = nullptr;
+        return false;
+    }
+
+    m_Offset = sizeof(header);
+    m_Failed = false;
+    m_Index.clear();
+    m_Positions.clear();
+    m_Stats = {};
+
+    return true;
+}
+
+bool SimulationCacheWriter::AddFrame(const ParticleFrameData &data)
+{
+    if (!m_File || m_Failed)
+        return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<int32_t> positions(data.m_InstanceCount * 3);
+    for (uint32_t i = 0; i < data.m_InstanceCount; i++) {
+        XMFLOAT3 pos;
+        XMStoreFloat3(&pos, data.m_Instances[i].m_Model.r[3]);
+        positions[i * 3 + 0] = Quantize(pos.x, m_Quantization);
+        positions[i * 3 + 1] = Quantize(pos.y, m_Quantization);
+        positions[i * 3 + 2] = Quantize(pos.z, m_Quantization);
+    }
+
+    // deltas go against the same instance index of the previous frame, once
+    // particles spawn, die or pools compact that index is another particle
+    // and the deltas are no smaller than the positions themselves. Such
+    // frames are written as keyframes instead.
+    bool keyframe = m_Index.size() % m_KeyframeInterval == 0 || positions.size() != m_Positions.size();
+    if (!keyframe) {
+        uint64_t delta_bytes = 0, key_bytes = 0;
+        for (size_t i = 0; i < positions.size(); i++) {
+            delta_bytes += VarintSize(Zigzag(positions[i] - m_Positions[i]));
+            key_bytes += VarintSize(Zigzag(positions[i]));
+        }
+        keyframe = delta_bytes >= key_bytes;
+    }
+
+    auto &out = m_Buffer;
+    out.clear();
+
+    PutVarint(out, data.m_InstanceCount);
+    PutVarint(out, data.m_LightCount);
+    PutVarint(out, data.m_BillboardCount);
+    PutVarint(out, data.m_TrailCount);
+
+    for (uint32_t i = 0; i < data.m_InstanceCount; i++) {
+        auto &instance = data.m_Instances[i];
+
+        PutVarint(out, (uint32_t)data.m_InstanceMaterials[i]);
+
+        for (int c = 0; c < 3; c++)
+            PutZigzag(out, positions[i * 3 + c] - (keyframe ? 0 : m_Positions[i * 3 + c]));
+
+        // model is rotation * uniform scale * translation
+        float scale = XMVectorGetX(XMVector3Length(instance.m_Model.r[0]));
+        PutHalf(out, scale);
+
+        XMVECTOR rotation = XMQuaternionIdentity();
+        if (scale > 0.f) {
+            XMMATRIX m = instance.m_Model;
+            m.r[0] /= scale;
+            m.r[1] /= scale;
+            m.r[2] /= scale;
+            m.r[3] = XMVectorSet(0.f, 0.f, 0.f, 1.f);
+
+            rotation = XMQuaternionNormalize(XMQuaternionRotationMatrix(m));
+            if (XMVectorGetW(rotation) < 0.f)
+                rotation = -rotation;
+        }
+
+        XMFLOAT4 quat;
+        XMStoreFloat4(&quat, rotation);
+        float q[4] = { quat.x, quat.y, quat.z, quat.w };
+        for (int c = 0; c < 4; c++) {
+            int16_t snorm = (int16_t)std::lround(q[c] * 32767.f);
+            PutRaw(out, &snorm, sizeof(snorm));
+        }
+
+        XMFLOAT4 color;
+        XMStoreFloat4(&color, instance.m_Color);
+        PutHalf(out, color.x);
+        PutHalf(out, color.y);
+        PutHalf(out, color.z);
+        PutHalf(out, color.w);
+
+        PutHalf(out, instance.m_Age);
+        PutHalf(out, instance.m_Deform);
+        PutHalf(out, instance.m_DeformSpeed);
+        PutHalf(out, instance.m_NoiseScale);
+        PutHalf(out, instance.m_NoiseSpeed);
+    }
+    m_Positions.swap(positions);
+
+    PutRaw(out, data.m_Lights, data.m_LightCount * sizeof(Light));
+    PutRaw(out, data.m_Billboards, data.m_BillboardCount * sizeof(BillboardParticle));
+
+    for (uint32_t i = 0; i < data.m_TrailCount; i++) {
+        auto &trail = data.m_Trails[i];
+
+        PutVarint(out, (uint32_t)trail.idx);
+
+        int32_t prev[3] = {};
+        for (int j = 0; j < TRAIL_COUNT; j++) {
+            auto &point = trail.points[j];
+
+            float p[3] = { point.m_Position.x, point.m_Position.y, point.m_Position.z };
+            for (int c = 0; c < 3; c++) {
+                int32_t q = Quantize(p[c], m_Quantization);
+                PutZigzag(out, q - prev[c]);
+                prev[c] = q;
+            }
+
+            PutHalf(out, point.m_Size.x);
+            PutHalf(out, point.m_Size.y);
+        }
+    }
+
+    if (fwrite(out.data(), 1, out.size(), m_File) != out.size()) {
+        m_Failed = true;
+        return false;
+    }
+
+    m_Index.push_back({ m_Offset, (uint32_t)out.size(), keyframe ? 1u : 0u });
+    m_Offset += out.size();
+
+    m_Stats.m_Frames++;
+    m_Stats.m_Bytes += out.size();
+    m_Stats.m_RawBytes += data.m_InstanceCount * (sizeof(GeometryParticleInstance) + sizeof(int)) +
+        data.m_LightCount * sizeof(Light) +
+        data.m_BillboardCount * sizeof(BillboardParticle) +
+        data.m_TrailCount * sizeof(Trail);
+    m_Stats.m_Ms += ElapsedMs(start);
+
+    return true;
+}
+
+bool SimulationCacheWriter::Close()
+{
+    if (!m_File)
+        return false;
+
+    bool ok = !m_Failed;
+    ok = ok && fwrite(m_Index.data(), sizeof(SimulationCacheIndexEntry), m_Index.size(), m_File) == m_Index.size();
+
+    SimulationCacheHeader header = {};
+    memcpy(header.m_Magic, SimulationCacheMagic, sizeof(header.m_Magic));
+    header.m_Version = SIMULATION_CACHE_VERSION;
+    header.m_FrameCount = (uint32_t)m_Index.size();
+    header.m_KeyframeInterval = m_KeyframeInterval;
+    header.m_Quantization = m_Quantization;
+    header.m_IndexOffset = m_Offset;
+
+    // without a valid header a reader rejects the file, so a failure above
+    // leaves the zeroed one in place
+    ok = ok && fseek(m_File, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof(header), 1, m_File) == 1;
+
+    ok = !ferror(m_File) && ok;
+    ok = fclose(m_File) == 0 && ok;
+    m_File = nullptr;
+
+    return ok;
+}
+
+SimulationCacheReader::SimulationCacheReader()
+    : m_Header(), m_LastFrame(-1), m_LastTarget(nullptr), m_Stats()
+{
+}
+
+SimulationCacheReader::~SimulationCacheReader()
+{
+}
+
+bool SimulationCacheReader::Open(const char *path)
+{
+    m_Index.clear();
+    m_LastFrame = -1;
+    m_LastTarget = nullptr;
+    m_Stats = {};
+
+    if (!m_File.Open(path))
+        return false;
+
+    if (m_File.GetSize() < sizeof(SimulationCacheHeader))
+        return false;
+
+    memcpy(&m_Header, m_File.GetData(), sizeof(m_Header));
+    if (memcmp(m_Header.m_Magic, SimulationCacheMagic, sizeof(m_Header.m_Magic)) != 0 ||
+        m_Header.m_Version != SIMULATION_CACHE_VERSION ||
+        m_Header.m_KeyframeInterval == 0)
+        return false;
+
+    uint64_t index_size = (uint64_t)m_Header.m_FrameCount * sizeof(SimulationCacheIndexEntry);
+    if (m_Header.m_IndexOffset + index_size > m_File.GetSize())
+        return false;
+
+    // copied out since the offset gives no alignment guarantee
+    m_Index.resize(m_Header.m_FrameCount);
+    memcpy(m_Index.data(), m_File.GetData() + m_Header.m_IndexOffset, (size_t)index_size);
+
+    for (auto &entry : m_Index) {
+        if (entry.m_Offset + entry.m_Size > m_Header.m_IndexOffset) {
+            m_Index.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SimulationCacheReader::ReadFrame(uint32_t frame, SimulationCacheFrame &out)
+{
+    if (frame >= m_Index.size())
+        return false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t first = frame;
+    if (&out != m_LastTarget || m_LastFrame + 1 != frame) {
+        while (!m_Index[first].m_Keyframe && first > 0)
+            first--;
+    }
+
+    bool ok = true;
+    for (uint32_t i = first; i <= frame && ok; i++)
+        ok = DecodeFrame(i, out);
+
+    m_LastFrame = ok ? frame : -1;
+    m_LastTarget = ok ? &out : nullptr;
+
+    m_Stats.m_Ms += ElapsedMs(start);
+
+    return ok;
+}
+
+bool SimulationCacheReader::DecodeFrame(uint32_t frame, SimulationCacheFrame &out)
+{
+    auto &entry = m_Index[frame];
+    float step = m_Header.m_Quantization;
+
+    CacheCursor cursor = { m_File.GetData() + entry.m_Offset, m_File.GetData() + entry.m_Offset + entry.m_Size, true };
+
+    uint32_t instance_count = cursor.Varint();
+    uint32_t light_count = cursor.Varint();
+    uint32_t billboard_count = cursor.Varint();
+    uint32_t trail_count = cursor.Varint();
+
+    // every counted item takes at least a byte, anything larger is corrupt
+    if (!cursor.m_Ok || (uint64_t)instance_count + light_count + billboard_count + trail_count > entry.m_Size)
+        return false;
+
+    std::vector<int32_t> positions(instance_count * 3);
+
+    out.m_Instances.resize(instance_count);
+    out.m_Materials.resize(instance_count);
+    for (uint32_t i = 0; i < instance_count; i++) {
+        auto &instance = out.m_Instances[i];
+
+        out.m_Materials[i] = (int)cursor.Varint();
+
+        float p[3];
+        for (int c = 0; c < 3; c++) {
+            int32_t base = !entry.m_Keyframe && i * 3 + c < out.m_Positions.size() ? out.m_Positions[i * 3 + c] : 0;
+            positions[i * 3 + c] = base + cursor.Zigzag();
+            p[c] = positions[i * 3 + c] * step;
+        }
+
+        float scale = cursor.Half();
+
+        int16_t q[4];
+        for (int c = 0; c < 4; c++)
+            cursor.Raw(&q[c], sizeof(int16_t));
+        XMVECTOR rotation = XMQuaternionNormalize(XMVectorSet(q[0] / 32767.f, q[1] / 32767.f, q[2] / 32767.f, q[3] / 32767.f));
+
+        instance.m_Model = XMMatrixRotationQuaternion(rotation) * XMMatrixScaling(scale, scale, scale) * XMMatrixTranslation(p[0], p[1], p[2]);
+
+        float r = cursor.Half();
+        float g = cursor.Half();
+        float b = cursor.Half();
+        float a = cursor.Half();
+        instance.m_Color = XMVectorSet(r, g, b, a);
+
+        instance.m_Age = cursor.Half();
+        instance.m_Deform = cursor.Half();
+        instance.m_DeformSpeed = cursor.Half();
+        instance.m_NoiseScale = cursor.Half();
+        instance.m_NoiseSpeed = cursor.Half();
+    }
+    out.m_Positions.swap(positions);
+
+    out.m_Lights.resize(light_count);
+    cursor.Raw(out.m_Lights.data(), light_count * sizeof(Light));
+
+    out.m_Billboards.resize(billboard_count);
+    cursor.Raw(out.m_Billboards.data(), billboard_count * sizeof(BillboardParticle));
+
+    out.m_Trails.resize(trail_count);
+    for (uint32_t i = 0; i < trail_count; i++) {
+        auto &trail = out.m_Trails[i];
+        trail = {};
+        trail.idx = (int)cursor.Varint();
+
+        int32_t prev[3] = {};
+        for (int j = 0; j < TRAIL_COUNT; j++) {
+            auto &point = trail.points[j];
+
+            for (int c = 0; c < 3; c++)
+                prev[c] += cursor.Zigzag();
+
+            point.m_Position = { prev[0] * step, prev[1] * step, prev[2] * step };
+            point.m_Size.x = cursor.Half();
+            point.m_Size.y = cursor.Half();
+        }
+    }
+
+    if (!cursor.m_Ok)
+        return false;
+
+    m_Stats.m_Frames++;
+    m_Stats.m_Bytes += entry.m_Size;
+    m_Stats.m_RawBytes += instance_count * (sizeof(GeometryParticleInstance) + sizeof(int)) +
+        light_count * sizeof(Light) +
+        billboard_count * sizeof(BillboardParticle) +
+        trail_count * sizeof(Trail);
+
+    return true;
+}
+
+bool BenchmarkSimulationCache(const char *path, uint32_t frames, uint32_t instances, SimulationCacheBenchmark &result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto ms = [](Clock::time_point start) { return std::chrono::duration<float, std::milli>(Clock::now() - start).count(); };
+
+    result = {};
+    result.m_Frames = frames;
+    result.m_Instances = instances;
+    result.m_Seeks = std::min(frames, 256u);
+
+    if (frames == 0)
+        return false;
+
+    // every instance flies along its own parabola and spins. Once a second a
+    // tenth of them are missing for a frame, the count change forces
+    // keyframes in between the regular ones.
+    uint32_t state = 1;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.f / 16777216.f);
+    };
+
+    std::vector<XMFLOAT3> starts(instances), velocities(instances);
+    for (uint32_t i = 0; i < instances; i++) {
+        starts[i] = { random() * 20.f - 10.f, random() * 2.f, random() * 20.f - 10.f };
+        velocities[i] = { random() * 2.f - 1.f, random() * 4.f, random() * 2.f - 1.f };
+    }
+
+    const float dt = 1.f / 60.f;
+
+    SimulationCacheFrame frame;
+    frame.m_Instances.resize(instances);
+    frame.m_Materials.resize(instances);
+
+    auto timer = Clock::now();
+    SimulationCacheWriter writer;
+    if (!writer.Open(path))
+        return false;
+
+    for (uint32_t f = 0; f < frames; f++) {
+        float t = f * dt;
+        uint32_t alive = instances - (uint32_t)(instances / 10 * (f % 60 == 59));
+        frame.m_Instances.resize(alive);
+        frame.m_Materials.resize(alive);
+
+        for (uint32_t i = 0; i < alive; i++) {
+            auto &instance = frame.m_Instances[i];
+            auto position = XMLoadFloat3(&starts[i]) + XMLoadFloat3(&velocities[i]) * t + XMVectorSet(0.f, -0.5f * t * t, 0.f, 0.f);
+
+            instance.m_Model = XMMatrixRotationY(t + i) * XMMatrixScaling(0.1f, 0.1f, 0.1f) * XMMatrixTranslationFromVector(position);
+            instance.m_Color = XMVectorSet(1.f, 0.5f, 0.25f, 1.f - t / (frames * dt));
+            instance.m_Age = t;
+            instance.m_Deform = 0.5f;
+            instance.m_DeformSpeed = 1.f;
+            instance.m_NoiseScale = 1.f;
+            instance.m_NoiseSpeed = 1.f;
+            frame.m_Materials[i] = (int)(i % 4);
+        }
+
+        if (!writer.AddFrame(frame.GetFrameData()))
+            return false;
+    }
+
+    if (!writer.Close())
+        return false;
+    result.m_WriteMs = ms(timer);
+    result.m_Bytes = writer.GetStats().m_Bytes;
+
+    SimulationCacheReader reader;
+    if (!reader.Open(path) || reader.GetFrameCount() != frames)
+        return false;
+
+    bool ok = true;
+
+    SimulationCacheFrame out;
+    timer = Clock::now();
+    for (uint32_t f = 0; f < frames && ok; f++)
+        ok = reader.ReadFrame(f, out);
+    result.m_SequentialMs = ms(timer);
+
+    timer = Clock::now();
+    for (uint32_t i = 0; i < result.m_Seeks && ok; i++)
+        ok = reader.ReadFrame((uint32_t)(random() * frames) % frames, out);
+    result.m_SeekMs = ms(timer);
+
+    return ok;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ParticleSystem.h"
+
+#define SIMULATION_CACHE_VERSION 1
+
+/*
+ * File format, little endian:
+ *   header: SimulationCacheHeader,
+ *   frames: [u8; index[i].size] for every frame,
+ *   index:  [SimulationCacheIndexEntry; frame_count] at header.index_offset
+ *
+ * Frame:
+ *   instance_count, light_count, billboard_count, trail_count: varint,
+ *   instances: [{
+ *     material: varint,
+ *     position: [zigzag varint; 3], quantized, delta from the same instance
+ *               index in the previous frame unless the frame is a keyframe.
+ *               Instances carry no particle id, so the index only matches
+ *               while nothing spawned, died or moved between pools; frames
+ *               whose instance count changed or whose deltas come out no
+ *               smaller than the positions are written as keyframes,
+ *     scale: half,
+ *     rotation: [snorm16; 4], quaternion,
+ *     color: [half; 4],
+ *     age, deform, deformspeed, noisescale, noisespeed: half
+ *   }; instance_count],
+ *   lights: [Light; light_count],
+ *   billboards: [BillboardParticle; billboard_count],
+ *   trails: [{
+ *     material: varint,
+ *     points: [{
+ *       position: [zigzag varint; 3], quantized, delta from the previous point,
+ *       size: [half; 2]
+ *     }; TRAIL_COUNT]
+ *   }; trail_count]
+ *
+ * Every `keyframe_interval`th frame is a keyframe, more may be in between.
+ * Seeking decodes from the closest keyframe, so any frame costs at most
+ * `keyframe_interval` frame decodes regardless of the cache length.
+ */
+struct SimulationCacheHeader {
+    char m_Magic[4];
+    uint32_t m_Version;
+    uint32_t m_FrameCount;
+    uint32_t m_KeyframeInterval;
+    float m_Quantization;
+    uint32_t m_Reserved;
+    uint64_t m_IndexOffset;
+};
+
+struct SimulationCacheIndexEntry {
+    uint64_t m_Offset;
+    uint32_t m_Size;
+    uint32_t m_Keyframe;
+};
+
+// A decoded frame, owns everything its ParticleFrameData points at.
+// Trails come back without a definition and velocities, they can only be
+// rendered, not simulated further.
+struct SimulationCacheFrame {
+    std::vector<GeometryParticleInstance> m_Instances;
+    std::vector<int> m_Materials;
+    std::vector<Light> m_Lights;
+    std::vector<BillboardParticle> m_Billboards;
+    std::vector<Trail> m_Trails;
+
+    // quantized instance positions, the base for the next delta frame
+    std::vector<int32_t> m_Positions;
+
+    // the sphere mesh and light are not part of the cache
+    ParticleFrameData GetFrameData() const;
+};
+
+struct SimulationCacheStats {
+    uint32_t m_Frames;
+    uint64_t m_Bytes;    // encoded bytes written or decoded
+    uint64_t m_RawBytes; // what the same frames take up in memory
+    float m_Ms;          // time spent encoding and writing, or decoding
+};
+
+class SimulationCacheWriter {
+public:
+    SimulationCacheWriter(uint32_t keyframe_interval = 30, float quantization = 1.f / 1024.f);
+    ~SimulationCacheWriter();
+
+    bool Open(const char *path);
+    // false if the frame could not be written, the cache is broken from
+    // then on and Close() fails too
+    bool AddFrame(const ParticleFrameData &data);
+
+    // writes the index table and patches the header
+    bool Close();
+
+    bool IsOpen() const { return m_File != nullptr; }
+    const SimulationCacheStats &GetStats() const { return m_Stats; }
+
+private:
+    FILE *m_File;
+    uint32_t m_KeyframeInterval;
+    float m_Quantization;
+    uint64_t m_Offset;
+    bool m_Failed;
+
+    std::vector<SimulationCacheIndexEntry> m_Index;
+    std::vector<int32_t> m_Positions;
+    std::vector<uint8_t> m_Buffer;
+
+    SimulationCacheStats m_Stats;
+};
+
+class SimulationCacheReader {
+public:
+    SimulationCacheReader();
+    ~SimulationCacheReader();
+
+    bool Open(const char *path);
+
+    uint32_t GetFrameCount() const { return (uint32_t)m_Index.size(); }
+
+    // decodes only `frame` when it directly follows the last frame read into
+    // `out`, otherwise starts over from the closest keyframe
+    bool ReadFrame(uint32_t frame, SimulationCacheFrame &out);
+
+    const SimulationCacheStats &GetStats() const { return m_Stats; }
+
+private:
+    bool DecodeFrame(uint32_t frame, SimulationCacheFrame &out);
+
+    MappedFile m_File;
+    SimulationCacheHeader m_Header;
+    std::vector<SimulationCacheIndexEntry> m_Index;
+
+    int64_t m_LastFrame;
+    const SimulationCacheFrame *m_LastTarget;
+
+    SimulationCacheStats m_Stats;
+};
+
+struct SimulationCacheBenchmark {
+    uint32_t m_Frames;
+    uint32_t m_Instances;
+    uint64_t m_Bytes;
+    float m_WriteMs;
+    // every frame in order, decoding only the new frame each time
+    float m_SequentialMs;
+    // `m_Seeks` frames in random order, each decoded from its keyframe
+    float m_SeekMs;
+    uint32_t m_Seeks;
+};
+
+// Records `frames` synthetic frames of `instances` moving instances to `path`,
+// then times reading them back in order and seeking to random frames. The
+// frames and the seek order are seeded, runs with the same arguments write
+// and read the same cache.
+bool BenchmarkSimulationCache(const char *path, uint32_t frames, uint32_t instances, SimulationCacheBenchmark &result);
@@ -0,0 +1,415 @@
+#include "SoftwareRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "ImageIO.h"
+#include "JobPool.h"
+
+// matches GLOBAL_LIGHT_COLOR in LightCalc.hlsli
+static const XMFLOAT3 GlobalLightColor = { 0.1f, 0.1f, 0.3f };
+
+// matches the inner color of BillboardParticleSimple.hlsl
+static const XMFLOAT3 BillboardColor = { 1.000f, 0.894f, 0.710f };
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static float Edge(float ax, float ay, float bx, float by, float px, float py)
+{
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+// pixels exactly on an edge belong to the triangle only for top and left
+// edges, so blended triangles sharing an edge don't double up
+static bool IsTopLeft(float ax, float ay, float bx, float by)
+{
+    return (ay == by && bx > ax) || by < ay;
+}
+
+SoftwareRenderer::SoftwareRenderer(uint32_t width, uint32_t height, uint32_t tile_size)
+    : m_Width(width), m_Height(height), m_TileSize(tile_size), m_Stats()
+{
+    m_TilesX = (width + tile_size - 1) / tile_size;
+    m_TilesY = (height + tile_size - 1) / tile_size;
+
+    m_Color.resize((size_t)width * height * 4);
+    m_Depth.resize((size_t)width * height);
+
+    m_Bins.resize(m_TilesX * m_TilesY);
+    m_TilePixels.resize(m_TilesX * m_TilesY);
+
+    Clear({ 0.f, 0.f, 0.f, 0.f });
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+}
+
+void SoftwareRenderer::Clear(XMFLOAT4 color)
+{
+    for (size_t i = 0; i < m_Depth.size(); i++) {
+        m_Color[i * 4 + 0] = color.x;
+        m_Color[i * 4 + 1] = color.y;
+        m_Color[i * 4 + 2] = color.z;
+        m_Color[i * 4 + 3] = color.w;
+        m_Depth[i] = 1.f;
+    }
+}
+
+void SoftwareRenderer::SetupTriangle(RasterTriangle &tri, const XMVECTOR clip[3], const XMFLOAT4 color[3], const XMFLOAT2 uv[3], ShadeMode mode, bool depthtest, bool depthwrite) const
+{
+    tri.valid = false;
+    tri.mode = mode;
+    tri.depthtest = depthtest;
+    tri.depthwrite = depthwrite;
+
+    for (int i = 0; i < 3; i++) {
+        XMFLOAT4 c;
+        XMStoreFloat4(&c, clip[i]);
+
+        // no near plane clipping, particles crossing it are simply dropped
+        if (c.w <= 1e-5f)
+            return;
+
+        float inv = 1.f / c.w;
+        auto &v = tri.v[i];
+        v.x = (c.x * inv * 0.5f + 0.5f) * m_Width;
+        v.y = (0.5f - c.y * inv * 0.5f) * m_Height;
+        v.z = c.z * inv;
+        v.w = inv;
+        v.color = color[i];
+        v.uv = uv[i];
+    }
+
+    float area = Edge(tri.v[0].x, tri.v[0].y, tri.v[1].x, tri.v[1].y, tri.v[2].x, tri.v[2].y);
+    if (std::fabs(area) < 1e-8f)
+        return;
+
+    // no culling, wind everything the same way
+    if (area < 0.f)
+        std::swap(tri.v[1], tri.v[2]);
+
+    float minx = std::min({ tri.v[0].x, tri.v[1].x, tri.v[2].x });
+    float maxx = std::max({ tri.v[0].x, tri.v[1].x, tri.v[2].x });
+    float miny = std::min({ tri.v[0].y, tri.v[1].y, tri.v[2].y });
+    float maxy = std::max({ tri.v[0].y, tri.v[1].y, tri.v[2].y });
+
+    if (maxx < 0.f || maxy < 0.f || minx >= m_Width || miny >= m_Height)
+        return;
+
+    tri.valid = true;
+}
+
+void SoftwareRenderer::Render(const ParticleFrameData &frame, XMMATRIX view, XMMATRIX proj)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    XMMATRIX viewproj = view * proj;
+
+    uint32_t sphere_tris = frame.m_SphereIndexCount / 3;
+    uint32_t trail_tris = (TRAIL_COUNT - 3) * 2;
+
+    size_t sphere_base = 0;
+    size_t trail_base = sphere_base + (size_t)frame.m_InstanceCount * sphere_tris;
+    size_t billboard_base = trail_base + (size_t)frame.m_TrailCount * trail_tris;
+    size_t total = billboard_base + (size_t)frame.m_BillboardCount * 2;
+
+    m_Triangles.resize(total);
+
+    // spheres, gouraud shaded with the directional light
+    {
+        XMVECTOR light_dir = XMVector3Normalize(XMLoadFloat4(&frame.m_Light.position));
+        XMVECTOR light_color = XMLoadFloat3(&frame.m_Light.color);
+        XMVECTOR ambient = XMLoadFloat3(&frame.m_Light.ambient) + XMLoadFloat3(&GlobalLightColor);
+
+        // the vertex count isn't stored, the highest index is enough
+        uint32_t vertex_count = 0;
+        for (uint32_t i = 0; i < frame.m_SphereIndexCount; i++)
+            vertex_count = std::max<uint32_t>(vertex_count, frame.m_SphereIndices[i] + 1);
+
+        ParallelFor(frame.m_InstanceCount, 4, [&](size_t begin, size_t end) {
+            std::vector<XMVECTOR> clip(vertex_count);
+            std::vector<XMFLOAT4> colors(vertex_count);
+
+            for (size_t i = begin; i < end; i++) {
+                auto &instance = frame.m_Instances[i];
+
+                for (uint32_t v = 0; v < vertex_count; v++) {
+                    auto &vertex = frame.m_SphereVertices[v];
+
+                    XMVECTOR world = XMVector3Transform(XMLoadFloat3(&vertex.position), instance.m_Model);
+                    XMVECTOR normal = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.normal), instance.m_Model));
+
+                    XMVECTOR lit = ambient + light_color * XMVectorMax(XMVector3Dot(normal, light_dir), XMVectorZero());
+                    XMVECTOR color = XMVectorSelect(XMVectorSplatOne(), instance.m_Color * lit, XMVectorSelectControl(1, 1, 1, 0));
+
+                    clip[v] = XMVector4Transform(world, viewproj);
+                    XMStoreFloat4(&colors[v], color);
+                }
+
+                auto tris = &m_Triangles[sphere_base + i * sphere_tris];
+                for (uint32_t t = 0; t < sphere_tris; t++) {
+                    auto idx = &frame.m_SphereIndices[t * 3];
+
+                    XMVECTOR c[3] = { clip[idx[0]], clip[idx[1]], clip[idx[2]] };
+                    XMFLOAT4 col[3] = { colors[idx[0]], colors[idx[1]], colors[idx[2]] };
+                    XMFLOAT2 uv[3] = {
+                        frame.m_SphereVertices[idx[0]].uv,
+                        frame.m_SphereVertices[idx[1]].uv,
+                        frame.m_SphereVertices[idx[2]].uv
+                    };
+
+                    SetupTriangle(tris[t], c, col, uv, ShadeMode::Color, true, true);
+                }
+            }
+        });
+    }
+
+    // trails, one ribbon quad per line strip adjacency primitive
+    {
+        XMVECTOR orient = XMVectorSet(XMVectorGetZ(view.r[0]), XMVectorGetZ(view.r[1]), XMVectorGetZ(view.r[2]), 0.f);
+
+        ParallelFor(frame.m_TrailCount, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                auto points = frame.m_Trails[i].points;
+                auto tris = &m_Triangles[trail_base + i * trail_tris];
+
+                for (int j = 0; j < TRAIL_COUNT - 3; j++) {
+                    XMVECTOR p0 = XMLoadFloat3(&points[j + 0].m_Position);
+                    XMVECTOR p1 = XMLoadFloat3(&points[j + 1].m_Position);
+                    XMVECTOR p2 = XMLoadFloat3(&points[j + 2].m_Position);
+                    XMVECTOR p3 = XMLoadFloat3(&points[j + 3].m_Position);
+
+                    XMVECTOR u = XMVector3Normalize(XMVector3Normalize(p1 - p0) + XMVector3Normalize(p2 - p1));
+                    XMVECTOR v = XMVector3Normalize(XMVector3Normalize(p2 - p1) + XMVector3Normalize(p3 - p2));
+
+                    XMVECTOR r0 = XMVector3Cross(u * points[j + 1].m_Size.x, orient);
+                    XMVECTOR r1 = XMVector3Cross(v * points[j + 2].m_Size.x, orient);
+
+                    // collapsed points give NaN ribs, those segments are skipped
+                    if (XMVector3IsNaN(r0) || XMVector3IsNaN(r1)) {
+                        tris[j * 2 + 0].valid = false;
+                        tris[j * 2 + 1].valid = false;
+                        continue;
+                    }
+
+                    XMVECTOR q[4] = {
+                        XMVector4Transform(XMVectorSetW(p1 - r0, 1.f), viewproj),
+                        XMVector4Transform(XMVectorSetW(p1 + r0, 1.f), viewproj),
+                        XMVector4Transform(XMVectorSetW(p2 - r1, 1.f), viewproj),
+                        XMVector4Transform(XMVectorSetW(p2 + r1, 1.f), viewproj)
+                    };
+
+                    float y0 = j / (float)TRAIL_COUNT;
+                    float y1 = (j - 1) / (float)TRAIL_COUNT;
+                    XMFLOAT2 uv[4] = { { 1.f, y0 }, { 0.f, y0 }, { 1.f, y1 }, { 0.f, y1 } };
+                    XMFLOAT4 col[4];
+                    for (int k = 0; k < 4; k++)
+                        col[k] = { 1.f, 1.f, 1.f, 1.f - uv[k].y };
+
+                    XMVECTOR c0[3] = { q[0], q[1], q[2] };
+                    XMFLOAT4 col0[3] = { col[0], col[1], col[2] };
+                    XMFLOAT2 uv0[3] = { uv[0], uv[1], uv[2] };
+                    SetupTriangle(tris[j * 2 + 0], c0, col0, uv0, ShadeMode::Color, true, true);
+
+                    XMVECTOR c1[3] = { q[1], q[3], q[2] };
+                    XMFLOAT4 col1[3] = { col[1], col[3], col[2] };
+                    XMFLOAT2 uv1[3] = { uv[1], uv[3], uv[2] };
+                    SetupTriangle(tris[j * 2 + 1], c1, col1, uv1, ShadeMode::Color, true, true);
+                }
+            }
+        });
+    }
+
+    // billboards, expanded in view space like the geometry shader does. The
+    // GPU path binds no depth buffer for these, so there is no depth test
+    for (uint32_t i = 0; i < frame.m_BillboardCount; i++) {
+        auto &particle = frame.m_Billboards[i];
+
+        XMVECTOR pos = XMVector3Transform(XMLoadFloat3(&particle.position), view);
+        XMVECTOR N = XMVectorSet(0.f, particle.size.x, 0.f, 0.f);
+        XMVECTOR E = XMVectorSet(-particle.size.y, 0.f, 0.f, 0.f);
+
+        XMVECTOR q[4] = {
+            XMVector4Transform(pos + N - E, proj),
+            XMVector4Transform(pos - N - E, proj),
+            XMVector4Transform(pos + N + E, proj),
+            XMVector4Transform(pos - N + E, proj)
+        };
+        XMFLOAT2 uv[4] = { { 0.f, 0.f }, { 0.f, 1.f }, { 1.f, 0.f }, { 1.f, 1.f } };
+        XMFLOAT4 col[3] = {
+            { BillboardColor.x, BillboardColor.y, BillboardColor.z, 1.f },
+            { BillboardColor.x, BillboardColor.y, BillboardColor.z, 1.f },
+            { BillboardColor.x, BillboardColor.y, BillboardColor.z, 1.f }
+        };
+
+        XMVECTOR c0[3] = { q[0], q[1], q[2] };
+        XMFLOAT2 uv0[3] = { uv[0], uv[1], uv[2] };
+        SetupTriangle(m_Triangles[billboard_base + i * 2 + 0], c0, col, uv0, ShadeMode::Billboard, false, false);
+
+        XMVECTOR c1[3] = { q[1], q[3], q[2] };
+        XMFLOAT2 uv1[3] = { uv[1], uv[3], uv[2] };
+        SetupTriangle(m_Triangles[billboard_base + i * 2 + 1], c1, col, uv1, ShadeMode::Billboard, false, false);
+    }
+
+    m_Stats.m_Triangles = (uint32_t)total;
+    m_Stats.m_SetupMs = ElapsedMs(start);
+    start = std::chrono::high_resolution_clock::now();
+
+    // binning is serial so every bin keeps submission order
+    for (auto &bin : m_Bins)
+        bin.clear();
+
+    m_Stats.m_BinnedTriangles = 0;
+    for (uint32_t i = 0; i < (uint32_t)total; i++) {
+        auto &tri = m_Triangles[i];
+        if (!tri.valid)
+            continue;
+
+        float minx = std::min({ tri.v[0].x, tri.v[1].x, tri.v[2].x });
+        float maxx = std::max({ tri.v[0].x, tri.v[1].x, tri.v[2].x });
+        float miny = std::min({ tri.v[0].y, tri.v[1].y, tri.v[2].y });
+        float maxy = std::max({ tri.v[0].y, tri.v[1].y, tri.v[2].y });
+
+        uint32_t tx0 = (uint32_t)std::max(0.f, minx) / m_TileSize;
+        uint32_t ty0 = (uint32_t)std::max(0.f, miny) / m_TileSize;
+        uint32_t tx1 = std::min((uint32_t)std::max(0.f, maxx) / m_TileSize, m_TilesX - 1);
+        uint32_t ty1 = std::min((uint32_t)std::max(0.f, maxy) / m_TileSize, m_TilesY - 1);
+
+        for (uint32_t ty = ty0; ty <= ty1; ty++) {
+            for (uint32_t tx = tx0; tx <= tx1; tx++) {
+                m_Bins[ty * m_TilesX + tx].push_back(i);
+                m_Stats.m_BinnedTriangles++;
+            }
+        }
+    }
+
+    m_Stats.m_BinMs = ElapsedMs(start);
+    start = std::chrono::high_resolution_clock::now();
+
+    ParallelFor(m_Bins.size(), 1, [this](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++)
+            RasterizeTile((uint32_t)tile);
+    });
+
+    m_Stats.m_ShadedPixels = 0;
+    for (auto pixels : m_TilePixels)
+        m_Stats.m_ShadedPixels += pixels;
+
+    m_Stats.m_RasterMs = ElapsedMs(start);
+}
+
+void SoftwareRenderer::RasterizeTile(uint32_t tile)
+{
+    int tx0 = (tile % m_TilesX) * m_TileSize;
+    int ty0 = (tile / m_TilesX) * m_TileSize;
+    int tx1 = std::min<int>(tx0 + m_TileSize, m_Width) - 1;
+    int ty1 = std::min<int>(ty0 + m_TileSize, m_Height) - 1;
+
+    uint64_t shaded = 0;
+
+    for (auto idx : m_Bins[tile]) {
+        auto &tri = m_Triangles[idx];
+        auto &a = tri.v[0];
+        auto &b = tri.v[1];
+        auto &c = tri.v[2];
+
+        int x0 = std::max(tx0, (int)std::floor(std::min({ a.x, b.x, c.x })));
+        int x1 = std::min(tx1, (int)std::ceil(std::max({ a.x, b.x, c.x })));
+        int y0 = std::max(ty0, (int)std::floor(std::min({ a.y, b.y, c.y })));
+        int y1 = std::min(ty1, (int)std::ceil(std::max({ a.y, b.y, c.y })));
+
+        float area = Edge(a.x, a.y, b.x, b.y, c.x, c.y);
+        float inv_area = 1.f / area;
+
+        bool tl0 = IsTopLeft(b.x, b.y, c.x, c.y);
+        bool tl1 = IsTopLeft(c.x, c.y, a.x, a.y);
+        bool tl2 = IsTopLeft(a.x, a.y, b.x, b.y);
+
+        for (int y = y0; y <= y1; y++) {
+            float py = y + 0.5f;
+
+            for (int x = x0; x <= x1; x++) {
+                float px = x + 0.5f;
+
+                float w0 = Edge(b.x, b.y, c.x, c.y, px, py);
+                float w1 = Edge(c.x, c.y, a.x, a.y, px, py);
+                float w2 = Edge(a.x, a.y, b.x, b.y, px, py);
+
+                if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+                    continue;
+                if ((w0 == 0.f && !tl0) || (w1 == 0.f && !tl1) || (w2 == 0.f && !tl2))
+                    continue;
+
+                w0 *= inv_area;
+                w1 *= inv_area;
+                w2 *= inv_area;
+
+                size_t pixel = (size_t)y * m_Width + x;
+
+                float z = w0 * a.z + w1 * b.z + w2 * c.z;
+                if (z < 0.f || z > 1.f)
+                    continue;
+                if (tri.depthtest && z >= m_Depth[pixel])
+                    continue;
+
+                // perspective correct attributes
+                float p0 = w0 * a.w, p1 = w1 * b.w, p2 = w2 * c.w;
+                float inv = 1.f / (p0 + p1 + p2);
+                p0 *= inv; p1 *= inv; p2 *= inv;
+
+                float r = p0 * a.color.x + p1 * b.color.x + p2 * c.color.x;
+                float g = p0 * a.color.y + p1 * b.color.y + p2 * c.color.y;
+                float bl = p0 * a.color.z + p1 * b.color.z + p2 * c.color.z;
+                float alpha = p0 * a.color.w + p1 * b.color.w + p2 * c.color.w;
+
+                if (tri.mode == ShadeMode::Billboard) {
+                    float u = p0 * a.uv.x + p1 * b.uv.x + p2 * c.uv.x - 0.5f;
+                    float v = p0 * a.uv.y + p1 * b.uv.y + p2 * c.uv.y - 0.5f;
+                    alpha *= std::max(0.f, 1.f - 2.f * std::sqrt(u * u + v * v));
+                }
+
+                alpha = std::min(std::max(alpha, 0.f), 1.f);
+
+                // SRC_ALPHA / INV_SRC_ALPHA for both color and alpha, same
+                // as the particle blend state
+                float *dst = &m_Color[pixel * 4];
+                dst[0] = r * alpha + dst[0] * (1.f - alpha);
+                dst[1] = g * alpha + dst[1] * (1.f - alpha);
+                dst[2] = bl * alpha + dst[2] * (1.f - alpha);
+                dst[3] = alpha * alpha + dst[3] * (1.f - alpha);
+
+                if (tri.depthwrite)
+                    m_Depth[pixel] = z;
+
+                shaded++;
+            }
+        }
+    }
+
+    m_TilePixels[tile] = shaded;
+}
+
+std::vector<uint8_t> SoftwareRenderer::Resolve() const
+{
+    std::vector<uint8_t> out(m_Color.size());
+    for (size_t i = 0; i < m_Color.size(); i++)
+        out[i] = (uint8_t)(std::min(std::max(m_Color[i], 0.f), 1.f) * 255.f + 0.5f);
+
+    return out;
+}
+
+bool SoftwareRenderer::SavePNG(const char *path) const
+{
+    auto pixels = Resolve();
+    return WritePNG(path, m_Width, m_Height, pixels.data());
+}
+
+bool SoftwareRenderer::SaveEXR(const char *path) const
+{
+    return WriteEXR(path, m_Width, m_Height, m_Color.data());
+}
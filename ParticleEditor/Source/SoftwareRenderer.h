@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ParticleSystem.h"
+
+struct SoftwareRenderStats {
+    uint32_t m_Triangles;
+    uint32_t m_BinnedTriangles;
+    uint64_t m_ShadedPixels;
+
+    float m_SetupMs;
+    float m_BinMs;
+    float m_RasterMs;
+};
+
+// Tile based CPU rasterizer that draws the same instance data the GPU path
+// consumes, for golden images, offline previews and render cost timing
+// without a device. Material pixel shaders are not evaluated: spheres get
+// the directional light with gouraud shading, billboards a radial falloff
+// and trails the fade of TrailParticleSimple.hlsl.
+class SoftwareRenderer {
+public:
+    SoftwareRenderer(uint32_t width, uint32_t height, uint32_t tile_size = 32);
+    ~SoftwareRenderer();
+
+    void Clear(XMFLOAT4 color);
+
+    // draws spheres, trails and billboards in the same order and with the
+    // same depth/blend state as ParticleSystem::render
+    void Render(const ParticleFrameData &frame, XMMATRIX view, XMMATRIX proj);
+
+    uint32_t GetWidth() const { return m_Width; }
+    uint32_t GetHeight() const { return m_Height; }
+
+    // linear RGBA, row major
+    const std::vector<float> &GetColor() const { return m_Color; }
+    std::vector<uint8_t> Resolve() const;
+
+    bool SavePNG(const char *path) const;
+    bool SaveEXR(const char *path) const;
+
+    const SoftwareRenderStats &GetStats() const { return m_Stats; }
+
+private:
+    enum class ShadeMode : uint8_t {
+        Color,
+        Billboard
+    };
+
+    struct RasterVertex {
+        float x, y, z, w;
+        XMFLOAT4 color;
+        XMFLOAT2 uv;
+    };
+
+    struct RasterTriangle {
+        RasterVertex v[3];
+        ShadeMode mode;
+        bool depthtest;
+        bool depthwrite;
+        bool valid;
+    };
+
+    void SetupTriangle(RasterTriangle &tri, const XMVECTOR clip[3], const XMFLOAT4 color[3], const XMFLOAT2 uv[3], ShadeMode mode, bool depthtest, bool depthwrite) const;
+    void RasterizeTile(uint32_t tile);
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+    uint32_t m_TileSize;
+    uint32_t m_TilesX;
+    uint32_t m_TilesY;
+
+    std::vector<float> m_Color;
+    std::vector<float> m_Depth;
+
+    std::vector<RasterTriangle> m_Triangles;
+    std::vector<std::vector<uint32_t>> m_Bins;
+    std::vector<uint64_t> m_TilePixels;
+
+    SoftwareRenderStats m_Stats;
+};
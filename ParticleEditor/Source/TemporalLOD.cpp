@@ -0,0 +1,14 @@
+#include "TemporalLOD.h"
+
+void TemporalLOD::SetScreenSize(float screen_size, const TemporalLODSettings &settings, uint32_t &stagger)
+{
+    uint32_t bucket = 0;
+    while (bucket < TEMPORAL_LOD_BUCKETS - 1 && screen_size < settings.m_ScreenSize[bucket])
+        bucket++;
+
+    if (bucket == m_Bucket)
+        return;
+
+    m_Bucket = bucket;
+    m_Phase = stagger++ % GetInterval();
+}
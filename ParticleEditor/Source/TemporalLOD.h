@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Effects are simulated every 1, 2, 4 or 8 frames depending on how large
+// they are on screen, bucket `i` ticks every `1 << i` frames.
+#define TEMPORAL_LOD_BUCKETS 4
+
+struct TemporalLODSettings {
+    // smallest projected radius, as a fraction of the screen height, an
+    // effect can have and still land in bucket 0, 1 and 2
+    float m_ScreenSize[TEMPORAL_LOD_BUCKETS - 1] = { 0.1f, 0.04f, 0.015f };
+};
+
+struct TemporalLODStats {
+    uint32_t m_Effects[TEMPORAL_LOD_BUCKETS];
+    uint32_t m_Ticked[TEMPORAL_LOD_BUCKETS];
+    // particles replayed from their last tick instead of simulated
+    uint32_t m_SavedParticles[TEMPORAL_LOD_BUCKETS];
+};
+
+// Scheduling state of one effect. Effects that enter a bucket are spread
+// over its frames so the same number of them tick every frame.
+struct TemporalLOD {
+    uint32_t m_Bucket;
+    uint32_t m_Phase;
+    // simulation time since the last tick, the next tick advances this much
+    float m_Elapsed;
+
+    uint32_t GetInterval() const { return 1u << m_Bucket; }
+    bool ShouldTick(uint64_t frame) const { return (frame + m_Phase) % GetInterval() == 0; }
+
+    // `stagger` is shared by every effect of a system and hands out phases
+    void SetScreenSize(float screen_size, const TemporalLODSettings &settings, uint32_t &stagger);
+};
@@ -0,0 +1,220 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "ImageIO.h"
+#include "JobPool.h"
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "stb_rect_pack.h"
+
+struct AtlasImage {
+    uint32_t m_Width;
+    uint32_t m_Height;
+    bool m_Opaque;
+    std::vector<uint8_t> m_Pixels;
+
+    // cell in the page, padding and alignment included
+    uint32_t m_X;
+    uint32_t m_Y;
+};
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+AtlasPacker::AtlasPacker(const AtlasSettings &settings)
+    : m_Settings(settings), m_Stats()
+{
+}
+
+bool AtlasPacker::Pack(const std::vector<std::string> &paths)
+{
+    m_Stats = {};
+    m_Stats.m_Textures = (uint32_t)std::count_if(paths.begin(), paths.end(), [](const std::string &path) { return !path.empty(); });
+    m_Placements.assign(paths.size(), AtlasPlacement{ -1 });
+    m_Pages.clear();
+
+    auto timer = std::chrono::high_resolution_clock::now();
+
+    std::vector<AtlasImage> images(paths.size());
+    ParallelFor(paths.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            auto &image = images[i];
+            if (paths[i].empty() || !ReadImage(paths[i].c_str(), image.m_Width, image.m_Height, image.m_Pixels)) {
+                image.m_Width = image.m_Height = 0;
+                continue;
+            }
+
+            image.m_Opaque = true;
+            for (size_t p = 3; p < image.m_Pixels.size() && image.m_Opaque; p += 4)
+                image.m_Opaque = image.m_Pixels[p] == 255;
+        }
+    });
+
+    m_Stats.m_DecodeMs = ElapsedMs(timer);
+    timer = std::chrono::high_resolution_clock::now();
+
+    uint32_t align = 1u << m_Settings.m_MipLevels;
+    uint32_t page_size = AlignUp(m_Settings.m_PageSize, align);
+    uint32_t pad = m_Settings.m_Padding;
+
+    std::vector<stbrp_rect> pending;
+    for (size_t i = 0; i < images.size(); i++) {
+        auto &image = images[i];
+        if (!image.m_Width)
+            continue;
+
+        stbrp_rect rect = {};
+        rect.id = (int)i;
+        rect.w = (stbrp_coord)AlignUp(image.m_Width + pad * 2, align);
+        rect.h = (stbrp_coord)AlignUp(image.m_Height + pad * 2, align);
+        if ((uint32_t)rect.w > page_size || (uint32_t)rect.h > page_size)
+            continue;
+
+        pending.push_back(rect);
+    }
+
+    // every cell is a multiple of the alignment, so are the positions the
+    // skyline hands out; true if every rect fit
+    std::vector<stbrp_node> nodes(page_size);
+    auto pack = [&nodes](uint32_t width, uint32_t height, std::vector<stbrp_rect> &rects) {
+        stbrp_context context;
+        stbrp_init_target(&context, (int)width, (int)height, nodes.data(), (int)width);
+        stbrp_pack_rects(&context, rects.data(), (int)rects.size());
+
+        return std::all_of(rects.begin(), rects.end(), [](const stbrp_rect &rect) { return rect.was_packed != 0; });
+    };
+
+    uint64_t used = 0;
+    uint64_t area = 0;
+    while (!pending.empty()) {
+        pack(page_size, page_size, pending);
+
+        std::vector<stbrp_rect> placed, rest;
+        for (auto &rect : pending)
+            (rect.was_packed ? placed : rest).push_back(rect);
+
+        // a page that packed nothing never will
+        if (placed.empty())
+            break;
+
+        // the page as packed, cut down to the power of two that holds it
+        uint32_t width = align, height = align;
+        for (auto &rect : placed) {
+            while (width < (uint32_t)(rect.x + rect.w))
+                width *= 2;
+            while (height < (uint32_t)(rect.y + rect.h))
+                height *= 2;
+        }
+        width = std::min(width, page_size);
+        height = std::min(height, page_size);
+
+        // The skyline lines a few textures up along the top of a page, which
+        // leaves a wide strip with little in it. Repacking into every smaller
+        // power of two size finds the smallest page that holds them.
+        for (uint32_t w = align; w <= page_size; w *= 2) {
+            for (uint32_t h = align; h <= page_size; h *= 2) {
+                if ((uint64_t)w * h >= (uint64_t)width * height)
+                    continue;
+
+                auto trial = placed;
+                if (pack(w, h, trial)) {
+                    placed.swap(trial);
+                    width = w;
+                    height = h;
+                }
+            }
+        }
+
+        AtlasPage page = {};
+        page.m_Width = width;
+        page.m_Height = height;
+        page.m_Opaque = true;
+
+        for (auto &rect : placed) {
+            auto &image = images[rect.id];
+            image.m_X = rect.x;
+            image.m_Y = rect.y;
+
+            auto &placement = m_Placements[rect.id];
+            placement.m_Page = (int32_t)m_Pages.size();
+            placement.m_Width = image.m_Width;
+            placement.m_Height = image.m_Height;
+            page.m_Opaque = page.m_Opaque && image.m_Opaque;
+
+            used += (uint64_t)image.m_Width * image.m_Height;
+            m_Stats.m_Packed++;
+        }
+
+        area += (uint64_t)page.m_Width * page.m_Height;
+
+        m_Pages.push_back(std::move(page));
+        pending.swap(rest);
+    }
+
+    for (size_t i = 0; i < images.size(); i++) {
+        auto &placement = m_Placements[i];
+        if (placement.m_Page < 0)
+            continue;
+
+        auto &page = m_Pages[placement.m_Page];
+        auto &image = images[i];
+        placement.m_Rect[0] = (image.m_X + pad) / (float)page.m_Width;
+        placement.m_Rect[1] = (image.m_Y + pad) / (float)page.m_Height;
+        placement.m_Rect[2] = (image.m_X + pad + image.m_Width) / (float)page.m_Width;
+        placement.m_Rect[3] = (image.m_Y + pad + image.m_Height) / (float)page.m_Height;
+    }
+
+    m_Stats.m_Pages = (uint32_t)m_Pages.size();
+    m_Stats.m_Coverage = area ? used / (float)area : 0.f;
+    m_Stats.m_PackMs = ElapsedMs(timer);
+    timer = std::chrono::high_resolution_clock::now();
+
+    for (auto &page : m_Pages) {
+        page.m_Pixels.assign((size_t)page.m_Width * page.m_Height * 4, 0);
+        if (page.m_Opaque) {
+            for (size_t p = 3; p < page.m_Pixels.size(); p += 4)
+                page.m_Pixels[p] = 255;
+        }
+    }
+
+    // cells never overlap, every job owns its part of the page; the padding
+    // and alignment around the texture repeat its closest edge texel
+    ParallelFor(images.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            auto &placement = m_Placements[i];
+            if (placement.m_Page < 0)
+                continue;
+
+            auto &page = m_Pages[placement.m_Page];
+            auto &image = images[i];
+            uint32_t cell_w = AlignUp(image.m_Width + pad * 2, align);
+            uint32_t cell_h = AlignUp(image.m_Height + pad * 2, align);
+
+            for (uint32_t y = 0; y < cell_h; y++) {
+                int32_t sy = std::min(std::max((int32_t)y - (int32_t)pad, 0), (int32_t)image.m_Height - 1);
+                const uint8_t *src = &image.m_Pixels[(size_t)sy * image.m_Width * 4];
+                uint8_t *dst = &page.m_Pixels[((size_t)(image.m_Y + y) * page.m_Width + image.m_X) * 4];
+
+                for (uint32_t x = 0; x < cell_w; x++) {
+                    int32_t sx = std::min(std::max((int32_t)x - (int32_t)pad, 0), (int32_t)image.m_Width - 1);
+                    memcpy(dst + x * 4, src + sx * 4, 4);
+                }
+            }
+        }
+    });
+
+    m_Stats.m_BlitMs = ElapsedMs(timer);
+
+    return m_Stats.m_Packed > 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AtlasSettings {
+    // largest page, every page is cut down to the smallest power of two size
+    // its textures fit in
+    uint32_t m_PageSize = 2048;
+
+    // edge texels repeated around every texture so bilinear filtering never
+    // reaches a neighbour
+    uint32_t m_Padding = 4;
+
+    // Textures start on multiples of 1 << m_MipLevels and take up whole
+    // blocks of it, so the first m_MipLevels mips of a page never mix two
+    // textures into one texel.
+    uint32_t m_MipLevels = 4;
+};
+
+struct AtlasPlacement {
+    // -1 if the texture could not be read or is larger than a page
+    int32_t m_Page;
+    uint32_t m_Width;
+    uint32_t m_Height;
+
+    // texture area in page uv: min u, min v, max u, max v
+    float m_Rect[4];
+};
+
+struct AtlasPage {
+    uint32_t m_Width;
+    uint32_t m_Height;
+    // Every texture on the page is opaque. Space no texture covers is then
+    // opaque black instead of transparent, so BlockFormat::Auto picks BC1.
+    bool m_Opaque;
+    std::vector<uint8_t> m_Pixels;
+};
+
+struct AtlasStats {
+    uint32_t m_Textures;
+    uint32_t m_Packed;
+    uint32_t m_Pages;
+    // texture texels over page texels
+    float m_Coverage;
+    float m_DecodeMs;
+    float m_PackMs;
+    float m_BlitMs;
+};
+
+// Packs textures into RGBA8 pages with stb_rect_pack. Decoding and copying
+// into the pages run on the shared JobPool, one texture per job.
+class AtlasPacker {
+public:
+    AtlasPacker(const AtlasSettings &settings);
+
+    // false if no texture could be packed, empty paths are left out and keep
+    // page -1
+    bool Pack(const std::vector<std::string> &paths);
+
+    const std::vector<AtlasPlacement> &GetPlacements() const { return m_Placements; }
+    const std::vector<AtlasPage> &GetPages() const { return m_Pages; }
+    const AtlasStats &GetStats() const { return m_Stats; }
+
+private:
+    AtlasSettings m_Settings;
+    AtlasStats m_Stats;
+
+    std::vector<AtlasPlacement> m_Placements;
+    std::vector<AtlasPage> m_Pages;
+};
@@ -0,0 +1,768 @@
+#include "TextureCompress.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "JobPool.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TEXTURE_COMPRESS_SSE2
+#include <emmintrin.h>
+#endif
+
+// DXGI_FORMAT values, DDS files carry them in the DX10 header
+#define DXGI_BC1_UNORM 71
+#define DXGI_BC1_UNORM_SRGB 72
+#define DXGI_BC4_UNORM 80
+#define DXGI_BC5_UNORM 83
+#define DXGI_BC7_UNORM 98
+#define DXGI_BC7_UNORM_SRGB 99
+
+// 16 texels, one channel per array so four texels go through SSE at once
+struct Block {
+    alignas(16) float m_Channels[4][16];
+};
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static uint32_t GetBlockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+static void LoadBlock(const uint8_t *rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, Block &block)
+{
+    // edges of mips that are not a multiple of 4 repeat the last texel
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t x = std::min(bx * 4 + (i & 3), width - 1);
+        uint32_t y = std::min(by * 4 + (i >> 2), height - 1);
+        const uint8_t *texel = rgba + ((size_t)y * width + x) * 4;
+
+        for (int c = 0; c < 4; c++)
+            block.m_Channels[c][i] = texel[c];
+    }
+}
+
+// Position of every texel along `origin + t * axis`, as t. Endpoints of all
+// formats here lie on one line, so the closest palette entry of a texel is
+// the one closest to its t.
+static void Project(const Block &block, int channels, const float *origin, const float *axis, float *t)
+{
+    float len = 0.f;
+    for (int c = 0; c < channels; c++)
+        len += axis[c] * axis[c];
+
+    float scale = len > 0.f ? 1.f / len : 0.f;
+
+#ifdef TEXTURE_COMPRESS_SSE2
+    for (int i = 0; i < 16; i += 4) {
+        __m128 dot = _mm_setzero_ps();
+        for (int c = 0; c < channels; c++) {
+            __m128 d = _mm_sub_ps(_mm_load_ps(&block.m_Channels[c][i]), _mm_set1_ps(origin[c]));
+            dot = _mm_add_ps(dot, _mm_mul_ps(d, _mm_set1_ps(axis[c])));
+        }
+        _mm_storeu_ps(t + i, _mm_mul_ps(dot, _mm_set1_ps(scale)));
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        float dot = 0.f;
+        for (int c = 0; c < channels; c++)
+            dot += (block.m_Channels[c][i] - origin[c]) * axis[c];
+        t[i] = dot * scale;
+    }
+#endif
+}
+
+// Principal axis of the texels through their mean, by power iteration on
+// the covariance. Returns false for blocks of a single color.
+static bool FitLine(const Block &block, int channels, float *mean, float *axis)
+{
+    for (int c = 0; c < channels; c++) {
+        float sum = 0.f;
+        for (int i = 0; i < 16; i++)
+            sum += block.m_Channels[c][i];
+        mean[c] = sum / 16.f;
+    }
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = a; b < channels; b++)
+                cov[a][b] += (block.m_Channels[a][i] - mean[a]) * (block.m_Channels[b][i] - mean[b]);
+        }
+    }
+
+    // start from the channel with the largest spread
+    int widest = 0;
+    for (int c = 0; c < channels; c++) {
+        for (int k = 0; k < c; k++)
+            cov[c][k] = cov[k][c];
+        if (cov[c][c] > cov[widest][widest])
+            widest = c;
+    }
+
+    if (cov[widest][widest] <= 0.f)
+        return false;
+
+    float v[4] = {};
+    v[widest] = 1.f;
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float len = 0.f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                next[a] += cov[a][b] * v[b];
+            len += next[a] * next[a];
+        }
+
+        if (len <= 0.f)
+            break;
+
+        len = 1.f / std::sqrt(len);
+        for (int c = 0; c < channels; c++)
+            v[c] = next[c] * len;
+    }
+
+    memcpy(axis, v, sizeof(float) * channels);
+
+    return true;
+}
+
+static void GetExtents(const Block &block, int channels, const float *mean, const float *axis, float *e0, float *e1)
+{
+    float t[16];
+    Project(block, channels, mean, axis, t);
+
+    float lo = *std::min_element(t, t + 16);
+    float hi = *std::max_element(t, t + 16);
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::min(std::max(mean[c] + lo * axis[c], 0.f), 255.f);
+        e1[c] = std::min(std::max(mean[c] + hi * axis[c], 0.f), 255.f);
+    }
+}
+
+// Least squares endpoints for texels with the given interpolation weights,
+// false if the weights can not tell the endpoints apart.
+static bool RefitEndpoints(const Block &block, int channels, const float *weights, float *e0, float *e1)
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float x[4] = {}, y[4] = {};
+    for (int i = 0; i < 16; i++) {
+        float w = weights[i];
+        aa += (1.f - w) * (1.f - w);
+        ab += (1.f - w) * w;
+        bb += w * w;
+        for (int c = 0; c < channels; c++) {
+            x[c] += (1.f - w) * block.m_Channels[c][i];
+            y[c] += w * block.m_Channels[c][i];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::min(std::max((bb * x[c] - ab * y[c]) / det, 0.f), 255.f);
+        e1[c] = std::min(std::max((aa * y[c] - ab * x[c]) / det, 0.f), 255.f);
+    }
+
+    return true;
+}
+
+static float BlockError(const Block &block, int channels, const uint8_t *decoded)
+{
+    float error = 0.f;
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++) {
+            float d = block.m_Channels[c][i] - decoded[i * 4 + c];
+            error += d * d;
+        }
+    }
+
+    return error;
+}
+
+// BC1
+
+static uint16_t To565(const float *color)
+{
+    uint32_t r = (uint32_t)std::lround(color[0] * 31.f / 255.f);
+    uint32_t g = (uint32_t)std::lround(color[1] * 63.f / 255.f);
+    uint32_t b = (uint32_t)std::lround(color[2] * 31.f / 255.f);
+
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void From565(uint16_t color, uint8_t *rgb)
+{
+    uint32_t r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (uint8_t)(r << 3 | r >> 2);
+    rgb[1] = (uint8_t)(g << 2 | g >> 4);
+    rgb[2] = (uint8_t)(b << 3 | b >> 2);
+}
+
+static void DecodeBC1(const uint8_t *src, uint8_t *rgba)
+{
+    uint16_t c0, c1;
+    uint32_t indices;
+    memcpy(&c0, src, 2);
+    memcpy(&c1, src + 2, 2);
+    memcpy(&indices, src + 4, 4);
+
+    uint8_t palette[4][4];
+    From565(c0, palette[0]);
+    From565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1) {
+            palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+        else {
+            palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+
+    for (int i = 0; i < 16; i++)
+        memcpy(rgba + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+}
+
+static float EncodeBC1Endpoints(const Block &block, uint16_t c0, uint16_t c1, uint8_t *dst, float *weights)
+{
+    // four color mode needs c0 > c1
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint8_t p0[4], p1[4];
+    From565(c0, p0);
+    From565(c1, p1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        float origin[3] = { (float)p0[0], (float)p0[1], (float)p0[2] };
+        float axis[3] = { (float)(p1[0] - p0[0]), (float)(p1[1] - p0[1]), (float)(p1[2] - p0[2]) };
+
+        float t[16];
+        Project(block, 3, origin, axis, t);
+
+        // steps along the line to palette indices
+        static const uint32_t ORDER[4] = { 0, 2, 3, 1 };
+        for (int i = 0; i < 16; i++) {
+            int step = (int)std::lround(std::min(std::max(t[i], 0.f), 1.f) * 3.f);
+            indices |= ORDER[step] << (i * 2);
+            weights[i] = step / 3.f;
+        }
+    }
+    else {
+        std::fill(weights, weights + 16, 0.f);
+    }
+
+    memcpy(dst, &c0, 2);
+    memcpy(dst + 2, &c1, 2);
+    memcpy(dst + 4, &indices, 4);
+
+    uint8_t decoded[64];
+    DecodeBC1(dst, decoded);
+
+    return BlockError(block, 3, decoded);
+}
+
+static void EncodeBC1(const Block &block, uint8_t *dst)
+{
+    float mean[4], axis[4], e0[4], e1[4], weights[16];
+    if (!FitLine(block, 3, mean, axis)) {
+        uint16_t color = To565(mean);
+        EncodeBC1Endpoints(block, color, color, dst, weights);
+        return;
+    }
+
+    GetExtents(block, 3, mean, axis, e0, e1);
+    float error = EncodeBC1Endpoints(block, To565(e0), To565(e1), dst, weights);
+
+    uint8_t refit[8];
+    if (RefitEndpoints(block, 3, weights, e0, e1) && EncodeBC1Endpoints(block, To565(e0), To565(e1), refit, weights) < error)
+        memcpy(dst, refit, 8);
+}
+
+// BC4, BC5 is two of these
+
+static void DecodeBC4(const uint8_t *src, uint8_t *out, int stride)
+{
+    uint32_t a0 = src[0], a1 = src[1];
+    uint8_t palette[8] = { (uint8_t)a0, (uint8_t)a1 };
+    for (uint32_t i = 2; i < 8; i++) {
+        palette[i] = a0 > a1
+            ? (uint8_t)(((8 - i) * a0 + (i - 1) * a1) / 7)
+            : (i < 6 ? (uint8_t)(((6 - i) * a0 + (i - 1) * a1) / 5) : (uint8_t)(i == 6 ? 0 : 255));
+    }
+
+    uint64_t indices = 0;
+    memcpy(&indices, src + 2, 6);
+    for (int i = 0; i < 16; i++)
+        out[i * stride] = palette[(indices >> (i * 3)) & 7];
+}
+
+static void EncodeBC4(const Block &block, int channel, uint8_t *dst)
+{
+    const float *values = block.m_Channels[channel];
+    float lo = *std::min_element(values, values + 16);
+    float hi = *std::max_element(values, values + 16);
+
+    uint8_t a0 = (uint8_t)std::lround(hi);
+    uint8_t a1 = (uint8_t)std::lround(lo);
+
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        float origin = a0;
+        float axis = (float)a1 - a0;
+
+        float t[16];
+        Block line;
+        memcpy(line.m_Channels[0], values, sizeof(line.m_Channels[0]));
+        Project(line, 1, &origin, &axis, t);
+
+        // steps from a0 towards a1, the ends are indices 0 and 1
+        for (int i = 0; i < 16; i++) {
+            uint64_t step = (uint64_t)std::lround(std::min(std::max(t[i], 0.f), 1.f) * 7.f);
+            uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+            indices |= index << (i * 3);
+        }
+    }
+
+    dst[0] = a0;
+    dst[1] = a1;
+    memcpy(dst + 2, &indices, 6);
+}
+
+// BC7, mode 6 only: one subset, RGBA endpoints with 7 bits and a p-bit each,
+// 4 bit indices
+
+static const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+    uint64_t m_Bits[2];
+    uint32_t m_Pos;
+
+    void Put(uint32_t value, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; i++, m_Pos++) {
+            if ((value >> i) & 1)
+                m_Bits[m_Pos >> 6] |= 1ull << (m_Pos & 63);
+        }
+    }
+};
+
+static uint32_t GetBits(const uint8_t *src, uint32_t &pos, uint32_t count)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; i++, pos++)
+        value |= ((src[pos >> 3] >> (pos & 7)) & 1u) << i;
+
+    return value;
+}
+
+static void DecodeBC7(const uint8_t *src, uint8_t *rgba)
+{
+    if ((src[0] & 0x7f) != 0x40) {
+        // some other mode, not written by this encoder
+        memset(rgba, 0, 64);
+        return;
+    }
+
+    uint32_t pos = 7;
+    uint32_t endpoints[2][4];
+    for (int c = 0; c < 4; c++) {
+        endpoints[0][c] = GetBits(src, pos, 7);
+        endpoints[1][c] = GetBits(src, pos, 7);
+    }
+
+    uint32_t p0 = GetBits(src, pos, 1);
+    uint32_t p1 = GetBits(src, pos, 1);
+    for (int c = 0; c < 4; c++) {
+        endpoints[0][c] = endpoints[0][c] << 1 | p0;
+        endpoints[1][c] = endpoints[1][c] << 1 | p1;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t w = BC7_WEIGHTS[GetBits(src, pos, i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+            rgba[i * 4 + c] = (uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+    }
+}
+
+// picks the p-bit that lands the 7 bit endpoint closest to `e`
+static void QuantizeBC7(const float *e, uint32_t *q, uint32_t &p)
+{
+    float best = FLT_MAX;
+    for (uint32_t bit = 0; bit < 2; bit++) {
+        uint32_t candidate[4];
+        float error = 0.f;
+        for (int c = 0; c < 4; c++) {
+            int value = (int)std::lround((e[c] - bit) / 2.f);
+            candidate[c] = (uint32_t)std::min(std::max(value, 0), 127);
+
+            float d = (float)(candidate[c] << 1 | bit) - e[c];
+            error += d * d;
+        }
+
+        if (error < best) {
+            best = error;
+            p = bit;
+            memcpy(q, candidate, sizeof(candidate));
+        }
+    }
+}
+
+static float EncodeBC7Endpoints(const Block &block, const float *e0, const float *e1, uint8_t *dst, float *weights)
+{
+    uint32_t q[2][4], p[2];
+    QuantizeBC7(e0, q[0], p[0]);
+    QuantizeBC7(e1, q[1], p[1]);
+
+    float d0[4], axis[4];
+    for (int c = 0; c < 4; c++) {
+        d0[c] = (float)(q[0][c] << 1 | p[0]);
+        axis[c] = (float)(q[1][c] << 1 | p[1]) - d0[c];
+    }
+
+    // nearest of the 16 weights for every t * 64
+    static uint8_t nearest[65];
+    static bool init = [] {
+        for (uint32_t w = 0; w <= 64; w++) {
+            uint32_t best = 0;
+            for (uint32_t i = 1; i < 16; i++) {
+                if ((uint32_t)std::abs((int)BC7_WEIGHTS[i] - (int)w) < (uint32_t)std::abs((int)BC7_WEIGHTS[best] - (int)w))
+                    best = i;
+            }
+            nearest[w] = (uint8_t)best;
+        }
+        return true;
+    }();
+    (void)init;
+
+    float t[16];
+    Project(block, 4, d0, axis, t);
+
+    uint32_t indices[16];
+    for (int i = 0; i < 16; i++)
+        indices[i] = nearest[std::lround(std::min(std::max(t[i], 0.f), 1.f) * 64.f)];
+
+    // the first index only has 3 bits, its top bit has to be 0
+    if (indices[0] & 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for (auto &index : indices)
+            index = 15 - index;
+    }
+
+    BitWriter bits = {};
+    bits.Put(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        bits.Put(q[0][c], 7);
+        bits.Put(q[1][c], 7);
+    }
+    bits.Put(p[0], 1);
+    bits.Put(p[1], 1);
+    for (int i = 0; i < 16; i++) {
+        bits.Put(indices[i], i == 0 ? 3 : 4);
+        weights[i] = BC7_WEIGHTS[indices[i]] / 64.f;
+    }
+    memcpy(dst, bits.m_Bits, 16);
+
+    uint8_t decoded[64];
+    DecodeBC7(dst, decoded);
+
+    return BlockError(block, 4, decoded);
+}
+
+static void EncodeBC7(const Block &block, uint8_t *dst)
+{
+    float mean[4], axis[4], e0[4], e1[4], weights[16];
+    if (!FitLine(block, 4, mean, axis)) {
+        EncodeBC7Endpoints(block, mean, mean, dst, weights);
+        return;
+    }
+
+    GetExtents(block, 4, mean, axis, e0, e1);
+    float error = EncodeBC7Endpoints(block, e0, e1, dst, weights);
+
+    uint8_t refit[16];
+    if (RefitEndpoints(block, 4, weights, e0, e1) && EncodeBC7Endpoints(block, e0, e1, refit, weights) < error)
+        memcpy(dst, refit, 16);
+}
+
+// Mips
+
+static float SRGBToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSRGB(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+// Halves an RGBA8 mip. Color is weighted by alpha so fully transparent
+// texels, usually black, do not darken the edges of what is visible.
+static void Downsample(uint32_t width, uint32_t height, const uint8_t *src, bool srgb, std::vector<uint8_t> &dst)
+{
+    static float to_linear[256];
+    static bool init = [] {
+        for (int i = 0; i < 256; i++)
+            to_linear[i] = SRGBToLinear(i / 255.f);
+        return true;
+    }();
+    (void)init;
+
+    uint32_t w = std::max(width / 2, 1u);
+    uint32_t h = std::max(height / 2, 1u);
+    dst.resize((size_t)w * h * 4);
+
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            float color[3] = {};
+            float alpha = 0.f;
+            float plain[3] = {};
+
+            for (uint32_t k = 0; k < 4; k++) {
+                uint32_t sx = std::min(x * 2 + (k & 1), width - 1);
+                uint32_t sy = std::min(y * 2 + (k >> 1), height - 1);
+                const uint8_t *texel = src + ((size_t)sy * width + sx) * 4;
+
+                float a = texel[3] / 255.f;
+                for (int c = 0; c < 3; c++) {
+                    float value = srgb ? to_linear[texel[c]] : texel[c] / 255.f;
+                    color[c] += value * a;
+                    plain[c] += value;
+                }
+                alpha += a;
+            }
+
+            uint8_t *out = &dst[((size_t)y * w + x) * 4];
+            for (int c = 0; c < 3; c++) {
+                float value = alpha > 0.f ? color[c] / alpha : plain[c] / 4.f;
+                if (srgb)
+                    value = LinearToSRGB(value);
+                out[c] = (uint8_t)std::lround(std::min(std::max(value, 0.f), 1.f) * 255.f);
+            }
+            out[3] = (uint8_t)std::lround(alpha / 4.f * 255.f);
+        }
+    }
+}
+
+static void CompressMip(BlockFormat format, uint32_t width, uint32_t height, const uint8_t *rgba, std::vector<uint8_t> &out)
+{
+    uint32_t bw = (width + 3) / 4;
+    uint32_t bh = (height + 3) / 4;
+    uint32_t size = GetBlockSize(format);
+    out.resize((size_t)bw * bh * size);
+
+    ParallelFor(bh, 1, [&](size_t begin, size_t end) {
+        for (size_t by = begin; by < end; by++) {
+            for (uint32_t bx = 0; bx < bw; bx++) {
+                Block block;
+                LoadBlock(rgba, width, height, bx, (uint32_t)by, block);
+
+                uint8_t *dst = &out[(by * bw + bx) * size];
+                switch (format) {
+                    case BlockFormat::BC1:
+                        EncodeBC1(block, dst);
+                        break;
+                    case BlockFormat::BC4:
+                        EncodeBC4(block, 0, dst);
+                        break;
+                    case BlockFormat::BC5:
+                        EncodeBC4(block, 0, dst);
+                        EncodeBC4(block, 1, dst + 8);
+                        break;
+                    default:
+                        EncodeBC7(block, dst);
+                        break;
+                }
+            }
+        }
+    });
+}
+
+void DecompressMip(BlockFormat format, uint32_t width, uint32_t height, const uint8_t *blocks, uint8_t *rgba)
+{
+    uint32_t bw = (width + 3) / 4;
+    uint32_t bh = (height + 3) / 4;
+    uint32_t size = GetBlockSize(format);
+
+    for (uint32_t by = 0; by < bh; by++) {
+        for (uint32_t bx = 0; bx < bw; bx++) {
+            const uint8_t *src = blocks + ((size_t)by * bw + bx) * size;
+
+            uint8_t texels[64];
+            switch (format) {
+                case BlockFormat::BC1:
+                    DecodeBC1(src, texels);
+                    break;
+                case BlockFormat::BC4:
+                    memset(texels, 0, sizeof(texels));
+                    DecodeBC4(src, texels, 4);
+                    break;
+                case BlockFormat::BC5:
+                    memset(texels, 0, sizeof(texels));
+                    DecodeBC4(src, texels, 4);
+                    DecodeBC4(src + 8, texels + 1, 4);
+                    break;
+                default:
+                    DecodeBC7(src, texels);
+                    break;
+            }
+
+            for (uint32_t i = 0; i < 16; i++) {
+                uint32_t x = bx * 4 + (i & 3);
+                uint32_t y = by * 4 + (i >> 2);
+                if (x < width && y < height)
+                    memcpy(rgba + ((size_t)y * width + x) * 4, texels + i * 4, 4);
+            }
+        }
+    }
+}
+
+static int GetChannelCount(BlockFormat format)
+{
+    switch (format) {
+        case BlockFormat::BC1: return 3;
+        case BlockFormat::BC4: return 1;
+        case BlockFormat::BC5: return 2;
+        default: return 4;
+    }
+}
+
+bool CompressTexture(uint32_t width, uint32_t height, const uint8_t *rgba, const TextureCompressSettings &settings, CompressedTexture &out, TextureCompressStats &stats)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    stats = {};
+    out = {};
+    if (!width || !height)
+        return false;
+
+    auto format = settings.m_Format;
+    if (format == BlockFormat::Auto) {
+        format = BlockFormat::BC1;
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            if (rgba[i * 4 + 3] != 255) {
+                format = BlockFormat::BC7;
+                break;
+            }
+        }
+    }
+
+    bool color = format == BlockFormat::BC1 || format == BlockFormat::BC7;
+    bool srgb = settings.m_SRGB && color;
+    bool linear_mips = (settings.m_LinearMips || srgb) && color;
+
+    out.m_Format = format;
+    out.m_Width = width;
+    out.m_Height = height;
+    switch (format) {
+        case BlockFormat::BC1: out.m_DXGIFormat = srgb ? DXGI_BC1_UNORM_SRGB : DXGI_BC1_UNORM; break;
+        case BlockFormat::BC4: out.m_DXGIFormat = DXGI_BC4_UNORM; break;
+        case BlockFormat::BC5: out.m_DXGIFormat = DXGI_BC5_UNORM; break;
+        default: out.m_DXGIFormat = srgb ? DXGI_BC7_UNORM_SRGB : DXGI_BC7_UNORM; break;
+    }
+
+    std::vector<uint8_t> mip(rgba, rgba + (size_t)width * height * 4);
+    std::vector<uint8_t> next;
+    uint32_t w = width, h = height;
+    for (;;) {
+        out.m_Mips.emplace_back();
+        CompressMip(format, w, h, mip.data(), out.m_Mips.back());
+
+        stats.m_RawBytes += (uint64_t)w * h * 4;
+        stats.m_CompressedBytes += out.m_Mips.back().size();
+
+        if ((w == 1 && h == 1) || (settings.m_MaxMips && out.m_Mips.size() >= settings.m_MaxMips))
+            break;
+
+        Downsample(w, h, mip.data(), linear_mips, next);
+        mip.swap(next);
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+
+    std::vector<uint8_t> decoded((size_t)width * height * 4);
+    DecompressMip(format, width, height, out.m_Mips[0].data(), decoded.data());
+
+    int channels = GetChannelCount(format);
+    double error = 0.0;
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        for (int c = 0; c < channels; c++) {
+            double d = (double)rgba[i * 4 + c] - decoded[i * 4 + c];
+            error += d * d;
+        }
+    }
+
+    double mse = error / ((double)width * height * channels);
+    stats.m_PSNR = mse > 0.0 ? (float)(10.0 * std::log10(255.0 * 255.0 / mse)) : INFINITY;
+    stats.m_Format = format;
+    stats.m_Mips = (uint32_t)out.m_Mips.size();
+    stats.m_Ms = ElapsedMs(start);
+
+    return true;
+}
+
+bool WriteDDS(const char *path, const CompressedTexture &texture)
+{
+    uint32_t header[32 + 5] = {};
+    header[0] = 0x20534444; // "DDS "
+    header[1] = 124;
+    // caps, height, width, pixel format, mip count, linear size
+    header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    header[3] = texture.m_Height;
+    header[4] = texture.m_Width;
+    header[5] = texture.m_Mips.empty() ? 0 : (uint32_t)texture.m_Mips[0].size();
+    header[7] = (uint32_t)texture.m_Mips.size();
+
+    // pixel format: fourcc "DX10"
+    header[19] = 32;
+    header[20] = 0x4;
+    header[21] = 0x30315844;
+
+    // texture, complex and mipmap when there is a chain
+    header[27] = 0x1000 | (texture.m_Mips.size() > 1 ? 0x8 | 0x400000 : 0);
+
+    // DX10 header: format, 2D, no flags, array size 1
+    header[32] = texture.m_DXGIFormat;
+    header[33] = 3;
+    header[35] = 1;
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+    for (auto &mip : texture.m_Mips)
+        ok = ok && fwrite(mip.data(), 1, mip.size(), f) == mip.size();
+
+    ok = fclose(f) == 0 && ok;
+
+    return ok;
+}
+
+const char *GetBlockFormatName(BlockFormat format)
+{
+    switch (format) {
+        case BlockFormat::BC1: return "BC1";
+        case BlockFormat::BC4: return "BC4";
+        case BlockFormat::BC5: return "BC5";
+        case BlockFormat::BC7: return "BC7";
+        default: return "auto";
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class BlockFormat : uint32_t {
+    // BC1 for opaque textures, BC7 for the rest
+    Auto,
+    BC1,
+    BC4,
+    BC5,
+    BC7,
+};
+
+struct TextureCompressSettings {
+    BlockFormat m_Format = BlockFormat::Auto;
+
+    // BC1/BC7 are written as _SRGB formats. Off by default since the editor
+    // creates its textures as R8G8B8A8_UNORM, turn it on only for textures
+    // that are sampled through an sRGB view everywhere. BC4/BC5 are always
+    // linear.
+    bool m_SRGB = false;
+
+    // Color is authored in sRGB whatever format it ends up in, so mips are
+    // averaged in linear space and converted back. Without it a black and
+    // white checker fades to 50% gray instead of 73%. Turn it off for data
+    // that is not color, BC4/BC5 channels are never converted.
+    bool m_LinearMips = true;
+
+    // 0 keeps the whole chain down to 1x1
+    uint32_t m_MaxMips = 0;
+};
+
+struct CompressedTexture {
+    BlockFormat m_Format;
+    uint32_t m_DXGIFormat;
+    uint32_t m_Width;
+    uint32_t m_Height;
+
+    // blocks of every mip, largest first
+    std::vector<std::vector<uint8_t>> m_Mips;
+};
+
+struct TextureCompressStats {
+    BlockFormat m_Format;
+    uint32_t m_Mips;
+    // the same mip chain as RGBA8
+    uint64_t m_RawBytes;
+    uint64_t m_CompressedBytes;
+    // of the top mip, over the channels the format keeps
+    float m_PSNR;
+    float m_Ms;
+};
+
+// Builds the mip chain of an RGBA8 image and encodes every mip, blocks are
+// encoded in parallel on the shared JobPool. Only BC7 mode 6 is produced,
+// one subset with RGBA endpoints, the other modes are left out.
+bool CompressTexture(uint32_t width, uint32_t height, const uint8_t *rgba, const TextureCompressSettings &settings, CompressedTexture &out, TextureCompressStats &stats);
+
+// Decodes one mip back to RGBA8, the inverse of what CompressTexture writes.
+void DecompressMip(BlockFormat format, uint32_t width, uint32_t height, const uint8_t *blocks, uint8_t *rgba);
+
+// DDS with a DX10 header, as the D3D11 loaders expect for BC4-BC7
+bool WriteDDS(const char *path, const CompressedTexture &texture);
+
+const char *GetBlockFormatName(BlockFormat format);
@@ -0,0 +1,164 @@
+#include "TextureLoader.h"
+
+#include <chrono>
+
+#include "ImageIO.h"
+
+static float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+TextureLoader::TextureLoader(unsigned threads)
+    : m_Pool(threads), m_NextTicket(1), m_Pending(0)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+    m_Pool.Wait();
+}
+
+TextureTicket TextureLoader::Request(const std::string &path)
+{
+    TextureTicket ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        ticket = m_NextTicket++;
+        if (m_NextTicket == 0)
+            m_NextTicket = 1;
+    }
+
+    m_Pending++;
+    m_Pool.Submit([this, ticket, path]() {
+        auto timer = std::chrono::high_resolution_clock::now();
+
+        TextureLoadResult result;
+        result.m_Ticket = ticket;
+        result.m_Path = path;
+        result.m_Width = 0;
+        result.m_Height = 0;
+        result.m_Ok = ReadImage(path.c_str(), result.m_Width, result.m_Height, result.m_Pixels);
+        if (!result.m_Ok)
+            result.m_Pixels.clear();
+        result.m_DecodeMs = ElapsedMs(timer);
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Done.push_back(std::move(result));
+    });
+
+    return ticket;
+}
+
+void TextureLoader::Poll(std::vector<TextureLoadResult> &out, uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    uint64_t bytes = 0;
+    size_t count = 0;
+    while (count < m_Done.size() && (count == 0 || bytes + m_Done[count].m_Pixels.size() <= budget)) {
+        bytes += m_Done[count].m_Pixels.size();
+        out.push_back(std::move(m_Done[count]));
+        count++;
+    }
+
+    m_Done.erase(m_Done.begin(), m_Done.begin() + count);
+    m_Pending -= (uint32_t)count;
+}
+
+void TextureLoader::Wait()
+{
+    m_Pool.Wait();
+}
+
+TextureSlots::TextureSlots(size_t count)
+    : m_Tickets(count, 0), m_State(count, SlotState::Empty)
+{
+}
+
+bool TextureSlots::Request(TextureLoader &loader, size_t slot, const std::string &path)
+{
+    m_Tickets[slot] = loader.Request(path);
+    if (m_State[slot] != SlotState::Empty)
+        return false;
+
+    m_State[slot] = SlotState::Placeholder;
+    return true;
+}
+
+void TextureSlots::Cancel(size_t slot)
+{
+    m_Tickets[slot] = 0;
+}
+
+void TextureSlots::Clear(size_t slot)
+{
+    m_State[slot] = SlotState::Empty;
+}
+
+void TextureSlots::Update(TextureLoader &loader, uint64_t budget, const std::function<bool(size_t, TextureLoadResult &)> &upload)
+{
+    std::vector<TextureLoadResult> results;
+    loader.Poll(results, budget);
+
+    for (auto &result : results) {
+        size_t slot = 0;
+        while (slot < m_Tickets.size() && m_Tickets[slot] != result.m_Ticket)
+            slot++;
+
+        // requested again since
+        if (slot == m_Tickets.size())
+            continue;
+
+        m_Tickets[slot] = 0;
+        if (upload(slot, result))
+            m_State[slot] = SlotState::Loaded;
+    }
+}
+
+bool TextureSlots::IsIdle() const
+{
+    for (auto ticket : m_Tickets) {
+        if (ticket)
+            return false;
+    }
+
+    return true;
+}
+
+bool BenchmarkTextureLoads(const std::vector<std::string> &paths, TextureLoadBenchmark &result)
+{
+    result = {};
+    result.m_Textures = (uint32_t)paths.size();
+
+    auto timer = std::chrono::high_resolution_clock::now();
+    for (auto &path : paths) {
+        uint32_t width, height;
+        std::vector<uint8_t> pixels;
+        if (!ReadImage(path.c_str(), width, height, pixels))
+            return false;
+        result.m_Bytes += pixels.size();
+    }
+    result.m_SerialMs = ElapsedMs(timer);
+
+    TextureLoader loader;
+
+    timer = std::chrono::high_resolution_clock::now();
+    for (auto &path : paths)
+        loader.Request(path);
+    result.m_RequestMs = ElapsedMs(timer);
+
+    std::vector<TextureLoadResult> loads;
+    while (loads.size() < paths.size()) {
+        loader.Wait();
+        loader.Poll(loads);
+    }
+    result.m_AsyncMs = ElapsedMs(timer);
+
+    for (auto &load : loads) {
+        if (!load.m_Ok)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "JobPool.h"
+
+// 0 is never handed out
+typedef uint32_t TextureTicket;
+
+struct TextureLoadResult {
+    TextureTicket m_Ticket;
+    std::string m_Path;
+    // false if the file is missing or not something ReadImage decodes
+    bool m_Ok;
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+    // RGBA8, waiting to be uploaded
+    std::vector<uint8_t> m_Pixels;
+
+    float m_DecodeMs;
+};
+
+/*
+ * Decodes textures on worker threads with ReadImage and queues the pixels
+ * for the render thread, which uploads what comes out of Poll. Nothing in
+ * here touches the device.
+ */
+class TextureLoader {
+public:
+    // 0 threads picks one per hardware thread, see JobPool
+    TextureLoader(unsigned threads = 0);
+    ~TextureLoader();
+
+    TextureTicket Request(const std::string &path);
+
+    // moves finished loads into `out`, stops once `budget` bytes of pixels
+    // have been handed out so a burst of uploads is spread over frames. At
+    // least one load is handed out when any is ready.
+    void Poll(std::vector<TextureLoadResult> &out, uint64_t budget = UINT64_MAX);
+    uint32_t GetPending() const { return m_Pending; }
+
+    // blocks until every request has been decoded, they still go through Poll
+    void Wait();
+
+private:
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    JobPool m_Pool;
+
+    std::mutex m_Lock;
+    std::vector<TextureLoadResult> m_Done;
+    TextureTicket m_NextTicket;
+    // requested and not handed out by Poll yet
+    std::atomic<uint32_t> m_Pending;
+};
+
+/*
+ * The load each of a fixed number of texture slots waits on. A request
+ * supersedes the slot's previous one, whose result is dropped when it comes
+ * out of Poll, so a slot only ever swaps to the texture it asked for last.
+ * A slot without a texture draws a placeholder until its first load is
+ * uploaded, later requests keep the previous texture until theirs is.
+ */
+class TextureSlots {
+public:
+    explicit TextureSlots(size_t count);
+
+    // true if the slot has no texture yet and should draw the placeholder
+    bool Request(TextureLoader &loader, size_t slot, const std::string &path);
+    // drops the pending load, the texture stays
+    void Cancel(size_t slot);
+    // the caller let go of the slot's texture, it draws nothing again
+    void Clear(size_t slot);
+
+    // Polls `loader` with `budget` and hands every load that is still the
+    // latest request of its slot to `upload`, which returns false if it did
+    // not swap the texture in.
+    void Update(TextureLoader &loader, uint64_t budget, const std::function<bool(size_t, TextureLoadResult &)> &upload);
+
+    bool IsPending(size_t slot) const { return m_Tickets[slot] != 0; }
+    bool IsPlaceholder(size_t slot) const { return m_State[slot] == SlotState::Placeholder; }
+    bool IsIdle() const;
+
+private:
+    enum class SlotState : uint8_t {
+        Empty,
+        Placeholder,
+        Loaded,
+    };
+
+    std::vector<TextureTicket> m_Tickets;
+    std::vector<SlotState> m_State;
+};
+
+struct TextureLoadBenchmark {
+    uint32_t m_Textures;
+    uint64_t m_Bytes; // decoded
+    float m_SerialMs;
+    // the time the calling thread spent queueing requests
+    float m_RequestMs;
+    float m_AsyncMs;
+};
+
+// Decodes `paths` one after the other, then again through a TextureLoader.
+bool BenchmarkTextureLoads(const std::vector<std::string> &paths, TextureLoadBenchmark &result);
@@ -0,0 +1,103 @@
+#include "TrailRibbon.h"
+
+// miters get long for sharp turns, past this they are clamped
+#define TRAIL_RIBBON_MITER_LIMIT 2.f
+
+static float DistanceToSegment(FXMVECTOR p, FXMVECTOR a, FXMVECTOR b)
+{
+    auto ab = b - a;
+    auto length = XMVectorGetX(XMVector3LengthSq(ab));
+    if (length <= 1e-12f)
+        return XMVectorGetX(XMVector3Length(p - a));
+
+    auto t = XMVectorGetX(XMVector3Dot(p - a, ab)) / length;
+    t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+
+    return XMVectorGetX(XMVector3Length(p - (a + ab * t)));
+}
+
+uint32_t BuildTrailRibbon(const Trail &trail, FXMMATRIX view, float tolerance, TrailRibbonVertex *out, TrailRibbonStats *stats)
+{
+    // the GS draws the segments between points 1 and TRAIL_COUNT - 2, the
+    // outer points only provide adjacency
+    const int first = 1;
+    const int last = TRAIL_COUNT - 2;
+
+    XMVECTOR det;
+    auto eye = XMMatrixInverse(&det, view).r[3];
+
+    XMVECTOR points[TRAIL_COUNT];
+    float sizes[TRAIL_COUNT];
+    float distances[TRAIL_COUNT];
+    int kept = 0;
+
+    auto prev = XMLoadFloat3(&trail.points[first].m_Position);
+    points[kept] = prev;
+    sizes[kept] = trail.points[first].m_Size.x;
+    distances[kept] = (float)(first - 1);
+    kept++;
+
+    for (int i = first + 1; i < last; i++) {
+        auto p = XMLoadFloat3(&trail.points[i].m_Position);
+        auto next = XMLoadFloat3(&trail.points[i + 1].m_Position);
+
+        // dead points sit on top of each other, the error grows with the
+        // distance to the eye so far trails lose more points
+        auto eye_distance = XMVectorGetX(XMVector3Length(p - eye));
+        if (DistanceToSegment(p, points[kept - 1], next) <= tolerance * eye_distance)
+            continue;
+
+        points[kept] = p;
+        sizes[kept] = trail.points[i].m_Size.x;
+        distances[kept] = (float)(i - 1);
+        kept++;
+    }
+
+    // an end on top of the last kept point replaces it
+    auto end = XMLoadFloat3(&trail.points[last].m_Position);
+    if (XMVectorGetX(XMVector3LengthSq(end - points[kept - 1])) <= 1e-12f) {
+        if (kept == 1)
+            return 0;
+        kept--;
+    }
+
+    points[kept] = end;
+    sizes[kept] = trail.points[last].m_Size.x;
+    distances[kept] = (float)(last - 1);
+    kept++;
+
+    if (stats) {
+        stats->m_InputPoints += last - first + 1;
+        stats->m_KeptPoints += kept;
+    }
+
+    for (int i = 0; i < kept; i++) {
+        auto p = points[i];
+
+        // direction in, direction out, a single one at the ends, normalizing
+        // a zero vector gives zero
+        auto in = i > 0 ? XMVector3Normalize(p - points[i - 1]) : XMVectorZero();
+        auto outdir = i < kept - 1 ? XMVector3Normalize(points[i + 1] - p) : XMVectorZero();
+        auto tangent = XMVector3Normalize(in + outdir);
+        if (XMVector3Equal(tangent, XMVectorZero()))
+            tangent = in;
+
+        // the side is perpendicular to the tangent and the view direction
+        auto side = XMVector3Normalize(XMVector3Cross(tangent, eye - p));
+        auto segment = i > 0 ? in : outdir;
+        auto segment_side = XMVector3Normalize(XMVector3Cross(segment, eye - p));
+
+        auto miter = XMVectorGetX(XMVector3Dot(side, segment_side));
+        auto length = sizes[i] / (miter > 1.f / TRAIL_RIBBON_MITER_LIMIT ? miter : 1.f / TRAIL_RIBBON_MITER_LIMIT);
+
+        auto offset = side * length;
+        auto v = distances[i] / (float)(TRAIL_COUNT - 2);
+
+        XMStoreFloat3(&out[i * 2 + 0].m_Position, p - offset);
+        XMStoreFloat3(&out[i * 2 + 1].m_Position, p + offset);
+        out[i * 2 + 0].m_UV = { 1.f, v };
+        out[i * 2 + 1].m_UV = { 0.f, v };
+    }
+
+    return (uint32_t)kept * 2;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Particle.h"
+
+// Two vertices per trail point, drawn as one triangle strip per trail.
+#define TRAIL_RIBBON_MAX_VERTICES (TRAIL_COUNT * 2)
+
+struct TrailRibbonVertex {
+    XMFLOAT3 m_Position;
+    XMFLOAT2 m_UV;
+};
+
+struct TrailRibbonStats {
+    uint32_t m_InputPoints;
+    uint32_t m_KeptPoints;
+};
+
+// Builds a camera facing strip for the drawn points of a trail, the ones the
+// TrailParticleSimple.hlsl GS sees as the middle of its line adjacency.
+// Points that deviate less than `tolerance` times their view distance from
+// the line through their neighbours are dropped, joins are mitered.
+// Returns the number of vertices written, at most TRAIL_RIBBON_MAX_VERTICES.
+uint32_t BuildTrailRibbon(const Trail &trail, FXMMATRIX view, float tolerance, TrailRibbonVertex *out, TrailRibbonStats *stats = nullptr);
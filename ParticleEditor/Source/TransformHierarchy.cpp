@@ -0,0 +1,108 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+
+TransformHierarchy::TransformHierarchy()
+    : m_Slots(1, NO_PARENT), m_Updated(0)
+{
+}
+
+TransformID TransformHierarchy::Create(TransformID parent, FXMMATRIX local)
+{
+    TransformID id;
+    if (!m_Free.empty()) {
+        id = m_Free.back();
+        m_Free.pop_back();
+    }
+    else {
+        id = (TransformID)m_Slots.size();
+        m_Slots.push_back(NO_PARENT);
+    }
+
+    // appending keeps the order, the parent already exists so it is in front
+    m_Slots[id] = (uint32_t)m_Ids.size();
+    m_Ids.push_back(id);
+    m_Parents.push_back(parent == TRANSFORM_NONE ? NO_PARENT : m_Slots[parent]);
+    m_Dirty.push_back(1);
+    m_Local.push_back(local);
+    m_World.push_back(local);
+
+    return id;
+}
+
+void TransformHierarchy::Destroy(TransformID id)
+{
+    assert(id != TRANSFORM_NONE && m_Slots[id] != NO_PARENT);
+
+    auto first = m_Slots[id];
+
+    // children come after their parent, so one pass from the node finds the
+    // whole subtree. `remap` holds the new index of every kept node.
+    std::vector<uint32_t> remap(m_Ids.size() - first);
+    std::vector<uint8_t> removed(m_Ids.size() - first, 0);
+    removed[0] = 1;
+
+    auto write = first;
+    for (auto i = first; i < m_Ids.size(); i++) {
+        auto parent = m_Parents[i];
+        if (i != first && parent != NO_PARENT && parent >= first && removed[parent - first])
+            removed[i - first] = 1;
+
+        if (removed[i - first]) {
+            m_Slots[m_Ids[i]] = NO_PARENT;
+            m_Free.push_back(m_Ids[i]);
+            continue;
+        }
+
+        remap[i - first] = write;
+        m_Ids[write] = m_Ids[i];
+        m_Parents[write] = (parent != NO_PARENT && parent >= first) ? remap[parent - first] : parent;
+        m_Dirty[write] = m_Dirty[i];
+        m_Local[write] = m_Local[i];
+        m_World[write] = m_World[i];
+        m_Slots[m_Ids[write]] = write;
+        write++;
+    }
+
+    m_Ids.resize(write);
+    m_Parents.resize(write);
+    m_Dirty.resize(write);
+    m_Local.resize(write);
+    m_World.resize(write);
+}
+
+void TransformHierarchy::SetLocal(TransformID id, FXMMATRIX local)
+{
+    auto idx = m_Slots[id];
+    m_Local[idx] = local;
+    m_Dirty[idx] = 1;
+}
+
+uint32_t TransformHierarchy::Update()
+{
+    auto count = m_Ids.size();
+    auto parents = m_Parents.data();
+    auto dirty = m_Dirty.data();
+    auto local = m_Local.data();
+    auto world = m_World.data();
+
+    // a node is dirty when it or any of its ancestors changed, parents are
+    // always resolved before their children are looked at
+    m_Updated = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto parent = parents[i];
+        if (parent != NO_PARENT)
+            dirty[i] |= dirty[parent];
+
+        if (!dirty[i])
+            continue;
+
+        world[i] = parent == NO_PARENT ? local[i] : XMMatrixMultiply(local[i], world[parent]);
+        m_Updated++;
+    }
+
+    std::fill(m_Dirty.begin(), m_Dirty.end(), (uint8_t)0);
+
+    return m_Updated;
+}
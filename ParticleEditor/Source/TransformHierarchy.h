@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// 0 is never handed out, it stands for "no node" and for the root when used
+// as a parent.
+using TransformID = uint32_t;
+#define TRANSFORM_NONE 0
+
+// Flat transform tree for things effects attach to, like animated bones.
+// Nodes are stored in arrays ordered so that every parent comes before its
+// children, Update() then recomputes all dirty world matrices front to back
+// in a single pass without recursion or pointer chasing.
+class TransformHierarchy {
+public:
+    TransformHierarchy();
+
+    TransformID Create(TransformID parent = TRANSFORM_NONE, FXMMATRIX local = XMMatrixIdentity());
+
+    // removes the node together with everything attached below it
+    void Destroy(TransformID id);
+
+    void SetLocal(TransformID id, FXMMATRIX local);
+    const XMMATRIX &GetLocal(TransformID id) const { return m_Local[m_Slots[id]]; }
+
+    // valid as of the last Update()
+    const XMMATRIX &GetWorld(TransformID id) const { return m_World[m_Slots[id]]; }
+
+    // recomputes the world matrix of every node that changed or sits below a
+    // node that changed, returns how many were recomputed
+    uint32_t Update();
+
+    uint32_t GetNodeCount() const { return (uint32_t)m_Ids.size(); }
+    uint32_t GetUpdatedCount() const { return m_Updated; }
+
+private:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    // id -> array index, NO_PARENT for free ids
+    std::vector<uint32_t> m_Slots;
+    std::vector<TransformID> m_Free;
+
+    // parallel arrays in parent before child order
+    std::vector<TransformID> m_Ids;
+    std::vector<uint32_t> m_Parents;
+    std::vector<uint8_t> m_Dirty;
+    std::vector<XMMATRIX> m_Local;
+    std::vector<XMMATRIX> m_World;
+
+    uint32_t m_Updated;
+};
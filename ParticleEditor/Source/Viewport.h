@@ -1,6 +1,5 @@
 #pragma once
 
-#include <fstream>
 #include <vector>
 
 #include <ImwPlatformWindowDX11.h>
@@ -10,65 +9,44 @@
 #include "External\Helpers.h"
 #include "External\ImGuizmo.h"
 
+#include "FlipbookBaker.h"
+#include "MeshCache.h"
+#include "RenderBackendD3D11.h"
+#include "SimulationCache.h"
+#include "SoftwareRenderer.h"
+
 #include <imgui_internal.h>
 
 using namespace DirectX;
 using namespace ImWindow;
 
-struct Vertex {
-    XMFLOAT3 position;
-    XMFLOAT3 normal;
-    XMFLOAT2 textureCoordinates;
-};
-
 class SkySphere {
 public:
-    SkySphere(ID3D11Device *device) {
-        std::ifstream meshfile("Resources/Mesh/sphere.dat", std::ifstream::in | std::ifstream::binary);
-        if (!meshfile.is_open())
+    // the sphere comes out of `meshes`, which uploads through `backend`
+    SkySphere(ID3D11Device *device, ShaderCache *shaders, RenderBackend *backend, MeshCache *meshes) {
+        auto mesh = meshes->Load("Resources/Mesh/sphere.dat");
+        if (!mesh)
             throw "Can't load sky dome mesh";
 
-        uint32_t vertexcount = 0;
-        uint32_t indexcount = 0;
-
-        meshfile.read(reinterpret_cast<char*>(&vertexcount), sizeof(uint32_t));
-        if (!vertexcount)
-            throw "Parse error";
-
-        meshfile.read(reinterpret_cast<char*>(&indexcount), sizeof(uint32_t));
-        if (!indexcount)
-            throw "Parse error";
+        m_IndexCount = mesh->m_LODs[0].m_IndexCount;
+        m_VertexBuffer = (ID3D11Buffer*)backend->GetNativeBuffer(mesh->m_VertexBuffer);
+        m_IndexBuffer = (ID3D11Buffer*)backend->GetNativeBuffer(mesh->m_IndexBuffer);
 
-        std::vector<Vertex> vertices;
-        std::vector<UINT16> indices;
-
-        vertices.resize(vertexcount);
-        meshfile.read(reinterpret_cast<char*>(&vertices.front()), sizeof(Vertex) * vertexcount);
-
-        indices.resize(indexcount);
-        meshfile.read(reinterpret_cast<char*>(&indices.front()), sizeof(UINT16) * indexcount);
-
-        m_IndexCount = indexcount;
-        m_VertexBuffer = new VertexBuffer<Vertex>(device, BufferUsageImmutable, BufferAccessNone, vertexcount, &vertices[0]);
-        m_IndexBuffer = new IndexBuffer<UINT16>(device, BufferUsageImmutable, BufferAccessNone, indexcount, &indices[0]);
-
-        ID3DBlob *blob = compile_shader(L"Resources/Shaders/SkySphere.hlsl", "VS", "vs_5_0", device);
-        DXCALL(device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_VertexShader));
+        ShaderBinary binary;
+        BuildShader(shaders, "Resources/Shaders/SkySphere.hlsl", "VS", "vs_5_0", binary);
+        DXCALL(device->CreateVertexShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &m_VertexShader));
 
         D3D11_INPUT_ELEMENT_DESC input_desc[] = {
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,                            D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_FLOAT, 0, 0,                            D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "NORMAL",   0, DXGI_FORMAT_R8G8B8A8_SNORM,     0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
         };
-        m_InputLayout = create_input_layout(input_desc, ARRAYSIZE(input_desc), blob->GetBufferPointer(), blob->GetBufferSize(), device);
+        m_InputLayout = create_input_layout(input_desc, ARRAYSIZE(input_desc), binary.m_Bytecode.data(), binary.m_Bytecode.size(), device);
 
-        blob = compile_shader(L"Resources/Shaders/SkySphere.hlsl", "PS", "ps_5_0", device);
-        DXCALL(device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_PixelShader));
+        BuildShader(shaders, "Resources/Shaders/SkySphere.hlsl", "PS", "ps_5_0", binary);
+        DXCALL(device->CreatePixelShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &m_PixelShader));
     }
     ~SkySphere() {
-        delete m_VertexBuffer;
-        delete m_IndexBuffer;
-
         m_InputLayout->Release();
         m_VertexShader->Release();
         m_PixelShader->Release();
@@ -76,13 +54,13 @@ public:
 
     void Draw(ID3D11DeviceContext *cxt, Camera *camera)
     {
-        UINT stride = sizeof(Vertex);
+        UINT stride = sizeof(MeshVertex);
         UINT offset = 0u;
 
         cxt->IASetInputLayout(m_InputLayout);
 
-        cxt->IASetIndexBuffer(*m_IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-        cxt->IASetVertexBuffers(0, 1, *m_VertexBuffer, &stride, &offset);
+        cxt->IASetIndexBuffer(m_IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+        cxt->IASetVertexBuffers(0, 1, &m_VertexBuffer, &stride, &offset);
         cxt->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
         cxt->VSSetShader(m_VertexShader, nullptr, 0);
@@ -93,8 +71,9 @@ public:
         cxt->DrawIndexed(m_IndexCount, 0, 0);
     }
 
-    VertexBuffer<Vertex> *m_VertexBuffer;
-    IndexBuffer<UINT16> *m_IndexBuffer;
+    // owned by the mesh cache's backend, LOD 0 starts at index 0
+    ID3D11Buffer *m_VertexBuffer;
+    ID3D11Buffer *m_IndexBuffer;
 
 
     UINT m_IndexCount;
@@ -119,10 +98,12 @@ public:
         m_Batch(new PrimitiveBatch<VertexPositionColor>(ImwPlatformWindowDX11::s_pDeviceContext)),
         m_Effect(new BasicEffect(ImwPlatformWindowDX11::s_pDevice)),
         m_States(new CommonStates(ImwPlatformWindowDX11::s_pDevice)),
-        m_Sphere(ImwPlatformWindowDX11::s_pDevice),
         m_Mouse(new Mouse()),
         m_Keyboard(new Keyboard()),
         m_RenderSize({}),
+        m_CacheWriter(nullptr),
+        m_CacheReader(nullptr),
+        m_CachePosition(0),
         m_Dirty(true),
         m_GizmoActive(false),
         m_Dragging(false),
@@ -153,16 +134,17 @@ public:
 
             m_GridBuffer = new VertexBuffer<GridVertex>(device, BufferUsageImmutable, BufferAccessNone, 6, &vertices[0]);
 
-            ID3DBlob *blob = compile_shader(L"Resources/Shaders/GridPlane.hlsl", "VS", "vs_5_0", device);
-            DXCALL(device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_GridShaderVS));
+            ShaderBinary binary;
+            BuildShader(Editor::Shaders, "Resources/Shaders/GridPlane.hlsl", "VS", "vs_5_0", binary);
+            DXCALL(device->CreateVertexShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &m_GridShaderVS));
             D3D11_INPUT_ELEMENT_DESC input_desc[] = {
                 { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,                            D3D11_INPUT_PER_VERTEX_DATA, 0 },
                 { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
             };
-            m_GridLayout = create_input_layout(input_desc, ARRAYSIZE(input_desc), blob->GetBufferPointer(), blob->GetBufferSize(), device);
+            m_GridLayout = create_input_layout(input_desc, ARRAYSIZE(input_desc), binary.m_Bytecode.data(), binary.m_Bytecode.size(), device);
 
-            blob = compile_shader(L"Resources/Shaders/GridPlane.hlsl", "PS", "ps_5_0", device);
-            DXCALL(device->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &m_GridShaderPS));
+            BuildShader(Editor::Shaders, "Resources/Shaders/GridPlane.hlsl", "PS", "ps_5_0", binary);
+            DXCALL(device->CreatePixelShader(binary.m_Bytecode.data(), binary.m_Bytecode.size(), nullptr, &m_GridShaderPS));
 
             DXCALL(CreateWICTextureFromFile(device, L"Resources/Textures/Grid.png", nullptr, &m_GridTexture));
 
@@ -190,11 +172,25 @@ public:
         }
 
         XMStoreFloat4x4(&m_ParticlePosition, XMMatrixTranslation(0, 0, 0));
+        m_LastParticlePosition = {};
 
-        FXSystem = new ParticleSystem(L"", 2048, 0, 0, device, cxt);
+        m_Backend = new D3D11RenderBackend(device, cxt, Editor::Shaders);
+        m_Recorder = new RecordingRenderBackend(m_Backend);
+        m_Meshes = new MeshCache(m_Recorder);
+
+        m_Sphere = new SkySphere(device, Editor::Shaders, m_Recorder, m_Meshes);
+        FXSystem = new ParticleSystem(L"", 2048, 0, 0, m_Recorder, m_Meshes);
     }
 
     ~EditorViewport() {
+        delete m_CacheWriter;
+        delete m_CacheReader;
+        delete FXSystem;
+        FXSystem = nullptr;
+        delete m_Sphere;
+        delete m_Meshes;
+        delete m_Recorder;
+        delete m_Backend;
         delete m_Camera;
         delete m_Batch;
         delete m_Effect;
@@ -202,6 +198,80 @@ public:
         delete m_Keyboard;
     }
 
+    // opens and closes the simulation cache as the settings are toggled.
+    // Recording truncates the file a reader has mapped, so the two never run
+    // at the same time: both close before either opens, and neither opens
+    // while the other is open.
+    void UpdateCache()
+    {
+        if (!Editor::RecordCache && m_CacheWriter) {
+            auto &stats = m_CacheWriter->GetStats();
+            if (m_CacheWriter->Close())
+                Editor::ConsoleOutput->AddLog("Recorded %u frames to simulation.cache (%.2f MB)\n", stats.m_Frames, stats.m_Bytes / (1024.f * 1024.f));
+            else
+                Editor::ConsoleOutput->AddLog("[error] Failed to write simulation.cache\n");
+
+            delete m_CacheWriter;
+            m_CacheWriter = nullptr;
+        }
+
+        if (!Editor::PlayCache && m_CacheReader) {
+            delete m_CacheReader;
+            m_CacheReader = nullptr;
+        }
+
+        if (Editor::RecordCache && m_CacheReader) {
+            Editor::ConsoleOutput->AddLog("[error] Stop playing simulation.cache before recording it\n");
+            Editor::RecordCache = false;
+        }
+
+        if (Editor::PlayCache && m_CacheWriter) {
+            Editor::ConsoleOutput->AddLog("[error] Stop recording simulation.cache before playing it\n");
+            Editor::PlayCache = false;
+        }
+
+        // both asked for in the same frame, recording wins like in the menu
+        if (Editor::RecordCache && Editor::PlayCache && !m_CacheWriter && !m_CacheReader)
+            Editor::PlayCache = false;
+
+        if (Editor::RecordCache && !m_CacheWriter) {
+            m_CacheWriter = new SimulationCacheWriter();
+            if (!m_CacheWriter->Open("simulation.cache")) {
+                Editor::ConsoleOutput->AddLog("[error] Failed to open simulation.cache for writing\n");
+                Editor::RecordCache = false;
+
+                delete m_CacheWriter;
+                m_CacheWriter = nullptr;
+            }
+        }
+
+        if (Editor::PlayCache && !m_CacheReader) {
+            m_CacheReader = new SimulationCacheReader();
+            if (!m_CacheReader->Open("simulation.cache") || m_CacheReader->GetFrameCount() == 0) {
+                Editor::ConsoleOutput->AddLog("[error] Failed to open simulation.cache\n");
+                Editor::PlayCache = false;
+
+                delete m_CacheReader;
+                m_CacheReader = nullptr;
+            }
+
+            m_CachePosition = 0;
+        }
+
+        if (m_CacheReader) {
+            ImGui::SetNextWindowPos(ImGui::GetWindowPos() + ImVec2(ImGui::GetWindowWidth() - 260, 10), ImGuiSetCond_Always);
+            ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.0f, 0.0f, 0.0f, 0.3f));
+            if (ImGui::Begin("Cache:", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings))
+            {
+                ImGui::PushItemWidth(240);
+                ImGui::SliderInt("##cacheframe", &m_CachePosition, 0, m_CacheReader->GetFrameCount() - 1, "frame %.0f");
+                ImGui::PopItemWidth();
+                ImGui::End();
+            }
+            ImGui::PopStyleColor();
+        }
+    }
+
     void OnResize(int width, int height)
     {
 
@@ -342,7 +412,7 @@ public:
 
         m_Camera->Update(cxt);
 
-        m_Sphere.Draw(cxt, m_Camera);
+        m_Sphere->Draw(cxt, m_Camera);
 
         m_Effect->SetProjection(m_Camera->GetProjection());
         m_Effect->SetView(m_Camera->GetView());
@@ -370,7 +440,10 @@ public:
         cxt->PSSetShaderResources(4, MAX_MATERIAL_TEXTURES-4, SRVs);
         cxt->OMSetBlendState(m_States->AlphaBlend(), nullptr, 0xFFFFFFFF);
 
-        if (Editor::SelectedAnchorEffect.fx) {
+        UpdateCache();
+
+        // nothing is simulated while a cache plays back
+        if (Editor::SelectedAnchorEffect.fx && !m_CacheReader) {
             XMFLOAT4X4 view, proj;
 
             XMStoreFloat4x4(&view, m_Camera->GetView());
@@ -381,12 +454,34 @@ public:
                 ImGuizmo::Manipulate((float*)view.m, (float*)proj.m, ImGuizmo::TRANSLATE, ImGuizmo::WORLD, (float*)m_ParticlePosition.m, nullptr, nullptr, nullptr, nullptr);
             }
             auto pos = XMLoadFloat4x4(&m_ParticlePosition);
+            auto dt = delta * Editor::Speed * (Editor::Paused ? 0.f : 1.f);
+
+            // dragging the gizmo moves the emitter, its velocity is measured
+            // in simulation time so spawns spread over the simulated frame
+            auto velocity = XMVectorZero();
+            if (dt > 0.f)
+                velocity = (pos.r[3] - XMLoadFloat3(&m_LastParticlePosition)) / dt;
+            XMStoreFloat3(&m_LastParticlePosition, pos.r[3]);
+
+            // past the LOD distance of its flipbook the effect is drawn from
+            // the bake and only its age moves on, particles already alive
+            // finish on their own
+            auto flipbook = Editor::LoadedFlipbook;
+            bool use_flipbook = false;
+            if (Editor::FlipbookLOD && flipbook && Editor::LoadedFlipbookEffect == Editor::SelectedAnchorEffect.fx->name) {
+                auto distance = XMVectorGetX(XMVector3Length(m_Camera->GetValues().m_Position - pos.r[3]));
+                use_flipbook = flipbook->ShouldUse(distance);
+            }
 
-            if (Editor::SelectedAnchorEffect.fx->anchor) {
-                FXSystem->ProcessAnchoredFX(&Editor::SelectedAnchorEffect, pos, delta * Editor::Speed * (Editor::Paused ? 0.f : 1.f));
+            if (use_flipbook) {
+                Editor::SelectedAnchorEffect.fx->age += dt;
+                FXSystem->ProcessFlipbook(flipbook, Editor::LoadedFlipbookSRV, pos, Editor::SelectedAnchorEffect.fx->age);
+            }
+            else if (Editor::SelectedAnchorEffect.fx->anchor) {
+                FXSystem->ProcessAnchoredFX(&Editor::SelectedAnchorEffect, pos, dt);
             }
             else {
-                FXSystem->ProcessFX(Editor::SelectedAnchorEffect.fx, pos, delta * Editor::Speed * (Editor::Paused ? 0.f : 1.f));
+                FXSystem->ProcessFX(*Editor::SelectedAnchorEffect.fx, pos, velocity, dt);
             }
 
             if (Editor::SelectedAnchorEffect.fx->age >= Editor::SelectedAnchorEffect.fx->time) {
@@ -413,16 +508,79 @@ public:
         cxt->PSSetShaderResources(0, 1, &m_GridTexture);
         ID3D11Buffer *psbuffers[] = {
             *m_Camera->GetBuffer(),
-            *FXSystem->m_DirectionalLight,
-            *FXSystem->m_Lights
+            (ID3D11Buffer*)m_Recorder->GetNativeBuffer(FXSystem->m_DirectionalLight),
+            (ID3D11Buffer*)m_Recorder->GetNativeBuffer(FXSystem->m_Lights)
         };
         cxt->VSSetConstantBuffers(0, 1, psbuffers);
         cxt->PSSetConstantBuffers(0, 3, psbuffers);
         cxt->Draw(6, 0);
 
 
-        FXSystem->update(m_Camera, delta * Editor::Speed * (Editor::Paused ? 0.f : 1.f));
-        FXSystem->render(m_Camera, m_States, m_DepthDSV, ImwPlatformWindowDX11::s_pRTV, Editor::Debug);
+        FXSystem->m_BillboardQuads = Editor::BillboardQuads;
+        FXSystem->m_TrailRibbons = Editor::TrailRibbons;
+        FXSystem->m_TrailRibbonTolerance = Editor::TrailRibbonTolerance;
+        FXSystem->m_MeshLOD = Editor::MeshLOD;
+        FXSystem->m_MeshLODTolerance = Editor::MeshLODTolerance;
+
+        if (m_CacheReader) {
+            if (m_CacheReader->ReadFrame(m_CachePosition, m_CacheFrame))
+                FXSystem->upload(m_CacheFrame.GetFrameData());
+
+            if (!Editor::Paused)
+                m_CachePosition = (m_CachePosition + 1) % m_CacheReader->GetFrameCount();
+        }
+        else {
+            FXSystem->m_SpecializedKernels = Editor::SpecializedKernels;
+            FXSystem->m_CompactInstances = Editor::CompactInstances;
+            FXSystem->m_TemporalLOD = Editor::TemporalLOD;
+            FXSystem->update(m_Camera, delta * Editor::Speed * (Editor::Paused ? 0.f : 1.f));
+
+            if (m_CacheWriter && !m_CacheWriter->AddFrame(FXSystem->GetFrameData())) {
+                Editor::ConsoleOutput->AddLog("[error] Failed to write frame %u of simulation.cache, recording stopped\n", m_CacheWriter->GetStats().m_Frames);
+                Editor::RecordCache = false;
+
+                delete m_CacheWriter;
+                m_CacheWriter = nullptr;
+            }
+        }
+
+        if (Editor::CaptureReference) {
+            Editor::CaptureReference = false;
+
+            SoftwareRenderer reference((uint32_t)m_RenderSize.x, (uint32_t)m_RenderSize.y);
+            reference.Render(FXSystem->GetFrameData(), m_Camera->GetView(), m_Camera->GetProjection());
+
+            if (reference.SavePNG("reference.png") && reference.SaveEXR("reference.exr")) {
+                auto &stats = reference.GetStats();
+                Editor::ConsoleOutput->AddLog("Rendered reference.png/.exr: %u triangles, %llu pixels, setup %.2fms, bin %.2fms, raster %.2fms\n",
+                    stats.m_Triangles, (unsigned long long)stats.m_ShadedPixels, stats.m_SetupMs, stats.m_BinMs, stats.m_RasterMs);
+            }
+            else {
+                Editor::ConsoleOutput->AddLog("[error] Failed to write reference image\n");
+            }
+        }
+        FXSystem->render(m_Camera, m_DepthDSV, ImwPlatformWindowDX11::s_pRTV, Editor::Debug);
+
+        // spawn LOD factor next to every entry that spawned this frame
+        if (Editor::ShowSpawnLOD) {
+            auto draw = ImGui::GetWindowDrawList();
+            auto transform = m_Camera->GetView() * m_Camera->GetProjection();
+            char label[32];
+
+            for (auto &lod : FXSystem->m_SpawnLODDebug) {
+                auto clip = XMVector4Transform(XMVectorSet(lod.m_Position.x, lod.m_Position.y, lod.m_Position.z, 1.f), transform);
+                auto w = XMVectorGetW(clip);
+                if (w <= 0.f)
+                    continue;
+
+                auto x = min.x + (XMVectorGetX(clip) / w * 0.5f + 0.5f) * m_RenderSize.x;
+                auto y = min.y + (0.5f - XMVectorGetY(clip) / w * 0.5f) * m_RenderSize.y;
+
+                sprintf(label, "lod %.2f", lod.m_Factor);
+                draw->AddText(ImVec2(x, y), lod.m_Factor < 1.f ? 0xff40c0ff : 0xff80ff80, label);
+            }
+        }
+
         FXSystem->frame();
 
 
@@ -459,6 +617,52 @@ public:
             }
         }
         ImGui::PopStyleColor();
+
+        if (Editor::ShowStats) {
+            auto &stats = m_Recorder->GetFrameStats();
+
+            ImGui::SetNextWindowPos(ImGui::GetWindowPos() + ImVec2(10, ImGui::GetWindowHeight() - 150), ImGuiSetCond_Always);
+            ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.0f, 0.0f, 0.0f, 0.3f));
+            if (ImGui::Begin("Stats:", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings))
+            {
+                ImGui::Text(ICON_MD_TIMELINE " %u draws, %u instances, %u shader binds", stats.m_DrawCalls, stats.m_Instances, stats.m_ShaderBinds);
+                ImGui::Text(ICON_MD_FILE_UPLOAD " %u maps, %.2f KB uploaded", stats.m_Maps, stats.m_UploadBytes / 1024.f);
+                ImGui::Text(ICON_MD_MEMORY " %u geometry pools, %.3f ms simulated (%s)", FXSystem->m_GeometryPoolCount, FXSystem->m_GeometryUpdateMs, FXSystem->m_SpecializedKernels ? "specialized" : "generic");
+                ImGui::Text(ICON_MD_MEMORY " %u bytes per particle, %.2f KB of particle state touched", (UINT)sizeof(GeometryParticle), 2.f * sizeof(GeometryParticle) * FXSystem->m_GeometrySimulatedCount / 1024.f);
+                if (FXSystem->m_BillboardQuads)
+                    ImGui::Text(ICON_MD_MEMORY " %u billboards expanded in %.3f ms", (UINT)FXSystem->m_BillboardDrawParticles.size(), FXSystem->m_BillboardExpandMs);
+                if (FXSystem->m_TrailRibbons)
+                    ImGui::Text(ICON_MD_MEMORY " %u of %u trail points kept, built in %.3f ms", FXSystem->m_TrailRibbonStats.m_KeptPoints, FXSystem->m_TrailRibbonStats.m_InputPoints, FXSystem->m_TrailRibbonMs);
+                if (FXSystem->m_TemporalLOD) {
+                    auto &lod = FXSystem->m_TemporalLODStats;
+                    for (int i = 0; i < TEMPORAL_LOD_BUCKETS; i++) {
+                        ImGui::Text(ICON_MD_MEMORY " lod 1/%d: %u effects, %u ticked, %u particles replayed", 1 << i, lod.m_Effects[i], lod.m_Ticked[i], lod.m_SavedParticles[i]);
+                    }
+                }
+                if (FXSystem->m_MeshLOD) {
+                    auto &mesh = FXSystem->m_MeshLODStats;
+                    auto &lods = FXSystem->m_Sphere->m_LODs;
+                    for (size_t i = 0; i < lods.size(); i++) {
+                        ImGui::Text(ICON_MD_MEMORY " sphere lod %u: %u triangles, %u instances", (UINT)i, lods[i].m_IndexCount / 3, mesh.m_Instances[i]);
+                    }
+                    ImGui::Text(ICON_MD_MEMORY " %llu sphere vertices shaded, %llu without lods and reordering", mesh.m_Vertices, mesh.m_BaselineVertices);
+                }
+
+                if (m_CacheWriter || m_CacheReader) {
+                    auto &cache = m_CacheWriter ? m_CacheWriter->GetStats() : m_CacheReader->GetStats();
+                    float seconds = cache.m_Ms / 1000.f;
+
+                    ImGui::Text(ICON_MD_SAVE " cache %s: %u frames, %.2f MB (%.1f%% of raw), %.1f MB/s",
+                        m_CacheWriter ? "record" : "playback",
+                        cache.m_Frames,
+                        cache.m_Bytes / (1024.f * 1024.f),
+                        cache.m_RawBytes ? 100.f * cache.m_Bytes / cache.m_RawBytes : 0.f,
+                        seconds > 0.f ? cache.m_RawBytes / (1024.f * 1024.f) / seconds : 0.f);
+                }
+                ImGui::End();
+            }
+            ImGui::PopStyleColor();
+        }
     }
 
 private:
@@ -476,6 +680,16 @@ private:
 
     Camera *m_Camera;
 
+    RenderBackend *m_Backend;
+    RecordingRenderBackend *m_Recorder;
+    // sphere.dat and its LODs, shared by the sky and the particle system
+    MeshCache *m_Meshes;
+
+    SimulationCacheWriter *m_CacheWriter;
+    SimulationCacheReader *m_CacheReader;
+    SimulationCacheFrame m_CacheFrame;
+    int m_CachePosition;
+
     ID3D11DepthStencilView *m_DepthDSV;
     ID3D11InputLayout *m_BatchLayout;
     PrimitiveBatch<VertexPositionColor> *m_Batch;
@@ -488,9 +702,10 @@ private:
     Keyboard::KeyboardStateTracker m_Tracker;
 
 
-    SkySphere m_Sphere;
+    SkySphere *m_Sphere;
 
     XMFLOAT4X4 m_ParticlePosition;
+    XMFLOAT3 m_LastParticlePosition;
     ImVec2 m_RenderSize;
     ImVec2 m_DisplaySize;
     bool m_Dirty;
@@ -0,0 +1,194 @@
+#include "Test.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../Source/BillboardQuads.h"
+
+struct TestBillboard {
+    float m_Position[3];
+    float m_Size[2];
+    float m_Age;
+};
+
+static void Cross(const float a[3], const float b[3], float out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float Dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void Normalize(float v[3])
+{
+    float length = std::sqrt(Dot(v, v));
+    for (int c = 0; c < 3; c++)
+        v[c] /= length;
+}
+
+// XMMatrixLookAtRH, row major and applied to row vectors.
+static void LookAtRH(const float eye[3], const float at[3], const float up[3], float view[4][4])
+{
+    float z[3] = { eye[0] - at[0], eye[1] - at[1], eye[2] - at[2] };
+    Normalize(z);
+    float x[3];
+    Cross(up, z, x);
+    Normalize(x);
+    float y[3];
+    Cross(z, x, y);
+
+    for (int c = 0; c < 3; c++) {
+        view[c][0] = x[c];
+        view[c][1] = y[c];
+        view[c][2] = z[c];
+        view[c][3] = 0.f;
+    }
+    view[3][0] = -Dot(x, eye);
+    view[3][1] = -Dot(y, eye);
+    view[3][2] = -Dot(z, eye);
+    view[3][3] = 1.f;
+}
+
+static void TransformPoint(const float p[3], const float m[4][4], float out[3])
+{
+    for (int c = 0; c < 3; c++)
+        out[c] = p[0] * m[0][c] + p[1] * m[1][c] + p[2] * m[2][c] + m[3][c];
+}
+
+// What the GS in BillboardParticleSimple.hlsl emits for one billboard, in view
+// space: the center moved by N/S (y, size.x) and W/E (x, size.y).
+static void GetReferenceCorners(const TestBillboard &particle, const float view[4][4], float corners[4][3], float uvs[4][2])
+{
+    float center[3];
+    TransformPoint(particle.m_Position, view, center);
+
+    float w = particle.m_Size[0];
+    float h = particle.m_Size[1];
+
+    // N + W, S + W, N + E, S + E
+    float offsets[4][2] = { { h, w }, { h, -w }, { -h, w }, { -h, -w } };
+    for (int i = 0; i < 4; i++) {
+        corners[i][0] = center[0] + offsets[i][0];
+        corners[i][1] = center[1] + offsets[i][1];
+        corners[i][2] = center[2];
+    }
+
+    // UV.xy, UV.xw, UV.zy, UV.zw with UV = (0, 0, 1, 1)
+    float reference[4][2] = { { 0.f, 0.f }, { 0.f, 1.f }, { 1.f, 0.f }, { 1.f, 1.f } };
+    for (int i = 0; i < 4; i++) {
+        uvs[i][0] = reference[i][0];
+        uvs[i][1] = reference[i][1];
+    }
+}
+
+static std::vector<TestBillboard> MakeParticles(size_t count)
+{
+    std::vector<TestBillboard> particles(count);
+    srand(42);
+    for (auto &particle : particles) {
+        auto random = []() { return rand() / (float)RAND_MAX; };
+
+        particle.m_Position[0] = random() * 20.f - 10.f;
+        particle.m_Position[1] = random() * 5.f;
+        particle.m_Position[2] = random() * 20.f - 10.f;
+        particle.m_Size[0] = 0.05f + random();
+        particle.m_Size[1] = 0.05f + random();
+        particle.m_Age = random() * 3.f;
+    }
+
+    return particles;
+}
+
+static void ExpandAll(const std::vector<TestBillboard> &particles, const BillboardAxes &axes, BillboardVertex *out)
+{
+    for (size_t i = 0; i < particles.size(); i++)
+        ExpandBillboardQuad(particles[i].m_Position, particles[i].m_Size, particles[i].m_Age, axes, out + i * 4);
+}
+
+TEST(BillboardQuadsMatchGeometryShader)
+{
+    auto particles = MakeParticles(64);
+
+    float cameras[][3][3] = {
+        { { 0, 2, 8 }, { 0, 0, 0 }, { 0, 1, 0 } },
+        { { -6, 9, -3 }, { 1, 0.5f, 2 }, { 0, 1, 0 } },
+        { { 3, -2, 1 }, { 0, 0, 0 }, { 0, 0, 1 } },
+    };
+
+    std::vector<BillboardVertex> vertices(particles.size() * 4);
+    for (auto &camera : cameras) {
+        float view[4][4];
+        LookAtRH(camera[0], camera[1], camera[2], view);
+        ExpandAll(particles, GetBillboardAxes(view), vertices.data());
+
+        float error = 0.f;
+        bool uvs_match = true;
+        bool ages_match = true;
+        for (size_t i = 0; i < particles.size(); i++) {
+            float corners[4][3];
+            float uvs[4][2];
+            GetReferenceCorners(particles[i], view, corners, uvs);
+
+            for (int c = 0; c < 4; c++) {
+                auto &vertex = vertices[i * 4 + c];
+
+                // the CPU quads are in world space, VSQuad applies the view
+                float position[3];
+                TransformPoint(vertex.m_Position, view, position);
+
+                for (int k = 0; k < 3; k++)
+                    error = fmaxf(error, fabsf(position[k] - corners[c][k]));
+
+                uvs_match = uvs_match && vertex.m_UV[0] == uvs[c][0] && vertex.m_UV[1] == uvs[c][1];
+                ages_match = ages_match && vertex.m_Age == particles[i].m_Age;
+            }
+        }
+
+        CHECK(error < 1e-4f);
+        CHECK(uvs_match);
+        CHECK(ages_match);
+    }
+}
+
+TEST(BillboardQuadIndicesFollowTheStrip)
+{
+    std::vector<uint16_t> indices(BILLBOARD_QUAD_MAX * 6);
+    BuildBillboardQuadIndices(indices.data(), BILLBOARD_QUAD_MAX);
+
+    // the strip 0 1 2 3 is the triangles 0 1 2 and 2 1 3, same winding
+    uint16_t first[] = { 0, 1, 2, 2, 1, 3 };
+    for (int i = 0; i < 6; i++)
+        CHECK(indices[i] == first[i]);
+
+    // the last quad still fits a 16 bit index
+    auto last = &indices[(BILLBOARD_QUAD_MAX - 1) * 6];
+    CHECK(last[5] == 65535);
+    CHECK(last[0] == 65532);
+}
+
+// Not a check, prints what expanding the largest batch costs.
+TEST(BillboardQuadsBenchmark)
+{
+    auto particles = MakeParticles(BILLBOARD_QUAD_MAX);
+    std::vector<BillboardVertex> vertices(particles.size() * 4);
+
+    float eye[3] = { 0, 2, 8 }, at[3] = { 0, 0, 0 }, up[3] = { 0, 1, 0 };
+    float view[4][4];
+    LookAtRH(eye, at, up, view);
+
+    const int runs = 50;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < runs; i++)
+        ExpandAll(particles, GetBillboardAxes(view), vertices.data());
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+
+    printf("  %u billboards: %.3f ms, %.1f ns per quad, %.1f MB of vertices\n",
+        (unsigned)particles.size(), ms, ms * 1e6 / particles.size(), vertices.size() * sizeof(BillboardVertex) / (1024.0 * 1024.0));
+}
@@ -0,0 +1,58 @@
+#include "Test.h"
+
+#include <cstring>
+#include <experimental/filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Source/ImageIO.h"
+
+namespace fs = std::experimental::filesystem;
+
+TEST(Crc32KnownValues)
+{
+    auto text = (const uint8_t*)"123456789";
+    CHECK(Crc32(text, 9) == 0xcbf43926u);
+    CHECK(Crc32(nullptr, 0) == 0u);
+
+    // running crc, as the PNG chunks and journal records use it
+    CHECK(Crc32(text + 4, 5, Crc32(text, 4)) == 0xcbf43926u);
+}
+
+// The first calls may come from several workers at once.
+TEST(Crc32ConcurrentFirstUse)
+{
+    std::vector<uint8_t> data(1 << 16);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (uint8_t)(i * 31 + 7);
+
+    uint32_t expected = Crc32(data.data(), data.size());
+
+    std::vector<uint32_t> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); i++)
+        threads.emplace_back([&, i]() { results[i] = Crc32(data.data(), data.size()); });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (auto result : results)
+        CHECK(result == expected);
+}
+
+TEST(ImageWriteReadPNG)
+{
+    uint32_t width = 13, height = 7;
+    std::vector<uint8_t> rgba(width * height * 4);
+    for (size_t i = 0; i < rgba.size(); i++)
+        rgba[i] = (uint8_t)(i * 13);
+
+    auto path = (fs::temp_directory_path() / "pe_imageio.png").generic_string();
+    CHECK(WritePNG(path.c_str(), width, height, rgba.data()));
+
+    uint32_t w = 0, h = 0;
+    std::vector<uint8_t> read;
+    CHECK(ReadImage(path.c_str(), w, h, read));
+    CHECK(w == width && h == height);
+    CHECK(read == rgba);
+}
@@ -0,0 +1,40 @@
+#include "Test.h"
+
+#include <cstring>
+
+std::vector<TestCase> &GetTests()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+int &GetTestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+// `tests [filter]` runs every test whose name contains the filter
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+
+    int failed = 0, run = 0;
+    for (auto &test : GetTests()) {
+        if (filter && !strstr(test.m_Name, filter))
+            continue;
+
+        int before = GetTestFailures();
+        test.m_Func();
+        run++;
+
+        bool ok = GetTestFailures() == before;
+        if (!ok)
+            failed++;
+
+        printf("[%s] %s\n", ok ? " ok " : "FAIL", test.m_Name);
+    }
+
+    printf("%d of %d tests passed\n", run - failed, run);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+#include "Test.h"
+
+#include <cstring>
+
+#include "../Source/RenderBackend.h"
+
+TEST(NullBackendKeepsBufferData)
+{
+    NullRenderBackend backend;
+
+    float data[] = { 1.f, 2.f, 3.f, 4.f };
+    auto immutable = backend.CreateBuffer(RenderBufferType::Vertex, RenderBufferUsage::Immutable, sizeof(float), 4, data);
+    auto dynamic = backend.CreateBuffer(RenderBufferType::Constant, RenderBufferUsage::Dynamic, 16, 2);
+
+    CHECK(immutable != dynamic);
+    CHECK(backend.GetBufferSize(immutable) == sizeof(data));
+    CHECK(memcmp(backend.GetBufferData(immutable), data, sizeof(data)) == 0);
+
+    CHECK(backend.GetBufferSize(dynamic) == 32);
+    memcpy(backend.Map(dynamic), data, sizeof(data));
+    backend.Unmap(dynamic, sizeof(data));
+    CHECK(memcmp(backend.GetBufferData(dynamic), data, sizeof(data)) == 0);
+
+    RenderInputLayout layout = nullptr;
+    auto vs = backend.CreateShader(RenderShaderStage::Vertex, L"a.hlsl", "VS", nullptr, 0, &layout);
+    auto ps = backend.CreateShader(RenderShaderStage::Pixel, L"a.hlsl", "PS");
+    CHECK(vs && ps && layout);
+    CHECK(vs != ps && vs != layout);
+}
+
+// Fixed function state goes through the backend like everything else, so a
+// recording of a headless frame shows where the state changes.
+TEST(RecordingBackendRecordsState)
+{
+    RecordingRenderBackend backend;
+
+    int color = 0, depth = 0;
+    auto camera = backend.CreateBuffer(RenderBufferType::Constant, RenderBufferUsage::Dynamic, 64, 1);
+    backend.EndFrame();
+
+    backend.Map(camera);
+    backend.Unmap(camera, 64);
+    backend.BindSamplers();
+    backend.SetBlendState(RenderBlendState::NonPremultiplied);
+    backend.SetDepthState(RenderDepthState::Read);
+    backend.SetRasterState(RenderRasterState::Wireframe);
+    backend.BindRenderTargets(&color, &depth);
+    backend.BindRenderTargets(&color, nullptr);
+    backend.BindTexture(RenderShaderStage::Pixel, 2, &color);
+    backend.Draw(4, 0);
+    backend.EndFrame();
+
+    auto &commands = backend.GetCommands();
+    RenderCommandType expected[] = {
+        RenderCommandType::Map,
+        RenderCommandType::Unmap,
+        RenderCommandType::BindSamplers,
+        RenderCommandType::SetBlendState,
+        RenderCommandType::SetDepthState,
+        RenderCommandType::SetRasterState,
+        RenderCommandType::BindRenderTargets,
+        RenderCommandType::BindRenderTargets,
+        RenderCommandType::BindTexture,
+        RenderCommandType::Draw,
+    };
+
+    CHECK(commands.size() == sizeof(expected) / sizeof(expected[0]));
+    for (size_t i = 0; i < commands.size() && i < sizeof(expected) / sizeof(expected[0]); i++)
+        CHECK(commands[i].m_Type == expected[i]);
+
+    if (commands.size() == sizeof(expected) / sizeof(expected[0])) {
+        CHECK(commands[3].m_Args[0] == (uint32_t)RenderBlendState::NonPremultiplied);
+        CHECK(commands[4].m_Args[0] == (uint32_t)RenderDepthState::Read);
+        CHECK(commands[5].m_Args[0] == (uint32_t)RenderRasterState::Wireframe);
+        CHECK(commands[6].m_Args[0] == 1 && commands[6].m_Args[1] == 1);
+        CHECK(commands[7].m_Args[0] == 1 && commands[7].m_Args[1] == 0);
+        CHECK(commands[8].m_Args[0] == (uint32_t)RenderShaderStage::Pixel && commands[8].m_Args[1] == 2);
+    }
+
+    auto &stats = backend.GetFrameStats();
+    CHECK(stats.m_Maps == 1);
+    CHECK(stats.m_UploadBytes == 64);
+    CHECK(stats.m_DrawCalls == 1);
+    CHECK(stats.m_Vertices == 4);
+}
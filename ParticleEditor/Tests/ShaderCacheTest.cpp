@@ -0,0 +1,314 @@
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <experimental/filesystem>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "../Source/ShaderCache.h"
+
+namespace fs = std::experimental::filesystem;
+
+static std::string ToString(const std::vector<uint8_t> &bytes)
+{
+    return std::string(bytes.begin(), bytes.end());
+}
+
+// Stands in for D3D11ShaderCompiler: the "bytecode" is the shader file as it
+// was read, so a test can tell which version of a source got compiled.
+class StubShaderCompiler : public ShaderCompiler {
+public:
+    StubShaderCompiler()
+        : m_Compiles(0), m_Running(0), m_MaxRunning(0), m_Delay(0)
+    {
+    }
+
+    const char *GetId() const override { return "stub"; }
+
+    bool Compile(const ShaderDesc &desc, std::vector<uint8_t> &bytecode, std::string &log) override
+    {
+        auto running = ++m_Running;
+        auto max = m_MaxRunning.load();
+        while (running > max && !m_MaxRunning.compare_exchange_weak(max, running)) {
+        }
+
+        m_Compiles++;
+        if (m_Delay)
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_Delay));
+        if (m_BeforeRead)
+            m_BeforeRead();
+
+        bool ok = false;
+        FILE *file = fopen(desc.m_Path.c_str(), "rb");
+        if (file) {
+            char buffer[4096];
+            size_t n;
+            bytecode.clear();
+            while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+                bytecode.insert(bytecode.end(), buffer, buffer + n);
+            fclose(file);
+
+            ok = ToString(bytecode).find("error") == std::string::npos;
+        }
+        else {
+            log = desc.m_Path + ": not found";
+        }
+
+        m_Running--;
+        return ok;
+    }
+
+    std::atomic<int> m_Compiles;
+    std::atomic<int> m_Running;
+    std::atomic<int> m_MaxRunning;
+    int m_Delay;
+    // runs inside Compile before the source is read
+    std::function<void()> m_BeforeRead;
+};
+
+static std::string MakeDir(const char *name)
+{
+    auto dir = (fs::temp_directory_path() / name).generic_string();
+
+    std::error_code error;
+    fs::remove_all(dir, error);
+    fs::create_directories(dir, error);
+
+    return dir;
+}
+
+static void WriteText(const std::string &path, const char *text)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    fputs(text, file);
+    fclose(file);
+}
+
+static ShaderDesc MakeDesc(const std::string &path, const char *entry = "PS")
+{
+    ShaderDesc desc;
+    desc.m_Path = path;
+    desc.m_Entry = entry;
+    desc.m_Profile = "ps_5_0";
+    return desc;
+}
+
+TEST(ShaderCacheHitAfterMiss)
+{
+    auto dir = MakeDir("pe_shader_hit");
+    WriteText(dir + "/a.hlsl", "float4 PS() : SV_Target { return 1; }");
+
+    StubShaderCompiler compiler;
+    ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+
+    ShaderBinary first, second;
+    CHECK(cache.Build(MakeDesc(dir + "/a.hlsl"), first));
+    CHECK(!first.m_Cached);
+    CHECK(cache.Build(MakeDesc(dir + "/a.hlsl"), second));
+    CHECK(second.m_Cached);
+    CHECK(first.m_Hash == second.m_Hash);
+    CHECK(first.m_Bytecode == second.m_Bytecode);
+    CHECK(compiler.m_Compiles == 1);
+
+    auto stats = cache.GetStats();
+    CHECK(stats.m_Hits == 1);
+    CHECK(stats.m_Misses == 1);
+    CHECK(stats.m_Failed == 0);
+}
+
+TEST(ShaderCacheKeyCoversIncludesAndDefines)
+{
+    auto dir = MakeDir("pe_shader_key");
+    WriteText(dir + "/a.hlsl", "#include \"common.hlsli\"\nfloat4 PS() : SV_Target { return 1; }");
+    WriteText(dir + "/common.hlsli", "static const float A = 1;");
+
+    StubShaderCompiler compiler;
+    ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+
+    auto desc = MakeDesc(dir + "/a.hlsl");
+    auto base = cache.Hash(desc);
+    CHECK(base == cache.Hash(desc));
+
+    std::vector<std::string> files;
+    cache.GetFiles(desc, files);
+    CHECK(files.size() == 2);
+
+    auto other = desc;
+    other.m_Defines.push_back("TRAILS=1");
+    CHECK(cache.Hash(other) != base);
+
+    other = desc;
+    other.m_Entry = "VS";
+    CHECK(cache.Hash(other) != base);
+
+    WriteText(dir + "/common.hlsli", "static const float A = 2;");
+    CHECK(cache.Hash(desc) != base);
+}
+
+TEST(ShaderCacheFailedBuildIsNotCached)
+{
+    auto dir = MakeDir("pe_shader_fail");
+    WriteText(dir + "/a.hlsl", "error");
+
+    StubShaderCompiler compiler;
+    ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+
+    ShaderBinary binary;
+    CHECK(!cache.Build(MakeDesc(dir + "/a.hlsl"), binary));
+    CHECK(binary.m_Bytecode.empty());
+    CHECK(!cache.Build(MakeDesc(dir + "/a.hlsl"), binary));
+    CHECK(compiler.m_Compiles == 2);
+    CHECK(cache.GetStats().m_Failed == 2);
+}
+
+TEST(ShaderCacheCorruptBinaryIsAMiss)
+{
+    auto dir = MakeDir("pe_shader_corrupt");
+    WriteText(dir + "/a.hlsl", "float4 PS() : SV_Target { return 1; }");
+
+    StubShaderCompiler compiler;
+    ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+
+    ShaderBinary binary;
+    CHECK(cache.Build(MakeDesc(dir + "/a.hlsl"), binary));
+
+    for (auto &entry : fs::directory_iterator(dir + "/cache")) {
+        if (entry.path().extension() != ".cso")
+            continue;
+
+        // flip a byte of the bytecode, the CRC has to catch it
+        FILE *file = fopen(entry.path().generic_string().c_str(), "r+b");
+        fseek(file, -1, SEEK_END);
+        fputc('!', file);
+        fclose(file);
+    }
+
+    CHECK(cache.Build(MakeDesc(dir + "/a.hlsl"), binary));
+    CHECK(!binary.m_Cached);
+    CHECK(compiler.m_Compiles == 2);
+}
+
+// An edit saved between hashing and compiling must not leave the new bytecode
+// cached under the old hash, or undoing the edit would load the wrong shader.
+TEST(ShaderCacheEditDuringCompile)
+{
+    auto dir = MakeDir("pe_shader_race");
+    auto path = dir + "/a.hlsl";
+    WriteText(path, "float4 PS() : SV_Target { return 1; }");
+
+    StubShaderCompiler compiler;
+    ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+
+    auto desc = MakeDesc(path);
+    auto old_hash = cache.Hash(desc);
+
+    compiler.m_BeforeRead = [&]() { WriteText(path, "float4 PS() : SV_Target { return 2; }"); };
+
+    ShaderBinary binary;
+    CHECK(cache.Build(desc, binary));
+    CHECK(binary.m_Hash == old_hash);
+    CHECK(ToString(binary.m_Bytecode).find("return 2") != std::string::npos);
+
+    compiler.m_BeforeRead = nullptr;
+
+    // the edited source compiles again and is cached this time
+    CHECK(cache.Build(desc, binary));
+    CHECK(!binary.m_Cached);
+    CHECK(cache.Build(desc, binary));
+    CHECK(binary.m_Cached);
+
+    // back to the first version, nothing was cached for it
+    WriteText(path, "float4 PS() : SV_Target { return 1; }");
+    CHECK(cache.Build(desc, binary));
+    CHECK(!binary.m_Cached);
+    CHECK(ToString(binary.m_Bytecode).find("return 1") != std::string::npos);
+    CHECK(compiler.m_Compiles == 3);
+}
+
+TEST(ShaderCacheRequestsCompileInParallel)
+{
+    auto dir = MakeDir("pe_shader_parallel");
+
+    StubShaderCompiler compiler;
+    compiler.m_Delay = 20;
+    ShaderCache cache((dir + "/cache").c_str(), &compiler, 4);
+
+    std::set<ShaderTicket> tickets;
+    for (int i = 0; i < 8; i++) {
+        auto path = dir + "/s" + std::to_string(i) + ".hlsl";
+        WriteText(path, ("float4 PS() : SV_Target { return " + std::to_string(i) + "; }").c_str());
+        tickets.insert(cache.Request(MakeDesc(path)));
+    }
+
+    CHECK(tickets.size() == 8);
+    CHECK(tickets.count(0) == 0);
+
+    cache.Wait();
+    CHECK(cache.GetPending() == 0);
+
+    std::vector<ShaderResult> results;
+    cache.Poll(results);
+    CHECK(results.size() == 8);
+
+    for (auto &result : results) {
+        CHECK(result.m_Ok);
+        CHECK(tickets.count(result.m_Ticket) == 1);
+    }
+
+    CHECK(compiler.m_Compiles == 8);
+    CHECK(compiler.m_MaxRunning > 1);
+
+    // everything was handed out once
+    results.clear();
+    cache.Poll(results);
+    CHECK(results.empty());
+}
+
+TEST(ShaderCacheWarmFromIndex)
+{
+    auto dir = MakeDir("pe_shader_warm");
+    WriteText(dir + "/a.hlsl", "float4 PS() : SV_Target { return 1; }");
+    WriteText(dir + "/b.hlsl", "float4 PS() : SV_Target { return 2; }");
+
+    {
+        StubShaderCompiler compiler;
+        ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+
+        ShaderBinary binary;
+        cache.Build(MakeDesc(dir + "/a.hlsl"), binary);
+        cache.Build(MakeDesc(dir + "/b.hlsl"), binary);
+    }
+
+    // the next launch finds both in the index and the binaries on disk
+    {
+        StubShaderCompiler compiler;
+        ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+        cache.Warm();
+
+        CHECK(compiler.m_Compiles == 0);
+        CHECK(cache.GetStats().m_Hits == 2);
+    }
+
+    // a shader that no longer builds is dropped from the index
+    WriteText(dir + "/b.hlsl", "error");
+    {
+        StubShaderCompiler compiler;
+        ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+        cache.Warm();
+
+        CHECK(compiler.m_Compiles == 1);
+        CHECK(cache.GetStats().m_Failed == 1);
+    }
+    {
+        StubShaderCompiler compiler;
+        ShaderCache cache((dir + "/cache").c_str(), &compiler, 2);
+        cache.Warm();
+
+        CHECK(compiler.m_Compiles == 0);
+        CHECK(cache.GetStats().m_Hits == 1);
+    }
+}
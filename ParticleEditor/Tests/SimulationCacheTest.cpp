@@ -0,0 +1,223 @@
+#include "Test.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <experimental/filesystem>
+#include <string>
+#include <vector>
+
+#include "../Source/SimulationCache.h"
+
+namespace fs = std::experimental::filesystem;
+
+static const float CacheStep = 1.f / 1024.f;
+
+// `count` instances drifting apart, spinning and fading over the frames. On
+// every 7th frame the last instance is missing, which forces a keyframe.
+static void MakeCacheFrame(uint32_t frame, uint32_t count, SimulationCacheFrame &out)
+{
+    if (frame % 7 == 6)
+        count--;
+
+    out.m_Instances.resize(count);
+    out.m_Materials.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        float t = frame / 60.f;
+        auto &instance = out.m_Instances[i];
+        instance.m_Model = XMMatrixRotationRollPitchYaw(t, t * 0.5f + i, 0.3f) *
+            XMMatrixScaling(0.25f, 0.25f, 0.25f) *
+            XMMatrixTranslation(i * 0.37f + t * 1.3f, 1.f - t * t, -2.f + i * 0.011f);
+        instance.m_Color = XMVectorSet(1.f, 0.5f, 0.25f, 1.f - t * 0.1f);
+        instance.m_Age = t;
+        instance.m_Deform = 0.5f;
+        instance.m_DeformSpeed = 2.f;
+        instance.m_NoiseScale = 0.125f;
+        instance.m_NoiseSpeed = 3.f;
+        out.m_Materials[i] = (int)(i % 3);
+    }
+}
+
+static std::string WriteTestCache(const char *name, uint32_t frames, uint32_t keyframe_interval)
+{
+    auto path = (fs::temp_directory_path() / name).generic_string();
+
+    SimulationCacheWriter writer(keyframe_interval, CacheStep);
+    CHECK(writer.Open(path.c_str()));
+
+    SimulationCacheFrame frame;
+    for (uint32_t f = 0; f < frames; f++) {
+        MakeCacheFrame(f, 16, frame);
+        CHECK(writer.AddFrame(frame.GetFrameData()));
+    }
+    CHECK(writer.Close());
+
+    return path;
+}
+
+static bool SameFrame(const SimulationCacheFrame &a, const SimulationCacheFrame &b)
+{
+    if (a.m_Instances.size() != b.m_Instances.size() || a.m_Materials != b.m_Materials)
+        return false;
+
+    for (size_t i = 0; i < a.m_Instances.size(); i++) {
+        XMFLOAT4X4 ma, mb;
+        XMStoreFloat4x4(&ma, a.m_Instances[i].m_Model);
+        XMStoreFloat4x4(&mb, b.m_Instances[i].m_Model);
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                if (ma.m[r][c] != mb.m[r][c])
+                    return false;
+    }
+
+    return true;
+}
+
+TEST(SimulationCacheRoundTrip)
+{
+    const uint32_t frames = 40;
+    auto path = WriteTestCache("pe_simulation_roundtrip.cache", frames, 16);
+
+    SimulationCacheReader reader;
+    CHECK(reader.Open(path.c_str()));
+    CHECK(reader.GetFrameCount() == frames);
+
+    SimulationCacheFrame expected, read;
+    for (uint32_t f = 0; f < frames; f++) {
+        MakeCacheFrame(f, 16, expected);
+        CHECK(reader.ReadFrame(f, read));
+        CHECK(read.m_Instances.size() == expected.m_Instances.size());
+        CHECK(read.m_Materials == expected.m_Materials);
+        if (read.m_Instances.size() != expected.m_Instances.size())
+            continue;
+
+        for (size_t i = 0; i < expected.m_Instances.size(); i++) {
+            auto &a = expected.m_Instances[i];
+            auto &b = read.m_Instances[i];
+
+            XMFLOAT4X4 ma, mb;
+            XMStoreFloat4x4(&ma, a.m_Model);
+            XMStoreFloat4x4(&mb, b.m_Model);
+
+            // positions round to the quantization step, deltas must not
+            // accumulate any error on top
+            for (int c = 0; c < 3; c++)
+                CHECK(std::fabs(ma.m[3][c] - mb.m[3][c]) <= CacheStep * 0.5f + 1e-5f);
+
+            // scale is a half and the rotation snorm16
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++)
+                    CHECK(std::fabs(ma.m[r][c] - mb.m[r][c]) < 1e-3f);
+
+            XMFLOAT4 ca, cb;
+            XMStoreFloat4(&ca, a.m_Color);
+            XMStoreFloat4(&cb, b.m_Color);
+            CHECK(std::fabs(ca.x - cb.x) < 1e-3f && std::fabs(ca.y - cb.y) < 1e-3f);
+            CHECK(std::fabs(ca.z - cb.z) < 1e-3f && std::fabs(ca.w - cb.w) < 1e-3f);
+
+            CHECK(std::fabs(a.m_Age - b.m_Age) < 1e-3f);
+            CHECK(b.m_Deform == a.m_Deform && b.m_DeformSpeed == a.m_DeformSpeed);
+            CHECK(b.m_NoiseScale == a.m_NoiseScale && b.m_NoiseSpeed == a.m_NoiseSpeed);
+        }
+    }
+
+    CHECK(!reader.ReadFrame(frames, read));
+}
+
+// A jump decodes from the closest keyframe and has to land on exactly what
+// reading every frame in order gives.
+TEST(SimulationCacheKeyframeSeek)
+{
+    const uint32_t frames = 30;
+    auto path = WriteTestCache("pe_simulation_seek.cache", frames, 4);
+
+    SimulationCacheReader reader;
+    CHECK(reader.Open(path.c_str()));
+
+    std::vector<SimulationCacheFrame> sequential(frames);
+    SimulationCacheFrame running;
+    for (uint32_t f = 0; f < frames; f++) {
+        CHECK(reader.ReadFrame(f, running));
+        sequential[f] = running;
+    }
+
+    uint32_t seeks[] = { 10, 3, 29, 0, 13, 14, 6, 7, 22 };
+    for (auto f : seeks) {
+        SimulationCacheFrame fresh;
+        CHECK(reader.ReadFrame(f, fresh));
+        CHECK(SameFrame(fresh, sequential[f]));
+
+        // and the same target reused across a backwards jump
+        CHECK(reader.ReadFrame(f, running));
+        CHECK(SameFrame(running, sequential[f]));
+    }
+}
+
+TEST(SimulationCacheRejectsCorruptFiles)
+{
+    auto path = WriteTestCache("pe_simulation_corrupt.cache", 12, 4);
+
+    std::vector<uint8_t> bytes(fs::file_size(path));
+    FILE *file = fopen(path.c_str(), "rb");
+    CHECK(file && fread(bytes.data(), 1, bytes.size(), file) == bytes.size());
+    if (file)
+        fclose(file);
+
+    auto write = [](const std::string &name, const std::vector<uint8_t> &data) {
+        auto out = (fs::temp_directory_path() / name).generic_string();
+        FILE *file = fopen(out.c_str(), "wb");
+        CHECK(file && fwrite(data.data(), 1, data.size(), file) == data.size());
+        if (file)
+            fclose(file);
+        return out;
+    };
+
+    SimulationCacheHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    CHECK(header.m_FrameCount == 12);
+
+    SimulationCacheReader reader;
+
+    // cut into the index table
+    auto truncated = bytes;
+    truncated.resize(bytes.size() - sizeof(SimulationCacheIndexEntry) / 2);
+    CHECK(!reader.Open(write("pe_simulation_truncated.cache", truncated).c_str()));
+
+    // cut before the header ends
+    truncated.resize(sizeof(SimulationCacheHeader) - 1);
+    CHECK(!reader.Open(write("pe_simulation_short.cache", truncated).c_str()));
+
+    // an index entry pointing past the frame data
+    auto index = bytes;
+    SimulationCacheIndexEntry entry;
+    size_t entry_offset = (size_t)header.m_IndexOffset + 5 * sizeof(entry);
+    memcpy(&entry, index.data() + entry_offset, sizeof(entry));
+    entry.m_Offset = header.m_IndexOffset;
+    memcpy(index.data() + entry_offset, &entry, sizeof(entry));
+    CHECK(!reader.Open(write("pe_simulation_index.cache", index).c_str()));
+
+    // frame bytes claiming far more instances than the frame can hold, the
+    // index is fine so only reading that frame fails
+    auto frame = bytes;
+    memcpy(&entry, frame.data() + entry_offset, sizeof(entry));
+    frame[(size_t)entry.m_Offset + 0] = 0xff;
+    frame[(size_t)entry.m_Offset + 1] = 0xff;
+    frame[(size_t)entry.m_Offset + 2] = 0x7f;
+    CHECK(reader.Open(write("pe_simulation_frame.cache", frame).c_str()));
+
+    SimulationCacheFrame out;
+    CHECK(reader.ReadFrame(4, out));
+    CHECK(!reader.ReadFrame(5, out));
+}
+
+TEST(SimulationCacheBenchmark)
+{
+    auto path = (fs::temp_directory_path() / "pe_simulation_benchmark.cache").generic_string();
+
+    SimulationCacheBenchmark result;
+    CHECK(BenchmarkSimulationCache(path.c_str(), 600, 2000, result));
+
+    printf("  %u frames of %u instances, %.1f MB: write %.1fms, sequential read %.1fms, %u random seeks %.1fms\n",
+        result.m_Frames, result.m_Instances, result.m_Bytes / (1024.f * 1024.f),
+        result.m_WriteMs, result.m_SequentialMs, result.m_Seeks, result.m_SeekMs);
+}
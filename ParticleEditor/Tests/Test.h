@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// Just enough of a test runner for the parts of the editor that build without
+// D3D. Every test file adds its cases with TEST, Main.cpp runs all of them.
+
+typedef void (*TestFunc)();
+
+struct TestCase {
+    const char *m_Name;
+    TestFunc m_Func;
+};
+
+std::vector<TestCase> &GetTests();
+int &GetTestFailures();
+
+struct TestRegistrar {
+    TestRegistrar(const char *name, TestFunc func) { GetTests().push_back({ name, func }); }
+};
+
+#define TEST(name) \
+    static void test_##name(); \
+    static TestRegistrar registrar_##name(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            GetTestFailures()++; \
+        } \
+    } while (0)
@@ -0,0 +1,98 @@
+#include "Test.h"
+
+#include <experimental/filesystem>
+#include <string>
+#include <vector>
+
+#include "../Source/ImageIO.h"
+#include "../Source/TextureAtlas.h"
+
+namespace fs = std::experimental::filesystem;
+
+static std::string WriteSolidImage(const std::string &dir, const char *name, uint32_t width, uint32_t height)
+{
+    auto path = dir + "/" + name;
+    std::vector<uint8_t> rgba((size_t)width * height * 4, 200);
+    WritePNG(path.c_str(), width, height, rgba.data());
+    return path;
+}
+
+static std::string MakeAtlasDir()
+{
+    auto dir = (fs::temp_directory_path() / "pe_atlas_pack").generic_string();
+    std::error_code error;
+    fs::create_directories(dir, error);
+    return dir;
+}
+
+// A few small textures must not end up on a mostly empty full width page.
+TEST(TextureAtlasShrinksPages)
+{
+    auto dir = MakeAtlasDir();
+    std::vector<std::string> paths = {
+        WriteSolidImage(dir, "a.png", 200, 100),
+        WriteSolidImage(dir, "b.png", 100, 300),
+        WriteSolidImage(dir, "c.png", 60, 60),
+    };
+
+    AtlasPacker packer(AtlasSettings{});
+    CHECK(packer.Pack(paths));
+    CHECK(packer.GetPages().size() == 1);
+
+    auto &page = packer.GetPages()[0];
+    printf("  %ux%u, %.0f%% used\n", page.m_Width, page.m_Height, packer.GetStats().m_Coverage * 100.f);
+    CHECK(page.m_Width < 2048);
+    CHECK((uint64_t)page.m_Width * page.m_Height <= 512 * 512);
+    CHECK(packer.GetStats().m_Coverage > 0.25f);
+
+    // every texture lands inside the page, on its own texels
+    auto &placements = packer.GetPlacements();
+    for (size_t i = 0; i < placements.size(); i++) {
+        auto &a = placements[i];
+        CHECK(a.m_Page == 0);
+        CHECK(a.m_Rect[0] >= 0.f && a.m_Rect[1] >= 0.f && a.m_Rect[2] <= 1.f && a.m_Rect[3] <= 1.f);
+        CHECK((a.m_Rect[2] - a.m_Rect[0]) * page.m_Width == a.m_Width);
+
+        for (size_t j = i + 1; j < placements.size(); j++) {
+            auto &b = placements[j];
+            bool apart = a.m_Rect[2] <= b.m_Rect[0] || b.m_Rect[2] <= a.m_Rect[0] || a.m_Rect[3] <= b.m_Rect[1] || b.m_Rect[3] <= a.m_Rect[1];
+            CHECK(apart);
+        }
+    }
+}
+
+TEST(TextureAtlasSkipsEmptyPaths)
+{
+    auto dir = MakeAtlasDir();
+    std::vector<std::string> paths = {
+        WriteSolidImage(dir, "a.png", 64, 64),
+        std::string(),
+        WriteSolidImage(dir, "b.png", 32, 32),
+    };
+
+    AtlasPacker packer(AtlasSettings{});
+    CHECK(packer.Pack(paths));
+    CHECK(packer.GetStats().m_Textures == 2);
+    CHECK(packer.GetStats().m_Packed == 2);
+    CHECK(packer.GetPlacements()[0].m_Page == 0);
+    CHECK(packer.GetPlacements()[1].m_Page == -1);
+    CHECK(packer.GetPlacements()[2].m_Page == 0);
+}
+
+// Textures that do not fit one page spill onto more, each cut to size.
+TEST(TextureAtlasSpillsOntoMorePages)
+{
+    auto dir = MakeAtlasDir();
+    std::vector<std::string> paths;
+    for (int i = 0; i < 5; i++)
+        paths.push_back(WriteSolidImage(dir, ("big" + std::to_string(i) + ".png").c_str(), 900, 900));
+
+    AtlasSettings settings;
+    AtlasPacker packer(settings);
+    CHECK(packer.Pack(paths));
+    CHECK(packer.GetStats().m_Packed == 5);
+    CHECK(packer.GetPages().size() == 2);
+
+    auto &last = packer.GetPages().back();
+    CHECK(last.m_Width <= 1024 && last.m_Height <= 1024);
+}
@@ -0,0 +1,210 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <experimental/filesystem>
+#include <string>
+#include <vector>
+
+#include "../Source/ImageIO.h"
+#include "../Source/TextureAtlas.h"
+#include "../Source/TextureCompress.h"
+
+namespace fs = std::experimental::filesystem;
+
+// Smooth gradients with some high frequency detail on top, close enough to
+// the particle textures to keep the PSNR floors meaningful. `alpha` false
+// keeps every texel opaque.
+static std::vector<uint8_t> MakeImage(uint32_t width, uint32_t height, bool alpha)
+{
+    std::vector<uint8_t> rgba((size_t)width * height * 4);
+    uint32_t seed = 1234;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            int noise = (int)(seed >> 28) - 8;
+
+            auto p = &rgba[((size_t)y * width + x) * 4];
+            p[0] = (uint8_t)std::min(std::max((int)(x * 255 / width) + noise, 0), 255);
+            p[1] = (uint8_t)std::min(std::max((int)(y * 255 / height) + noise, 0), 255);
+            p[2] = (uint8_t)(128 + 100 * sinf(x * 0.2f) * cosf(y * 0.15f));
+            p[3] = alpha ? (uint8_t)(255 * (0.5f + 0.5f * sinf((x + y) * 0.05f))) : 255;
+        }
+    }
+
+    return rgba;
+}
+
+static double GetPSNR(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b, int channels)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < a.size() / 4; i++) {
+        for (int c = 0; c < channels; c++) {
+            double d = (double)a[i * 4 + c] - b[i * 4 + c];
+            error += d * d;
+        }
+    }
+
+    double mse = error / (a.size() / 4 * channels);
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+static void CheckRoundTrip(BlockFormat format, int channels, bool alpha, double floor)
+{
+    uint32_t width = 64, height = 48;
+    auto rgba = MakeImage(width, height, alpha);
+
+    TextureCompressSettings settings;
+    settings.m_Format = format;
+
+    CompressedTexture texture;
+    TextureCompressStats stats;
+    CHECK(CompressTexture(width, height, rgba.data(), settings, texture, stats));
+    CHECK(texture.m_Format == format);
+
+    std::vector<uint8_t> decoded(rgba.size());
+    DecompressMip(format, width, height, texture.m_Mips[0].data(), decoded.data());
+
+    auto psnr = GetPSNR(rgba, decoded, channels);
+    printf("  %s: %.1f dB, %.1f:1\n", GetBlockFormatName(format), psnr, (double)stats.m_RawBytes / stats.m_CompressedBytes);
+
+    CHECK(psnr >= floor);
+    // what the exporter logs is what decoding gives
+    CHECK(fabs(psnr - stats.m_PSNR) < 0.01);
+}
+
+TEST(TextureCompressRoundTripBC1)
+{
+    CheckRoundTrip(BlockFormat::BC1, 3, false, 30.0);
+}
+
+TEST(TextureCompressRoundTripBC4)
+{
+    CheckRoundTrip(BlockFormat::BC4, 1, false, 38.0);
+}
+
+TEST(TextureCompressRoundTripBC5)
+{
+    CheckRoundTrip(BlockFormat::BC5, 2, false, 38.0);
+}
+
+TEST(TextureCompressRoundTripBC7)
+{
+    CheckRoundTrip(BlockFormat::BC7, 4, true, 34.0);
+}
+
+TEST(TextureCompressMipChain)
+{
+    auto rgba = MakeImage(64, 16, false);
+
+    TextureCompressSettings settings;
+    settings.m_Format = BlockFormat::BC1;
+
+    CompressedTexture texture;
+    TextureCompressStats stats;
+    CHECK(CompressTexture(64, 16, rgba.data(), settings, texture, stats));
+
+    // 64x16 down to 1x1, a BC1 block is 8 bytes and covers at least 1x1
+    CHECK(texture.m_Mips.size() == 7);
+    CHECK(texture.m_Mips[0].size() == 16 * 4 * 8);
+    CHECK(texture.m_Mips.back().size() == 8);
+
+    settings.m_MaxMips = 3;
+    CHECK(CompressTexture(64, 16, rgba.data(), settings, texture, stats));
+    CHECK(texture.m_Mips.size() == 3);
+}
+
+TEST(TextureCompressAutoAndColorSpace)
+{
+    TextureCompressSettings settings;
+    CompressedTexture texture;
+    TextureCompressStats stats;
+
+    auto opaque = MakeImage(32, 32, false);
+    CHECK(CompressTexture(32, 32, opaque.data(), settings, texture, stats));
+    CHECK(texture.m_Format == BlockFormat::BC1);
+    // the editor samples R8G8B8A8_UNORM, the default must not switch to sRGB
+    CHECK(texture.m_DXGIFormat == 71);
+
+    auto alpha = MakeImage(32, 32, true);
+    CHECK(CompressTexture(32, 32, alpha.data(), settings, texture, stats));
+    CHECK(texture.m_Format == BlockFormat::BC7);
+    CHECK(texture.m_DXGIFormat == 98);
+
+    settings.m_SRGB = true;
+    CHECK(CompressTexture(32, 32, alpha.data(), settings, texture, stats));
+    CHECK(texture.m_DXGIFormat == 99);
+}
+
+// A black and white checker has to average to the gray it looks like from
+// afar, 188 in sRGB, even when the output format itself is not sRGB.
+TEST(TextureCompressLinearMips)
+{
+    std::vector<uint8_t> checker(8 * 8 * 4);
+    for (uint32_t i = 0; i < 8 * 8; i++) {
+        uint8_t value = ((i % 8) + (i / 8)) % 2 ? 255 : 0;
+        checker[i * 4 + 0] = checker[i * 4 + 1] = checker[i * 4 + 2] = value;
+        checker[i * 4 + 3] = 255;
+    }
+
+    TextureCompressSettings settings;
+    settings.m_Format = BlockFormat::BC1;
+    settings.m_MaxMips = 2;
+
+    CompressedTexture texture;
+    TextureCompressStats stats;
+    std::vector<uint8_t> mip(4 * 4 * 4);
+
+    CHECK(CompressTexture(8, 8, checker.data(), settings, texture, stats));
+    CHECK(texture.m_DXGIFormat == 71);
+    DecompressMip(texture.m_Format, 4, 4, texture.m_Mips[1].data(), mip.data());
+    CHECK(std::abs(mip[0] - 188) <= 4 && mip[0] == mip[4 * 4 * 4 - 4]);
+
+    settings.m_LinearMips = false;
+    CHECK(CompressTexture(8, 8, checker.data(), settings, texture, stats));
+    DecompressMip(texture.m_Format, 4, 4, texture.m_Mips[1].data(), mip.data());
+    CHECK(std::abs(mip[0] - 128) <= 4);
+}
+
+static std::string WriteTestImage(const std::string &dir, const char *name, uint32_t width, uint32_t height, bool alpha)
+{
+    auto path = dir + "/" + name;
+    auto rgba = MakeImage(width, height, alpha);
+    WritePNG(path.c_str(), width, height, rgba.data());
+    return path;
+}
+
+// Space between the textures of an opaque page must not make it BC7.
+TEST(TextureAtlasOpaquePageIsBC1)
+{
+    auto dir = (fs::temp_directory_path() / "pe_atlas_opaque").generic_string();
+    std::error_code error;
+    fs::create_directories(dir, error);
+
+    std::vector<std::string> paths = {
+        WriteTestImage(dir, "a.png", 100, 60, false),
+        WriteTestImage(dir, "b.png", 40, 90, false),
+    };
+
+    AtlasPacker packer(AtlasSettings{});
+    CHECK(packer.Pack(paths));
+    CHECK(packer.GetPages().size() == 1);
+
+    auto &page = packer.GetPages()[0];
+    CHECK(page.m_Opaque);
+
+    TextureCompressSettings settings;
+    CompressedTexture texture;
+    TextureCompressStats stats;
+    CHECK(CompressTexture(page.m_Width, page.m_Height, page.m_Pixels.data(), settings, texture, stats));
+    CHECK(texture.m_Format == BlockFormat::BC1);
+
+    paths.push_back(WriteTestImage(dir, "c.png", 30, 30, true));
+    CHECK(packer.Pack(paths));
+    CHECK(!packer.GetPages()[0].m_Opaque);
+
+    auto &mixed = packer.GetPages()[0];
+    CHECK(CompressTexture(mixed.m_Width, mixed.m_Height, mixed.m_Pixels.data(), settings, texture, stats));
+    CHECK(texture.m_Format == BlockFormat::BC7);
+}
@@ -0,0 +1,173 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <experimental/filesystem>
+#include <string>
+#include <vector>
+
+#include "../Source/ImageIO.h"
+#include "../Source/TextureLoader.h"
+
+namespace fs = std::experimental::filesystem;
+
+static std::string WriteLoaderImage(const char *name, uint32_t width, uint32_t height)
+{
+    auto dir = (fs::temp_directory_path() / "pe_texture_loader").generic_string();
+    std::error_code error;
+    fs::create_directories(dir, error);
+
+    std::vector<uint8_t> rgba((size_t)width * height * 4);
+    for (size_t i = 0; i < rgba.size(); i++)
+        rgba[i] = (uint8_t)(i * 7 + width);
+
+    auto path = dir + "/" + name;
+    WritePNG(path.c_str(), width, height, rgba.data());
+    return path;
+}
+
+TEST(TextureLoaderCompletesEveryTicket)
+{
+    std::vector<std::string> paths = {
+        WriteLoaderImage("a.png", 16, 8),
+        WriteLoaderImage("b.png", 4, 4),
+        (fs::temp_directory_path() / "pe_texture_loader" / "missing.png").generic_string(),
+        WriteLoaderImage("c.png", 1, 32),
+    };
+
+    TextureLoader loader(2);
+    std::vector<TextureTicket> tickets;
+    for (auto &path : paths)
+        tickets.push_back(loader.Request(path));
+
+    for (size_t i = 0; i < tickets.size(); i++) {
+        CHECK(tickets[i] != 0);
+        CHECK(std::count(tickets.begin(), tickets.end(), tickets[i]) == 1);
+    }
+
+    loader.Wait();
+    CHECK(loader.GetPending() == tickets.size());
+
+    std::vector<TextureLoadResult> results;
+    loader.Poll(results);
+    CHECK(results.size() == tickets.size());
+    CHECK(loader.GetPending() == 0);
+
+    for (auto &result : results) {
+        size_t i = std::find(tickets.begin(), tickets.end(), result.m_Ticket) - tickets.begin();
+        CHECK(i < tickets.size());
+        if (i == tickets.size())
+            continue;
+
+        CHECK(result.m_Path == paths[i]);
+        if (i == 2) {
+            CHECK(!result.m_Ok && result.m_Pixels.empty());
+        }
+        else {
+            CHECK(result.m_Ok);
+            CHECK(result.m_Pixels.size() == (size_t)result.m_Width * result.m_Height * 4);
+        }
+    }
+
+    // nothing is handed out twice
+    results.clear();
+    loader.Poll(results);
+    CHECK(results.empty());
+}
+
+// 64x64 RGBA8 is 16 KB, a 40 KB budget fits two of them per Poll. A budget
+// smaller than any load still hands one out so nothing stalls.
+TEST(TextureLoaderPollBudget)
+{
+    TextureLoader loader(1);
+    for (int i = 0; i < 5; i++)
+        loader.Request(WriteLoaderImage(("budget" + std::to_string(i) + ".png").c_str(), 64, 64));
+    loader.Wait();
+
+    std::vector<TextureLoadResult> results;
+    loader.Poll(results, 40 << 10);
+    CHECK(results.size() == 2);
+    CHECK(loader.GetPending() == 3);
+
+    loader.Poll(results, 1);
+    CHECK(results.size() == 3);
+
+    loader.Poll(results, 40 << 10);
+    CHECK(results.size() == 5);
+    CHECK(loader.GetPending() == 0);
+
+    // an empty queue hands out nothing, whatever the budget
+    loader.Poll(results, 0);
+    CHECK(results.size() == 5);
+}
+
+TEST(TextureSlotsSwapPlaceholderForLatestLoad)
+{
+    auto first = WriteLoaderImage("slot_first.png", 8, 8);
+    auto second = WriteLoaderImage("slot_second.png", 16, 16);
+
+    TextureLoader loader(2);
+    TextureSlots slots(3);
+
+    std::vector<std::string> uploaded(3);
+    auto upload = [&](size_t slot, TextureLoadResult &result) {
+        if (!result.m_Ok)
+            return false;
+        uploaded[slot] = result.m_Path;
+        return true;
+    };
+
+    // nothing to show yet, the placeholder is drawn until the load is in
+    CHECK(slots.Request(loader, 0, first));
+    CHECK(slots.IsPlaceholder(0) && slots.IsPending(0));
+    CHECK(!slots.IsIdle());
+
+    // superseded before it finished, only the second load may land
+    CHECK(!slots.Request(loader, 0, second));
+    loader.Wait();
+    slots.Update(loader, UINT64_MAX, upload);
+    CHECK(uploaded[0] == second);
+    CHECK(!slots.IsPlaceholder(0) && !slots.IsPending(0));
+    CHECK(slots.IsIdle());
+
+    // a reload keeps the loaded texture until the new one is uploaded
+    CHECK(!slots.Request(loader, 0, first));
+    CHECK(!slots.IsPlaceholder(0));
+    loader.Wait();
+    slots.Update(loader, UINT64_MAX, upload);
+    CHECK(uploaded[0] == first);
+
+    // a failed load leaves the placeholder in place
+    CHECK(slots.Request(loader, 1, "pe_texture_loader_missing.png"));
+    loader.Wait();
+    slots.Update(loader, UINT64_MAX, upload);
+    CHECK(slots.IsPlaceholder(1) && !slots.IsPending(1));
+    CHECK(uploaded[1].empty());
+
+    // a cancelled load is dropped, a cleared slot asks for a placeholder again
+    CHECK(slots.Request(loader, 2, first));
+    slots.Cancel(2);
+    CHECK(slots.IsIdle());
+    loader.Wait();
+    slots.Update(loader, UINT64_MAX, upload);
+    CHECK(uploaded[2].empty());
+
+    slots.Clear(0);
+    CHECK(slots.Request(loader, 0, second));
+    loader.Wait();
+    slots.Update(loader, UINT64_MAX, upload);
+    CHECK(!slots.IsPlaceholder(0));
+}
+
+TEST(TextureLoaderBenchmark)
+{
+    std::vector<std::string> paths;
+    for (int i = 0; i < 16; i++)
+        paths.push_back(WriteLoaderImage(("bench" + std::to_string(i) + ".png").c_str(), 512, 512));
+
+    TextureLoadBenchmark result;
+    CHECK(BenchmarkTextureLoads(paths, result));
+    CHECK(result.m_Bytes == 16ull * 512 * 512 * 4);
+
+    printf("  %u textures, %.1f MB: serial %.1fms, request %.3fms, async %.1fms\n",
+        result.m_Textures, result.m_Bytes / (1024.f * 1024.f), result.m_SerialMs, result.m_RequestMs, result.m_AsyncMs);
+}